@@ -0,0 +1,195 @@
+// Libdeepdive interface
+extern "C" {
+  #include <deepdive.h>
+}
+
+// STL
+#include <chrono>
+#include <mutex>
+#include <map>
+
+// This include
+#include "deepdive_adapter.hh"
+
+// Various constants used by the Vive system
+static constexpr double GRAVITY         = 9.80665;
+static constexpr double GYRO_SCALE      = 32.768;
+static constexpr double ACC_SCALE       = 4096.0;
+static constexpr double SWEEP_DURATION  = 400000.0;
+static constexpr double SWEEP_CENTER    = 200000.0;
+static constexpr double TICKS_PER_SEC   = 48e6;
+
+namespace deepdive {
+
+// The driver callbacks carry no user data, so find the adapter by driver
+static std::mutex mutex_;
+static std::map<struct ::Driver*, DriverAdapter*> adapters_;
+
+// Current time in seconds, on the same clock for all measurements
+static double Now() {
+  return std::chrono::duration<double>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Find the adapter attached to a driver
+static DriverAdapter * Find(struct ::Driver * driver) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::map<struct ::Driver*, DriverAdapter*>::iterator it
+    = adapters_.find(driver);
+  if (it == adapters_.end())
+    return nullptr;
+  return it->second;
+}
+
+// Lighthouses are stored in the driver, which is how we find the adapter
+static DriverAdapter * Find(struct ::Lighthouse * lighthouse) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::map<struct ::Driver*, DriverAdapter*>::iterator it;
+  for (it = adapters_.begin(); it != adapters_.end(); it++)
+    if (lighthouse >= it->first->lighthouses &&
+        lighthouse < it->first->lighthouses + MAX_NUM_LIGHTHOUSES)
+      return it->second;
+  return nullptr;
+}
+
+struct DriverAdapter::Callbacks {
+  // Called back when new light data is available
+  static void Light(struct ::Tracker * tracker,
+    struct ::Lighthouse * lighthouse, uint8_t axis, uint32_t synctime,
+    uint16_t num_sensors, uint16_t *sensors, uint32_t *sweeptimes,
+    uint32_t *angles, uint16_t *lengths) {
+    DriverAdapter * adapter = Find(tracker->driver);
+    if (!adapter || !lighthouse || axis >= NUM_MOTORS)
+      return;
+    // Reuse the sweep, so that we don't allocate per measurement
+    Sweep & sweep = adapter->sweep_;
+    sweep.time = Now();
+    // Engine ids are known once calibration is in, and -1 until then
+    sweep.tracker = adapter->tracker_ids_[tracker->id];
+    sweep.lighthouse = adapter->lighthouse_ids_[lighthouse->id];
+    sweep.axis = axis;
+    sweep.pulses.resize(num_sensors);
+    for (uint16_t i = 0; i < num_sensors; i++) {
+      sweep.pulses[i].sensor = sensors[i];
+      sweep.pulses[i].angle = (M_PI / SWEEP_DURATION)
+        * (static_cast<double>(angles[i]) - SWEEP_CENTER);
+      sweep.pulses[i].duration =
+        static_cast<double>(lengths[i]) / TICKS_PER_SEC;
+    }
+    bool used = adapter->engine_.Light(sweep);
+    if (adapter->sweep_fn_)
+      adapter->sweep_fn_(sweep, used);
+  }
+
+  // Called back when new IMU data is available
+  static void Imu(struct ::Tracker * tracker, uint32_t timecode,
+    int16_t acc[3], int16_t gyr[3], int16_t mag[3]) {
+    DriverAdapter * adapter = Find(tracker->driver);
+    if (!adapter)
+      return;
+    Inertial & inertial = adapter->inertial_;
+    inertial.time = Now();
+    inertial.tracker = adapter->tracker_ids_[tracker->id];
+    for (size_t i = 0; i < 3; i++) {
+      inertial.acc[i] = static_cast<double>(acc[i]) * GRAVITY / ACC_SCALE;
+      inertial.gyr[i] =
+        static_cast<double>(gyr[i]) * (1./GYRO_SCALE) * (M_PI/180.);
+    }
+    bool used = adapter->engine_.Imu(inertial);
+    if (adapter->inertial_fn_)
+      adapter->inertial_fn_(inertial, used);
+  }
+
+  // Called back when tracker calibration has been read
+  static void Tracker(struct ::Tracker * t) {
+    if (!t) return;
+    DriverAdapter * adapter = Find(t->driver);
+    if (!adapter)
+      return;
+    TrackerMap::iterator it = adapter->trackers_.find(t->serial);
+    if (it == adapter->trackers_.end())
+      return;
+    deepdive::Tracker & tracker = it->second;
+    for (size_t i = 0; i < 3; i++) {
+      tracker.errors[ERROR_ACC_BIAS][i] = t->cal.acc_bias[i];
+      tracker.errors[ERROR_ACC_SCALE][i] = t->cal.acc_scale[i];
+      tracker.errors[ERROR_GYR_BIAS][i] = t->cal.gyr_bias[i];
+      tracker.errors[ERROR_GYR_SCALE][i] = t->cal.gyr_scale[i];
+    }
+    for (size_t i = 0; i < t->cal.num_channels && i < NUM_SENSORS; i++) {
+      for (size_t j = 0; j < 3; j++) {
+        tracker.sensors[6*i+j] = t->cal.positions[i][j];
+        tracker.sensors[6*i+3+j] = t->cal.normals[i][j];
+      }
+    }
+    // Transforms are stored as (qw, qx, qy, qz, x, y, z)
+    double q[4], p[3];
+    for (size_t i = 0; i < 4; i++) q[i] = t->cal.head_transform[i];
+    for (size_t i = 0; i < 3; i++) p[i] = t->cal.head_transform[4+i];
+    PoseToAngleAxis(p, q, tracker.tTh);
+    for (size_t i = 0; i < 4; i++) q[i] = t->cal.imu_transform[i];
+    for (size_t i = 0; i < 3; i++) p[i] = t->cal.imu_transform[4+i];
+    PoseToAngleAxis(p, q, tracker.tTi);
+    tracker.ready = true;
+    adapter->tracker_ids_[t->id] =
+      adapter->engine_.SetTracker(it->first, tracker);
+  }
+
+  // Called back when lighthouse calibration has been received over OOTX
+  static void Lighthouse(struct ::Lighthouse * l) {
+    if (!l) return;
+    DriverAdapter * adapter = Find(l);
+    if (!adapter)
+      return;
+    LighthouseMap::iterator it = adapter->lighthouses_.find(l->serial);
+    if (it == adapter->lighthouses_.end())
+      return;
+    deepdive::Lighthouse & lighthouse = it->second;
+    for (size_t i = 0; i < NUM_MOTORS; i++) {
+      lighthouse.params[i*NUM_PARAMS + PARAM_PHASE] = l->motors[i].phase;
+      lighthouse.params[i*NUM_PARAMS + PARAM_TILT] = l->motors[i].tilt;
+      lighthouse.params[i*NUM_PARAMS + PARAM_GIB_PHASE] = l->motors[i].gibphase;
+      lighthouse.params[i*NUM_PARAMS + PARAM_GIB_MAG] = l->motors[i].gibmag;
+      lighthouse.params[i*NUM_PARAMS + PARAM_CURVE] = l->motors[i].curve;
+    }
+    lighthouse.ready = true;
+    adapter->lighthouse_ids_[l->id] =
+      adapter->engine_.SetLighthouse(it->first, lighthouse);
+  }
+};
+
+DriverAdapter::DriverAdapter(struct ::Driver * driver, TrackingEngine & engine,
+  LighthouseMap const& lighthouses, TrackerMap const& trackers)
+    : driver_(driver), engine_(engine),
+      lighthouses_(lighthouses), trackers_(trackers),
+      tracker_ids_(UINT8_MAX + 1, -1), lighthouse_ids_(UINT8_MAX + 1, -1) {
+  sweep_.pulses.reserve(NUM_SENSORS);
+  // Tell the engine what to wait for before tracking
+  LighthouseMap::iterator it;
+  for (it = lighthouses_.begin(); it != lighthouses_.end(); it++) {
+    it->second.ready = false;
+    engine_.SetLighthouse(it->first, it->second);
+  }
+  TrackerMap::iterator jt;
+  for (jt = trackers_.begin(); jt != trackers_.end(); jt++) {
+    jt->second.ready = false;
+    engine_.SetTracker(jt->first, jt->second);
+  }
+  // Attach to the driver
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    adapters_[driver_] = this;
+  }
+  deepdive_install_light_fn(driver_, Callbacks::Light);
+  deepdive_install_imu_fn(driver_, Callbacks::Imu);
+  deepdive_install_tracker_fn(driver_, Callbacks::Tracker);
+  deepdive_install_lighthouse_fn(driver_, Callbacks::Lighthouse);
+}
+
+// The callbacks stay installed, but will no longer find this adapter
+DriverAdapter::~DriverAdapter() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  adapters_.erase(driver_);
+}
+
+}  // namespace deepdive
@@ -0,0 +1,56 @@
+#ifndef CORE_DEEPDIVE_ADAPTER_HH
+#define CORE_DEEPDIVE_ADAPTER_HH
+
+// STL
+#include <functional>
+#include <vector>
+
+// Core types
+#include "deepdive_core.hh"
+#include "deepdive_engine.hh"
+
+// Libdeepdive driver context
+struct Driver;
+
+namespace deepdive {
+
+// Feeds a tracking engine directly from the libdeepdive callbacks, so that
+// tracking runs in the driver's thread without any middleware in between.
+// Only the lighthouses and trackers passed in are tracked, and tracking
+// starts once the driver has provided calibration for all of them. At most
+// one adapter may be attached to a driver at any time.
+class DriverAdapter {
+ public:
+  // Called back after each measurement has been passed to the engine
+  typedef std::function<void(Sweep const&, bool)> SweepFn;
+  typedef std::function<void(Inertial const&, bool)> InertialFn;
+
+  DriverAdapter(struct ::Driver * driver, TrackingEngine & engine,
+    LighthouseMap const& lighthouses, TrackerMap const& trackers);
+  ~DriverAdapter();
+
+  // Non-copyable
+  DriverAdapter(DriverAdapter const&) = delete;
+  DriverAdapter& operator=(DriverAdapter const&) = delete;
+
+  // Optionally observe the measurements, for example to log them
+  void OnSweep(SweepFn fn) { sweep_fn_ = fn; }
+  void OnInertial(InertialFn fn) { inertial_fn_ = fn; }
+
+ private:
+  struct Callbacks;
+  struct ::Driver * driver_;
+  TrackingEngine & engine_;
+  LighthouseMap lighthouses_;
+  TrackerMap trackers_;
+  std::vector<int> tracker_ids_;      // Driver id -> engine id
+  std::vector<int> lighthouse_ids_;   // Driver id -> engine id
+  Sweep sweep_;
+  Inertial inertial_;
+  SweepFn sweep_fn_;
+  InertialFn inertial_fn_;
+};
+
+}  // namespace deepdive
+
+#endif
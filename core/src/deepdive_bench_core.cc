@@ -0,0 +1,148 @@
+// STL
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Core
+#include "deepdive_core.hh"
+#include "deepdive_engine.hh"
+
+using namespace deepdive;
+
+// Measures how many measurements per second the tracking engine can take
+// with each filter, using a stationary tracker two meters in front of a
+// single lighthouse. The filter starts a few centimeters away from the
+// tracker, and the final position error is reported.
+
+// Number of sensors that see each sweep
+static constexpr size_t BENCH_SENSORS = 8;
+
+// Sweep rate of one lighthouse in 'A' mode
+static constexpr double BENCH_SWEEP_RATE = 120.0;
+
+// IMU sample rate
+static constexpr double BENCH_IMU_RATE = 1000.0;
+
+// Set up an engine with one lighthouse and one tracker, ready to track
+static void Setup(TrackingEngine & engine, Tracker & tracker) {
+  Lighthouse lighthouse;
+  memset(&lighthouse, 0, sizeof(lighthouse));
+  lighthouse.vTl[2] = -2.0;
+  lighthouse.ready = true;
+  memset(&tracker, 0, sizeof(tracker));
+  for (size_t i = 0; i < BENCH_SENSORS; i++) {
+    double a = 2.0 * M_PI * i / BENCH_SENSORS;
+    tracker.sensors[6*i+0] = 0.05 * cos(a);
+    tracker.sensors[6*i+1] = 0.05 * sin(a);
+    tracker.sensors[6*i+2] = 0.01 * (i % 2);
+  }
+  for (size_t i = 0; i < 3; i++) {
+    tracker.errors[ERROR_ACC_SCALE][i] = 1.0;
+    tracker.errors[ERROR_GYR_SCALE][i] = 1.0;
+  }
+  tracker.ready = true;
+  engine.SetLighthouse("LH", lighthouse);
+  engine.SetTracker("TR", tracker);
+}
+
+// Initial position error in each axis
+static constexpr double BENCH_OFFSET = 0.05;
+
+// Tuning that keeps the filter well conditioned on perfect measurements
+static EngineConfig Config() {
+  EngineConfig config;
+  config.gravity[2] = 0.0;
+  for (size_t i = 0; i < 3; i++)
+    config.est_position[i] = BENCH_OFFSET;
+  for (size_t i = 0; i < 6; i++) {
+    for (size_t j = 0; j < 3; j++) {
+      config.cov[i][j] = 1e-2;
+      config.noise[i][j] = 1e-4;
+    }
+  }
+  for (size_t i = 0; i < 4; i++) {
+    for (size_t j = 0; j < 3; j++) {
+      config.imu_cov[i][j] = 1e-4;
+      config.imu_noise[i][j] = 1e-6;
+    }
+  }
+  return config;
+}
+
+// Time a number of updates of one kind, returning nanoseconds per update
+// and the final position error in meters. IMU samples may be preintegrated
+// for the duration of a sweep.
+static double Run(FilterType filter, bool light, bool preintegrate,
+  size_t count, size_t & used, double & error) {
+  EngineConfig config = Config();
+  config.filter = filter;
+  config.preintegration = (preintegrate ? 1.0 / BENCH_SWEEP_RATE : 0.0);
+  config.use_light = light;
+  config.use_accelerometer = !light;
+  config.use_gyroscope = !light;
+  TrackingEngine engine(config);
+  Tracker tracker;
+  Setup(engine, tracker);
+  Pose pose;
+  engine.OnCorrection([&pose](Pose const& p) { pose = p; });
+  Sweep sweep;
+  sweep.tracker = engine.TrackerId("TR");
+  sweep.lighthouse = engine.LighthouseId("LH");
+  sweep.pulses.resize(BENCH_SENSORS);
+  Inertial inertial;
+  inertial.tracker = engine.TrackerId("TR");
+  for (size_t i = 0; i < 3; i++) {
+    inertial.acc[i] = 0.0;
+    inertial.gyr[i] = 0.0;
+  }
+  std::chrono::steady_clock::time_point tic = std::chrono::steady_clock::now();
+  for (size_t n = 0; n < count; n++) {
+    if (light) {
+      sweep.time = 1.0 + n / BENCH_SWEEP_RATE;
+      sweep.axis = n % NUM_MOTORS;
+      for (size_t i = 0; i < BENCH_SENSORS; i++) {
+        double x = tracker.sensors[6*i+0];
+        double y = tracker.sensors[6*i+1];
+        double z = tracker.sensors[6*i+2] + 2.0;
+        sweep.pulses[i].sensor = i;
+        sweep.pulses[i].angle = atan2(sweep.axis ? y : x, z);
+        sweep.pulses[i].duration = 1e-5;
+      }
+      engine.Light(sweep);
+    } else {
+      inertial.time = 1.0 + n / BENCH_IMU_RATE;
+      engine.Imu(inertial);
+    }
+  }
+  double ns = std::chrono::duration<double, std::nano>(
+    std::chrono::steady_clock::now() - tic).count();
+  EngineStats const& stats = engine.Stats();
+  used = light ? stats.sweeps : stats.inertials;
+  error = sqrt(pose.position[0] * pose.position[0]
+    + pose.position[1] * pose.position[1]
+    + pose.position[2] * pose.position[2]);
+  return ns / count;
+}
+
+int main(int argc, char **argv) {
+  size_t count = (argc > 1 ? strtoul(argv[1], nullptr, 10) : 10000);
+  printf("filter,name,updates,used,ns_per_update,updates_per_sec,error_m\n");
+  FilterType filters[] = {FilterType::UKF, FilterType::ESKF};
+  const char* names[] = {"ukf", "eskf"};
+  for (size_t f = 0; f < 2; f++) {
+    size_t used;
+    double error;
+    double ns = Run(filters[f], true, false, count, used, error);
+    printf("%s,light,%zu,%zu,%.1f,%.1f,%.6f\n",
+      names[f], count, used, ns, 1e9 / ns, error);
+    ns = Run(filters[f], false, false, count, used, error);
+    printf("%s,imu,%zu,%zu,%.1f,%.1f,%.6f\n",
+      names[f], count, used, ns, 1e9 / ns, error);
+    ns = Run(filters[f], false, true, count, used, error);
+    printf("%s,imu_preintegrated,%zu,%zu,%.1f,%.1f,%.6f\n",
+      names[f], count, used, ns, 1e9 / ns, error);
+  }
+  return 0;
+}
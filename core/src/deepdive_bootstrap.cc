@@ -0,0 +1,300 @@
+// This include
+#include "deepdive_bootstrap.hh"
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+// Eigen
+#include <Eigen/Eigenvalues>
+
+namespace deepdive {
+
+// Angles are only matched with others this recent, which is a few sweeps of
+// each axis, so that the body barely moves between them
+static constexpr double WINDOW = 0.1;
+
+// Gauss-Newton iterations refining a pose
+static constexpr size_t ITERATIONS = 10;
+
+// The fewest sensors that fix a pose
+static constexpr int MIN_SENSORS = 4;
+
+// Sensors in each random set that is fit, when not all sensors agree. This
+// is a few more than the fewest, so that noise barely moves the fit.
+static constexpr Eigen::Index SAMPLE = 5;
+
+// Most random sets to fit, and the confidence of having fit one set with no
+// disagreeing sensor at which to stop early
+static constexpr size_t TRIALS = 32;
+static constexpr double CONFIDENCE = 0.99;
+
+// Largest standard deviations of a solution, beyond which the light is too
+// noisy, or the tracker too far away, to start the filter from it
+static constexpr double MAX_POSITION_DEVIATION = 0.05;    // m
+static constexpr double MAX_ATTITUDE_DEVIATION = 0.05;    // rad
+
+typedef Eigen::Matrix<double, 3, Eigen::Dynamic> Points;
+typedef Eigen::Matrix<double, 2, Eigen::Dynamic> AngleList;
+typedef Eigen::Matrix<double, 6, 6> Matrix6d;
+typedef Eigen::Matrix<double, 6, 1> Vector6d;
+typedef std::vector<Eigen::Index> Indices;
+
+// Fit a pose to the ideal angles of some points in closed form, under scaled
+// orthography. A tracker is small next to its distance from the lighthouse,
+// so this lands close to the truth, and for points that are not all in one
+// plane it is unique. Returns false if the points are too close to a plane.
+static bool Seed(Points const& points, AngleList const& angles,
+  Indices const& use, Eigen::Affine3d & A) {
+  Eigen::Index m = use.size();
+  Eigen::Vector3d p_mean = Eigen::Vector3d::Zero();
+  Eigen::Vector2d u_mean = Eigen::Vector2d::Zero();
+  Eigen::Matrix<double, Eigen::Dynamic, 3> P(m, 3);
+  Eigen::Matrix<double, Eigen::Dynamic, 2> U(m, 2);
+  for (Eigen::Index i = 0; i < m; i++) {
+    P.row(i) = points.col(use[i]).transpose();
+    U(i, 0) = tan(angles(0, use[i]));
+    U(i, 1) = tan(angles(1, use[i]));
+    p_mean += P.row(i).transpose();
+    u_mean += U.row(i).transpose();
+  }
+  p_mean /= m;
+  u_mean /= m;
+  P.rowwise() -= p_mean.transpose();
+  U.rowwise() -= u_mean.transpose();
+  // The image is a linear function of the centered points, whose rows are
+  // the first two rows of the rotation over the distance
+  Eigen::Matrix3d PtP = P.transpose() * P;
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> spread(PtP);
+  if (!(spread.eigenvalues()[0] > 1e-4 * spread.eigenvalues()[2]))
+    return false;
+  Eigen::Matrix<double, 2, 3> M = (PtP.ldlt().solve(P.transpose() * U))
+    .transpose();
+  Eigen::JacobiSVD<Eigen::Matrix<double, 2, 3>> svd(M,
+    Eigen::ComputeFullU | Eigen::ComputeFullV);
+  double scale = 0.5 * (svd.singularValues()[0] + svd.singularValues()[1]);
+  if (!(scale > 0))
+    return false;
+  Eigen::Matrix<double, 2, 3> rows =
+    svd.matrixU() * svd.matrixV().leftCols<2>().transpose();
+  Eigen::Matrix3d R;
+  R.row(0) = rows.row(0);
+  R.row(1) = rows.row(1);
+  R.row(2) = rows.row(0).cross(rows.row(1));
+  double depth = 1.0 / scale;
+  A.linear() = R;
+  A.translation() = depth * Eigen::Vector3d(u_mean[0], u_mean[1], 1.0)
+    - R * p_mean;
+  return true;
+}
+
+// Refine a pose by Gauss-Newton on the ideal angles of some points. Returns
+// the sum of their squared errors, and optionally the information matrix of
+// the attitude and position, in that order.
+static double Refine(Points const& points, AngleList const& angles,
+  Indices const& use, Eigen::Affine3d & A, Matrix6d * information = nullptr) {
+  Matrix6d H;
+  double error = std::numeric_limits<double>::infinity();
+  for (size_t it = 0; it <= ITERATIONS; it++) {
+    H.setZero();
+    Vector6d g = Vector6d::Zero();
+    double last = error;
+    error = 0.0;
+    for (size_t i = 0; i < use.size(); i++) {
+      Eigen::Vector3d r = A.linear() * points.col(use[i]);
+      Eigen::Vector3d x = r + A.translation();
+      if (x[2] <= 0)
+        return std::numeric_limits<double>::infinity();
+      Eigen::Matrix<double, 3, 6> dx;
+      dx << -Skew(r), Eigen::Matrix3d::Identity();
+      for (size_t a = 0; a < 2; a++) {
+        double d = x[a] * x[a] + x[2] * x[2];
+        Eigen::RowVector3d da = Eigen::RowVector3d::Zero();
+        da[a] = x[2] / d;
+        da[2] = -x[a] / d;
+        Eigen::Matrix<double, 1, 6> J = da * dx;
+        double residual = angles(a, use[i]) - atan2(x[a], x[2]);
+        H += J.transpose() * J;
+        g += J.transpose() * residual;
+        error += residual * residual;
+      }
+    }
+    if (it == ITERATIONS || !(error < last) || last - error < 1e-12 * last)
+      break;
+    Vector6d step = H.ldlt().solve(g);
+    A.linear() = Exp(step.head<3>()).toRotationMatrix() * A.linear();
+    A.translation() += step.tail<3>();
+  }
+  if (information)
+    *information = H;
+  return error;
+}
+
+// Largest error in the angles of a point in the lighthouse frame
+static double Residual(double const* params, Eigen::Vector3d const& x,
+  double const angles[2], bool correct) {
+  if (x[2] <= 0)
+    return std::numeric_limits<double>::infinity();
+  double pred[2];
+  Predict(params, x.data(), pred, correct);
+  return std::max(fabs(angles[0] - pred[0]), fabs(angles[1] - pred[1]));
+}
+
+Bootstrap::Bootstrap(EngineConfig const& config, Frames const& frames)
+  : config_(config), frames_(frames) {}
+
+void Bootstrap::Add(double time, int tracker, int lighthouse,
+  Bundle const& bundle) {
+  std::pair<int, int> key(tracker, lighthouse);
+  if (angles_.find(key) == angles_.end()) {
+    Angles & angles = angles_[key];
+    std::fill(&angles.time[0][0], &angles.time[0][0] + 2 * NUM_SENSORS,
+      -std::numeric_limits<double>::infinity());
+    angles.tried = -std::numeric_limits<double>::infinity();
+    angles.seen = 0;
+  }
+  Angles & angles = angles_[key];
+  for (size_t i = 0; i < bundle.count; i++) {
+    angles.angle[bundle.sensors[i]][bundle.axis] = bundle.angles[i];
+    angles.time[bundle.sensors[i]][bundle.axis] = time;
+  }
+}
+
+bool Bootstrap::Solve(double time, int tracker, int lighthouse,
+  Eigen::Vector3d & position, Eigen::Quaterniond & attitude) {
+  std::map<std::pair<int, int>, Angles>::iterator it =
+    angles_.find(std::make_pair(tracker, lighthouse));
+  if (it == angles_.end())
+    return false;
+  Angles & angles = it->second;
+  double const* params = frames_.lighthouses[lighthouse].params;
+  Eigen::Index needed = std::max(MIN_SENSORS, config_.bootstrap_count);
+
+  // Ideal angles of the sensors seen recently on both axes, which are those
+  // that a lighthouse without errors would have measured
+  std::vector<size_t> sensors;
+  Points points(3, NUM_SENSORS);
+  AngleList ideals(2, NUM_SENSORS);
+  for (size_t s = 0; s < NUM_SENSORS; s++) {
+    if (angles.time[s][0] < time - WINDOW || angles.time[s][1] < time - WINDOW)
+      continue;
+    double ideal[2] = {angles.angle[s][0], angles.angle[s][1]};
+    Correct(params, ideal, frames_.correct);
+    Eigen::Index n = sensors.size();
+    ideals.col(n) = Eigen::Vector2d(ideal[0], ideal[1]);
+    points.col(n) = frames_.sensors[tracker].col(s);
+    sensors.push_back(s);
+  }
+  Eigen::Index n = sensors.size();
+  if (n < needed)
+    return false;
+  if (static_cast<size_t>(n) <= angles.seen && time - angles.tried < WINDOW)
+    return false;
+  angles.tried = time;
+  angles.seen = n;
+
+  // Fit all sensors first, and then random sets of a few sensors, and keep
+  // the pose that the most sensors agree with, so that a sensor seeing a
+  // reflection cannot drag the fit away. Sets are drawn until one with no
+  // disagreeing sensor has most likely been drawn.
+  std::minstd_rand random(n);
+  Indices order(n);
+  for (Eigen::Index i = 0; i < n; i++)
+    order[i] = i;
+  Eigen::Index sample = std::min(SAMPLE, n);
+  Eigen::Affine3d best = Eigen::Affine3d::Identity();
+  Indices inliers;
+  size_t trials = TRIALS;
+  for (size_t trial = 0; trial <= trials
+    && static_cast<Eigen::Index>(inliers.size()) < n; trial++) {
+    Eigen::Index m = (trial == 0 ? n : sample);
+    for (Eigen::Index i = 0; i < m && trial > 0; i++)
+      std::swap(order[i], order[i + random() % (n - i)]);
+    Indices use(order.begin(), order.begin() + m);
+    Eigen::Affine3d A;
+    if (!Seed(points, ideals, use, A)
+      || !std::isfinite(Refine(points, ideals, use, A)))
+      continue;
+    Indices agree;
+    for (Eigen::Index i = 0; i < n; i++)
+      if (Residual(params, A * Eigen::Vector3d(points.col(i)),
+        angles.angle[sensors[i]], frames_.correct) <= config_.bootstrap_error)
+        agree.push_back(i);
+    if (agree.size() <= inliers.size())
+      continue;
+    best = A;
+    inliers.swap(agree);
+    double w = std::pow(static_cast<double>(inliers.size()) / n, sample);
+    if (w < 1.0)
+      trials = std::min(trials, static_cast<size_t>(
+        std::ceil(std::log(1.0 - CONFIDENCE) / std::log(1.0 - w))));
+  }
+  Eigen::Index count = inliers.size();
+  if (count < needed)
+    return false;
+
+  // Fit the sensors that agree, starting from the best pose
+  Matrix6d information;
+  double squares = Refine(points, ideals, inliers, best, &information);
+  if (!std::isfinite(squares))
+    return false;
+
+  // Only accept a pose that explains all of the light it was fit to
+  double sum = 0.0;
+  for (Eigen::Index i = 0; i < count; i++) {
+    double residual = Residual(params,
+      best * Eigen::Vector3d(points.col(inliers[i])),
+      angles.angle[sensors[inliers[i]]], frames_.correct);
+    sum += residual * residual;
+  }
+  if (!(sqrt(sum / count) <= config_.bootstrap_error))
+    return false;
+
+  // ... and that the light fixes well enough. The noise is estimated from
+  // what is left over, but is never taken to be less than the filter's.
+  double noise = std::max(NOISE_ANGLE,
+    squares / std::max<Eigen::Index>(2 * count - 6, 1));
+  Eigen::FullPivLU<Matrix6d> lu(information);
+  if (!lu.isInvertible())
+    return false;
+  Matrix6d covariance = noise * lu.inverse();
+  if (!(covariance.topLeftCorner<3, 3>().trace()
+      <= MAX_ATTITUDE_DEVIATION * MAX_ATTITUDE_DEVIATION)
+    || !(covariance.bottomRightCorner<3, 3>().trace()
+      <= MAX_POSITION_DEVIATION * MAX_POSITION_DEVIATION))
+    return false;
+  Eigen::Affine3d wTb = frames_.lTw[lighthouse].inverse(Eigen::Isometry)
+    * best;
+  position = wTb.translation();
+  attitude = Eigen::Quaterniond(wTb.linear()).normalized();
+  return true;
+}
+
+double Bootstrap::Error(int tracker, int lighthouse, Bundle const& bundle,
+  Eigen::Vector3d const& position, Eigen::Quaterniond const& attitude) const {
+  if (bundle.count == 0)
+    return 0.0;
+  Eigen::Affine3d const& lTw = frames_.lTw[lighthouse];
+  double const* params = frames_.lighthouses[lighthouse].params;
+  Eigen::Matrix3d LR = lTw.linear() * attitude.toRotationMatrix();
+  Eigen::Vector3d origin = lTw * position;
+  double sum = 0.0;
+  for (size_t i = 0; i < bundle.count; i++) {
+    Eigen::Vector3d x = origin
+      + LR * frames_.sensors[tracker].col(bundle.sensors[i]);
+    double pred[2];
+    Predict(params, x.data(), pred, frames_.correct);
+    double error = bundle.angles[i] - pred[bundle.axis];
+    sum += error * error;
+  }
+  return sqrt(sum / bundle.count);
+}
+
+void Bootstrap::Clear() {
+  angles_.clear();
+}
+
+}  // namespace deepdive
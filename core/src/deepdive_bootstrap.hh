@@ -0,0 +1,58 @@
+#ifndef CORE_DEEPDIVE_BOOTSTRAP_HH
+#define CORE_DEEPDIVE_BOOTSTRAP_HH
+
+// STL
+#include <map>
+#include <utility>
+
+// Filters
+#include "deepdive_filter.hh"
+
+namespace deepdive {
+
+// Solves the body pose from light alone, so that the filter can be started
+// close to the truth instead of from a fixed estimate. The latest angle on
+// each axis of every sensor is kept for each tracker and lighthouse, and
+// once enough sensors have been seen on both axes within a short window,
+// their bearings are matched to the sensor positions in the body frame.
+// Solving is far more costly than fusing a sweep, so it is only attempted
+// once per window for each tracker and lighthouse, unless more sensors have
+// been seen since. This header is private to the core.
+class Bootstrap {
+ public:
+  Bootstrap(EngineConfig const& config, Frames const& frames);
+
+  // Remember the angles of a sweep
+  void Add(double time, int tracker, int lighthouse, Bundle const& bundle);
+
+  // Solve for the body pose from what one tracker has recently seen of one
+  // lighthouse, returning false if there is too little light, the pose does
+  // not explain it well enough, or the light is too noisy to fix the pose,
+  // or if it was solved too recently to try again
+  bool Solve(double time, int tracker, int lighthouse,
+    Eigen::Vector3d & position, Eigen::Quaterniond & attitude);
+
+  // RMS error in radians of the angles of a sweep, as predicted from a pose
+  double Error(int tracker, int lighthouse, Bundle const& bundle,
+    Eigen::Vector3d const& position, Eigen::Quaterniond const& attitude) const;
+
+  // Forget all angles
+  void Clear();
+
+ private:
+  // Latest angle of every sensor on each axis, and when it was seen
+  struct Angles {
+    double angle[NUM_SENSORS][2];
+    double time[NUM_SENSORS][2];
+    double tried;                    // When a solution was last attempted
+    size_t seen;                     // Sensors it was attempted with
+  };
+
+  EngineConfig const& config_;
+  Frames const& frames_;
+  std::map<std::pair<int, int>, Angles> angles_;   // By tracker, lighthouse
+};
+
+}  // namespace deepdive
+
+#endif
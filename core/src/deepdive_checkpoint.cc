@@ -0,0 +1,91 @@
+// This include
+#include "deepdive_checkpoint.hh"
+
+// STL
+#include <cstdio>
+#include <fstream>
+
+namespace deepdive {
+
+static constexpr uint32_t MAGIC = 0x54504b43;   // "CKPT"
+static constexpr uint32_t VERSION = 1;
+
+// Serials are short, so anything longer means the file is damaged
+static constexpr uint32_t MAX_SERIAL = 256;
+
+template <typename T>
+static void Write(std::ofstream & out, T const* values, size_t count = 1) {
+  out.write(reinterpret_cast<char const*>(values), sizeof(T) * count);
+}
+
+template <typename T>
+static bool Read(std::ifstream & in, T * values, size_t count = 1) {
+  in.read(reinterpret_cast<char*>(values), sizeof(T) * count);
+  return in.good();
+}
+
+bool WriteCheckpoint(std::string const& path, Checkpoint const& checkpoint) {
+  std::string tmp = path + ".tmp";
+  {
+    std::ofstream out(tmp.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out)
+      return false;
+    uint32_t header[2] = {MAGIC, VERSION};
+    Write(out, header, 2);
+    Write(out, &checkpoint.calibration);
+    Write(out, checkpoint.position, 3);
+    Write(out, checkpoint.attitude, 4);
+    Write(out, checkpoint.variances, 6);
+    uint32_t count = checkpoint.trackers.size();
+    Write(out, &count);
+    std::map<std::string, TrackerCheckpoint>::const_iterator it;
+    for (it = checkpoint.trackers.begin(); it != checkpoint.trackers.end();
+      it++) {
+      uint32_t length = it->first.size();
+      Write(out, &length);
+      Write(out, it->first.data(), length);
+      Write(out, &it->second.calibration);
+      Write(out, &it->second.errors[0][0], NUM_ERRORS * 3);
+      Write(out, &it->second.variances[0][0], NUM_ERRORS * 3);
+    }
+    out.flush();
+    if (!out) {
+      std::remove(tmp.c_str());
+      return false;
+    }
+  }
+  return (std::rename(tmp.c_str(), path.c_str()) == 0);
+}
+
+bool ReadCheckpoint(std::string const& path, Checkpoint & checkpoint) {
+  std::ifstream in(path.c_str(), std::ios::binary);
+  uint32_t header[2];
+  if (!in || !Read(in, header, 2) || header[0] != MAGIC
+    || header[1] != VERSION)
+    return false;
+  Checkpoint result;
+  uint32_t count;
+  if (!Read(in, &result.calibration) || !Read(in, result.position, 3)
+    || !Read(in, result.attitude, 4) || !Read(in, result.variances, 6)
+    || !Read(in, &count))
+    return false;
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t length;
+    if (!Read(in, &length) || length > MAX_SERIAL)
+      return false;
+    std::string serial(length, '\0');
+    TrackerCheckpoint tracker;
+    if (!Read(in, &serial[0], length) || !Read(in, &tracker.calibration)
+      || !Read(in, &tracker.errors[0][0], NUM_ERRORS * 3)
+      || !Read(in, &tracker.variances[0][0], NUM_ERRORS * 3))
+      return false;
+    result.trackers[serial] = tracker;
+  }
+  // Nothing may follow the last tracker
+  if (in.peek() != std::ifstream::traits_type::eof())
+    return false;
+  checkpoint = result;
+  return true;
+}
+
+}  // namespace deepdive
@@ -0,0 +1,27 @@
+#ifndef CORE_DEEPDIVE_CHECKPOINT_HH
+#define CORE_DEEPDIVE_CHECKPOINT_HH
+
+// STL
+#include <string>
+
+// Core types
+#include "deepdive_engine.hh"
+
+// Checkpoints are kept on disk in a small binary file, so that a restarted
+// tracker can pick up where it left off. The file starts with a magic and a
+// version, followed by the pose and then the IMU errors of each tracker by
+// serial, all in host byte order.
+
+namespace deepdive {
+
+// Write a checkpoint to a file, replacing it in one step so that a reader
+// never sees half of it. Returns false if the file could not be written.
+bool WriteCheckpoint(std::string const& path, Checkpoint const& checkpoint);
+
+// Read a checkpoint from a file, returning false if it is missing, was
+// written by another version, or is damaged
+bool ReadCheckpoint(std::string const& path, Checkpoint & checkpoint);
+
+}  // namespace deepdive
+
+#endif
@@ -0,0 +1,220 @@
+// STL
+#include <fstream>
+#include <sstream>
+#include <numeric>
+#include <iostream>
+
+// This include
+#include "deepdive_core.hh"
+
+namespace deepdive {
+
+// LOGGING
+
+// Default log sink
+static void DefaultLogFn(Level level, std::string const& msg) {
+  switch (level) {
+  case Level::DEBUG: std::cerr << "[DEBUG] " << msg << std::endl; break;
+  case Level::INFO:  std::cerr << "[INFO] "  << msg << std::endl; break;
+  case Level::WARN:  std::cerr << "[WARN] "  << msg << std::endl; break;
+  default:           std::cerr << "[ERROR] " << msg << std::endl; break;
+  }
+}
+
+static LogFn log_fn_ = DefaultLogFn;
+
+void SetLogFn(LogFn fn) {
+  log_fn_ = fn ? fn : DefaultLogFn;
+}
+
+void Log(Level level, std::string const& msg) {
+  log_fn_(level, msg);
+}
+
+// TRANSFORMS
+
+// Convert a ceres to an Eigen transform
+Eigen::Affine3d CeresToEigen(double ceres[6], bool invert) {
+  Eigen::Affine3d A;
+  A.translation()[0] = ceres[0];
+  A.translation()[1] = ceres[1];
+  A.translation()[2] = ceres[2];
+  Eigen::Vector3d v(ceres[3], ceres[4], ceres[5]);
+  Eigen::AngleAxisd aa;
+  if (v.norm() > 0) {
+    aa.angle() = v.norm();
+    aa.axis() = v.normalized();
+  }
+  A.linear() = aa.toRotationMatrix();
+  if (invert)
+    return A.inverse();
+  return A;
+}
+
+// Convert an angle axis to an eigen transform
+Eigen::Affine3d AngleAxisToTransform(double const data[6]) {
+  Eigen::Affine3d tf = Eigen::Affine3d::Identity();
+  tf.translation() = Eigen::Vector3d(data[0], data[1], data[2]);
+  Eigen::Vector3d v(data[3], data[4], data[5]);
+  if (v.norm() > 0) {
+    Eigen::AngleAxisd aa = Eigen::AngleAxisd::Identity();
+    aa.angle() = v.norm();
+    aa.axis() = v.normalized();
+    tf.linear() = aa.toRotationMatrix();
+  }
+  return tf;
+}
+
+// Convert a translation and quaternion (w, x, y, z) to an angle axis
+void PoseToAngleAxis(double const t[3], double const q[4], double data[6]) {
+  Eigen::AngleAxisd aa(Eigen::Quaterniond(q[0], q[1], q[2], q[3]));
+  data[0] = t[0];
+  data[1] = t[1];
+  data[2] = t[2];
+  data[3] = aa.angle() * aa.axis()[0];
+  data[4] = aa.angle() * aa.axis()[1];
+  data[5] = aa.angle() * aa.axis()[2];
+}
+
+// CONFIG MANAGEMENT
+
+// Parse a human-readable configuration
+bool ReadConfig(std::string const& calfile,   // Calibration file
+  std::string const& frame_world,             // World name
+  std::string const& frame_vive,              // Vive frame name
+  std::string const& frame_body,              // Body frame name
+  double registration[6],
+  LighthouseMap & lighthouses, TrackerMap & trackers) {
+  // Entries take the form x y z qx qy qz qw parent child
+  std::ifstream infile(calfile);
+  if (!infile.is_open()) {
+    Log(Level::WARN, "Could not open config file for reading");
+    return false;
+  }
+  std::string line;
+  int count = 0;
+  while (std::getline(infile, line)) {
+    std::istringstream iss(line);
+    double x, y, z, qx, qy, qz, qw;
+    std::string p, c;
+    if (!(iss >> x >> y >> z >> qx >> qy >> qz >> qw >> p >> c)) {
+      Log(Level::ERROR, "Badly formatted config file");
+      return false;
+    }
+    Eigen::AngleAxisd aa(Eigen::Quaterniond(qw, qx, qy, qz));
+    if (p == frame_world && c == frame_vive) {
+      registration[0] = x;
+      registration[1] = y;
+      registration[2] = z;
+      registration[3] = aa.angle() * aa.axis()[0];
+      registration[4] = aa.angle() * aa.axis()[1];
+      registration[5] = aa.angle() * aa.axis()[2];
+      count++;
+      continue;
+    }
+    if (p == frame_vive && lighthouses.find(c) != lighthouses.end()) {
+      lighthouses[c].vTl[0] = x;
+      lighthouses[c].vTl[1] = y;
+      lighthouses[c].vTl[2] = z;
+      lighthouses[c].vTl[3] = aa.angle() * aa.axis()[0];
+      lighthouses[c].vTl[4] = aa.angle() * aa.axis()[1];
+      lighthouses[c].vTl[5] = aa.angle() * aa.axis()[2];
+      count++;
+      continue;
+    }
+    if (p == frame_body && trackers.find(c) != trackers.end()) {
+      trackers[c].bTh[0] = x;
+      trackers[c].bTh[1] = y;
+      trackers[c].bTh[2] = z;
+      trackers[c].bTh[3] = aa.angle() * aa.axis()[0];
+      trackers[c].bTh[4] = aa.angle() * aa.axis()[1];
+      trackers[c].bTh[5] = aa.angle() * aa.axis()[2];
+      count++;
+      continue;
+    }
+    Log(Level::WARN, "Transform " + p + " -> " + c + " invalid");
+  }
+  return (count == 1 + lighthouses.size() + trackers.size());
+}
+
+// Write a human-readable configuration
+bool WriteConfig(std::string const& calfile,    // Calibration file
+  std::string const& frame_world,               // World name
+  std::string const& frame_vive,                // Vive frame name
+  std::string const& frame_body,                // Body frame name
+  double registration[6],
+  LighthouseMap const& lighthouses, TrackerMap const& trackers) {
+  std::ofstream outfile(calfile);
+  if (!outfile.is_open()) {
+    Log(Level::WARN, "Could not open config file for writing");
+    return false;
+  }
+  // World registration
+  {
+    Eigen::Vector3d v(registration[3], registration[4], registration[5]);
+    Eigen::AngleAxisd aa = Eigen::AngleAxisd::Identity();
+    if (v.norm() > 0) {
+      aa.angle() = v.norm();
+      aa.axis() = v.normalized();
+    }
+    Eigen::Quaterniond q(aa);
+    outfile << registration[0] << " "
+            << registration[1] << " "
+            << registration[2] << " "
+            << q.x() << " "
+            << q.y() << " "
+            << q.z() << " "
+            << q.w() << " "
+            << frame_world << " " << frame_vive
+            << std::endl;
+  }
+  LighthouseMap::const_iterator it;
+  for (it = lighthouses.begin(); it != lighthouses.end(); it++)  {
+    Eigen::Vector3d v(it->second.vTl[3], it->second.vTl[4], it->second.vTl[5]);
+    Eigen::AngleAxisd aa;
+    if (v.norm() > 0) {
+      aa.angle() = v.norm();
+      aa.axis() = v.normalized();
+    }
+    Eigen::Quaterniond q(aa);
+    outfile << it->second.vTl[0] << " "
+            << it->second.vTl[1] << " "
+            << it->second.vTl[2] << " "
+            << q.x() << " "
+            << q.y() << " "
+            << q.z() << " "
+            << q.w() << " "
+            << frame_vive << " " << it->first
+            << std::endl;
+  }
+  TrackerMap::const_iterator jt;
+  for (jt = trackers.begin(); jt != trackers.end(); jt++)  {
+    Eigen::Vector3d v(jt->second.bTh[3], jt->second.bTh[4], jt->second.bTh[5]);
+    Eigen::AngleAxisd aa;
+    if (v.norm() > 0) {
+      aa.angle() = v.norm();
+      aa.axis() = v.normalized();
+    }
+    Eigen::Quaterniond q(aa);
+    outfile << jt->second.bTh[0] << " "
+            << jt->second.bTh[1] << " "
+            << jt->second.bTh[2] << " "
+            << q.x() << " "
+            << q.y() << " "
+            << q.z() << " "
+            << q.w() << " "
+            << frame_body << " " << jt->first
+            << std::endl;
+  }
+  return true;
+}
+
+// STATISTICS
+
+bool Mean(std::vector<double> const& v, double & d) {
+  if (v.empty()) return false;
+  d = std::accumulate(v.begin(), v.end(), 0.0) / v.size();
+  return true;
+}
+
+}  // namespace deepdive
@@ -0,0 +1,726 @@
+// STL
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <map>
+#include <queue>
+#include <vector>
+
+// This include
+#include "deepdive_engine.hh"
+
+// Filters
+#include "deepdive_bootstrap.hh"
+#include "deepdive_filter.hh"
+#include "deepdive_preintegrator.hh"
+
+namespace deepdive {
+
+// A measurement waiting to be fused, which has already been checked
+struct Pending {
+  double time;                       // Time of the measurement
+  uint64_t seq;                      // Arrival order, to break ties
+  int tracker;                       // Engine id of the tracker
+  int lighthouse;                    // Engine id of the lighthouse, or -1
+  Bundle bundle;                     // LIGHT: accepted pulses
+  double acc[3];                     // IMU: acceleration
+  double gyr[3];                     // IMU: angular velocity
+  bool use_acc;                      // IMU: whether to use acceleration
+  bool use_gyr;                      // IMU: whether to use angular velocity
+  size_t samples;                    // IMU: number of samples averaged
+};
+
+// Orders the queue so that the oldest measurement is on top
+struct Later {
+  bool operator()(Pending const& a, Pending const& b) const {
+    return (a.time > b.time || (a.time == b.time && a.seq > b.seq));
+  }
+};
+
+// An IMU sample that has not been fused yet, kept for forward prediction
+struct Sample {
+  double time;                       // Time of the sample
+  int tracker;                       // Engine id of the tracker
+  double acc[3];                     // Acceleration
+  double gyr[3];                     // Angular velocity
+};
+
+// FNV-1a hash of some values, to tell whether a calibration has changed
+static uint64_t Fingerprint(double const* values, size_t count,
+  uint64_t hash = 14695981039346656037ULL) {
+  unsigned char const* bytes = reinterpret_cast<unsigned char const*>(values);
+  for (size_t i = 0; i < count * sizeof(double); i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// ENGINE STATE
+
+struct TrackingEngine::Impl {
+  EngineConfig config;               // Tuning
+  Frames frames;                     // Frames for prediction
+  std::vector<Tracker> trackers;     // Trackers, by engine id
+  std::vector<Preintegrator> preintegrators;  // IMU samples, by engine id
+  std::map<std::string, int> tracker_ids;     // Serial -> engine id
+  std::map<std::string, int> lighthouse_ids;  // Serial -> engine id
+  uint64_t epoch = 0;                // Lighthouses and trackers set so far
+  std::unique_ptr<Filter> filter;    // Tracking filter
+  EngineStats stats;                 // Measurement usage
+  bool initialized = false;          // Are we initialized and ready to track
+  bool started = false;              // Have we seen a timestamp yet
+  double last = 0.0;                 // Time of the last filter step
+  std::priority_queue<Pending, std::vector<Pending>, Later> queue;
+  uint64_t seq = 0;                  // Measurements queued so far
+  double newest = -std::numeric_limits<double>::infinity();
+  std::deque<Sample> recent;         // IMU samples after the last step
+  Bootstrap bootstrap{config, frames};  // Solves the pose from light
+  bool locked = false;               // Has the pose been solved from light
+  bool losing = false;               // Do the sweeps disagree with the state
+  double lost = 0.0;                 // Since when they have disagreed
+  Checkpoint restore;                // State to warm start from
+  bool restoring = false;            // Whether there is such a state
+  PoseFn correction_fn;              // Called after every correction
+  Pose pose;                         // Reused for the correction callback
+
+  // Time since the last step, which must be positive and under one second
+  bool Delta(double time, double & dt) {
+    if (!started) {
+      started = true;
+      last = time;
+    }
+    dt = time - last;
+    if (dt > 0)
+      last = time;
+    return (dt > 0 && dt < 1.0);
+  }
+
+  // Copy the tracking filter state into a pose
+  void Fill(double time, Pose & pose) const {
+    pose.time = time;
+    pose.horizon = 0.0;
+    filter->Fill(pose);
+  }
+
+  // Queue a measurement, and fuse everything older than the lag in time
+  // order. Measurements older than the last one fused are dropped.
+  bool Schedule(Pending & pending) {
+    if (started && pending.time < last) {
+      stats.late++;
+      return false;
+    }
+    if (pending.time < newest)
+      stats.reordered++;
+    else
+      newest = pending.time;
+    pending.seq = seq++;
+    queue.push(pending);
+    if (pending.lighthouse < 0 && Tracking())
+      Remember(pending);
+    Flush(newest - config.lag);
+    return true;
+  }
+
+  // Keep an IMU sample in time order until the filter has passed it
+  void Remember(Pending const& pending) {
+    Sample sample;
+    sample.time = pending.time;
+    sample.tracker = pending.tracker;
+    for (size_t i = 0; i < 3; i++) {
+      sample.acc[i] = pending.acc[i];
+      sample.gyr[i] = pending.gyr[i];
+    }
+    std::deque<Sample>::iterator it = recent.end();
+    while (it != recent.begin() && (it - 1)->time > sample.time)
+      --it;
+    recent.insert(it, sample);
+  }
+
+  // Forget the IMU samples that the filter has passed
+  void Forget() {
+    while (!recent.empty() && recent.front().time <= last)
+      recent.pop_front();
+  }
+
+  // Body angular velocity and world acceleration from an IMU sample, using
+  // the current error estimates. This inverts the measurement models.
+  void Inertial(Sample const& sample, Eigen::Quaterniond const& attitude,
+    Eigen::Vector3d & omega, Eigen::Vector3d & acceleration) const {
+    double errors[NUM_ERRORS][3];
+    filter->GetErrors(sample.tracker, errors);
+    Eigen::Affine3d const& iTb = frames.iTb[sample.tracker];
+    Eigen::Matrix3d Rt = iTb.linear().transpose();
+    if (config.use_gyroscope) {
+      Eigen::Vector3d z(sample.gyr[0], sample.gyr[1], sample.gyr[2]);
+      omega = Rt * (Eigen::Vector3d(errors[ERROR_GYR_SCALE]).cwiseProduct(z)
+        + Eigen::Vector3d(errors[ERROR_GYR_BIAS]));
+    }
+    if (config.use_accelerometer) {
+      Eigen::Vector3d z(sample.acc[0], sample.acc[1], sample.acc[2]);
+      Eigen::Vector3d r = iTb.translation();
+      Eigen::Vector3d f = Rt * (Eigen::Vector3d(errors[ERROR_ACC_SCALE])
+        .cwiseProduct(z) + Eigen::Vector3d(errors[ERROR_ACC_BIAS]));
+      acceleration = attitude * (f - omega.cross(omega.cross(r)))
+        - frames.gravity;
+    }
+  }
+
+  // This may be called far more often than the filter is corrected, so only
+  // the mean is moved. It follows the IMU samples that the filter has not
+  // fused yet, holding the last one, or the posterior rates without them.
+  bool Predict(double time, Pose & pose) const {
+    double horizon = time - last;
+    if (!initialized || !started || horizon < 0 || horizon >= 1.0)
+      return false;
+    filter->Fill(pose);
+    Eigen::Vector3d position(pose.position[0], pose.position[1],
+      pose.position[2]);
+    Eigen::Vector3d velocity(pose.velocity[0], pose.velocity[1],
+      pose.velocity[2]);
+    Eigen::Vector3d omega(pose.omega[0], pose.omega[1], pose.omega[2]);
+    Eigen::Vector3d acceleration = Eigen::Vector3d::Zero();
+    Eigen::Quaterniond attitude(pose.attitude[0], pose.attitude[1],
+      pose.attitude[2], pose.attitude[3]);
+    double t = last;
+    for (std::deque<Sample>::const_iterator it = recent.begin();
+      it != recent.end() && t < time; ++it) {
+      if (it->time <= t)
+        continue;
+      double dt = std::min(it->time, time) - t;
+      Inertial(*it, attitude, omega, acceleration);
+      position += (velocity + 0.5 * dt * acceleration) * dt;
+      velocity += acceleration * dt;
+      attitude = (attitude * Exp(omega * dt)).normalized();
+      t += dt;
+    }
+    if (t < time) {
+      double dt = time - t;
+      position += (velocity + 0.5 * dt * acceleration) * dt;
+      velocity += acceleration * dt;
+      attitude = (attitude * Exp(omega * dt)).normalized();
+    }
+    for (size_t i = 0; i < 3; i++) {
+      pose.position[i] = position[i];
+      pose.velocity[i] = velocity[i];
+      pose.omega[i] = omega[i];
+    }
+    pose.attitude[0] = attitude.w();
+    pose.attitude[1] = attitude.x();
+    pose.attitude[2] = attitude.y();
+    pose.attitude[3] = attitude.z();
+    pose.time = time;
+    pose.horizon = horizon;
+    return true;
+  }
+
+  // Whether the filter has a pose to work from
+  bool Tracking() const {
+    return (config.bootstrap_count <= 0 || locked);
+  }
+
+  // Until the filter has a pose, sweeps go to the bootstrap instead, and
+  // the first pose it solves starts the filter. After that, every sweep is
+  // checked against the state, and if they disagree for long enough the
+  // filter is started again. Returns whether the sweep should be fused.
+  bool Lock(Pending const& pending) {
+    if (config.bootstrap_count <= 0)
+      return true;
+    if (locked) {
+      Pose pose;
+      if (!Predict(pending.time, pose))
+        return true;
+      double error = bootstrap.Error(pending.tracker, pending.lighthouse,
+        pending.bundle, Eigen::Vector3d(pose.position),
+        Eigen::Quaterniond(pose.attitude[0], pose.attitude[1],
+          pose.attitude[2], pose.attitude[3]));
+      if (error <= config.bootstrap_error) {
+        losing = false;
+        return true;
+      }
+      if (!losing) {
+        losing = true;
+        lost = pending.time;
+      }
+      if (pending.time - lost < config.bootstrap_lost)
+        return true;
+      Log(Level::WARN, "Light disagrees with the state. Bootstrapping.");
+      locked = false;
+      recent.clear();
+      bootstrap.Clear();
+    }
+    bootstrap.Add(pending.time, pending.tracker, pending.lighthouse,
+      pending.bundle);
+    Eigen::Vector3d position;
+    Eigen::Quaterniond attitude;
+    if (!bootstrap.Solve(pending.time, pending.tracker, pending.lighthouse,
+      position, attitude))
+      return false;
+    Log(Level::INFO, "Pose solved from light. Tracking started.");
+    // Errors learned while the filter was lost cannot be trusted either
+    filter->ResetPose(position, attitude);
+    std::map<std::string, int>::const_iterator it;
+    for (it = tracker_ids.begin(); it != tracker_ids.end(); it++) {
+      if (!trackers[it->second].ready)
+        continue;
+      ResetErrors(it->second, it->first);
+      preintegrators[it->second].Clear();
+    }
+    double dt;
+    Delta(pending.time, dt);
+    locked = true;
+    losing = false;
+    stats.bootstraps++;
+    return false;
+  }
+
+  // Fuse all queued measurements up to a time
+  void Flush(double horizon) {
+    while (!queue.empty() && queue.top().time <= horizon) {
+      Pending const& pending = queue.top();
+      double dt;
+      if (!Tracking() && pending.lighthouse < 0) {
+        stats.not_ready++;
+      } else if (pending.lighthouse >= 0) {
+        // IMU samples before the sweep go in first
+        Preintegrated();
+        if (!Lock(pending)) {
+          stats.not_ready++;
+        } else if (!Delta(pending.time, dt)) {
+          stats.out_of_order++;
+        } else {
+          filter->Light(dt, pending.tracker, pending.lighthouse,
+            pending.bundle);
+          stats.sweeps++;
+          Corrected();
+        }
+      } else if (config.preintegration > 0) {
+        Preintegrate(pending);
+      } else if (!Delta(pending.time, dt)) {
+        stats.out_of_order++;
+      } else {
+        filter->Imu(dt, pending.tracker,
+          pending.use_acc ? pending.acc : nullptr,
+          pending.use_gyr ? pending.gyr : nullptr, pending.samples);
+        stats.inertials += pending.samples;
+        Corrected();
+      }
+      queue.pop();
+    }
+    Forget();
+  }
+
+  // Add an IMU sample to its tracker's interval, which is fused once it
+  // is long enough or a sweep arrives
+  void Preintegrate(Pending const& pending) {
+    Preintegrator & pre = preintegrators[pending.tracker];
+    if (pre.Count() == 0) {
+      double errors[NUM_ERRORS][3];
+      filter->GetErrors(pending.tracker, errors);
+      pre.Reset(started ? last : pending.time, errors);
+    }
+    if (!pre.Add(pending.time, pending.acc, pending.gyr, pending.samples)) {
+      stats.out_of_order += pending.samples;
+      return;
+    }
+    if (pre.End() - pre.Start() >= config.preintegration)
+      Preintegrated(pending.tracker);
+  }
+
+  // Fuse the IMU samples of one tracker as a single measurement
+  void Preintegrated(int tracker) {
+    Preintegrator & pre = preintegrators[tracker];
+    double dt;
+    if (!Delta(pre.End(), dt)) {
+      stats.out_of_order += pre.Count();
+      pre.Clear();
+      return;
+    }
+    double errors[NUM_ERRORS][3], acc[3], gyr[3];
+    filter->GetErrors(tracker, errors);
+    pre.Mean(errors, acc, gyr);
+    filter->Imu(dt, tracker, config.use_accelerometer ? acc : nullptr,
+      config.use_gyroscope ? gyr : nullptr, pre.Count());
+    stats.inertials += pre.Count();
+    pre.Clear();
+    Corrected();
+  }
+
+  // Fuse the IMU samples of all trackers, oldest interval first
+  void Preintegrated() {
+    for (;;) {
+      int next = -1;
+      for (size_t t = 0; t < preintegrators.size(); t++)
+        if (preintegrators[t].Count() > 0 && (next < 0 ||
+            preintegrators[t].End() < preintegrators[next].End()))
+          next = t;
+      if (next < 0)
+        return;
+      Preintegrated(next);
+    }
+  }
+
+  // Tell the observer about a correction
+  void Corrected() {
+    if (!correction_fn)
+      return;
+    Fill(last, pose);
+    correction_fn(pose);
+  }
+
+  // Find the engine id for a serial, or -1 if it has not been added
+  static int Find(std::map<std::string, int> const& ids,
+    std::string const& serial) {
+    std::map<std::string, int>::const_iterator it = ids.find(serial);
+    if (it == ids.end())
+      return -1;
+    return it->second;
+  }
+
+  // Check the tracker of a measurement, returning -1 if it is not ready
+  int ReadyTracker(int id) const {
+    if (id < 0 || static_cast<size_t>(id) >= trackers.size()
+      || !trackers[id].ready)
+      return -1;
+    return id;
+  }
+
+  // Check the lighthouse of a measurement, returning -1 if it is not ready
+  int ReadyLighthouse(int id) const {
+    if (id < 0 || static_cast<size_t>(id) >= frames.lighthouses.size()
+      || !frames.lighthouses[id].ready)
+      return -1;
+    return id;
+  }
+
+  // Fold the world -> lighthouse chain, which is rigid
+  void UpdateLighthouse(int id) {
+    frames.lTw[id] = frames.wTv.inverse(Eigen::Isometry)
+                   * frames.vTl[id].inverse(Eigen::Isometry);
+  }
+
+  // Fold the sensor -> body and body -> imu chains, which are rigid
+  void UpdateTracker(int id, Tracker const& tracker) {
+    Eigen::Affine3d bTh = AngleAxisToTransform(tracker.bTh);
+    Eigen::Affine3d tTh = AngleAxisToTransform(tracker.tTh);
+    Eigen::Affine3d tTi = AngleAxisToTransform(tracker.tTi);
+    Eigen::Affine3d bTt = bTh * tTh.inverse(Eigen::Isometry);
+    for (size_t i = 0; i < NUM_SENSORS; i++)
+      frames.sensors[id].col(i) = bTt * Eigen::Vector3d(tracker.sensors[6*i+0],
+        tracker.sensors[6*i+1], tracker.sensors[6*i+2]);
+    frames.iTb[id] = tTi.inverse(Eigen::Isometry) * tTh
+      * bTh.inverse(Eigen::Isometry);
+  }
+
+  // Fingerprint of everything a tracker's IMU errors are learned against
+  uint64_t TrackerCalibration(int id) const {
+    Tracker const& tracker = trackers[id];
+    uint64_t hash = Fingerprint(tracker.bTh, 6);
+    hash = Fingerprint(tracker.tTh, 6, hash);
+    hash = Fingerprint(tracker.tTi, 6, hash);
+    hash = Fingerprint(tracker.sensors, NUM_SENSORS * 6, hash);
+    return Fingerprint(&tracker.errors[0][0], NUM_ERRORS * 3, hash);
+  }
+
+  // Fingerprint of everything the world frame pose is learned against
+  uint64_t Calibration() const {
+    uint64_t hash = Fingerprint(frames.wTv.data(), 16);
+    std::map<std::string, int>::const_iterator it;
+    for (it = lighthouse_ids.begin(); it != lighthouse_ids.end(); it++) {
+      Lighthouse const& lighthouse = frames.lighthouses[it->second];
+      hash = Fingerprint(lighthouse.vTl, 6, hash);
+      hash = Fingerprint(lighthouse.params, NUM_MOTORS * NUM_PARAMS, hash);
+    }
+    return hash;
+  }
+
+  // Reset the IMU errors of a tracker from the checkpoint, if they were
+  // learned with the same calibration, or from the factory otherwise
+  void ResetErrors(int id, std::string const& serial) {
+    filter->ResetErrors(id, trackers[id]);
+    if (!restoring)
+      return;
+    std::map<std::string, TrackerCheckpoint>::const_iterator it =
+      restore.trackers.find(serial);
+    if (it == restore.trackers.end()
+      || it->second.calibration != TrackerCalibration(id))
+      return;
+    filter->SetErrors(id, it->second.errors, it->second.variances);
+    Log(Level::INFO, "IMU errors of " + serial + " read from checkpoint.");
+  }
+
+  // Start tracking once all trackers and lighthouses are ready
+  void CheckIfReadyToTrack() {
+    if (initialized)
+      return;
+    for (size_t i = 0; i < trackers.size(); i++)
+      if (!trackers[i].ready) return;
+    for (size_t i = 0; i < frames.lighthouses.size(); i++)
+      if (!frames.lighthouses[i].ready) return;
+    Log(Level::INFO, "All trackers and lighthouses found. Tracking started.");
+    initialized = true;
+    // The checkpoint pose is in the same world frame, but the body may have
+    // been moved since, so it is no more certain than the initial estimate
+    if (!restoring || restore.calibration != Calibration())
+      return;
+    double variances[6];
+    for (size_t i = 0; i < 6; i++)
+      variances[i] = std::max(restore.variances[i], config.cov[i / 3][i % 3]);
+    filter->ResetPose(Eigen::Vector3d(restore.position),
+      Eigen::Quaterniond(restore.attitude[0], restore.attitude[1],
+        restore.attitude[2], restore.attitude[3]));
+    filter->SetPoseVariances(variances);
+    Log(Level::INFO, "Pose read from checkpoint.");
+  }
+};
+
+TrackingEngine::TrackingEngine(EngineConfig const& config)
+  : impl_(new Impl) {
+  impl_->config = config;
+  impl_->frames.wTv = Eigen::Affine3d::Identity();
+  impl_->frames.gravity = Eigen::Vector3d(config.gravity[0],
+    config.gravity[1], config.gravity[2]);
+  impl_->frames.correct = config.correct;
+  // Setup the filter
+  switch (config.filter) {
+#ifdef DEEPDIVE_WITH_UKF
+  case FilterType::UKF:
+    impl_->filter = NewUkfFilter(impl_->config, impl_->frames);
+    break;
+#endif
+  default:
+    if (config.filter != FilterType::ESKF)
+      Log(Level::WARN, "Built without the UKF. Using the ESKF instead.");
+    impl_->filter = NewEskfFilter(impl_->config, impl_->frames);
+    break;
+  }
+}
+
+TrackingEngine::~TrackingEngine() {}
+
+void TrackingEngine::SetRegistration(double const registration[6]) {
+  impl_->frames.wTv = AngleAxisToTransform(registration);
+  for (size_t i = 0; i < impl_->frames.lighthouses.size(); i++)
+    impl_->UpdateLighthouse(i);
+}
+
+// Serials are only looked up here and by the id getters, as measurements
+// carry the ids
+int TrackingEngine::SetLighthouse(std::string const& serial,
+  Lighthouse const& lighthouse) {
+  Impl & impl = *impl_;
+  impl.epoch++;
+  int id = Impl::Find(impl.lighthouse_ids, serial);
+  if (id < 0) {
+    id = impl.frames.lighthouses.size();
+    impl.lighthouse_ids[serial] = id;
+    impl.frames.lighthouses.push_back(lighthouse);
+    impl.frames.vTl.push_back(Eigen::Affine3d::Identity());
+    impl.frames.lTw.push_back(Eigen::Affine3d::Identity());
+  }
+  impl.frames.lighthouses[id] = lighthouse;
+  impl.frames.vTl[id] = AngleAxisToTransform(lighthouse.vTl);
+  impl.UpdateLighthouse(id);
+  if (lighthouse.ready)
+    impl.CheckIfReadyToTrack();
+  return id;
+}
+
+int TrackingEngine::SetTracker(std::string const& serial,
+  Tracker const& tracker) {
+  Impl & impl = *impl_;
+  impl.epoch++;
+  int id = Impl::Find(impl.tracker_ids, serial);
+  if (id < 0) {
+    id = impl.trackers.size();
+    impl.tracker_ids[serial] = id;
+    impl.trackers.push_back(tracker);
+    impl.trackers.back().ready = false;
+    impl.filter->AddTracker();
+    impl.frames.sensors.push_back(SensorMatrix::Zero());
+    impl.frames.iTb.push_back(Eigen::Affine3d::Identity());
+    impl.preintegrators.push_back(Preintegrator());
+  }
+  bool initialize = tracker.ready && !impl.trackers[id].ready;
+  impl.trackers[id] = tracker;
+  impl.UpdateTracker(id, tracker);
+  if (!initialize)
+    return id;
+  // Initialize the IMU errors
+  impl.ResetErrors(id, serial);
+  // Check if we have got all info from lighthouses and trackers
+  impl.CheckIfReadyToTrack();
+  return id;
+}
+
+int TrackingEngine::LighthouseId(std::string const& serial) const {
+  return Impl::Find(impl_->lighthouse_ids, serial);
+}
+
+int TrackingEngine::TrackerId(std::string const& serial) const {
+  return Impl::Find(impl_->tracker_ids, serial);
+}
+
+uint64_t TrackingEngine::Epoch() const {
+  return impl_->epoch;
+}
+
+bool TrackingEngine::Ready() const {
+  return impl_->initialized;
+}
+
+// This will be called at approximately 120Hz
+// - Single lighthouse in 'A' mode : 120Hz (60Hz per axis)
+// - Dual lighthouses in b/A or b/c modes : 120Hz (30Hz per axis)
+bool TrackingEngine::Light(Sweep const& sweep) {
+  Impl & impl = *impl_;
+  EngineConfig const& config = impl.config;
+  if (!config.use_light || !impl.initialized) {
+    impl.stats.not_ready++;
+    return false;
+  }
+
+  // Check that the tracker/lighthouse is ready
+  int t = impl.ReadyTracker(sweep.tracker);
+  int l = impl.ReadyLighthouse(sweep.lighthouse);
+  if (t < 0 || l < 0) {
+    impl.stats.unknown++;
+    return false;
+  }
+
+  // Clean up the measurments
+  Pending pending;
+  pending.time = sweep.time;
+  pending.tracker = t;
+  pending.lighthouse = l;
+  Bundle & bundle = pending.bundle;
+  bundle.axis = sweep.axis;
+  bundle.count = 0;
+  for (size_t i = 0; i < sweep.pulses.size(); i++) {
+    // Basic sanity checks on the data
+    if (fabs(sweep.pulses[i].angle) > config.thresh_angle / 57.2958 ||
+        fabs(sweep.pulses[i].duration) < config.thresh_duration / 1e6 ||
+        sweep.pulses[i].sensor >= NUM_SENSORS) {
+      impl.stats.rejected++;
+      continue;
+    }
+    bundle.sensors[bundle.count] = sweep.pulses[i].sensor;
+    bundle.angles[bundle.count] = sweep.pulses[i].angle;
+    if (++bundle.count == NUM_SENSORS)
+      break;
+  }
+  if (config.thresh_count > 0 &&
+      bundle.count < static_cast<size_t>(config.thresh_count)) {
+    impl.stats.too_few++;
+    return false;
+  }
+
+  // Correct the filter, once the sweep is older than the lag
+  return impl.Schedule(pending);
+}
+
+// This will be called at approximately 250Hz
+bool TrackingEngine::Imu(Inertial const& inertial) {
+  Impl & impl = *impl_;
+  EngineConfig const& config = impl.config;
+  if ((!config.use_accelerometer && !config.use_gyroscope)
+    || !impl.initialized) {
+    impl.stats.not_ready++;
+    return false;
+  }
+
+  // Check that the tracker is ready
+  int t = impl.ReadyTracker(inertial.tracker);
+  if (t < 0) {
+    impl.stats.unknown++;
+    return false;
+  }
+
+  // Correct the filter, once the sample is older than the lag
+  Pending pending;
+  pending.time = inertial.time;
+  pending.tracker = t;
+  pending.lighthouse = -1;
+  pending.use_acc = config.use_accelerometer;
+  pending.use_gyr = config.use_gyroscope;
+  pending.samples = std::max<size_t>(inertial.samples, 1);
+  for (size_t i = 0; i < 3; i++) {
+    pending.acc[i] = inertial.acc[i];
+    pending.gyr[i] = inertial.gyr[i];
+  }
+  return impl.Schedule(pending);
+}
+
+// This will be called back at the desired tracking rate. The filter itself
+// is only ever moved to measurement times, so that measurements still in
+// the queue are not made late by the solution.
+bool TrackingEngine::Solution(double time, Pose & pose) {
+  Impl & impl = *impl_;
+  if (!impl.initialized)
+    return false;
+
+  // Fuse anything that has waited out the lag
+  impl.Flush(time - impl.config.lag);
+  impl.Preintegrated();
+  double dt = time - impl.last;
+  if (!impl.started || !impl.Tracking() || dt < 0 || dt >= 1.0)
+    return false;
+
+  // The filter relates WORLD and IMU frames
+  pose.time = time;
+  pose.horizon = dt;
+  impl.filter->Extrapolate(dt, pose);
+  return true;
+}
+
+bool TrackingEngine::Predict(double time, Pose & pose) const {
+  if (!impl_->Tracking())
+    return false;
+  return impl_->Predict(time, pose);
+}
+
+bool TrackingEngine::GetCheckpoint(Checkpoint & checkpoint) const {
+  Impl const& impl = *impl_;
+  if (!impl.initialized || !impl.started || !impl.Tracking())
+    return false;
+  Pose pose;
+  impl.filter->Fill(pose);
+  checkpoint.calibration = impl.Calibration();
+  for (size_t i = 0; i < 3; i++)
+    checkpoint.position[i] = pose.position[i];
+  for (size_t i = 0; i < 4; i++)
+    checkpoint.attitude[i] = pose.attitude[i];
+  for (size_t i = 0; i < 6; i++)
+    checkpoint.variances[i] = pose.pose_cov[i*6 + i];
+  // Trackers that have not been seen keep what they last learned
+  checkpoint.trackers.clear();
+  if (impl.restoring)
+    checkpoint.trackers = impl.restore.trackers;
+  std::map<std::string, int>::const_iterator it;
+  for (it = impl.tracker_ids.begin(); it != impl.tracker_ids.end(); it++) {
+    if (!impl.trackers[it->second].ready)
+      continue;
+    TrackerCheckpoint & tracker = checkpoint.trackers[it->first];
+    tracker.calibration = impl.TrackerCalibration(it->second);
+    impl.filter->GetErrors(it->second, tracker.errors);
+    impl.filter->GetVariances(it->second, tracker.variances);
+  }
+  return true;
+}
+
+void TrackingEngine::SetCheckpoint(Checkpoint const& checkpoint) {
+  impl_->restore = checkpoint;
+  impl_->restoring = true;
+}
+
+void TrackingEngine::OnCorrection(PoseFn fn) {
+  impl_->correction_fn = fn;
+}
+
+EngineStats const& TrackingEngine::Stats() const {
+  return impl_->stats;
+}
+
+}  // namespace deepdive
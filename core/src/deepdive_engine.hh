@@ -0,0 +1,189 @@
+#ifndef CORE_DEEPDIVE_ENGINE_HH
+#define CORE_DEEPDIVE_ENGINE_HH
+
+// STL
+#include <map>
+#include <memory>
+#include <string>
+#include <functional>
+
+// Core types
+#include "deepdive_core.hh"
+
+namespace deepdive {
+
+// Filters that the tracking engine can run
+enum class FilterType {
+  UKF,                               // Dual unscented Kalman filters
+  ESKF                               // Error-state Kalman filter
+};
+
+// Tuning for the tracking engine, with the same meaning as the ROS params
+struct EngineConfig {
+  // Which filter to run
+  FilterType filter = FilterType::UKF;
+  // Measurement rejection
+  int thresh_count = 4;              // Min num measurements required per bundle
+  double thresh_angle = 60.0;        // Angle threshold in degrees
+  double thresh_duration = 1.0;      // Duration threshold in microseconds
+  // Measurements are held for this long in seconds before being fused, so
+  // that they can be fused in time order. Zero fuses them on arrival.
+  double lag = 0.0;
+  // IMU samples are integrated for up to this long in seconds and fused as
+  // one measurement, or until a sweep or solution needs them. Zero fuses
+  // every sample on its own.
+  double preintegration = 0.0;
+  // The filter is started from a pose solved from light alone, once one
+  // tracker has seen this many sensors on both axes of a lighthouse, and
+  // the pose explains their angles to within the error in radians. It is
+  // started again in the same way if the sweeps disagree with the state by
+  // more than the error for lost seconds. Zero starts the filter from the
+  // initial estimate below and never restarts it.
+  int bootstrap_count = 0;
+  double bootstrap_error = 0.01;
+  double bootstrap_lost = 0.5;
+  // Which measurements to use, and whether to correct light
+  bool use_gyroscope = true;         // Input measurements from gyroscope
+  bool use_accelerometer = true;     // Input measurements from accelerometer
+  bool use_light = true;             // Input measurements from light
+  bool correct = false;              // Whether to correct light parameters
+  double gravity[3] = {0, 0, 9.80665};
+  // Tracking filter: initial estimate, covariance and process noise, in the
+  // order position, attitude, velocity, omega, acceleration, alpha. The
+  // attitude estimate is a quaternion (x, y, z, w) and everything else is
+  // a three-vector.
+  double est_position[3] = {0, 0, 0};
+  double est_attitude[4] = {0, 0, 0, 1};
+  double est_velocity[3] = {0, 0, 0};
+  double est_omega[3] = {0, 0, 0};
+  double est_acceleration[3] = {0, 0, 0};
+  double est_alpha[3] = {0, 0, 0};
+  double cov[6][3] = {};
+  double noise[6][3] = {};
+  // IMU error filter: initial covariance and process noise, in the order
+  // acc_bias, acc_scale, gyr_bias, gyr_scale
+  double imu_cov[4][3] = {};
+  double imu_noise[4][3] = {};
+};
+
+// Filter solution at a given time
+struct Pose {
+  double time;                       // Time in seconds
+  double horizon;                    // Seconds past the last measurement
+  double position[3];                // World frame position (m)
+  double attitude[4];                // Body to world quaternion (w, x, y, z)
+  double velocity[3];                // World frame velocity (m/s)
+  double omega[3];                   // Body frame angular velocity (rad/s)
+  double pose_cov[36];               // Position and attitude covariance
+  double twist_cov[36];              // Velocity and omega covariance
+};
+
+// IMU errors that the filter has learned for a tracker
+struct TrackerCheckpoint {
+  uint64_t calibration;              // Fingerprint of the tracker calibration
+  double errors[NUM_ERRORS][3];      // IMU errors
+  double variances[NUM_ERRORS][3];   // Their variances
+};
+
+// Converged filter state, which can be used in place of the initial
+// estimate and the factory IMU errors when tracking next starts. Each part
+// is only used if the calibration it was learned with has not changed.
+struct Checkpoint {
+  uint64_t calibration;              // Fingerprint of the other calibration
+  double position[3];                // World frame position (m)
+  double attitude[4];                // Body to world quaternion (w, x, y, z)
+  double variances[6];               // Position and attitude variances
+  std::map<std::string, TrackerCheckpoint> trackers;  // By serial
+};
+
+// Why measurements were not used, to be reported by the caller
+struct EngineStats {
+  uint64_t not_ready = 0;            // Tracking has not started
+  uint64_t out_of_order = 0;         // Timestamp not after the last one
+  uint64_t late = 0;                 // Arrived after the lag had passed
+  uint64_t reordered = 0;            // Arrived out of order within the lag
+  uint64_t unknown = 0;              // Unknown or unready tracker/lighthouse
+  uint64_t rejected = 0;             // Pulses failing the thresholds
+  uint64_t too_few = 0;              // Sweeps with too few good pulses
+  uint64_t sweeps = 0;               // Sweeps used
+  uint64_t inertials = 0;            // IMU samples used
+  uint64_t bootstraps = 0;           // Times the pose was solved from light
+};
+
+// Tracks a single rigid body, fusing light and IMU data from its trackers.
+// The filter implementation is hidden, so that users need not depend on it.
+// Calls must not be made concurrently. Different engines share no mutable
+// state, so each may be driven from its own thread.
+class TrackingEngine {
+ public:
+  // Called back with the filter state after every correction
+  typedef std::function<void(Pose const&)> PoseFn;
+
+  explicit TrackingEngine(EngineConfig const& config);
+  ~TrackingEngine();
+
+  // Non-copyable
+  TrackingEngine(TrackingEngine const&) = delete;
+  TrackingEngine& operator=(TrackingEngine const&) = delete;
+
+  // Set the world -> vive registration
+  void SetRegistration(double const registration[6]);
+
+  // Add or update a lighthouse, returning its engine id. Tracking starts
+  // once every lighthouse and tracker that has been added is ready.
+  int SetLighthouse(std::string const& serial, Lighthouse const& lighthouse);
+
+  // Add or update a tracker, returning its engine id. The IMU error filter
+  // for this tracker is reset from its errors when it first becomes ready.
+  int SetTracker(std::string const& serial, Tracker const& tracker);
+
+  // Engine ids are dense, start at zero and never change once assigned.
+  // Measurements name their devices by these ids, so callers should cache
+  // them. Returns -1 if the serial has not been added.
+  int LighthouseId(std::string const& serial) const;
+  int TrackerId(std::string const& serial) const;
+
+  // Number of lighthouses and trackers added or updated so far. A caller
+  // caching ids need only look up serials again when this has changed.
+  uint64_t Epoch() const;
+
+  // Whether all lighthouses and trackers are ready
+  bool Ready() const;
+
+  // Queue a sweep for the filter, returning false if it was dropped
+  bool Light(Sweep const& sweep);
+
+  // Queue an inertial sample for the filter, returning false if dropped
+  bool Imu(Inertial const& inertial);
+
+  // Fuse any measurements older than the lag, and get the solution at the
+  // given time, without moving the filter past the last measurement
+  bool Solution(double time, Pose & pose);
+
+  // Predict the pose at a time from the latest posterior and any IMU samples
+  // not yet fused, without fusing anything or touching the filter. Only the
+  // mean is predicted; the covariance is that of the posterior.
+  bool Predict(double time, Pose & pose) const;
+
+  // Get the current state, returning false if the engine is not tracking
+  bool GetCheckpoint(Checkpoint & checkpoint) const;
+
+  // Warm start from a checkpoint. The IMU errors of a tracker replace its
+  // factory errors whenever they are reset, and the pose replaces the
+  // initial estimate when tracking starts.
+  void SetCheckpoint(Checkpoint const& checkpoint);
+
+  // Observe the corrected state, without propagating the filter
+  void OnCorrection(PoseFn fn);
+
+  // Get the counters for measurement usage
+  EngineStats const& Stats() const;
+
+ private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}  // namespace deepdive
+
+#endif
@@ -0,0 +1,367 @@
+// STL
+#include <cmath>
+#include <vector>
+
+// This include
+#include "deepdive_filter.hh"
+
+namespace deepdive {
+
+namespace {
+
+// Pose error indexes, in the same order as the UKF state
+enum PoseIndex {
+  I_POSITION = 0,                    // Position (world frame, m)
+  I_ATTITUDE = 3,                    // Attitude (body frame, rads)
+  I_VELOCITY = 6,                    // Velocity (world frame, m/s)
+  I_OMEGA = 9,                       // Angular velocity (body frame, rads/s)
+  I_ACCELERATION = 12,               // Acceleration (body frame, m/s^2)
+  I_ALPHA = 15,                      // Angular acceleration (body, rads/s^2)
+  NUM_POSE = 18
+};
+
+// IMU error indexes, which follow the pose errors for each tracker in turn,
+// in the same order as the imu_cov and imu_noise tuning
+enum ImuIndex {
+  I_ACC_BIAS = 0,                    // Accelerometer bias (imu frame, m/s^2)
+  I_ACC_SCALE = 3,                   // Accelerometer scale (multiplier)
+  I_GYR_BIAS = 6,                    // Gyroscope bias (imu frame, rad/s)
+  I_GYR_SCALE = 9,                   // Gyroscope scale (multiplier)
+  NUM_IMU = 12
+};
+
+// The IMU errors in the order that they are indexed above
+static const int IMU_ERRORS[4] = {
+  ERROR_ACC_BIAS, ERROR_ACC_SCALE, ERROR_GYR_BIAS, ERROR_GYR_SCALE
+};
+
+// IMU errors of one tracker
+struct ImuErrors {
+  Eigen::Vector3d acc_bias;
+  Eigen::Vector3d acc_scale;
+  Eigen::Vector3d gyr_bias;
+  Eigen::Vector3d gyr_scale;
+};
+
+// Lighthouse angle on one axis for a point in the lighthouse frame, as in
+// Predict(), along with its derivative with respect to the point
+double PredictAngle(double const* params, Eigen::Vector3d const& x,
+  uint8_t axis, bool correct, Eigen::RowVector3d & J) {
+  size_t a = axis, b = 1 - axis;
+  double const* p = params + axis * NUM_PARAMS;
+  // Tilt and curvature
+  double u = x[a], dudb = 0.0;
+  if (correct) {
+    u -= (p[PARAM_TILT] + p[PARAM_CURVE] * x[b]) * x[b];
+    dudb = -(p[PARAM_TILT] + 2.0 * p[PARAM_CURVE] * x[b]);
+  }
+  double n = u * u + x[2] * x[2];
+  double ang = atan2(u, x[2]);
+  J[a] = x[2] / n;
+  J[b] = J[a] * dudb;
+  J[2] = -u / n;
+  // Phase and gib
+  if (correct) {
+    J *= 1.0 - p[PARAM_GIB_MAG] * cos(ang + p[PARAM_GIB_PHASE]);
+    ang -= p[PARAM_PHASE] + p[PARAM_GIB_MAG] * sin(ang + p[PARAM_GIB_PHASE]);
+  }
+  return ang;
+}
+
+// The pose and the IMU errors of every tracker are estimated jointly. The
+// nominal state is propagated with the same constant acceleration model as
+// the UKF, and the filter runs on its errors, with attitude errors being
+// small rotations in the body frame. Angular velocity is taken to be in the
+// body frame, as the gyroscope model has it. Every measurement model has an
+// analytic Jacobian, so a correction costs one small linear solve instead
+// of a pass over all sigma points.
+class EskfFilter : public Filter {
+ public:
+  EskfFilter(EngineConfig const& config, Frames const& frames)
+    : config_(config), frames_(frames),
+      covariance_(Eigen::MatrixXd::Zero(NUM_POSE, NUM_POSE)),
+      noise_(Eigen::VectorXd::Zero(NUM_POSE)) {
+    position_ = Vec(config.est_position);
+    attitude_ = Eigen::Quaterniond(config.est_attitude[3],
+      config.est_attitude[0], config.est_attitude[1],
+      config.est_attitude[2]).normalized();
+    velocity_ = Vec(config.est_velocity);
+    omega_ = Vec(config.est_omega);
+    acceleration_ = Vec(config.est_acceleration);
+    alpha_ = Vec(config.est_alpha);
+    for (size_t i = 0; i < 6; i++) {
+      covariance_.diagonal().segment<3>(3*i) = Vec(config.cov[i]);
+      noise_.segment<3>(3*i) = Vec(config.noise[i]);
+    }
+  }
+
+  void AddTracker() {
+    ImuErrors errors;
+    errors.acc_bias = Eigen::Vector3d::Zero();
+    errors.acc_scale = Eigen::Vector3d::Ones();
+    errors.gyr_bias = Eigen::Vector3d::Zero();
+    errors.gyr_scale = Eigen::Vector3d::Ones();
+    errors_.push_back(errors);
+    Eigen::Index n = covariance_.rows();
+    covariance_.conservativeResize(n + NUM_IMU, n + NUM_IMU);
+    covariance_.bottomRows<NUM_IMU>().setZero();
+    covariance_.rightCols<NUM_IMU>().setZero();
+    noise_.conservativeResize(n + NUM_IMU);
+    noise_.tail<NUM_IMU>().setZero();
+  }
+
+  void ResetErrors(int tracker, Tracker const& calibration) {
+    ImuErrors & errors = errors_[tracker];
+    errors.acc_bias = Vec(calibration.errors[ERROR_ACC_BIAS]);
+    errors.acc_scale = Vec(calibration.errors[ERROR_ACC_SCALE]);
+    errors.gyr_bias = Vec(calibration.errors[ERROR_GYR_BIAS]);
+    errors.gyr_scale = Vec(calibration.errors[ERROR_GYR_SCALE]);
+    Eigen::Index o = NUM_POSE + NUM_IMU * tracker;
+    covariance_.middleRows<NUM_IMU>(o).setZero();
+    covariance_.middleCols<NUM_IMU>(o).setZero();
+    for (size_t i = 0; i < 4; i++) {
+      covariance_.diagonal().segment<3>(o + 3*i) = Vec(config_.imu_cov[i]);
+      noise_.segment<3>(o + 3*i) = Vec(config_.imu_noise[i]);
+    }
+  }
+
+  void SetErrors(int tracker, double const errors[NUM_ERRORS][3],
+    double const variances[NUM_ERRORS][3]) {
+    ImuErrors & e = errors_[tracker];
+    e.acc_bias = Vec(errors[ERROR_ACC_BIAS]);
+    e.acc_scale = Vec(errors[ERROR_ACC_SCALE]);
+    e.gyr_bias = Vec(errors[ERROR_GYR_BIAS]);
+    e.gyr_scale = Vec(errors[ERROR_GYR_SCALE]);
+    Eigen::Index o = NUM_POSE + NUM_IMU * tracker;
+    covariance_.middleRows<NUM_IMU>(o).setZero();
+    covariance_.middleCols<NUM_IMU>(o).setZero();
+    for (size_t i = 0; i < 4; i++)
+      covariance_.diagonal().segment<3>(o + 3*i) =
+        Vec(variances[IMU_ERRORS[i]]);
+  }
+
+  void ResetPose(Eigen::Vector3d const& position,
+    Eigen::Quaterniond const& attitude) {
+    position_ = position;
+    attitude_ = attitude.normalized();
+    velocity_.setZero();
+    omega_.setZero();
+    acceleration_.setZero();
+    alpha_.setZero();
+    covariance_.topRows<NUM_POSE>().setZero();
+    covariance_.leftCols<NUM_POSE>().setZero();
+    for (size_t i = 0; i < 6; i++)
+      covariance_.diagonal().segment<3>(3*i) = Vec(config_.cov[i]);
+  }
+
+  void SetPoseVariances(double const variances[6]) {
+    covariance_.topRows<6>().setZero();
+    covariance_.leftCols<6>().setZero();
+    for (size_t i = 0; i < 6; i++)
+      covariance_(i, i) = variances[i];
+  }
+
+  // Each pulse depends only on the position and attitude
+  void Light(double dt, int tracker, int lighthouse, Bundle const& bundle) {
+    Predict(dt);
+    Eigen::Affine3d const& lTw = frames_.lTw[lighthouse];
+    double const* params = frames_.lighthouses[lighthouse].params;
+    Eigen::Matrix3d L = lTw.linear();
+    Eigen::Matrix3d LR = L * attitude_.toRotationMatrix();
+    Eigen::Vector3d origin = lTw * position_;
+    Eigen::Index n = bundle.count;
+    Eigen::MatrixXd H(n, I_VELOCITY);
+    Eigen::VectorXd residual(n);
+    Eigen::RowVector3d J;
+    for (Eigen::Index i = 0; i < n; i++) {
+      Eigen::Vector3d s = frames_.sensors[tracker].col(bundle.sensors[i]);
+      residual[i] = bundle.angles[i] - PredictAngle(params, origin + LR * s,
+        bundle.axis, frames_.correct, J);
+      H.block<1, 3>(i, I_POSITION) = J * L;
+      H.block<1, 3>(i, I_ATTITUDE) = -J * LR * Skew(s);
+    }
+    Update(H, residual, Eigen::VectorXd::Constant(n, NOISE_ANGLE));
+  }
+
+  // See http://www.mdpi.com/1424-8220/11/7/6771/htm
+  void Imu(double dt, int tracker, double const* acc, double const* gyr,
+    size_t samples) {
+    Predict(dt);
+    Eigen::Affine3d const& iTb = frames_.iTb[tracker];
+    Eigen::Matrix3d Ri = iTb.linear();
+    ImuErrors const& errors = errors_[tracker];
+    Eigen::Index o = NUM_POSE + NUM_IMU * tracker;
+    Eigen::Index n = (acc ? 3 : 0) + (gyr ? 3 : 0), row = 0;
+    Eigen::MatrixXd H = Eigen::MatrixXd::Zero(n, covariance_.rows());
+    Eigen::VectorXd residual(n), noise(n);
+    if (acc) {
+      Eigen::Vector3d r = iTb.translation();
+      Eigen::Vector3d g = attitude_.conjugate() * frames_.gravity;
+      Eigen::Vector3d inv = errors.acc_scale.cwiseInverse();
+      Eigen::Vector3d pred = inv.cwiseProduct(Ri * (acceleration_
+        + omega_.cross(omega_.cross(r)) + g) - errors.acc_bias);
+      residual.segment<3>(row) = Vec(acc) - pred;
+      noise.segment<3>(row).setConstant(NOISE_ACCELEROMETER / samples);
+      H.block<3, 3>(row, I_ATTITUDE) = inv.asDiagonal() * Ri * Skew(g);
+      H.block<3, 3>(row, I_OMEGA) = inv.asDiagonal() * Ri
+        * (omega_ * r.transpose() - 2.0 * r * omega_.transpose()
+          + omega_.dot(r) * Eigen::Matrix3d::Identity());
+      H.block<3, 3>(row, I_ACCELERATION) = inv.asDiagonal() * Ri;
+      H.block<3, 3>(row, o + I_ACC_BIAS).diagonal() = -inv;
+      H.block<3, 3>(row, o + I_ACC_SCALE).diagonal() =
+        -pred.cwiseQuotient(errors.acc_scale);
+      row += 3;
+    }
+    if (gyr) {
+      Eigen::Vector3d inv = errors.gyr_scale.cwiseInverse();
+      Eigen::Vector3d pred = inv.cwiseProduct(Ri * omega_ - errors.gyr_bias);
+      residual.segment<3>(row) = Vec(gyr) - pred;
+      noise.segment<3>(row).setConstant(NOISE_GYROSCOPE / samples);
+      H.block<3, 3>(row, I_OMEGA) = inv.asDiagonal() * Ri;
+      H.block<3, 3>(row, o + I_GYR_BIAS).diagonal() = -inv;
+      H.block<3, 3>(row, o + I_GYR_SCALE).diagonal() =
+        -pred.cwiseQuotient(errors.gyr_scale);
+      row += 3;
+    }
+    Update(H, residual, noise);
+  }
+
+  void GetErrors(int tracker, double errors[NUM_ERRORS][3]) const {
+    ImuErrors const& e = errors_[tracker];
+    for (size_t i = 0; i < 3; i++) {
+      errors[ERROR_ACC_BIAS][i] = e.acc_bias[i];
+      errors[ERROR_ACC_SCALE][i] = e.acc_scale[i];
+      errors[ERROR_GYR_BIAS][i] = e.gyr_bias[i];
+      errors[ERROR_GYR_SCALE][i] = e.gyr_scale[i];
+    }
+  }
+
+  void GetVariances(int tracker, double variances[NUM_ERRORS][3]) const {
+    Eigen::Index o = NUM_POSE + NUM_IMU * tracker;
+    for (size_t i = 0; i < 4; i++)
+      for (size_t j = 0; j < 3; j++)
+        variances[IMU_ERRORS[i]][j] = covariance_(o + 3*i + j, o + 3*i + j);
+  }
+
+  // The IMU errors are random walks, so only the pose errors are mixed
+  void Predict(double dt) {
+    Eigen::Matrix3d R = attitude_.toRotationMatrix();
+    Eigen::Matrix3d Fta = Eigen::Matrix3d::Identity() - Skew(omega_) * dt;
+    Eigen::Matrix3d Fvt = -R * Skew(acceleration_) * dt;
+    Eigen::Matrix3d Fva = R * dt;
+    Transition(covariance_, Fta, Fvt, Fva, dt);
+    Eigen::Transpose<Eigen::MatrixXd> Pt = covariance_.transpose();
+    Transition(Pt, Fta, Fvt, Fva, dt);
+    covariance_.diagonal() += noise_ * dt;
+    // Nominal state
+    Eigen::Vector3d acc = R * acceleration_;
+    position_ += (velocity_ + 0.5 * dt * acc) * dt;
+    velocity_ += acc * dt;
+    attitude_ = (attitude_ * Exp((omega_ + 0.5 * dt * alpha_) * dt));
+    attitude_.normalize();
+    omega_ += alpha_ * dt;
+  }
+
+  void Extrapolate(double dt, Pose & pose) const {
+    EskfFilter copy(*this);
+    copy.Predict(dt);
+    copy.Fill(pose);
+  }
+
+  void Fill(Pose & pose) const {
+    for (size_t i = 0; i < 3; i++) {
+      pose.position[i] = position_[i];
+      pose.velocity[i] = velocity_[i];
+      pose.omega[i] = omega_[i];
+    }
+    pose.attitude[0] = attitude_.w();
+    pose.attitude[1] = attitude_.x();
+    pose.attitude[2] = attitude_.y();
+    pose.attitude[3] = attitude_.z();
+    for (size_t i = 0; i < 6; i++) {
+      for (size_t j = 0; j < 6; j++) {
+        pose.pose_cov[i*6 + j] = covariance_(i, j);
+        pose.twist_cov[i*6 + j] = covariance_(6+i, 6+j);
+      }
+    }
+  }
+
+ private:
+  // Apply the error transition to the rows of a matrix. Most of it is the
+  // identity, so only the blocks that move are touched, in an order that
+  // leaves each block's inputs alone until it has been updated.
+  template <typename M>
+  static void Transition(M & m, Eigen::Matrix3d const& Fta,
+    Eigen::Matrix3d const& Fvt, Eigen::Matrix3d const& Fva, double dt) {
+    m.template middleRows<3>(I_POSITION) +=
+      dt * m.template middleRows<3>(I_VELOCITY);
+    m.template middleRows<3>(I_VELOCITY) +=
+      Fvt * m.template middleRows<3>(I_ATTITUDE)
+      + Fva * m.template middleRows<3>(I_ACCELERATION);
+    m.template middleRows<3>(I_ATTITUDE) =
+      Fta * m.template middleRows<3>(I_ATTITUDE)
+      + dt * m.template middleRows<3>(I_OMEGA);
+    m.template middleRows<3>(I_OMEGA) +=
+      dt * m.template middleRows<3>(I_ALPHA);
+  }
+
+  // Correct with the residuals of some measurements, given the Jacobian of
+  // the measurement model with respect to the errors. The Jacobian may only
+  // cover the leading errors, when it is zero for the rest.
+  void Update(Eigen::MatrixXd const& H, Eigen::VectorXd const& residual,
+    Eigen::VectorXd const& noise) {
+    Eigen::MatrixXd PHt = covariance_.leftCols(H.cols()) * H.transpose();
+    Eigen::MatrixXd S = H * PHt.topRows(H.cols());
+    S.diagonal() += noise;
+    Eigen::LLT<Eigen::MatrixXd> llt(S);
+    if (llt.info() != Eigen::Success)
+      return;
+    Eigen::MatrixXd K = llt.solve(PHt.transpose()).transpose();
+    covariance_.noalias() -= K * PHt.transpose();
+    covariance_ = (0.5 * (covariance_ + covariance_.transpose())).eval();
+    Inject(K * residual);
+  }
+
+  // Move the errors into the nominal state. The errors are then zero, and
+  // for small corrections their covariance is unchanged by the reset.
+  void Inject(Eigen::VectorXd const& dx) {
+    position_ += dx.segment<3>(I_POSITION);
+    attitude_ = attitude_ * Exp(dx.segment<3>(I_ATTITUDE));
+    attitude_.normalize();
+    velocity_ += dx.segment<3>(I_VELOCITY);
+    omega_ += dx.segment<3>(I_OMEGA);
+    acceleration_ += dx.segment<3>(I_ACCELERATION);
+    alpha_ += dx.segment<3>(I_ALPHA);
+    for (size_t t = 0; t < errors_.size(); t++) {
+      Eigen::Index o = NUM_POSE + NUM_IMU * t;
+      errors_[t].acc_bias += dx.segment<3>(o + I_ACC_BIAS);
+      errors_[t].acc_scale += dx.segment<3>(o + I_ACC_SCALE);
+      errors_[t].gyr_bias += dx.segment<3>(o + I_GYR_BIAS);
+      errors_[t].gyr_scale += dx.segment<3>(o + I_GYR_SCALE);
+    }
+  }
+
+  EngineConfig const& config_;       // Tuning
+  Frames const& frames_;             // Frames for prediction
+  Eigen::Vector3d position_;         // Position (world frame, m)
+  Eigen::Quaterniond attitude_;      // Attitude (body to world)
+  Eigen::Vector3d velocity_;         // Velocity (world frame, m/s)
+  Eigen::Vector3d omega_;            // Angular velocity (body frame, rads/s)
+  Eigen::Vector3d acceleration_;     // Acceleration (body frame, m/s^2)
+  Eigen::Vector3d alpha_;            // Angular acceleration (body frame)
+  std::vector<ImuErrors> errors_;    // IMU errors, by engine id
+  Eigen::MatrixXd covariance_;       // Covariance of all errors
+  Eigen::VectorXd noise_;            // Process noise, per second
+
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+}  // namespace
+
+std::unique_ptr<Filter> NewEskfFilter(EngineConfig const& config,
+  Frames const& frames) {
+  return std::unique_ptr<Filter>(new EskfFilter(config, frames));
+}
+
+}  // namespace deepdive
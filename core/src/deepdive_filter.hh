@@ -0,0 +1,140 @@
+#ifndef CORE_DEEPDIVE_FILTER_HH
+#define CORE_DEEPDIVE_FILTER_HH
+
+// STL
+#include <memory>
+#include <vector>
+
+// Core types
+#include "deepdive_core.hh"
+#include "deepdive_engine.hh"
+
+// Filters behind the tracking engine. This header is private to the core.
+
+namespace deepdive {
+
+// Measurement noise, shared by all filters
+static constexpr double NOISE_ACCELEROMETER = 1.0e-4;
+static constexpr double NOISE_GYROSCOPE = 1.0e-6;
+static constexpr double NOISE_ANGLE = 1.0e-8;
+
+// Vector from an array
+inline Eigen::Vector3d Vec(double const v[3]) {
+  return Eigen::Vector3d(v[0], v[1], v[2]);
+}
+
+// Cross product matrix, so that Skew(a) * b = a x b
+inline Eigen::Matrix3d Skew(Eigen::Vector3d const& v) {
+  Eigen::Matrix3d m;
+  m <<     0, -v[2],  v[1],
+        v[2],     0, -v[0],
+       -v[1],  v[0],     0;
+  return m;
+}
+
+// Rotation for a rotation vector
+inline Eigen::Quaterniond Exp(Eigen::Vector3d const& v) {
+  double angle = v.norm();
+  if (angle < 1e-12)
+    return Eigen::Quaterniond(1.0, 0.5*v[0], 0.5*v[1], 0.5*v[2]).normalized();
+  return Eigen::Quaterniond(Eigen::AngleAxisd(angle, v / angle));
+}
+
+// Per-tracker and per-lighthouse state, indexed by engine id
+typedef std::vector<Eigen::Affine3d,
+  Eigen::aligned_allocator<Eigen::Affine3d>> TransformList;
+typedef Eigen::Matrix<double, 3, NUM_SENSORS> SensorMatrix;
+typedef std::vector<SensorMatrix,
+  Eigen::aligned_allocator<SensorMatrix>> SensorList;
+
+// Everything needed to predict a measurement from the state. The static
+// parts of each transform chain are folded together whenever a frame
+// changes, so that the measurement models only apply the body pose.
+struct Frames {
+  Eigen::Affine3d wTv;               // ALL: world -> vive
+  TransformList vTl;                 // ALL: vive -> lighthouse
+  TransformList lTw;                 // LIGHT: world -> lighthouse
+  SensorList sensors;                // LIGHT: sensor positions in body frame
+  TransformList iTb;                 // IMU: body -> imu
+  std::vector<Lighthouse> lighthouses;
+  Eigen::Vector3d gravity;           // Gravity
+  bool correct;                      // Whether to correct light parameters
+};
+
+// The pulses of one sweep that passed the thresholds
+struct Bundle {
+  uint8_t axis;                      // Axis of the sweep
+  size_t count;                      // Number of pulses
+  uint16_t sensors[NUM_SENSORS];     // Sensor of each pulse
+  double angles[NUM_SENSORS];        // Angle of each pulse (rads)
+};
+
+// A filter that estimates the body pose and the IMU errors of every tracker.
+// The engine resolves ids, checks timestamps and thresholds measurements,
+// so a filter only sees clean measurements from ready devices. Filters of
+// different engines run concurrently, so anything a filter shares with the
+// others, such as static noise, must only be read.
+class Filter {
+ public:
+  virtual ~Filter() {}
+
+  // Make room for the IMU errors of a new tracker
+  virtual void AddTracker() = 0;
+
+  // Reset the IMU errors of a tracker from its calibration
+  virtual void ResetErrors(int tracker, Tracker const& calibration) = 0;
+
+  // Set the IMU errors of a tracker that has been reset, and their
+  // variances, which are taken to be uncorrelated with the rest of the state
+  virtual void SetErrors(int tracker, double const errors[NUM_ERRORS][3],
+    double const variances[NUM_ERRORS][3]) = 0;
+
+  // Restart the pose at rest from a position and attitude, with the initial
+  // covariance, keeping the IMU errors
+  virtual void ResetPose(Eigen::Vector3d const& position,
+    Eigen::Quaterniond const& attitude) = 0;
+
+  // Set the variances of the position and attitude, in that order, which
+  // are taken to be uncorrelated with each other and the rest of the state
+  virtual void SetPoseVariances(double const variances[6]) = 0;
+
+  // Propagate by dt and correct with the pulses of one sweep
+  virtual void Light(double dt, int tracker, int lighthouse,
+    Bundle const& bundle) = 0;
+
+  // Propagate by dt and correct with the mean of some IMU samples, whose
+  // noise is lower than that of a single sample. Either of the
+  // measurements may be null, if it is not used.
+  virtual void Imu(double dt, int tracker, double const* acc,
+    double const* gyr, size_t samples) = 0;
+
+  // Get the current IMU error estimates of a tracker
+  virtual void GetErrors(int tracker,
+    double errors[NUM_ERRORS][3]) const = 0;
+
+  // Get the variances of the current IMU error estimates of a tracker
+  virtual void GetVariances(int tracker,
+    double variances[NUM_ERRORS][3]) const = 0;
+
+  // Propagate by dt without a correction
+  virtual void Predict(double dt) = 0;
+
+  // Fill a pose with the state propagated by dt, leaving the filter alone
+  virtual void Extrapolate(double dt, Pose & pose) const = 0;
+
+  // Copy the state and its covariance into a pose, leaving the time alone
+  virtual void Fill(Pose & pose) const = 0;
+};
+
+// Dual unscented Kalman filters, one for the pose and one per tracker for
+// the IMU errors. Only built with DEEPDIVE_WITH_UKF.
+std::unique_ptr<Filter> NewUkfFilter(EngineConfig const& config,
+  Frames const& frames);
+
+// A single error-state Kalman filter with analytic Jacobians
+std::unique_ptr<Filter> NewEskfFilter(EngineConfig const& config,
+  Frames const& frames);
+
+}  // namespace deepdive
+
+#endif
@@ -0,0 +1,165 @@
+// This include
+#include "deepdive_intake.hh"
+
+// STL
+#include <algorithm>
+#include <vector>
+
+namespace deepdive {
+
+// Time of a measurement
+static double Time(Measurement const& m) {
+  return (m.light ? m.sweep.time : m.inertial.time);
+}
+
+// Running sum of the IMU samples of one tracker in a batch, each weighted
+// by the number of samples it is already the mean of
+struct Sum {
+  uint8_t tracker;                   // Caller's tracker id
+  size_t index;                      // Latest sample, which holds the mean
+  size_t count;                      // Number of measurements
+  size_t samples;                    // Number of samples
+  double time;                       // Sum of the times
+  double acc[3];                     // Sum of the accelerations
+  double gyr[3];                     // Sum of the angular velocities
+};
+
+Intake::Intake(IntakeConfig const& config) : config_(config) {}
+
+bool Intake::Push(Measurement && measurement) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (config_.capacity > 0 && queue_.size() >= config_.capacity) {
+    stats_.overflow++;
+    if (!Shed(measurement))
+      return false;
+  }
+  queue_.push_back(std::move(measurement));
+  stats_.depth = queue_.size();
+  stats_.peak = std::max(stats_.peak, stats_.depth);
+  return (queue_.size() == 1);
+}
+
+// This only runs when the intake is full, which is rare enough that a scan
+// costs less than keeping the queue ordered by priority
+bool Intake::Shed(Measurement const& measurement) {
+  std::deque<Measurement>::iterator victim = queue_.end(), it;
+  for (it = queue_.begin(); it != queue_.end(); it++) {
+    if (!it->light) {
+      victim = it;
+      break;
+    }
+    if (victim == queue_.end()
+      || it->sweep.pulses.size() < victim->sweep.pulses.size())
+      victim = it;
+  }
+  if (victim == queue_.end())
+    return false;
+  if (victim->light && (!measurement.light
+    || measurement.sweep.pulses.size() <= victim->sweep.pulses.size()))
+    return false;
+  queue_.erase(victim);
+  return true;
+}
+
+void Intake::Take(double now, std::deque<Measurement> & batch) {
+  batch.clear();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    batch.swap(queue_);
+    stats_.depth = 0;
+  }
+  uint64_t stale = 0, superseded = 0, coalesced = 0;
+  std::vector<char> drop(batch.size(), 0);
+
+  // Newest first, so that it is the newest sweep of each axis that is kept
+  std::vector<Measurement const*> axes;
+  for (size_t i = batch.size(); i-- > 0;) {
+    Measurement const& m = batch[i];
+    if (config_.budget > 0 && Time(m) < now - config_.budget) {
+      drop[i] = 1;
+      stale++;
+      continue;
+    }
+    if (!m.light)
+      continue;
+    std::vector<Measurement const*>::const_iterator it;
+    for (it = axes.begin(); it != axes.end(); it++)
+      if ((*it)->sweep.axis == m.sweep.axis
+        && (*it)->tracker == m.tracker
+        && (*it)->lighthouse == m.lighthouse)
+        break;
+    if (it == axes.end()) {
+      axes.push_back(&m);
+    } else {
+      drop[i] = 1;
+      superseded++;
+    }
+  }
+
+  // Average the samples of each tracker into the latest one
+  std::vector<Sum> sums;
+  for (size_t i = 0; i < batch.size(); i++) {
+    Inertial const& inertial = batch[i].inertial;
+    if (batch[i].light || drop[i])
+      continue;
+    std::vector<Sum>::iterator it;
+    for (it = sums.begin(); it != sums.end(); it++)
+      if (it->tracker == batch[i].tracker)
+        break;
+    if (it == sums.end()) {
+      sums.push_back(
+        Sum{batch[i].tracker, i, 0, 0, 0.0, {0, 0, 0}, {0, 0, 0}});
+      it = sums.end() - 1;
+    } else {
+      drop[it->index] = 1;
+      it->index = i;
+      coalesced++;
+    }
+    double weight = inertial.samples;
+    it->count++;
+    it->samples += inertial.samples;
+    it->time += weight * inertial.time;
+    for (size_t j = 0; j < 3; j++) {
+      it->acc[j] += weight * inertial.acc[j];
+      it->gyr[j] += weight * inertial.gyr[j];
+    }
+  }
+  for (size_t s = 0; s < sums.size(); s++) {
+    if (sums[s].count < 2)
+      continue;
+    Inertial & inertial = batch[sums[s].index].inertial;
+    inertial.samples = sums[s].samples;
+    inertial.time = sums[s].time / sums[s].samples;
+    for (size_t j = 0; j < 3; j++) {
+      inertial.acc[j] = sums[s].acc[j] / sums[s].samples;
+      inertial.gyr[j] = sums[s].gyr[j] / sums[s].samples;
+    }
+  }
+
+  // Keep the rest, in the order the engine needs them
+  size_t n = 0;
+  for (size_t i = 0; i < batch.size(); i++) {
+    if (drop[i])
+      continue;
+    if (n != i)
+      batch[n] = std::move(batch[i]);
+    n++;
+  }
+  batch.resize(n);
+  std::stable_sort(batch.begin(), batch.end(),
+    [](Measurement const& a, Measurement const& b) {
+      return Time(a) < Time(b);
+    });
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.stale += stale;
+  stats_.superseded += superseded;
+  stats_.coalesced += coalesced;
+}
+
+IntakeStats Intake::Stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+}  // namespace deepdive
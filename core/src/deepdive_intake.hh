@@ -0,0 +1,84 @@
+#ifndef CORE_DEEPDIVE_INTAKE_HH
+#define CORE_DEEPDIVE_INTAKE_HH
+
+// STL
+#include <deque>
+#include <mutex>
+
+// Core types
+#include "deepdive_core.hh"
+
+namespace deepdive {
+
+// Tuning for the intake
+struct IntakeConfig {
+  // Measurements older than this many seconds when they are taken are shed,
+  // as fusing them would only delay fresher ones. Their times must be on the
+  // same clock as the time they are taken at. Zero keeps them all.
+  double budget = 0.0;
+  // Most measurements held before shedding, to bound the memory used while
+  // the consumer is stalled. Zero holds as many as arrive.
+  size_t capacity = 1000;
+};
+
+// What the intake has held and shed
+struct IntakeStats {
+  uint64_t depth = 0;                // Measurements waiting now
+  uint64_t peak = 0;                 // Most measurements that have waited
+  uint64_t stale = 0;                // Shed for being older than the budget
+  uint64_t superseded = 0;           // Sweeps shed for a newer one on the axis
+  uint64_t overflow = 0;             // Shed because the intake was full
+  uint64_t coalesced = 0;            // IMU samples averaged into another
+};
+
+// A measurement waiting in the intake. Devices are told apart by the ids
+// of the caller, which are passed through to it.
+struct Measurement {
+  bool light;                        // Whether this is a sweep or IMU sample
+  Sweep sweep;                       // LIGHT: the sweep
+  Inertial inertial;                 // IMU: the sample
+  uint8_t tracker;                   // Caller's tracker id
+  uint8_t lighthouse;                // LIGHT: caller's lighthouse id
+};
+
+// Holds measurements between the threads that receive them and the thread
+// that fuses them, and sheds load when the latter falls behind. Everything
+// waiting is taken at once, so that the more there is, the more can be
+// shed: of the sweeps of each tracker, lighthouse and axis only the newest
+// is kept, and the IMU samples of each tracker are averaged into one, which
+// carries the number of samples so that the filter can weigh the mean. This
+// keeps the work per batch, and so the latency, bounded under any load.
+// Pushing and taking may be done concurrently.
+class Intake {
+ public:
+  explicit Intake(IntakeConfig const& config);
+
+  // Non-copyable
+  Intake(Intake const&) = delete;
+  Intake& operator=(Intake const&) = delete;
+
+  // Queue a measurement, returning true if the intake was empty, in which
+  // case the consumer must be woken to take it
+  bool Push(Measurement && measurement);
+
+  // Take everything queued, less what is shed, in time order
+  void Take(double now, std::deque<Measurement> & batch);
+
+  // Get a copy of the counters
+  IntakeStats Stats() const;
+
+ private:
+  // Drop one measurement to make room for another. IMU samples go before
+  // sweeps, and sweeps with fewer pulses before those with more, oldest
+  // first. Returns false if it is the new measurement that should go.
+  bool Shed(Measurement const& measurement);
+
+  IntakeConfig const config_;
+  mutable std::mutex mutex_;         // Protects everything below
+  std::deque<Measurement> queue_;    // Measurements in arrival order
+  IntakeStats stats_;
+};
+
+}  // namespace deepdive
+
+#endif
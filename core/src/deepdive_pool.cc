@@ -0,0 +1,67 @@
+// This include
+#include "deepdive_pool.hh"
+
+namespace deepdive {
+
+WorkerPool::WorkerPool(size_t threads, size_t strands) : strands_(strands) {
+  for (size_t i = 0; i < threads; i++)
+    threads_.push_back(std::thread(&WorkerPool::Run, this));
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (size_t i = 0; i < threads_.size(); i++)
+    threads_[i].join();
+}
+
+void WorkerPool::Post(size_t strand, Task task) {
+  if (threads_.empty()) {
+    task();
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Strand & s = strands_[strand];
+    s.tasks.push_back(std::move(task));
+    if (s.active)
+      return;
+    s.active = true;
+    ready_.push_back(strand);
+  }
+  cv_.notify_one();
+}
+
+size_t WorkerPool::Threads() const {
+  return threads_.size();
+}
+
+// A thread drains everything queued on a strand under one lock, and then
+// puts the strand at the back of the line if more arrived meanwhile, so that
+// a busy strand cannot starve the others.
+void WorkerPool::Run() {
+  std::deque<Task> batch;
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    cv_.wait(lock, [this] { return stop_ || !ready_.empty(); });
+    if (ready_.empty())
+      return;
+    size_t strand = ready_.front();
+    ready_.pop_front();
+    batch.swap(strands_[strand].tasks);
+    lock.unlock();
+    for (size_t i = 0; i < batch.size(); i++)
+      batch[i]();
+    batch.clear();
+    lock.lock();
+    if (strands_[strand].tasks.empty())
+      strands_[strand].active = false;
+    else
+      ready_.push_back(strand);
+  }
+}
+
+}  // namespace deepdive
@@ -0,0 +1,57 @@
+#ifndef CORE_DEEPDIVE_POOL_HH
+#define CORE_DEEPDIVE_POOL_HH
+
+// STL
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace deepdive {
+
+// Runs tasks on a fixed set of threads. Tasks posted to the same strand run
+// one at a time and in the order they were posted, while different strands
+// run in parallel, so that whatever a strand owns needs no locking. This is
+// used to run one tracking engine per strand. With no threads, every task
+// runs in the caller as soon as it is posted.
+class WorkerPool {
+ public:
+  typedef std::function<void()> Task;
+
+  WorkerPool(size_t threads, size_t strands);
+
+  // Runs the tasks that are still queued, and then joins the threads
+  ~WorkerPool();
+
+  // Non-copyable
+  WorkerPool(WorkerPool const&) = delete;
+  WorkerPool& operator=(WorkerPool const&) = delete;
+
+  // Queue a task on a strand
+  void Post(size_t strand, Task task);
+
+  // Number of threads, which may be zero
+  size_t Threads() const;
+
+ private:
+  struct Strand {
+    std::deque<Task> tasks;          // Tasks waiting to run
+    bool active = false;             // Whether a thread owns the strand
+  };
+
+  // Take strands with work until the pool stops
+  void Run();
+
+  std::mutex mutex_;                 // Protects everything below
+  std::condition_variable cv_;       // Signalled when a strand is ready
+  std::vector<Strand> strands_;      // Work, by strand
+  std::deque<size_t> ready_;         // Strands with work and no thread
+  bool stop_ = false;                // Whether the threads should exit
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace deepdive
+
+#endif
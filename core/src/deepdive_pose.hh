@@ -0,0 +1,164 @@
+#ifndef CORE_DEEPDIVE_POSE_HH
+#define CORE_DEEPDIVE_POSE_HH
+
+// POSIX shared memory
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// STL
+#include <atomic>
+#include <cstring>
+#include <string>
+
+// Core types
+#include "deepdive_engine.hh"
+
+// Header-only access to the latest filter solution through a block of
+// shared memory, so that controllers can poll the pose without any
+// middleware or serialization. There is a single writer, and readers
+// never write to the block, so they cannot slow down the filter.
+
+namespace deepdive {
+
+// Shared-memory block holding the latest pose, behind a seqlock
+struct PoseBlock {
+  static constexpr uint32_t MAGIC = 0x45534f50;   // "POSE"
+  static constexpr uint32_t VERSION = 2;
+  uint32_t magic;                    // MAGIC once initialized
+  uint32_t version;                  // Layout version
+  std::atomic<uint64_t> seq;         // Odd while the pose is being written
+  Pose pose;                         // Latest solution
+};
+
+// Segment names must start with a slash
+inline std::string PoseBlockName(std::string const& name) {
+  return (!name.empty() && name[0] == '/') ? name : "/" + name;
+}
+
+// Publishes poses into a block, which is removed when the writer goes away
+class PoseWriter {
+ public:
+  explicit PoseWriter(std::string const& name)
+    : name_(PoseBlockName(name)), block_(nullptr) {
+    // Readers may still map a block left by an earlier writer, and would
+    // fault if it were truncated, so it is unlinked and a fresh one made
+    shm_unlink(name_.c_str());
+    int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+      return;
+    if (ftruncate(fd, sizeof(PoseBlock)) == 0) {
+      void * ptr = mmap(nullptr, sizeof(PoseBlock),
+        PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (ptr != MAP_FAILED)
+        block_ = static_cast<PoseBlock*>(ptr);
+    }
+    close(fd);
+    if (!block_) {
+      shm_unlink(name_.c_str());
+      return;
+    }
+    // The block is zero-filled. Readers check the magic first.
+    block_->version = PoseBlock::VERSION;
+    block_->seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    block_->magic = PoseBlock::MAGIC;
+  }
+
+  ~PoseWriter() {
+    if (!block_)
+      return;
+    munmap(block_, sizeof(PoseBlock));
+    shm_unlink(name_.c_str());
+  }
+
+  // Non-copyable
+  PoseWriter(PoseWriter const&) = delete;
+  PoseWriter& operator=(PoseWriter const&) = delete;
+
+  // Whether the block was created
+  bool Ok() const { return block_ != nullptr; }
+
+  // Publish a pose. This never blocks or allocates.
+  void Write(Pose const& pose) {
+    if (!block_)
+      return;
+    uint64_t seq = block_->seq.load(std::memory_order_relaxed);
+    block_->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(&block_->pose, &pose, sizeof(Pose));
+    block_->seq.store(seq + 2, std::memory_order_release);
+  }
+
+ private:
+  std::string name_;
+  PoseBlock * block_;
+};
+
+// Reads poses from a block published by a writer in another process
+class PoseReader {
+ public:
+  explicit PoseReader(std::string const& name) : block_(nullptr) {
+    int fd = shm_open(PoseBlockName(name).c_str(), O_RDONLY, 0);
+    if (fd < 0)
+      return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t) sizeof(PoseBlock)) {
+      void * ptr = mmap(nullptr, sizeof(PoseBlock),
+        PROT_READ, MAP_SHARED, fd, 0);
+      if (ptr != MAP_FAILED)
+        block_ = static_cast<PoseBlock*>(ptr);
+    }
+    close(fd);
+    if (!block_)
+      return;
+    bool ok = (block_->magic == PoseBlock::MAGIC);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!ok || block_->version != PoseBlock::VERSION) {
+      munmap(block_, sizeof(PoseBlock));
+      block_ = nullptr;
+    }
+  }
+
+  ~PoseReader() {
+    if (block_)
+      munmap(block_, sizeof(PoseBlock));
+  }
+
+  // Non-copyable
+  PoseReader(PoseReader const&) = delete;
+  PoseReader& operator=(PoseReader const&) = delete;
+
+  // Whether the block was found
+  bool Ok() const { return block_ != nullptr; }
+
+  // Copy out the latest pose. Returns false if no pose has been written
+  // yet. The optional sequence number increases with every update, so it
+  // can be used to tell whether the pose has changed since the last read.
+  bool Read(Pose & pose, uint64_t * sequence = nullptr) const {
+    if (!block_)
+      return false;
+    for (;;) {
+      uint64_t seq = block_->seq.load(std::memory_order_acquire);
+      if (seq == 0)
+        return false;
+      if (seq & 1)
+        continue;
+      std::memcpy(&pose, &block_->pose, sizeof(Pose));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (block_->seq.load(std::memory_order_relaxed) != seq)
+        continue;
+      if (sequence)
+        *sequence = seq / 2;
+      return true;
+    }
+  }
+
+ private:
+  PoseBlock * block_;
+};
+
+}  // namespace deepdive
+
+#endif
@@ -0,0 +1,90 @@
+// This include
+#include "deepdive_preintegrator.hh"
+
+// Rotation helpers
+#include "deepdive_filter.hh"
+
+namespace deepdive {
+
+// Rotation vector for a rotation matrix
+static Eigen::Vector3d Log(Eigen::Matrix3d const& R) {
+  Eigen::AngleAxisd aa(R);
+  return aa.angle() * aa.axis();
+}
+
+Preintegrator::Preintegrator() : start_(0.0), end_(0.0), count_(0) {}
+
+void Preintegrator::Reset(double time, double const errors[NUM_ERRORS][3]) {
+  start_ = time;
+  end_ = time;
+  count_ = 0;
+  acc_bias_ = Vec(errors[ERROR_ACC_BIAS]);
+  acc_scale_ = Vec(errors[ERROR_ACC_SCALE]);
+  gyr_bias_ = Vec(errors[ERROR_GYR_BIAS]);
+  gyr_scale_ = Vec(errors[ERROR_GYR_SCALE]);
+  acc_sum_.setZero();
+  gyr_sum_.setZero();
+  dR_.setIdentity();
+  dv_.setZero();
+  dR_dbg_.setZero();
+  dv_dba_.setZero();
+  dv_dbg_.setZero();
+}
+
+// The IMU model is z = (w - b) / s, so a sample is corrected to w = s z + b
+bool Preintegrator::Add(double time, double const acc[3],
+  double const gyr[3], size_t samples) {
+  double dt = time - end_;
+  if (dt < 0)
+    return false;
+  Eigen::Vector3d f = acc_scale_.cwiseProduct(Vec(acc)) + acc_bias_;
+  Eigen::Vector3d w = gyr_scale_.cwiseProduct(Vec(gyr)) + gyr_bias_;
+  Eigen::Vector3d phi = w * dt;
+  Eigen::Matrix3d R = Exp(phi).toRotationMatrix();
+  // The velocity terms use the rotation before this sample
+  dv_dba_ += dR_ * dt;
+  dv_dbg_ -= dR_ * Skew(f) * dR_dbg_ * dt;
+  dv_ += dR_ * f * dt;
+  // Right Jacobian of the rotation, to first order
+  dR_dbg_ = R.transpose() * dR_dbg_
+          + (Eigen::Matrix3d::Identity() - 0.5 * Skew(phi)) * dt;
+  dR_ = dR_ * R;
+  acc_sum_ += static_cast<double>(samples) * Vec(acc);
+  gyr_sum_ += static_cast<double>(samples) * Vec(gyr);
+  end_ = time;
+  count_ += samples;
+  return true;
+}
+
+// The mean rate is the same in every frame along the rotation, and rotating
+// the velocity delta into the last frame leaves gravity exactly as the
+// measurement model has it for the state at the end of the interval
+void Preintegrator::Mean(double const errors[NUM_ERRORS][3],
+  double acc[3], double gyr[3]) const {
+  double duration = end_ - start_;
+  Eigen::Vector3d acc_bias = Vec(errors[ERROR_ACC_BIAS]);
+  Eigen::Vector3d gyr_bias = Vec(errors[ERROR_GYR_BIAS]);
+  if (duration <= 0) {
+    for (size_t i = 0; i < 3; i++) {
+      acc[i] = acc_sum_[i] / count_;
+      gyr[i] = gyr_sum_[i] / count_;
+    }
+    return;
+  }
+  Eigen::Vector3d dba = acc_bias - acc_bias_;
+  Eigen::Vector3d dbg = gyr_bias - gyr_bias_;
+  Eigen::Matrix3d dR = dR_ * Exp(dR_dbg_ * dbg).toRotationMatrix();
+  Eigen::Vector3d dv = dv_ + dv_dba_ * dba + dv_dbg_ * dbg;
+  Eigen::Vector3d w = Log(dR) / duration;
+  Eigen::Vector3d f = dR.transpose() * dv / duration;
+  Eigen::Vector3d z_acc =
+    (f - acc_bias).cwiseQuotient(Vec(errors[ERROR_ACC_SCALE]));
+  Eigen::Vector3d z_gyr =
+    (w - gyr_bias).cwiseQuotient(Vec(errors[ERROR_GYR_SCALE]));
+  for (size_t i = 0; i < 3; i++) {
+    acc[i] = z_acc[i];
+    gyr[i] = z_gyr[i];
+  }
+}
+
+}  // namespace deepdive
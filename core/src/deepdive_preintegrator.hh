@@ -0,0 +1,63 @@
+#ifndef CORE_DEEPDIVE_PREINTEGRATOR_HH
+#define CORE_DEEPDIVE_PREINTEGRATOR_HH
+
+// Core types
+#include "deepdive_core.hh"
+
+namespace deepdive {
+
+// Accumulates the IMU samples of one tracker between two filter steps, as
+// rotation and velocity deltas in the IMU frame of the first sample. The
+// samples are corrected with the IMU errors at the start, and the deltas
+// keep their Jacobians with respect to the biases, so that they can be
+// corrected to newer bias estimates without integrating them again. This
+// header is private to the core.
+class Preintegrator {
+ public:
+  Preintegrator();
+
+  // Start a new interval at a time, correcting samples with these errors
+  void Reset(double time, double const errors[NUM_ERRORS][3]);
+
+  // Add a sample, which may be the mean of several, returning false if it
+  // is before the last one
+  bool Add(double time, double const acc[3], double const gyr[3],
+    size_t samples = 1);
+
+  // Get the mean raw measurements over the interval, in the IMU frame at
+  // its end, as they would be seen with the given errors. Changes in scale
+  // are small and slow, and are not corrected for. There must be at least
+  // one sample.
+  void Mean(double const errors[NUM_ERRORS][3],
+    double acc[3], double gyr[3]) const;
+
+  // Start and end of the interval
+  double Start() const { return start_; }
+  double End() const { return end_; }
+
+  // Number of samples in the interval
+  size_t Count() const { return count_; }
+
+  // Forget all samples
+  void Clear() { count_ = 0; }
+
+ private:
+  double start_;                     // Start of the interval
+  double end_;                       // Time of the last sample
+  size_t count_;                     // Number of samples
+  Eigen::Vector3d acc_bias_;         // Errors the samples were corrected with
+  Eigen::Vector3d acc_scale_;
+  Eigen::Vector3d gyr_bias_;
+  Eigen::Vector3d gyr_scale_;
+  Eigen::Vector3d acc_sum_;          // Sum of raw samples, for when the
+  Eigen::Vector3d gyr_sum_;          // interval has no duration
+  Eigen::Matrix3d dR_;               // Rotation delta
+  Eigen::Vector3d dv_;               // Velocity delta
+  Eigen::Matrix3d dR_dbg_;           // Jacobians of the deltas
+  Eigen::Matrix3d dv_dba_;
+  Eigen::Matrix3d dv_dbg_;
+};
+
+}  // namespace deepdive
+
+#endif
@@ -0,0 +1,459 @@
+// UKF includes
+#include <UKF/Types.h>
+#include <UKF/Integrator.h>
+#include <UKF/StateVector.h>
+#include <UKF/MeasurementVector.h>
+#include <UKF/Core.h>
+
+// STL
+#include <utility>
+#include <vector>
+
+// This include
+#include "deepdive_filter.hh"
+
+namespace {
+
+// FILTER KEYS
+
+// State indexes
+enum Keys : uint8_t {
+  // STATE
+  Position,             // Position (world frame, m)
+  Attitude,             // Attitude quaternion (rotates vec from body to world)
+  Velocity,             // Velocity (world frame, m/s)
+  Omega,                // Angular velocity (body frame, rads/s)
+  Acceleration,         // Acceleration (body frame, m/s^2)
+  Alpha,                // Angular acceleration (body frame, rads/s^2)
+  // ERRORS
+  GyroscopeBias,        // Gyroscope bias offset (body frame, rad/s)
+  GyroscopeScale,       // Gyroscope scale factor (body frame, multiplier)
+  AccelerometerBias,    // Accelerometer bias offset (body frame, m/s^2)
+  AccelerometerScale,   // Accelerometer scale factor (body frame, mutliplier)
+  // MEASUREMENTS
+  Accelerometer,        // Acceleration (body frame, m/s^2)
+  Gyroscope,            // Gyroscope (body frame, rads/s)
+  Angle                 // Angle of sensor N has key Angle + N (rads)
+};
+
+// OBSERVATION
+
+// Every sensor has its own angle field, so that all pulses in a sweep can
+// be fused in a single innovation step
+template <typename Sensors> struct Measurements;
+template <size_t... N> struct Measurements<std::index_sequence<N...>> {
+  using type = UKF::DynamicMeasurementVector<
+    UKF::Field<Accelerometer, UKF::Vector<3>>,
+    UKF::Field<Gyroscope, UKF::Vector<3>>,
+    UKF::Field<Angle + N, real_t>...
+  >;
+};
+
+// Observation vector
+using Observation = Measurements<
+  std::make_index_sequence<deepdive::NUM_SENSORS>>::type;
+
+// Set the angle of a sensor, whose key is only known at runtime
+template <int Key>
+void SetAngle(Observation & obs, real_t angle) {
+  obs.set_field<Key>(angle);
+}
+template <size_t... N>
+void SetAngle(Observation & obs, uint16_t sensor, real_t angle,
+  std::index_sequence<N...>) {
+  typedef void (*Setter)(Observation &, real_t);
+  static constexpr Setter setters[] = { &SetAngle<Angle + N>... };
+  setters[sensor](obs, angle);
+}
+
+// TRACKING FILTER
+
+// State vector
+using State = UKF::StateVector<
+  UKF::Field<Position, UKF::Vector<3>>,
+  UKF::Field<Attitude, UKF::Quaternion>,
+  UKF::Field<Velocity, UKF::Vector<3>>,
+  UKF::Field<Omega, UKF::Vector<3>>,
+  UKF::Field<Acceleration, UKF::Vector<3>>,
+  UKF::Field<Alpha, UKF::Vector<3>>
+>;
+
+// For tracking
+using TrackingFilter = UKF::Core<
+  State, Observation, UKF::IntegratorRK4
+>;
+
+// ERROR FILTER
+
+// Parameters
+using Error = UKF::StateVector<
+  UKF::Field<AccelerometerBias, UKF::Vector<3>>,
+  UKF::Field<AccelerometerScale, UKF::Vector<3>>,
+  UKF::Field<GyroscopeBias, UKF::Vector<3>>,
+  UKF::Field<GyroscopeScale, UKF::Vector<3>>
+>;
+
+// The fields above, in the order of the covariance
+static const int IMU_ERRORS[4] = {
+  ERROR_ACC_BIAS, ERROR_ACC_SCALE, ERROR_GYR_BIAS, ERROR_GYR_SCALE
+};
+
+// For parameter estimation
+using ErrorFilter = UKF::Core<
+  Error, Observation, UKF::IntegratorEuler
+>;
+
+// Error filters, by engine id
+typedef std::vector<ErrorFilter,
+  Eigen::aligned_allocator<ErrorFilter>> ErrorList;
+
+// Context data
+struct Context {
+  deepdive::Frames const* frames;    // Frames
+  int lighthouse;                    // Active lighthouse
+  int tracker;                       // Active tracker
+  uint8_t axis;                      // Active axis
+};
+
+// Lighthouse angle prediction for one sensor
+real_t PredictAngle(State const& state, Context const& context,
+  size_t sensor) {
+  deepdive::Frames const& f = *context.frames;
+  UKF::Vector<3> x = f.lTw[context.lighthouse]              // world -> lh
+                   * (state.get_field<Position>()           // body -> world
+                    + state.get_field<Attitude>()
+                      * f.sensors[context.tracker].col(sensor));
+  double xyz[3], ang[2];
+  xyz[0] = x[0];
+  xyz[1] = x[1];
+  xyz[2] = x[2];
+  deepdive::Predict(f.lighthouses[context.lighthouse].params,
+    xyz, ang, f.correct);
+  return ang[context.axis];
+}
+
+}  // namespace
+
+// TRACKING FILTER
+
+namespace UKF {
+
+  // MEASURMENT
+
+  // Shared by the filters of all engines, which may run on different
+  // threads, so this is never written after initialization
+  template <>
+  Observation::CovarianceVector Observation::measurement_covariance(
+    (Observation::CovarianceVector() <<
+      UKF::Vector<3>::Constant(deepdive::NOISE_ACCELEROMETER),
+      UKF::Vector<3>::Constant(deepdive::NOISE_GYROSCOPE),
+      UKF::Vector<deepdive::NUM_SENSORS>::Constant(deepdive::NOISE_ANGLE))
+    .finished());
+
+  // TRACKING FILTER
+
+  // Standard 6DoF kinematics with constant Acceleration assumption. Omega
+  // is in the body frame, as the gyroscope model has it, so it multiplies
+  // the attitude from the right.
+  template <> template <> State
+  State::derivative<>() const {
+    UKF::Quaternion omega_q;
+    omega_q.vec() = get_field<Omega>() * 0.5;
+    omega_q.w() = 0;
+    State output;
+    output.set_field<Position>(get_field<Velocity>());
+    output.set_field<Velocity>(get_field<Attitude>() * get_field<Acceleration>());
+    output.set_field<Acceleration>(UKF::Vector<3>(0, 0, 0));
+    output.set_field<Attitude>(get_field<Attitude>() * omega_q);
+    output.set_field<Omega>(get_field<Alpha>());
+    output.set_field<Alpha>(UKF::Vector<3>(0, 0, 0));
+    return output;
+  }
+
+  // See http://www.mdpi.com/1424-8220/11/7/6771/htm
+  template <> template <> UKF::Vector<3>
+  Observation::expected_measurement<State, Accelerometer, Error, Context>(
+    State const& state, Error const& error, Context const& context) {
+    deepdive::Frames const& f = *context.frames;
+    Eigen::Affine3d const& iTb = f.iTb[context.tracker];
+    Eigen::Vector3d r = iTb.translation();
+    Eigen::Vector3d w = state.get_field<Omega>();
+    return error.get_field<AccelerometerScale>().cwiseInverse().cwiseProduct(
+        iTb.linear() * (state.get_field<Acceleration>()
+          + w.cross(w.cross(r))
+          + state.get_field<Attitude>().conjugate() * f.gravity)
+      - error.get_field<AccelerometerBias>());
+  }
+
+  // See http://www.mdpi.com/1424-8220/11/7/6771/htm
+  template <> template <> UKF::Vector<3>
+  Observation::expected_measurement<State, Gyroscope, Error, Context>(
+    State const& state, Error const& error, Context const& context) {
+    deepdive::Frames const& f = *context.frames;
+    Eigen::Affine3d const& iTb = f.iTb[context.tracker];
+    return error.get_field<GyroscopeScale>().cwiseInverse().cwiseProduct(
+        iTb.linear() * state.get_field<Omega>()
+      - error.get_field<GyroscopeBias>());
+  }
+
+
+  // ERROR FILTER
+
+  template <> template <> Error
+  Error::derivative<>() const {
+    return Error::Zero();
+  }
+
+  template <> template <> UKF::Vector<3>
+  Observation::expected_measurement<Error, Accelerometer, State, Context>(
+    Error const& errors, State const& state, Context const& context) {
+    return expected_measurement<State, Accelerometer, Error, Context>(
+      state, errors, context);
+  }
+
+  template <> template <> UKF::Vector<3>
+  Observation::expected_measurement<Error, Gyroscope, State, Context>(
+    Error const& errors, State const& state, Context const& context) {
+    return expected_measurement<State, Gyroscope, Error, Context>(
+      state, errors, context);
+  }
+
+  // LIGHT
+
+  // Lighthouse angle prediction for one sensor, in both filters
+  #define ANGLE_MODEL(N)                                                    \
+  template <> template <> real_t                                            \
+  Observation::expected_measurement<State, Angle + N, Error, Context>(      \
+    State const& state, Error const& error, Context const& context) {       \
+    return PredictAngle(state, context, N);                                 \
+  }                                                                         \
+  template <> template <> real_t                                            \
+  Observation::expected_measurement<Error, Angle + N, State, Context>(      \
+    Error const& errors, State const& state, Context const& context) {      \
+    return PredictAngle(state, context, N);                                 \
+  }
+  ANGLE_MODEL(0)  ANGLE_MODEL(1)  ANGLE_MODEL(2)  ANGLE_MODEL(3)
+  ANGLE_MODEL(4)  ANGLE_MODEL(5)  ANGLE_MODEL(6)  ANGLE_MODEL(7)
+  ANGLE_MODEL(8)  ANGLE_MODEL(9)  ANGLE_MODEL(10) ANGLE_MODEL(11)
+  ANGLE_MODEL(12) ANGLE_MODEL(13) ANGLE_MODEL(14) ANGLE_MODEL(15)
+  ANGLE_MODEL(16) ANGLE_MODEL(17) ANGLE_MODEL(18) ANGLE_MODEL(19)
+  ANGLE_MODEL(20) ANGLE_MODEL(21) ANGLE_MODEL(22) ANGLE_MODEL(23)
+  ANGLE_MODEL(24) ANGLE_MODEL(25) ANGLE_MODEL(26) ANGLE_MODEL(27)
+  ANGLE_MODEL(28) ANGLE_MODEL(29) ANGLE_MODEL(30) ANGLE_MODEL(31)
+  #undef ANGLE_MODEL
+  static_assert(deepdive::NUM_SENSORS == 32, "one angle model per sensor");
+}
+
+
+namespace deepdive {
+
+namespace {
+
+// The pose is tracked by one filter, and the IMU errors of each tracker by
+// another. At every measurement the error filter is corrected first, given
+// the pose, and then the pose, given the errors.
+class UkfFilter : public Filter {
+ public:
+  UkfFilter(EngineConfig const& config, Frames const& frames)
+    : config_(config), frames_(frames) {
+    filter_.state.set_field<Position>(Vec(config.est_position));
+    filter_.state.set_field<Attitude>(UKF::Quaternion(config.est_attitude[3],
+      config.est_attitude[0], config.est_attitude[1], config.est_attitude[2]));
+    filter_.state.set_field<Velocity>(Vec(config.est_velocity));
+    filter_.state.set_field<Omega>(Vec(config.est_omega));
+    filter_.state.set_field<Acceleration>(Vec(config.est_acceleration));
+    filter_.state.set_field<Alpha>(Vec(config.est_alpha));
+    filter_.covariance = State::CovarianceMatrix::Zero();
+    filter_.covariance.diagonal() <<
+      Vec(config.cov[0]), Vec(config.cov[1]),
+      Vec(config.cov[2]), Vec(config.cov[3]),
+      Vec(config.cov[4]), Vec(config.cov[5]);
+    filter_.process_noise_covariance = State::CovarianceMatrix::Zero();
+    filter_.process_noise_covariance.diagonal() <<
+      Vec(config.noise[0]), Vec(config.noise[1]),
+      Vec(config.noise[2]), Vec(config.noise[3]),
+      Vec(config.noise[4]), Vec(config.noise[5]);
+  }
+
+  void AddTracker() {
+    errors_.push_back(ErrorFilter());
+  }
+
+  void ResetErrors(int tracker, Tracker const& calibration) {
+    ErrorFilter & error = errors_[tracker];
+    error.state.set_field<AccelerometerBias>(
+      Vec(calibration.errors[ERROR_ACC_BIAS]));
+    error.state.set_field<AccelerometerScale>(
+      Vec(calibration.errors[ERROR_ACC_SCALE]));
+    error.state.set_field<GyroscopeBias>(
+      Vec(calibration.errors[ERROR_GYR_BIAS]));
+    error.state.set_field<GyroscopeScale>(
+      Vec(calibration.errors[ERROR_GYR_SCALE]));
+    error.covariance = Error::CovarianceMatrix::Zero();
+    error.covariance.diagonal() <<
+      Vec(config_.imu_cov[0]), Vec(config_.imu_cov[1]),
+      Vec(config_.imu_cov[2]), Vec(config_.imu_cov[3]);
+    error.process_noise_covariance = Error::CovarianceMatrix::Zero();
+    error.process_noise_covariance.diagonal() <<
+      Vec(config_.imu_noise[0]), Vec(config_.imu_noise[1]),
+      Vec(config_.imu_noise[2]), Vec(config_.imu_noise[3]);
+  }
+
+  void SetErrors(int tracker, double const errors[NUM_ERRORS][3],
+    double const variances[NUM_ERRORS][3]) {
+    ErrorFilter & error = errors_[tracker];
+    error.state.set_field<AccelerometerBias>(Vec(errors[ERROR_ACC_BIAS]));
+    error.state.set_field<AccelerometerScale>(Vec(errors[ERROR_ACC_SCALE]));
+    error.state.set_field<GyroscopeBias>(Vec(errors[ERROR_GYR_BIAS]));
+    error.state.set_field<GyroscopeScale>(Vec(errors[ERROR_GYR_SCALE]));
+    error.covariance = Error::CovarianceMatrix::Zero();
+    error.covariance.diagonal() <<
+      Vec(variances[IMU_ERRORS[0]]), Vec(variances[IMU_ERRORS[1]]),
+      Vec(variances[IMU_ERRORS[2]]), Vec(variances[IMU_ERRORS[3]]);
+  }
+
+  void ResetPose(Eigen::Vector3d const& position,
+    Eigen::Quaterniond const& attitude) {
+    filter_.state.set_field<Position>(position);
+    filter_.state.set_field<Attitude>(attitude.normalized());
+    filter_.state.set_field<Velocity>(UKF::Vector<3>(0, 0, 0));
+    filter_.state.set_field<Omega>(UKF::Vector<3>(0, 0, 0));
+    filter_.state.set_field<Acceleration>(UKF::Vector<3>(0, 0, 0));
+    filter_.state.set_field<Alpha>(UKF::Vector<3>(0, 0, 0));
+    filter_.covariance = State::CovarianceMatrix::Zero();
+    filter_.covariance.diagonal() <<
+      Vec(config_.cov[0]), Vec(config_.cov[1]),
+      Vec(config_.cov[2]), Vec(config_.cov[3]),
+      Vec(config_.cov[4]), Vec(config_.cov[5]);
+  }
+
+  void SetPoseVariances(double const variances[6]) {
+    filter_.covariance.topRows<6>().setZero();
+    filter_.covariance.leftCols<6>().setZero();
+    for (size_t i = 0; i < 6; i++)
+      filter_.covariance(i, i) = variances[i];
+  }
+
+  // All pulses are fused in one innovation step, as the filters only use
+  // the last innovation in their a posteriori step.
+  void Light(double dt, int tracker, int lighthouse, Bundle const& bundle) {
+    Observation obs;
+    for (size_t i = 0; i < bundle.count; i++)
+      SetAngle(obs, bundle.sensors[i], bundle.angles[i],
+        std::make_index_sequence<NUM_SENSORS>());
+    Context context;
+    context.frames = &frames_;
+    context.tracker = tracker;
+    context.lighthouse = lighthouse;
+    context.axis = bundle.axis;
+    Correct(dt, tracker, obs, context);
+  }
+
+  // The mean of several samples is less noisy than one of them. The noise
+  // is shared by all filters, so it is not scaled here but taken off the
+  // innovation covariance of this filter in the correction.
+  void Imu(double dt, int tracker, double const* acc, double const* gyr,
+    size_t samples) {
+    Observation obs;
+    if (acc)
+      obs.set_field<Accelerometer>(Vec(acc));
+    if (gyr)
+      obs.set_field<Gyroscope>(Vec(gyr));
+    Context context;
+    context.frames = &frames_;
+    context.tracker = tracker;
+    Correct(dt, tracker, obs, context, samples);
+  }
+
+  void GetErrors(int tracker, double errors[NUM_ERRORS][3]) const {
+    Error const& e = errors_[tracker].state;
+    for (size_t i = 0; i < 3; i++) {
+      errors[ERROR_ACC_BIAS][i] = e.get_field<AccelerometerBias>()[i];
+      errors[ERROR_ACC_SCALE][i] = e.get_field<AccelerometerScale>()[i];
+      errors[ERROR_GYR_BIAS][i] = e.get_field<GyroscopeBias>()[i];
+      errors[ERROR_GYR_SCALE][i] = e.get_field<GyroscopeScale>()[i];
+    }
+  }
+
+  void GetVariances(int tracker, double variances[NUM_ERRORS][3]) const {
+    Error::CovarianceMatrix const& P = errors_[tracker].covariance;
+    for (size_t i = 0; i < 4; i++)
+      for (size_t j = 0; j < 3; j++)
+        variances[IMU_ERRORS[i]][j] = P(3*i + j, 3*i + j);
+  }
+
+  void Predict(double dt) {
+    filter_.a_priori_step(dt);
+  }
+
+  void Extrapolate(double dt, Pose & pose) const {
+    TrackingFilter filter(filter_);
+    filter.a_priori_step(dt);
+    Fill(filter, pose);
+  }
+
+  void Fill(Pose & pose) const {
+    Fill(filter_, pose);
+  }
+
+ private:
+  // Copy the state of a tracking filter into a pose
+  static void Fill(TrackingFilter const& filter, Pose & pose) {
+    for (size_t i = 0; i < 3; i++) {
+      pose.position[i] = filter.state.get_field<Position>()[i];
+      pose.velocity[i] = filter.state.get_field<Velocity>()[i];
+      pose.omega[i] = filter.state.get_field<Omega>()[i];
+    }
+    pose.attitude[0] = filter.state.get_field<Attitude>().w();
+    pose.attitude[1] = filter.state.get_field<Attitude>().x();
+    pose.attitude[2] = filter.state.get_field<Attitude>().y();
+    pose.attitude[3] = filter.state.get_field<Attitude>().z();
+    for (size_t i = 0; i < 6; i++) {
+      for (size_t j = 0; j < 6; j++) {
+        pose.pose_cov[i*6 + j] = filter.covariance(i, j);
+        pose.twist_cov[i*6 + j] = filter.covariance(6+i, 6+j);
+      }
+    }
+  }
+
+  // Correct the error filter, and then the tracking filter, with the noise
+  // of an observation that is the mean of some samples
+  void Correct(double dt, int tracker, Observation const& obs,
+    Context const& context, size_t samples = 1) {
+    ErrorFilter & error = errors_[tracker];
+    error.a_priori_step(dt);
+    error.innovation_step(obs, filter_.state, context);
+    Average(error, obs, samples);
+    error.a_posteriori_step();
+    filter_.a_priori_step(dt);
+    filter_.innovation_step(obs, error.state, context);
+    Average(filter_, obs, samples);
+    filter_.a_posteriori_step();
+  }
+
+  // The innovation covariance holds the noise of one sample, of which all
+  // but the share of the mean is taken off before the gain is computed
+  template <typename F>
+  static void Average(F & filter, Observation const& obs, size_t samples) {
+    if (samples > 1)
+      filter.innovation_covariance -= (1.0 - 1.0 / samples)
+        * obs.calculate_measurement_covariance();
+  }
+
+  EngineConfig const& config_;       // Tuning
+  Frames const& frames_;             // Frames for prediction
+  TrackingFilter filter_;            // Tracking filter
+  ErrorList errors_;                 // Error filters, by engine id
+
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+}  // namespace
+
+std::unique_ptr<Filter> NewUkfFilter(EngineConfig const& config,
+  Frames const& frames) {
+  return std::unique_ptr<Filter>(new UkfFilter(config, frames));
+}
+
+}  // namespace deepdive
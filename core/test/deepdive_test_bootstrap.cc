@@ -0,0 +1,126 @@
+// Checks that the pose solved from light is accurate under noise and with
+// sensors seeing reflections, and that too much noise is refused rather
+// than solved badly.
+
+#undef NDEBUG
+
+// STL
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+// Core
+#include "deepdive_bootstrap.hh"
+
+using namespace deepdive;
+
+// Sensors spread over a dome, which is roughly how a tracker places them
+static SensorMatrix Dome(size_t count) {
+  SensorMatrix sensors = SensorMatrix::Zero();
+  for (size_t i = 0; i < count; i++) {
+    double azimuth = 2.0 * M_PI * i / count;
+    double elevation = 0.1 + 1.2 * (i % 4) / 4.0;
+    sensors.col(i) << 0.05 * cos(elevation) * cos(azimuth),
+      0.05 * cos(elevation) * sin(azimuth), 0.05 * sin(elevation);
+  }
+  return sensors;
+}
+
+struct Result {
+  size_t solved = 0;
+  double position = 0.0;             // Worst position error (m)
+  double attitude = 0.0;             // Worst attitude error (rad)
+};
+
+// Solve random poses from two sweeps each, with some noise on every angle
+// and a large error on the angles of the first few visible sensors
+static Result Run(Frames const& frames, double noise, size_t outliers,
+  size_t poses) {
+  EngineConfig config;
+  config.bootstrap_count = 6;
+  config.bootstrap_error = 0.01;
+  std::mt19937 random(42);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+  std::normal_distribution<double> gaussian(0.0, 1.0);
+  SensorMatrix const& sensors = frames.sensors[0];
+  Result result;
+  for (size_t k = 0; k < poses; k++) {
+    // Point the top of the dome at the lighthouse, give or take 45 degrees
+    Eigen::Vector3d axis(uniform(random), uniform(random), 0.0);
+    Eigen::Quaterniond attitude =
+      Eigen::Quaterniond(Eigen::AngleAxisd(M_PI, Eigen::Vector3d::UnitX()))
+      * Eigen::Quaterniond(Eigen::AngleAxisd(0.8 * uniform(random),
+        axis.normalized()))
+      * Eigen::Quaterniond(Eigen::AngleAxisd(M_PI * uniform(random),
+        Eigen::Vector3d::UnitZ()));
+    Eigen::Vector3d position(0.5 * uniform(random), 0.5 * uniform(random),
+      2.0 + 0.5 * uniform(random));
+    Bootstrap bootstrap(config, frames);
+    for (uint8_t axis = 0; axis < 2; axis++) {
+      Bundle bundle;
+      bundle.axis = axis;
+      bundle.count = 0;
+      size_t visible = 0;
+      for (size_t s = 0; s < NUM_SENSORS; s++) {
+        Eigen::Vector3d normal = attitude * sensors.col(s).normalized();
+        if (sensors.col(s).isZero() || normal[2] > -0.2)
+          continue;
+        Eigen::Vector3d x = position + attitude * sensors.col(s);
+        double angle = atan2(x[axis], x[2]) + noise * gaussian(random);
+        if (visible++ < outliers)
+          angle += 0.03;
+        bundle.sensors[bundle.count] = s;
+        bundle.angles[bundle.count++] = angle;
+      }
+      bootstrap.Add(0.01 * axis, 0, 0, bundle);
+    }
+    Eigen::Vector3d p;
+    Eigen::Quaterniond q;
+    if (!bootstrap.Solve(0.01, 0, 0, p, q))
+      continue;
+    result.solved++;
+    result.position = std::max(result.position, (p - position).norm());
+    result.attitude = std::max(result.attitude, q.angularDistance(attitude));
+    // Nothing new has been seen, so it is not solved again so soon
+    assert(!bootstrap.Solve(0.02, 0, 0, p, q));
+  }
+  return result;
+}
+
+int main() {
+  Frames frames;
+  frames.wTv = Eigen::Affine3d::Identity();
+  frames.vTl.push_back(Eigen::Affine3d::Identity());
+  frames.lTw.push_back(Eigen::Affine3d::Identity());
+  Lighthouse lighthouse;
+  memset(&lighthouse, 0, sizeof(lighthouse));
+  lighthouse.ready = true;
+  frames.lighthouses.push_back(lighthouse);
+  frames.sensors.push_back(Dome(22));
+  frames.correct = false;
+  size_t const poses = 50;
+
+  // Noise like that of a real lighthouse, with and without reflections
+  Result clean = Run(frames, 1e-4, 0, poses);
+  printf("clean: %zu/%zu solved, %.4f m, %.4f rad\n", clean.solved, poses,
+    clean.position, clean.attitude);
+  assert(clean.solved >= 0.9 * poses);
+  assert(clean.position < 0.02 && clean.attitude < 0.05);
+  Result reflections = Run(frames, 1e-4, 2, poses);
+  printf("reflections: %zu/%zu solved, %.4f m, %.4f rad\n",
+    reflections.solved, poses, reflections.position, reflections.attitude);
+  assert(reflections.solved >= 0.9 * poses);
+  assert(reflections.position < 0.02 && reflections.attitude < 0.05);
+
+  // Noise that barely fixes the pose may be refused, but never badly solved
+  double const noises[] = {1e-3, 5e-3};
+  for (double noise : noises) {
+    Result noisy = Run(frames, noise, 1, poses);
+    printf("noise %g: %zu/%zu solved, %.4f m, %.4f rad\n", noise,
+      noisy.solved, poses, noisy.position, noisy.attitude);
+    assert(noisy.position < 0.1 && noisy.attitude < 0.15);
+  }
+  return 0;
+}
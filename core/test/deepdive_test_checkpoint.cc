@@ -0,0 +1,215 @@
+// Checks that a checkpoint survives a round trip through its file, that a
+// damaged file is refused, and that the engine only warm starts from the
+// parts of a checkpoint whose calibration has not changed.
+
+#undef NDEBUG
+
+// STL
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Core
+#include "deepdive_checkpoint.hh"
+
+using namespace deepdive;
+
+static std::string const PATH = "deepdive_test_checkpoint.bin";
+
+// A checkpoint in which no two values are the same
+static Checkpoint Fill() {
+  Checkpoint checkpoint;
+  double value = 0.5;
+  checkpoint.calibration = 0x0123456789abcdefULL;
+  for (size_t i = 0; i < 3; i++) checkpoint.position[i] = value++;
+  for (size_t i = 0; i < 4; i++) checkpoint.attitude[i] = value++;
+  for (size_t i = 0; i < 6; i++) checkpoint.variances[i] = value++;
+  for (char const* serial : {"LHR-00000001", "LHR-00000002"}) {
+    TrackerCheckpoint & tracker = checkpoint.trackers[serial];
+    tracker.calibration = static_cast<uint64_t>(value++);
+    for (size_t i = 0; i < NUM_ERRORS; i++)
+      for (size_t j = 0; j < 3; j++) {
+        tracker.errors[i][j] = value++;
+        tracker.variances[i][j] = -value++;
+      }
+  }
+  return checkpoint;
+}
+
+static bool Same(Checkpoint const& a, Checkpoint const& b) {
+  if (a.calibration != b.calibration
+    || memcmp(a.position, b.position, sizeof(a.position))
+    || memcmp(a.attitude, b.attitude, sizeof(a.attitude))
+    || memcmp(a.variances, b.variances, sizeof(a.variances))
+    || a.trackers.size() != b.trackers.size())
+    return false;
+  std::map<std::string, TrackerCheckpoint>::const_iterator it, jt;
+  for (it = a.trackers.begin(), jt = b.trackers.begin();
+    it != a.trackers.end(); it++, jt++)
+    if (it->first != jt->first
+      || it->second.calibration != jt->second.calibration
+      || memcmp(it->second.errors, jt->second.errors,
+        sizeof(it->second.errors))
+      || memcmp(it->second.variances, jt->second.variances,
+        sizeof(it->second.variances)))
+      return false;
+  return true;
+}
+
+static std::vector<char> Load() {
+  std::ifstream in(PATH.c_str(), std::ios::binary);
+  return std::vector<char>(std::istreambuf_iterator<char>(in),
+    std::istreambuf_iterator<char>());
+}
+
+static void Save(std::vector<char> const& bytes) {
+  std::ofstream out(PATH.c_str(), std::ios::binary | std::ios::trunc);
+  out.write(bytes.data(), bytes.size());
+}
+
+static void TestFile() {
+  Checkpoint written = Fill(), read;
+  assert(WriteCheckpoint(PATH, written));
+  assert(ReadCheckpoint(PATH, read));
+  assert(Same(written, read));
+  // A refused file leaves the checkpoint alone
+  std::vector<char> bytes = Load();
+  Checkpoint untouched = Fill();
+  std::vector<char> damaged(bytes.begin(), bytes.end() - 1);
+  Save(damaged);
+  assert(!ReadCheckpoint(PATH, untouched));
+  damaged = bytes;
+  damaged.push_back(0);
+  Save(damaged);
+  assert(!ReadCheckpoint(PATH, untouched));
+  damaged = bytes;
+  damaged[4] ^= 1;
+  Save(damaged);
+  assert(!ReadCheckpoint(PATH, untouched));
+  assert(Same(untouched, Fill()));
+  std::remove(PATH.c_str());
+  assert(!ReadCheckpoint(PATH, untouched));
+  printf("file: round trip and damaged files ok\n");
+}
+
+// What the engine logged about the checkpoint
+struct Restored {
+  bool pose = false;
+  bool errors = false;
+};
+
+// Spin a tracker under a lighthouse, with eight sensors in a ring, until
+// tracking starts, and then get its checkpoint
+static Restored Spin(Checkpoint const* restore, Checkpoint * save,
+  double height, double bias) {
+  Restored restored;
+  SetLogFn([&restored](Level, std::string const& msg) {
+    if (msg == "Pose read from checkpoint.")
+      restored.pose = true;
+    if (msg == "IMU errors of TR read from checkpoint.")
+      restored.errors = true;
+  });
+  EngineConfig config;
+  config.filter = FilterType::ESKF;
+  config.est_position[0] = 0.5;
+  config.est_position[1] = -0.4;
+  config.est_position[2] = 0.3;
+  for (size_t i = 0; i < 6; i++)
+    for (size_t j = 0; j < 3; j++) {
+      config.cov[i][j] = 1e-2;
+      config.noise[i][j] = 1e-4;
+    }
+  for (size_t i = 0; i < NUM_ERRORS; i++)
+    for (size_t j = 0; j < 3; j++) {
+      config.imu_cov[i][j] = (i % 2) ? 1e-12 : 1e-4;
+      config.imu_noise[i][j] = 1e-10;
+    }
+  TrackingEngine engine(config);
+  if (restore)
+    engine.SetCheckpoint(*restore);
+  Lighthouse lighthouse;
+  memset(&lighthouse, 0, sizeof(lighthouse));
+  lighthouse.vTl[2] = height;
+  lighthouse.ready = true;
+  Tracker tracker;
+  memset(&tracker, 0, sizeof(tracker));
+  for (size_t i = 0; i < 8; i++) {
+    double azimuth = 2.0 * M_PI * i / 8;
+    tracker.sensors[6*i+0] = 0.05 * cos(azimuth);
+    tracker.sensors[6*i+1] = 0.05 * sin(azimuth);
+    tracker.sensors[6*i+2] = 0.02 * (i % 2);
+  }
+  for (size_t i = 0; i < 3; i++) {
+    tracker.errors[ERROR_ACC_SCALE][i] = 1.0;
+    tracker.errors[ERROR_GYR_SCALE][i] = 1.0;
+  }
+  tracker.errors[ERROR_GYR_BIAS][0] = bias;
+  tracker.ready = true;
+  engine.SetLighthouse("LH", lighthouse);
+  engine.SetTracker("TR", tracker);
+  double const rate = 0.5, yaw = 0.7;
+  Sweep sweep;
+  sweep.tracker = 0;
+  sweep.lighthouse = 0;
+  sweep.pulses.resize(8);
+  Inertial inertial;
+  inertial.tracker = 0;
+  for (size_t ms = 1; ms <= 2000; ms++) {
+    double time = 1.0 + ms * 1e-3;
+    inertial.time = time;
+    for (size_t i = 0; i < 3; i++) {
+      inertial.acc[i] = (i == 2 ? 9.80665 : 0.0);
+      inertial.gyr[i] = (i == 2 ? rate : 0.0);
+    }
+    engine.Imu(inertial);
+    if (ms % 8)
+      continue;
+    sweep.time = time + 1e-4;
+    sweep.axis = (ms / 8) % 2;
+    double angle = yaw + rate * (sweep.time - 1.0);
+    for (size_t i = 0; i < 8; i++) {
+      double bx = tracker.sensors[6*i+0], by = tracker.sensors[6*i+1];
+      double x = cos(angle) * bx - sin(angle) * by;
+      double y = sin(angle) * bx + cos(angle) * by;
+      double z = tracker.sensors[6*i+2] - height;
+      sweep.pulses[i].sensor = i;
+      sweep.pulses[i].angle = atan2(sweep.axis ? y : x, z);
+      sweep.pulses[i].duration = 1e-5;
+    }
+    engine.Light(sweep);
+  }
+  if (save)
+    assert(engine.GetCheckpoint(*save));
+  SetLogFn(nullptr);
+  return restored;
+}
+
+static void TestEngine() {
+  Checkpoint saved, read;
+  Restored restored = Spin(nullptr, &saved, -2.0, 0.0);
+  assert(!restored.pose && !restored.errors);
+  assert(saved.trackers.count("TR") == 1);
+  assert(WriteCheckpoint(PATH, saved));
+  assert(ReadCheckpoint(PATH, read));
+  std::remove(PATH.c_str());
+  // Nothing has changed, so all of it is used
+  restored = Spin(&read, nullptr, -2.0, 0.0);
+  assert(restored.pose && restored.errors);
+  // A moved lighthouse changes the world frame but not the IMU
+  restored = Spin(&read, nullptr, -2.1, 0.0);
+  assert(!restored.pose && restored.errors);
+  // New factory errors change the IMU but not the world frame
+  restored = Spin(&read, nullptr, -2.0, 1e-3);
+  assert(restored.pose && !restored.errors);
+  printf("engine: fingerprints ok\n");
+}
+
+int main() {
+  TestFile();
+  TestEngine();
+  return 0;
+}
@@ -0,0 +1,101 @@
+// Checks that the mean of preintegrated IMU samples, corrected to a newer
+// bias estimate through the Jacobians, matches integrating the samples
+// again with that estimate.
+
+#undef NDEBUG
+
+// STL
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+// Core
+#include "deepdive_preintegrator.hh"
+
+using namespace deepdive;
+
+static void Nominal(double errors[NUM_ERRORS][3]) {
+  for (size_t i = 0; i < 3; i++) {
+    errors[ERROR_GYR_BIAS][i] = 0.0;
+    errors[ERROR_GYR_SCALE][i] = 1.0;
+    errors[ERROR_ACC_BIAS][i] = 0.0;
+    errors[ERROR_ACC_SCALE][i] = 1.0;
+  }
+}
+
+static double Distance(double const a[3], double const b[3]) {
+  return std::sqrt((a[0] - b[0]) * (a[0] - b[0])
+    + (a[1] - b[1]) * (a[1] - b[1]) + (a[2] - b[2]) * (a[2] - b[2]));
+}
+
+// Integrate 10 ms of a tumbling, shaking tracker at 1 kHz with one set of
+// errors, and return the worst gap between the corrected mean and the mean
+// integrated with another set, for the accelerometer and the gyroscope
+static void Run(double const from[NUM_ERRORS][3],
+  double const to[NUM_ERRORS][3], double & acc_gap, double & gyr_gap) {
+  std::mt19937 random(7);
+  std::normal_distribution<double> gaussian(0.0, 1.0);
+  Preintegrator corrected, integrated;
+  corrected.Reset(0.0, from);
+  integrated.Reset(0.0, to);
+  for (size_t k = 1; k <= 10; k++) {
+    double time = k * 1e-3;
+    double acc[3] = {0.5 + 0.2 * gaussian(random),
+      -0.3 + 0.2 * gaussian(random), 9.8 + 0.2 * gaussian(random)};
+    double gyr[3] = {2.0 + 0.1 * gaussian(random),
+      -1.0 + 0.1 * gaussian(random), 3.0 + 0.1 * gaussian(random)};
+    assert(corrected.Add(time, acc, gyr));
+    assert(integrated.Add(time, acc, gyr));
+  }
+  assert(corrected.Count() == 10 && corrected.End() == 1e-2);
+  double acc[2][3], gyr[2][3];
+  corrected.Mean(to, acc[0], gyr[0]);
+  integrated.Mean(to, acc[1], gyr[1]);
+  acc_gap = Distance(acc[0], acc[1]);
+  gyr_gap = Distance(gyr[0], gyr[1]);
+}
+
+int main() {
+  double from[NUM_ERRORS][3], to[NUM_ERRORS][3];
+  Nominal(from);
+  from[ERROR_GYR_BIAS][0] = 0.01;
+  from[ERROR_ACC_BIAS][2] = -0.05;
+
+  // With the same errors there is nothing to correct
+  double acc_gap, gyr_gap;
+  Run(from, from, acc_gap, gyr_gap);
+  printf("same errors: acc %.1e gyr %.1e\n", acc_gap, gyr_gap);
+  assert(acc_gap < 1e-12 && gyr_gap < 1e-12);
+
+  // Bias changes of the size a filter makes in one step are corrected to
+  // well within the noise of a single sample, and the gap shrinks much
+  // faster than the change, as it does for a first order correction
+  double previous[2] = {0.0, 0.0};
+  for (double change : {1e-2, 1e-3}) {
+    Nominal(to);
+    for (size_t i = 0; i < 3; i++) {
+      to[ERROR_GYR_BIAS][i] = from[ERROR_GYR_BIAS][i] + change * (i + 1);
+      to[ERROR_ACC_BIAS][i] = from[ERROR_ACC_BIAS][i] - change * (i + 1);
+    }
+    Run(from, to, acc_gap, gyr_gap);
+    printf("change %.0e: acc %.1e gyr %.1e\n", change, acc_gap, gyr_gap);
+    assert(acc_gap < 1e-5 && gyr_gap < 1e-5);
+    if (previous[0] > 0.0)
+      assert(acc_gap < previous[0] / 10 && gyr_gap < previous[1] / 10);
+    previous[0] = acc_gap;
+    previous[1] = gyr_gap;
+  }
+
+  // A single sample has no duration, and is passed through unchanged
+  Preintegrator single;
+  single.Reset(1.0, from);
+  double acc[3] = {1.0, 2.0, 3.0}, gyr[3] = {-1.0, -2.0, -3.0};
+  assert(single.Add(1.0, acc, gyr, 4));
+  assert(!single.Add(0.5, acc, gyr));
+  double mean_acc[3], mean_gyr[3];
+  single.Mean(to, mean_acc, mean_gyr);
+  assert(Distance(mean_acc, acc) < 1e-12 && Distance(mean_gyr, gyr) < 1e-12);
+  printf("single sample ok\n");
+  return 0;
+}
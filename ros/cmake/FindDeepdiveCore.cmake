@@ -0,0 +1,16 @@
+# - Try to find the libdeepdive tracking core
+# Will define
+# DEEPDIVE_CORE_FOUND
+# DEEPDIVE_CORE_INCLUDE_DIRS
+# DEEPDIVE_CORE_LIBRARIES
+
+find_path(DEEPDIVE_CORE_INCLUDE_DIRS deepdive/deepdive_core.hh
+  HINTS ${DEEPDIVE_INCLUDEDIR})
+
+find_library(DEEPDIVE_CORE_LIBRARIES
+  NAMES deepdive_core
+  HINTS ${DEEPDIVE_LIBDIR})
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(deepdivecore DEFAULT_MSG DEEPDIVE_CORE_LIBRARIES DEEPDIVE_CORE_INCLUDE_DIRS)
+mark_as_advanced(DEEPDIVE_CORE_LIBRARIES DEEPDIVE_CORE_INCLUDE_DIRS)
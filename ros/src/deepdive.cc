@@ -3,10 +3,6 @@
 #include <tf2_ros/transform_broadcaster.h>
 #include <tf2_ros/static_transform_broadcaster.h>
 
-// STL
-#include <fstream>
-#include <sstream>
-
 // This include
 #include "deepdive.hh"
 
@@ -98,156 +94,53 @@ void SendTransforms(
   }
 }
 
-// Convert a ceres to an Eigen transform
-Eigen::Affine3d CeresToEigen(double ceres[6], bool invert) {
-  Eigen::Affine3d A;
-  A.translation()[0] = ceres[0];
-  A.translation()[1] = ceres[1];
-  A.translation()[2] = ceres[2];
-  Eigen::Vector3d v(ceres[3], ceres[4], ceres[5]);
-  Eigen::AngleAxisd aa;
-  if (v.norm() > 0) {
-    aa.angle() = v.norm();
-    aa.axis() = v.normalized();
-  }
-  A.linear() = aa.toRotationMatrix();
-  if (invert)
-    return A.inverse();
-  return A;
-}
-
-// CONFIG MANAGEMENT
-
-// Parse a human-readable configuration
-bool ReadConfig(std::string const& calfile,   // Calibration file
-  std::string const& frame_world,             // World name
-  std::string const& frame_vive,              // Vive frame name
-  std::string const& frame_body,              // Body frame name
-  double registration[6],
-  LighthouseMap & lighthouses, TrackerMap & trackers) {
-  // Entries take the form x y z qx qy qz qw parent child
-  std::ifstream infile(calfile);
-  if (!infile.is_open()) {
-    ROS_WARN("Could not open config file for reading");
-    return false;
+// Send the head and IMU frames of a tracker
+void SendTrackerTransforms(deepdive_ros::Tracker const& tracker) {
+  // Head -> light
+  {
+    Eigen::Quaterniond q(
+      tracker.head_transform.rotation.w,
+      tracker.head_transform.rotation.x,
+      tracker.head_transform.rotation.y,
+      tracker.head_transform.rotation.z);
+    Eigen::Affine3d tTh;
+    tTh.linear() = q.toRotationMatrix();
+    tTh.translation() = Eigen::Vector3d(
+      tracker.head_transform.translation.x,
+      tracker.head_transform.translation.y,
+      tracker.head_transform.translation.z);
+    Eigen::Affine3d hTt = tTh.inverse();
+    q = Eigen::Quaterniond(hTt.linear());
+    geometry_msgs::TransformStamped tfs;
+    tfs.header.frame_id = tracker.serial;
+    tfs.child_frame_id = tracker.serial + "/light";
+    tfs.transform.translation.x = hTt.translation()[0];
+    tfs.transform.translation.y = hTt.translation()[1];
+    tfs.transform.translation.z = hTt.translation()[2];
+    tfs.transform.rotation.w = q.w();
+    tfs.transform.rotation.x = q.x();
+    tfs.transform.rotation.y = q.y();
+    tfs.transform.rotation.z = q.z();
+    SendStaticTransform(tfs);
   }
-  std::string line;
-  int count = 0;
-  while (std::getline(infile, line)) {
-    std::istringstream iss(line);
-    double x, y, z, qx, qy, qz, qw;
-    std::string p, c;
-    if (!(iss >> x >> y >> z >> qx >> qy >> qz >> qw >> p >> c)) {
-      ROS_ERROR("Badly formatted config file");
-      return false;
-    }
-    // ROS_INFO_STREAM(p << " -> " << c);
-    Eigen::AngleAxisd aa(Eigen::Quaterniond(qw, qx, qy, qz));
-    if (p == frame_world && c == frame_vive) {
-      registration[0] = x;
-      registration[1] = y;
-      registration[2] = z;
-      registration[3] = aa.angle() * aa.axis()[0];
-      registration[4] = aa.angle() * aa.axis()[1];
-      registration[5] = aa.angle() * aa.axis()[2];
-      count++;
-      continue;
-    }
-    if (p == frame_vive && lighthouses.find(c) != lighthouses.end()) {
-      lighthouses[c].vTl[0] = x;
-      lighthouses[c].vTl[1] = y;
-      lighthouses[c].vTl[2] = z;
-      lighthouses[c].vTl[3] = aa.angle() * aa.axis()[0];
-      lighthouses[c].vTl[4] = aa.angle() * aa.axis()[1];
-      lighthouses[c].vTl[5] = aa.angle() * aa.axis()[2];
-      count++;
-      continue;
-    }
-    if (p == frame_body && trackers.find(c) != trackers.end()) {
-      trackers[c].bTh[0] = x;
-      trackers[c].bTh[1] = y;
-      trackers[c].bTh[2] = z;
-      trackers[c].bTh[3] = aa.angle() * aa.axis()[0];
-      trackers[c].bTh[4] = aa.angle() * aa.axis()[1];
-      trackers[c].bTh[5] = aa.angle() * aa.axis()[2];
-      count++;
-      continue;
-    }
-    ROS_WARN_STREAM("Transform " << p << " -> " << c << " invalid");
+  // Light -> IMU
+  {
+    geometry_msgs::TransformStamped tfs;
+    tfs.header.frame_id = tracker.serial + "/light";
+    tfs.child_frame_id = tracker.serial + "/imu";
+    tfs.transform = tracker.imu_transform;
+    SendStaticTransform(tfs);
   }
-  return (count == 1 + lighthouses.size() + trackers.size());
 }
 
-// Write a human-readable configuration
-bool WriteConfig(std::string const& calfile,    // Calibration file
-  std::string const& frame_world,               // World name
-  std::string const& frame_vive,                // Vive frame name
-  std::string const& frame_body,                // Body frame name
-  double registration[6],
-  LighthouseMap const& lighthouses, TrackerMap const& trackers) {
-  std::ofstream outfile(calfile);
-  if (!outfile.is_open()) {
-    ROS_WARN("Could not open config file for writing");
-    return false;
-  }
-  // World registration
-  {
-    Eigen::Vector3d v(registration[3], registration[4], registration[5]);
-    Eigen::AngleAxisd aa = Eigen::AngleAxisd::Identity();
-    if (v.norm() > 0) {
-      aa.angle() = v.norm();
-      aa.axis() = v.normalized();
-    }
-    Eigen::Quaterniond q(aa);
-    outfile << registration[0] << " "
-            << registration[1] << " "
-            << registration[2] << " "
-            << q.x() << " "
-            << q.y() << " "
-            << q.z() << " "
-            << q.w() << " "
-            << frame_world << " " << frame_vive
-            << std::endl;
+// Route messages from the tracking core to the ROS log
+void RosLog(Level level, std::string const& msg) {
+  switch (level) {
+  case Level::DEBUG: ROS_DEBUG("%s", msg.c_str()); break;
+  case Level::INFO:  ROS_INFO("%s", msg.c_str());  break;
+  case Level::WARN:  ROS_WARN("%s", msg.c_str());  break;
+  default:           ROS_ERROR("%s", msg.c_str()); break;
   }
-  LighthouseMap::const_iterator it;
-  for (it = lighthouses.begin(); it != lighthouses.end(); it++)  {
-    Eigen::Vector3d v(it->second.vTl[3], it->second.vTl[4], it->second.vTl[5]);
-    Eigen::AngleAxisd aa;
-    if (v.norm() > 0) {
-      aa.angle() = v.norm();
-      aa.axis() = v.normalized();
-    }
-    Eigen::Quaterniond q(aa);
-    outfile << it->second.vTl[0] << " "
-            << it->second.vTl[1] << " "
-            << it->second.vTl[2] << " "
-            << q.x() << " "
-            << q.y() << " "
-            << q.z() << " "
-            << q.w() << " "
-            << frame_vive << " " << it->first
-            << std::endl;
-  }
-  TrackerMap::const_iterator jt;
-  for (jt = trackers.begin(); jt != trackers.end(); jt++)  {
-    Eigen::Vector3d v(jt->second.bTh[3], jt->second.bTh[4], jt->second.bTh[5]);
-    Eigen::AngleAxisd aa;
-    if (v.norm() > 0) {
-      aa.angle() = v.norm();
-      aa.axis() = v.normalized();
-    }
-    Eigen::Quaterniond q(aa);
-    outfile << jt->second.bTh[0] << " "
-            << jt->second.bTh[1] << " "
-            << jt->second.bTh[2] << " "
-            << q.x() << " "
-            << q.y() << " "
-            << q.z() << " "
-            << q.w() << " "
-            << frame_body << " " << jt->first
-            << std::endl;
-  }
-  return true;
 }
 
 // REUSABLE CALLS
@@ -308,70 +201,25 @@ void TrackerCallback(deepdive_ros::Trackers::ConstPtr const& msg,
       tracker->second.sensors[6*i+4] = it->sensors[i].normal.y;
       tracker->second.sensors[6*i+5] = it->sensors[i].normal.z;
     }
-    // Add the head -> light transform
-    {
-      // Write to the global data structure
-      Eigen::Quaterniond q(
-        it->head_transform.rotation.w,
-        it->head_transform.rotation.x,
-        it->head_transform.rotation.y,
-        it->head_transform.rotation.z);
-      Eigen::AngleAxisd aa(q);
-      Eigen::Affine3d tTh;
-      tTh.linear() = q.toRotationMatrix();
-      tTh.translation() = Eigen::Vector3d(
-        it->head_transform.translation.x,
-        it->head_transform.translation.y,
-        it->head_transform.translation.z);
-      tracker->second.tTh[0] = tTh.translation()[0];
-      tracker->second.tTh[1] = tTh.translation()[1];
-      tracker->second.tTh[2] = tTh.translation()[2];
-      tracker->second.tTh[3] = aa.angle() * aa.axis()[0];
-      tracker->second.tTh[4] = aa.angle() * aa.axis()[1];
-      tracker->second.tTh[5] = aa.angle() * aa.axis()[2];
-      // Send off the transform
-      Eigen::Affine3d hTt = tTh.inverse();
-      q = Eigen::Quaterniond(hTt.linear());
-      geometry_msgs::TransformStamped tfs;
-      tfs.header.frame_id = it->serial;
-      tfs.child_frame_id = it->serial + "/light";
-      tfs.transform.translation.x = hTt.translation()[0];
-      tfs.transform.translation.y = hTt.translation()[1];
-      tfs.transform.translation.z = hTt.translation()[2];
-      tfs.transform.rotation.w = q.w();
-      tfs.transform.rotation.x = q.x();
-      tfs.transform.rotation.y = q.y();
-      tfs.transform.rotation.z = q.z();
-      SendStaticTransform(tfs);
-    }
-    // Add the imu -> light transform
-    {
-      // Write to the global data structure
-      Eigen::Quaterniond q(
-        it->imu_transform.rotation.w,
-        it->imu_transform.rotation.x,
-        it->imu_transform.rotation.y,
-        it->imu_transform.rotation.z);
-      Eigen::AngleAxisd aa(q);
-      Eigen::Affine3d tTi;
-      tTi.linear() = q.toRotationMatrix();
-      tTi.translation() = Eigen::Vector3d(
-        it->imu_transform.translation.x,
-        it->imu_transform.translation.y,
-        it->imu_transform.translation.z);
-      tracker->second.tTi[0] = tTi.translation()[0];
-      tracker->second.tTi[1] = tTi.translation()[1];
-      tracker->second.tTi[2] = tTi.translation()[2];
-      tracker->second.tTi[3] = aa.angle() * aa.axis()[0];
-      tracker->second.tTi[4] = aa.angle() * aa.axis()[1];
-      tracker->second.tTi[5] = aa.angle() * aa.axis()[2];
-      // Send off the transform
-      geometry_msgs::TransformStamped tfs;  
-      tfs.header.frame_id = it->serial + "/light";
-      tfs.child_frame_id = it->serial + "/imu";
-      tfs.transform = it->imu_transform;
-      SendStaticTransform(tfs);
-    }
+    // Add the head -> light and imu -> light transforms
+    double t[3], q[4];
+    t[0] = it->head_transform.translation.x;
+    t[1] = it->head_transform.translation.y;
+    t[2] = it->head_transform.translation.z;
+    q[0] = it->head_transform.rotation.w;
+    q[1] = it->head_transform.rotation.x;
+    q[2] = it->head_transform.rotation.y;
+    q[3] = it->head_transform.rotation.z;
+    PoseToAngleAxis(t, q, tracker->second.tTh);
+    t[0] = it->imu_transform.translation.x;
+    t[1] = it->imu_transform.translation.y;
+    t[2] = it->imu_transform.translation.z;
+    q[0] = it->imu_transform.rotation.w;
+    q[1] = it->imu_transform.rotation.x;
+    q[2] = it->imu_transform.rotation.y;
+    q[3] = it->imu_transform.rotation.z;
+    PoseToAngleAxis(t, q, tracker->second.tTi);
+    SendTrackerTransforms(*it);
     if (!tracker->second.ready) {
       tracker->second.ready = true;
       cb(tracker);
@@ -379,10 +227,42 @@ void TrackerCallback(deepdive_ros::Trackers::ConstPtr const& msg,
   }
 }
 
-// STATISTICS
-
-bool Mean(std::vector<double> const& v, double & d) {
-  if (v.empty()) return false;
-  d = std::accumulate(v.begin(), v.end(), 0.0) / v.size(); 
-  return true;
-}
\ No newline at end of file
+void LightBatchCallback(deepdive_ros::LightBatch::ConstPtr const& msg,
+  std::function<void(deepdive_ros::Light const&)> cb) {
+  static thread_local deepdive_ros::Light light;
+  size_t n = msg->sweep_end.size();
+  if (msg->sweep_stamp.size() != n || msg->sweep_tracker.size() != n ||
+      msg->sweep_lighthouse.size() != n || msg->sweep_axis.size() != n ||
+      msg->tracker_ids.size() != msg->trackers.size() ||
+      msg->lighthouse_ids.size() != msg->lighthouses.size() ||
+      msg->angle.size() != msg->sensor.size() ||
+      msg->duration.size() != msg->sensor.size()) {
+    ROS_WARN_THROTTLE(1.0, "Malformed light batch");
+    return;
+  }
+  // Unpack each sweep into the same message
+  size_t start = 0;
+  for (size_t s = 0; s < n; s++) {
+    size_t end = msg->sweep_end[s];
+    if (end < start || end > msg->sensor.size() ||
+        msg->sweep_tracker[s] >= msg->trackers.size() ||
+        msg->sweep_lighthouse[s] >= msg->lighthouses.size()) {
+      ROS_WARN_THROTTLE(1.0, "Malformed sweep in light batch");
+      return;
+    }
+    light.header.stamp = msg->sweep_stamp[s];
+    light.header.frame_id = msg->trackers[msg->sweep_tracker[s]];
+    light.lighthouse = msg->lighthouses[msg->sweep_lighthouse[s]];
+    light.tracker_id = msg->tracker_ids[msg->sweep_tracker[s]];
+    light.lighthouse_id = msg->lighthouse_ids[msg->sweep_lighthouse[s]];
+    light.axis = msg->sweep_axis[s];
+    light.pulses.resize(end - start);
+    for (size_t i = start; i < end; i++) {
+      light.pulses[i - start].sensor = msg->sensor[i];
+      light.pulses[i - start].angle = msg->angle[i];
+      light.pulses[i - start].duration = msg->duration[i];
+    }
+    cb(light);
+    start = end;
+  }
+}
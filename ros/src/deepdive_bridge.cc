@@ -1,5 +1,5 @@
 /*
-  This ROS node creates an instance of the libdeepdive driver, which it uses
+  This ROS nodelet creates an instance of the libdeepdive driver, which it uses
   to pull data from all available trackers, as well as lighthouse/tracker info.
 */
 
@@ -10,6 +10,8 @@ extern "C" {
 
 // ROS includes
 #include <ros/ros.h>
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
 
 // Standard messages
 #include <sensor_msgs/Imu.h>
@@ -20,6 +22,7 @@ extern "C" {
 // Non-standard messages
 #include <deepdive_ros/Button.h>
 #include <deepdive_ros/Light.h>
+#include <deepdive_ros/LightBatch.h>
 #include <deepdive_ros/Pulse.h>
 #include <deepdive_ros/Motor.h>
 #include <deepdive_ros/Sensor.h>
@@ -32,6 +35,12 @@ extern "C" {
 #include <map>
 #include <string>
 #include <limits>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Boost includes
+#include <boost/shared_ptr.hpp>
 
 // Various constants used by the Vive system
 static constexpr double GRAVITY         = 9.80665;
@@ -41,6 +50,54 @@ static constexpr double SWEEP_DURATION  = 400000.0;
 static constexpr double SWEEP_CENTER    = 200000.0;
 static constexpr double TICKS_PER_SEC   = 48e6;
 
+// Upper bound on pulses in a sweep, used to preallocate batches
+static constexpr size_t MAX_PULSES      = 32;
+
+// Number of messages of each type that are allocated up front
+static constexpr size_t POOL_SIZE       = 64;
+
+// MESSAGE POOLS
+
+// A fixed set of messages that are reused instead of allocated. Published
+// messages may still be held by subscribers in the same process or by the
+// publish queue, so a message is only handed out again once the pool holds
+// the only reference to it. If every message is in use a new one is made,
+// which is counted so that the pool can be sized.
+template <typename M>
+class MessagePool {
+ public:
+  typedef boost::shared_ptr<M> Ptr;
+
+  // Allocate all messages, letting the caller reserve space in each
+  template <typename Fn>
+  void Reserve(size_t n, Fn init) {
+    pool_.resize(n);
+    for (size_t i = 0; i < n; i++) {
+      pool_[i].reset(new M);
+      init(*pool_[i]);
+    }
+  }
+
+  // Get a message that nobody else holds, with its old contents
+  Ptr Get() {
+    for (size_t i = 0; i < pool_.size(); i++) {
+      next_ = (next_ + 1) % pool_.size();
+      if (pool_[next_].use_count() == 1)
+        return pool_[next_];
+    }
+    misses_++;
+    return Ptr(new M);
+  }
+
+  // Number of messages that had to be allocated
+  uint64_t Misses() const { return misses_; }
+
+ private:
+  std::vector<Ptr> pool_;
+  size_t next_ = 0;
+  uint64_t misses_ = 0;
+};
+
 // DATA STRUCTURES
 
 // Data structures for storing lighthouses and trackers
@@ -52,8 +109,23 @@ static ros::Publisher pub_lighthouses_;
 static ros::Publisher pub_trackers_;
 static ros::Publisher pub_button_;
 static ros::Publisher pub_light_;
+static ros::Publisher pub_light_batch_;
 static ros::Publisher pub_imu_;
 
+// Light batching. Messages are published by pointer, so that subscribers in
+// the same process receive them without a copy. A message must therefore not
+// be touched after it is published, and a new batch is started instead.
+static deepdive_ros::LightBatchPtr batch_;
+static ros::Time batch_start_;
+static int batch_size_ = 16;           // Maximum sweeps per batch
+static double batch_period_ = 0.01;    // Maximum age of a batch in seconds
+static bool legacy_ = false;           // Also publish one Light per sweep
+
+// Preallocated messages for the high-rate topics
+static MessagePool<deepdive_ros::LightBatch> batch_pool_;
+static MessagePool<deepdive_ros::Light> light_pool_;
+static MessagePool<sensor_msgs::Imu> imu_pool_;
+
 // Quaternion :: ROS <-> DOUBLE
 
 template <typename T> inline
@@ -104,6 +176,66 @@ void Convert(const T from[3], geometry_msgs::Point & to) {
   to.z = from[2];
 }
 
+// LIGHT BATCHING
+
+// Find or add a device in the batch tables. The tables are short, so a
+// linear search over the driver ids is quicker than a map and needs no
+// allocation, and the serial is only copied when a device is first added.
+static uint8_t BatchIndex(std::vector<uint8_t> & ids,
+  std::vector<std::string> & serials, uint8_t id, const char * serial) {
+  for (size_t i = 0; i < ids.size(); i++)
+    if (ids[i] == id)
+      return i;
+  ids.push_back(id);
+  serials.push_back(serial);
+  return ids.size() - 1;
+}
+
+// Make space for a full batch
+static void BatchReserve(deepdive_ros::LightBatch & batch) {
+  batch.trackers.reserve(MAX_NUM_TRACKERS);
+  batch.lighthouses.reserve(MAX_NUM_LIGHTHOUSES);
+  batch.tracker_ids.reserve(MAX_NUM_TRACKERS);
+  batch.lighthouse_ids.reserve(MAX_NUM_LIGHTHOUSES);
+  batch.sweep_stamp.reserve(batch_size_);
+  batch.sweep_tracker.reserve(batch_size_);
+  batch.sweep_lighthouse.reserve(batch_size_);
+  batch.sweep_axis.reserve(batch_size_);
+  batch.sweep_synctime.reserve(batch_size_);
+  batch.sweep_end.reserve(batch_size_);
+  batch.sensor.reserve(batch_size_ * MAX_PULSES);
+  batch.angle.reserve(batch_size_ * MAX_PULSES);
+  batch.duration.reserve(batch_size_ * MAX_PULSES);
+}
+
+// Start a new batch, keeping the space reserved in a pooled message
+static void BatchStart() {
+  batch_ = batch_pool_.Get();
+  batch_->trackers.clear();
+  batch_->lighthouses.clear();
+  batch_->tracker_ids.clear();
+  batch_->lighthouse_ids.clear();
+  batch_->sweep_stamp.clear();
+  batch_->sweep_tracker.clear();
+  batch_->sweep_lighthouse.clear();
+  batch_->sweep_axis.clear();
+  batch_->sweep_synctime.clear();
+  batch_->sweep_end.clear();
+  batch_->sensor.clear();
+  batch_->angle.clear();
+  batch_->duration.clear();
+  BatchReserve(*batch_);
+}
+
+// Publish the current batch, if it is non-empty, and start a new one
+static void BatchFlush() {
+  if (!batch_ || batch_->sweep_end.empty())
+    return;
+  batch_->header.stamp = ros::Time::now();
+  pub_light_batch_.publish(batch_);
+  BatchStart();
+}
+
 // CALLBACKS
 
 // Callback to display light info
@@ -111,29 +243,56 @@ void LightCallback(struct Tracker * tracker,
   struct Lighthouse * lighthouse, uint8_t axis, uint32_t synctime,
   uint16_t num_sensors, uint16_t *sensors, uint32_t *sweeptimes,
   uint32_t *angles, uint16_t *lengths) {
-  deepdive_ros::Light msg;
-  msg.header.frame_id = tracker->serial;
-  msg.header.stamp = ros::Time::now();
-  msg.lighthouse = lighthouse->serial;
+  ros::Time now = ros::Time::now();
   // Make sure we convert to RHS
+  uint8_t ax;
   switch (axis) {
   case MOTOR_AXIS0:
-    msg.axis = deepdive_ros::Motor::AXIS_0;
+    ax = deepdive_ros::Motor::AXIS_0;
     break;
   case MOTOR_AXIS1:
-    msg.axis = deepdive_ros::Motor::AXIS_1;
+    ax = deepdive_ros::Motor::AXIS_1;
     break;
   default:
     ROS_WARN("Received light with invalid axis");
     return;
   }
-  // Add the pulses
-  msg.pulses.resize(num_sensors);
+  // Add the sweep to the batch
+  if (batch_->sweep_end.empty())
+    batch_start_ = now;
+  batch_->sweep_stamp.push_back(now);
+  batch_->sweep_tracker.push_back(BatchIndex(batch_->tracker_ids,
+    batch_->trackers, tracker->id, tracker->serial));
+  batch_->sweep_lighthouse.push_back(BatchIndex(batch_->lighthouse_ids,
+    batch_->lighthouses, lighthouse->id, lighthouse->serial));
+  batch_->sweep_axis.push_back(ax);
+  batch_->sweep_synctime.push_back(synctime);
+  for (uint16_t i = 0; i < num_sensors; i++) {
+    batch_->sensor.push_back(sensors[i]);
+    batch_->angle.push_back((M_PI / SWEEP_DURATION)
+      * (static_cast<double>(angles[i]) - SWEEP_CENTER));
+    batch_->duration.push_back(
+      static_cast<double>(lengths[i]) / TICKS_PER_SEC);
+  }
+  batch_->sweep_end.push_back(batch_->sensor.size());
+  if (batch_->sweep_end.size() >= static_cast<size_t>(batch_size_))
+    BatchFlush();
+  // Old-style messages, one per sweep
+  if (!legacy_)
+    return;
+  deepdive_ros::LightPtr msg = light_pool_.Get();
+  msg->header.frame_id = tracker->serial;
+  msg->header.stamp = now;
+  msg->lighthouse = lighthouse->serial;
+  msg->tracker_id = tracker->id;
+  msg->lighthouse_id = lighthouse->id;
+  msg->axis = ax;
+  msg->pulses.resize(num_sensors);
   for (uint16_t i = 0; i < num_sensors; i++) {
-    msg.pulses[i].sensor = sensors[i];
-    msg.pulses[i].angle = (M_PI / SWEEP_DURATION)
+    msg->pulses[i].sensor = sensors[i];
+    msg->pulses[i].angle = (M_PI / SWEEP_DURATION)
       * (static_cast<double>(angles[i]) - SWEEP_CENTER);
-    msg.pulses[i].duration =
+    msg->pulses[i].duration =
       static_cast<double>(lengths[i]) / TICKS_PER_SEC;
   }
   // Publish the data
@@ -144,20 +303,20 @@ void LightCallback(struct Tracker * tracker,
 void ImuCallback(struct Tracker * tracker, uint32_t timecode,
   int16_t acc[3], int16_t gyr[3], int16_t mag[3]) {
   // Package up the IMU data
-  sensor_msgs::Imu msg;
-  msg.header.frame_id = tracker->serial;
-  msg.header.stamp = ros::Time::now();
-  msg.linear_acceleration.x =
+  sensor_msgs::ImuPtr msg = imu_pool_.Get();
+  msg->header.frame_id = tracker->serial;
+  msg->header.stamp = ros::Time::now();
+  msg->linear_acceleration.x =
     static_cast<double>(acc[0]) * GRAVITY / ACC_SCALE;
-  msg.linear_acceleration.y =
+  msg->linear_acceleration.y =
     static_cast<double>(acc[1]) * GRAVITY / ACC_SCALE;
-  msg.linear_acceleration.z =
+  msg->linear_acceleration.z =
     static_cast<double>(acc[2]) * GRAVITY / ACC_SCALE;
-  msg.angular_velocity.x =
+  msg->angular_velocity.x =
     static_cast<double>(gyr[0]) * (1./GYRO_SCALE) * (M_PI/180.);
-  msg.angular_velocity.y =
+  msg->angular_velocity.y =
     static_cast<double>(gyr[1]) * (1./GYRO_SCALE) * (M_PI/180.);
-  msg.angular_velocity.z =
+  msg->angular_velocity.z =
     static_cast<double>(gyr[2]) * (1./GYRO_SCALE) * (M_PI/180.);
   // Publish the data
   pub_imu_.publish(msg);
@@ -182,6 +341,7 @@ void TrackerCallback(struct Tracker * t) {
   if (!t) return;
   deepdive_ros::Tracker & tracker = trackers_[t->serial];
   tracker.serial = t->serial;
+  tracker.id = t->id;
   tracker.sensors.resize(t->cal.num_channels);
   for (size_t i = 0; i < t->cal.num_channels; i++) {
     Convert(t->cal.positions[i], tracker.sensors[i].position);
@@ -213,6 +373,7 @@ void LighthouseCallback(struct Lighthouse *l) {
   if (!l) return;
   deepdive_ros::Lighthouse & lighthouse = lighthouses_[l->serial];
   lighthouse.serial = l->serial;
+  lighthouse.id = l->id;
   lighthouse.motors.resize(2);
   for (size_t i = 0; i < MAX_NUM_MOTORS; i++) {
     lighthouse.motors[i].axis = i;
@@ -234,48 +395,121 @@ void LighthouseCallback(struct Lighthouse *l) {
   pub_lighthouses_.publish(msg);
 }
 
-// Main entry point of application
-int main(int argc, char **argv) {
-  // Initialize ROS
-  ros::init(argc, argv, "deepdive_bridge");
-  ros::NodeHandle nh;
-
-  // Latched publishers
-  pub_lighthouses_ =
-    nh.advertise<deepdive_ros::Lighthouses>("lighthouses", 10, true);
-  pub_trackers_ =
-    nh.advertise<deepdive_ros::Trackers>("trackers", 10, true);
-
-  // Non-latched publishers
-  pub_light_ = nh.advertise<deepdive_ros::Light>("light", 10);
-  pub_button_ = nh.advertise<deepdive_ros::Button>("button", 10);
-  pub_imu_ = nh.advertise<sensor_msgs::Imu>("imu", 10);
-
-  // Try to initialize vive
-  struct Driver *driver = deepdive_init();
-  if (!driver) {
-    ROS_ERROR("Deepdive initialization failed");
-    return 1;
+// Driver messages, called from the driver's log thread
+void LogCallback(uint8_t level, const char * msg) {
+  switch (level) {
+  case LEVEL_DEBUG: ROS_DEBUG("%s", msg); break;
+  case LEVEL_INFO:  ROS_INFO("%s", msg);  break;
+  case LEVEL_WARN:  ROS_WARN("%s", msg);  break;
+  default:          ROS_ERROR("%s", msg); break;
+  }
+}
+
+// NODELET
+
+namespace deepdive {
+
+class BridgeNodelet : public nodelet::Nodelet {
+ public:
+  BridgeNodelet() : driver_(nullptr), running_(false),
+    rt_(false), rt_priority_(80), rt_cpu_(-1) {}
+
+  // Stop polling and close the vive context, then send what's left
+  ~BridgeNodelet() {
+    running_ = false;
+    if (thread_.joinable())
+      thread_.join();
+    if (driver_)
+      deepdive_close(driver_);
+    BatchFlush();
+    uint64_t misses = batch_pool_.Misses() + light_pool_.Misses()
+      + imu_pool_.Misses();
+    if (misses > 0)
+      ROS_WARN("%lu messages were allocated after startup",
+        static_cast<unsigned long>(misses));
   }
 
-  // Install the callbacks
-  deepdive_install_light_fn(driver, LightCallback);
-  deepdive_install_imu_fn(driver, ImuCallback);
-  deepdive_install_button_fn(driver, ButtonCallback);
-  deepdive_install_lighthouse_fn(driver, LighthouseCallback);
-  deepdive_install_tracker_fn(driver, TrackerCallback);
-
-  // Set active to true on initialization
-  while (ros::ok()) {
-    // Poll the ros driver for activity
-    deepdive_poll(driver);
-    // Flush the ROS messaging queue
-    ros::spinOnce();
+ private:
+  void onInit() {
+    ros::NodeHandle & nh = getNodeHandle();
+    ros::NodeHandle & nhp = getPrivateNodeHandle();
+
+    // Light batching parameters
+    nhp.param("batch_size", batch_size_, batch_size_);
+    nhp.param("batch_period", batch_period_, batch_period_);
+    nhp.param("legacy", legacy_, legacy_);
+    if (batch_size_ < 1)
+      batch_size_ = 1;
+
+    // Real-time polling parameters
+    nhp.param("rt", rt_, rt_);
+    nhp.param("rt_priority", rt_priority_, rt_priority_);
+    nhp.param("rt_cpu", rt_cpu_, rt_cpu_);
+
+    // Allocate the high-rate messages up front
+    batch_pool_.Reserve(POOL_SIZE, BatchReserve);
+    light_pool_.Reserve(legacy_ ? POOL_SIZE : 0,
+      [](deepdive_ros::Light & msg) { msg.pulses.reserve(MAX_PULSES); });
+    imu_pool_.Reserve(POOL_SIZE, [](sensor_msgs::Imu & msg) {
+      msg.header.frame_id.reserve(MAX_SERIAL_LENGTH);
+    });
+    BatchStart();
+
+    // Latched publishers
+    pub_lighthouses_ =
+      nh.advertise<deepdive_ros::Lighthouses>("lighthouses", 10, true);
+    pub_trackers_ =
+      nh.advertise<deepdive_ros::Trackers>("trackers", 10, true);
+
+    // Non-latched publishers
+    pub_light_batch_ =
+      nh.advertise<deepdive_ros::LightBatch>("light_batch", 10);
+    if (legacy_)
+      pub_light_ = nh.advertise<deepdive_ros::Light>("light", 10);
+    pub_button_ = nh.advertise<deepdive_ros::Button>("button", 10);
+    pub_imu_ = nh.advertise<sensor_msgs::Imu>("imu", 10);
+
+    // Try to initialize vive
+    driver_ = deepdive_init();
+    if (!driver_) {
+      NODELET_ERROR("Deepdive initialization failed");
+      return;
+    }
+
+    // Install the callbacks
+    deepdive_install_log_fn(driver_, LogCallback);
+    deepdive_install_light_fn(driver_, LightCallback);
+    deepdive_install_imu_fn(driver_, ImuCallback);
+    deepdive_install_button_fn(driver_, ButtonCallback);
+    deepdive_install_lighthouse_fn(driver_, LighthouseCallback);
+    deepdive_install_tracker_fn(driver_, TrackerCallback);
+
+    // The driver blocks while waiting for USB events, so it gets a thread
+    running_ = true;
+    thread_ = std::thread(&BridgeNodelet::Poll, this);
   }
 
-  // Close the vive context
-  deepdive_close(driver);
+  // All driver callbacks are made from this thread
+  void Poll() {
+    if (rt_ && !deepdive_rt_thread(driver_, rt_priority_, rt_cpu_))
+      NODELET_WARN("Real-time mode is only partially enabled");
+    while (running_ && ros::ok()) {
+      deepdive_poll(driver_);
+      // Don't hold on to a partial batch for too long
+      if (!batch_->sweep_end.empty() &&
+        (ros::Time::now() - batch_start_).toSec() > batch_period_)
+          BatchFlush();
+    }
+  }
+
+  struct Driver * driver_;
+  std::atomic<bool> running_;
+  std::thread thread_;
+  bool rt_;
+  int rt_priority_;
+  int rt_cpu_;
+};
+
+}  // namespace deepdive
 
-  // Success!
-  return 0;
-}
\ No newline at end of file
+PLUGINLIB_EXPORT_CLASS(deepdive::BridgeNodelet, nodelet::Nodelet)
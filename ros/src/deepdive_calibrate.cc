@@ -1,5 +1,7 @@
 // ROS includes
 #include <ros/ros.h>
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
 #include <tf2_ros/transform_broadcaster.h>
 #include <tf2_ros/static_transform_broadcaster.h>
 
@@ -80,6 +82,10 @@ std::map<std::string, std::map<std::string, ros::Publisher>> pub_path_;
 // Timer for managing offline
 ros::Timer timer_;
 
+// Subscribers and services, which must outlive the initialization
+std::vector<ros::Subscriber> subs_;
+ros::ServiceServer service_;
+
 // Jointly solve
 bool Solve() {
   // Check that we have enough measurements
@@ -467,19 +473,19 @@ bool Solve() {
 
 // MESSAGE CALLBACKS
 
-void LightCallback(deepdive_ros::Light::ConstPtr const& msg) {
+void LightCallback(deepdive_ros::Light const& msg) {
   // Reset the timer use din offline mode to determine the end of experiment
   timer_.stop();
   timer_.start();
   // Check that we are recording and that the tracker/lighthouse is ready
   if (!recording_ ||
-    trackers_.find(msg->header.frame_id) == trackers_.end() ||
-    lighthouses_.find(msg->lighthouse) == lighthouses_.end() ||
-    !trackers_[msg->header.frame_id].ready ||
-    !lighthouses_[msg->lighthouse].ready) return;
+    trackers_.find(msg.header.frame_id) == trackers_.end() ||
+    lighthouses_.find(msg.lighthouse) == lighthouses_.end() ||
+    !trackers_[msg.header.frame_id].ready ||
+    !lighthouses_[msg.lighthouse].ready) return;
   // Copy over the data
   size_t deleted = 0;
-  deepdive_ros::Light data = *msg;
+  deepdive_ros::Light data = msg;
   std::vector<deepdive_ros::Pulse>::iterator it = data.pulses.end();
   while (it-- > data.pulses.begin()) {
     // std::cout << it->duration << std::endl;
@@ -492,7 +498,7 @@ void LightCallback(deepdive_ros::Light::ConstPtr const& msg) {
   if (data.pulses.size() < thresh_count_)
     return; 
   // Add the data
-  measurements_[ros::Time::now()].light = data;
+  measurements_[msg.header.stamp].light = data;
 }
 
 bool TriggerCallback(std_srvs::Trigger::Request  &req,
@@ -596,12 +602,12 @@ void NewTrackerCallback(TrackerMap::iterator tracker) {
   }
 }
 
-// MAIN ENTRY POINT
+// INITIALIZATION
 
-int main(int argc, char **argv) {
-  // Initialize ROS and create node handle
-  ros::init(argc, argv, "deepdive_calibrate");
-  ros::NodeHandle nh("~");
+// Set up the solver, given the node handle to read parameters from
+void Initialize(ros::NodeHandle & nh) {
+  // Send messages from the core library to rosconsole
+  deepdive::SetLogFn(RosLog);
 
   // If we are in offline mode when we will replay the data back at 10x the
   // speed, using it all to find a calibration solution for both the body
@@ -724,27 +730,39 @@ int main(int argc, char **argv) {
     wTv_, lighthouses_, trackers_);
 
   // Subscribe to tracker and lighthouse updates
-  ros::Subscriber sub_tracker  = 
-    nh.subscribe<deepdive_ros::Trackers>("/trackers", 1000, std::bind(
-      TrackerCallback, std::placeholders::_1, std::ref(trackers_),
-        NewTrackerCallback));
-  ros::Subscriber sub_lighthouse = 
-    nh.subscribe<deepdive_ros::Lighthouses>("/lighthouses", 1000, std::bind(
-      LighthouseCallback, std::placeholders::_1, std::ref(lighthouses_),
-        NewLighthouseCallback));
-  ros::Subscriber sub_light =
-    nh.subscribe("/light", 1000, LightCallback);
-  ros::Subscriber sub_corrections =
-    nh.subscribe("/tf", 1000, CorrectionCallback);
-  ros::ServiceServer service =
-    nh.advertiseService("/trigger", TriggerCallback);
+  subs_.push_back(nh.subscribe<deepdive_ros::Trackers>("/trackers", 1000,
+    std::bind(TrackerCallback, std::placeholders::_1,
+      std::ref(trackers_), NewTrackerCallback)));
+  subs_.push_back(nh.subscribe<deepdive_ros::Lighthouses>("/lighthouses", 1000,
+    std::bind(LighthouseCallback, std::placeholders::_1,
+      std::ref(lighthouses_), NewLighthouseCallback)));
+  // Light is read from only one topic, as the bridge may publish it on both
+  bool legacy = false;
+  nh.param("legacy", legacy, legacy);
+  if (legacy)
+    subs_.push_back(nh.subscribe("/light", 1000, LightCallback));
+  else
+    subs_.push_back(nh.subscribe<deepdive_ros::LightBatch>("/light_batch",
+      1000, std::bind(LightBatchCallback, std::placeholders::_1,
+        LightCallback)));
+  subs_.push_back(nh.subscribe("/tf", 1000, CorrectionCallback));
+  service_ = nh.advertiseService("/trigger", TriggerCallback);
 
   // Setup a timer to automatically trigger solution on end of experiment
   timer_ = nh.createTimer(ros::Duration(1.0), TimerCallback, true, false);
+}
+
+// NODELET
+
+namespace deepdive {
+
+class CalibrateNodelet : public nodelet::Nodelet {
+ private:
+  void onInit() {
+    Initialize(getPrivateNodeHandle());
+  }
+};
 
-  // Block until safe shutdown
-  ros::spin();
+}  // namespace deepdive
 
-  // Success!
-  return 0;
-}
\ No newline at end of file
+PLUGINLIB_EXPORT_CLASS(deepdive::CalibrateNodelet, nodelet::Nodelet)
@@ -0,0 +1,35 @@
+/*
+  Standalone wrapper, which runs one of the deepdive nodelets in its own
+  process. The nodelet type is set at compile time, so that each executable
+  keeps the name, parameters and topics of the node it replaces.
+*/
+
+// ROS includes
+#include <ros/ros.h>
+#include <nodelet/loader.h>
+
+// C++ includes
+#include <string>
+#include <vector>
+#include <map>
+
+// Main entry point of application
+int main(int argc, char **argv) {
+  // Initialize ROS
+  ros::init(argc, argv, DEEPDIVE_NODE_NAME);
+
+  // Load the nodelet in this process, passing through remappings and args
+  nodelet::Loader loader;
+  std::vector<std::string> args(argv + 1, argv + argc);
+  if (!loader.load(ros::this_node::getName(), DEEPDIVE_NODELET,
+    ros::names::getRemappings(), args)) {
+    ROS_FATAL("Could not load nodelet %s", DEEPDIVE_NODELET);
+    return 1;
+  }
+
+  // Block until safe shutdown
+  ros::spin();
+
+  // Success!
+  return 0;
+}
@@ -5,6 +5,8 @@
 
 // ROS includes
 #include <ros/ros.h>
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
 #include <tf2_ros/transform_broadcaster.h>
 #include <tf2_ros/static_transform_broadcaster.h>
 
@@ -16,103 +18,30 @@
 #include <deepdive_ros/Trackers.h>
 #include <deepdive_ros/Light.h>
 #include <deepdive_ros/Lighthouses.h>
+#include <deepdive_ros/Prediction.h>
 
 // Eigen includes
 #include <Eigen/Core>
 #include <Eigen/Geometry>
 
-// UKF includes
-#include <UKF/Types.h>
-#include <UKF/Integrator.h>
-#include <UKF/StateVector.h>
-#include <UKF/MeasurementVector.h>
-#include <UKF/Core.h>
-
 // C++ includes
+#include <algorithm>
+#include <deque>
 #include <vector>
+#include <memory>
 #include <functional>
+#include <thread>
+
+// Tracking engine
+#include <deepdive/deepdive_checkpoint.hh>
+#include <deepdive/deepdive_engine.hh>
+#include <deepdive/deepdive_intake.hh>
+#include <deepdive/deepdive_pose.hh>
+#include <deepdive/deepdive_pool.hh>
 
 // Deepdive internal
 #include "deepdive.hh"
 
-// FILTER KEYS
-
-// State indexes
-enum Keys : uint8_t {
-  // STATE
-  Position,             // Position (world frame, m)
-  Attitude,             // Attitude quaternion (rotates vec from body to world)
-  Velocity,             // Velocity (body frame, m/s)
-  Omega,                // Angular velocity (body frame, rads/s)
-  Acceleration,         // Acceleration (body frame, m/s^2)
-  Alpha,                // Angular acceleration (body frame, rads/s^2)
-  // ERRORS
-  GyroscopeBias,        // Gyroscope bias offset (body frame, rad/s)
-  GyroscopeScale,       // Gyroscope scale factor (body frame, multiplier)
-  AccelerometerBias,    // Accelerometer bias offset (body frame, m/s^2)
-  AccelerometerScale,   // Accelerometer scale factor (body frame, mutliplier)
-  // MEASUREMENTS
-  Accelerometer,        // Acceleration (body frame, m/s^2)
-  Gyroscope,            // Gyroscope (body frame, rads/s)
-  Angle
-};
-
-// OBSERVATION
-
-// Observation vector
-using Observation = UKF::DynamicMeasurementVector<
-  UKF::Field<Accelerometer, UKF::Vector<3>>,
-  UKF::Field<Gyroscope, UKF::Vector<3>>,
-  UKF::Field<Angle, real_t>
->;
-
-// TRACKING FILTER
-
-// State vector
-using State = UKF::StateVector<
-  UKF::Field<Position, UKF::Vector<3>>,
-  UKF::Field<Attitude, UKF::Quaternion>,
-  UKF::Field<Velocity, UKF::Vector<3>>,
-  UKF::Field<Omega, UKF::Vector<3>>,
-  UKF::Field<Acceleration, UKF::Vector<3>>,
-  UKF::Field<Alpha, UKF::Vector<3>>
->;
-
-// For tracking
-using TrackingFilter = UKF::Core<
-  State, Observation, UKF::IntegratorRK4
->;
-
-// ERROR FILTER
-
-// Parameters
-using Error = UKF::StateVector<
-  UKF::Field<AccelerometerBias, UKF::Vector<3>>,
-  UKF::Field<AccelerometerScale, UKF::Vector<3>>,
-  UKF::Field<GyroscopeBias, UKF::Vector<3>>,
-  UKF::Field<GyroscopeScale, UKF::Vector<3>>
->;
-
-// For parameter estimation
-using ErrorFilter = UKF::Core<
-  Error, Observation, UKF::IntegratorEuler
->;
-
-// For IMU parameter estimation
-
-typedef std::map<std::string, Eigen::Affine3d> TransformMap;
-typedef std::map<std::string, ErrorFilter> ErrorMap;
-
-// Default IMU errors
-Eigen::Vector3d imu_cov_ab_;         // Initial covariance: Accel bias
-Eigen::Vector3d imu_cov_as_;         // Initial covariance: Accel scale
-Eigen::Vector3d imu_cov_gb_;         // Initial covariance: Gyro bias
-Eigen::Vector3d imu_cov_gs_;         // Initial covariance: Gyro scale
-Eigen::Vector3d imu_proc_ab_;        // Process noise: Accel bias
-Eigen::Vector3d imu_proc_as_;        // Process noise: Accel scale
-Eigen::Vector3d imu_proc_gb_;        // Process noise: Gyro bias
-Eigen::Vector3d imu_proc_gs_;        // Process noise: Gyro scale
-
 // GLOBAL DATA STRUCTURES
 
 std::string calfile_ = "deepdive.tf2";
@@ -124,465 +53,403 @@ std::string frame_truth_ = "truth";     // Vive solution
 
 LighthouseMap lighthouses_;          // List of lighthouses
 TrackerMap trackers_;                // List of trackers
-ErrorMap errors_;                    // List of error filters
-TrackingFilter filter_;              // Tracking filter
-std::string frame_parent_;           // Parent frame, eg "world"
-std::string frame_child_;            // Child frame, eg "truth"
 double rate_ = 10.0;                 // Desired tracking rate in Hz
-int thresh_count_ = 4;               // Min num measurements required per bundle
-double thresh_angle_ = 60.0;         // Angle threshold in degrees
-double thresh_duration_ = 1.0;       // Duration threshold in micorseconds
-bool use_gyroscope_ = true;          // Input measurements from gyroscope
-bool use_accelerometer_ = true;      // Input measurements from accelerometer
-bool use_light_ = true;              // Input measurements from light
 double registration_[6];             // World -> vive
+EngineConfig config_;                // Filter tuning
+IntakeConfig intake_config_;         // Load shedding
+
+// An id resolved from the serial of the device with some driver id, which
+// is only looked up again once the epoch it was resolved in has passed
+struct Resolved {
+  int id = -1;                       // Resolved id, or -1 if unknown
+  uint64_t epoch = 0;                // Epoch the id was resolved in
+};
 
-// ROS publishers
-ros::Publisher pub_pose_;
-ros::Publisher pub_twist_;
-
-// Default measurement errors
-bool correct_ = false;               // Whether to correct light parameters
-Eigen::Vector3d gravity_;            // Gravity
-Eigen::Vector3d obs_cov_acc_;        // Measurement covariance: Accelerometer
-Eigen::Vector3d obs_cov_gyr_;        // Measurement covariance: Gyroscope
-double obs_cov_ang_;                 // Measurement covariance: Angle
-
-// Intermediary data
-Eigen::Affine3d wTv_;                // ALL: world -> vive
-TransformMap vTl_;                   // ALL: vive -> lighthouse
-TransformMap bTh_;                   // ALL: head -> body
-TransformMap tTh_;                   // ALL: head -> tracking
-TransformMap tTi_;                   // ALL: imu -> tracking
-
-// Context data
-struct Context {
-  std::string lighthouse;            // Active lighthouse
-  std::string tracker;               // Active tracker
-  Eigen::Vector3d sensor;            // Active sensor
-  uint8_t axis;                      // Active axis
+// A rigid body, tracked by its own engine from a group of trackers. The
+// engine has no knowledge of ROS, and is only called on the body's strand.
+struct Body {
+  std::string name;                  // Name of the body block, if any
+  std::string frame;                 // Frame of the tracked pose
+  std::unique_ptr<TrackingEngine> engine;
+  std::unique_ptr<Intake> intake;    // Measurements waiting for the engine
+  std::deque<Measurement> batch;     // Measurements taken from the intake
+  std::unique_ptr<PoseWriter> writer;   // Optional shared-memory copy
+  ros::Publisher pub_pose;
+  ros::Publisher pub_twist;
+  ros::Publisher pub_prediction;     // Optional predicted pose
+  ros::Time logged;                  // When the stats were last reported
+  std::string checkpoint;            // Optional file for the filter state
+  ros::Time saved;                   // When the state was last saved
+  // Driver id -> serial, copied to the strand as the driver ids change
+  std::vector<std::string> tracker_serials =
+    std::vector<std::string>(UINT8_MAX + 1);
+  std::vector<std::string> lighthouse_serials =
+    std::vector<std::string>(UINT8_MAX + 1);
+  // Driver id -> engine id, resolved again when the engine epoch changes
+  std::vector<Resolved> tracker_ids = std::vector<Resolved>(UINT8_MAX + 1);
+  std::vector<Resolved> lighthouse_ids = std::vector<Resolved>(UINT8_MAX + 1);
 };
+std::vector<std::unique_ptr<Body>> bodies_;
 
+// Driver id -> serial, learned from the calibration messages. The driver
+// may give an id to another device after a reconnect, which starts a new
+// epoch, so that everything resolved from the old serial is looked up again.
+std::vector<std::string> tracker_serials_(UINT8_MAX + 1);
+std::vector<std::string> lighthouse_serials_(UINT8_MAX + 1);
+std::map<std::string, uint8_t> tracker_drivers_;  // Serial -> driver id
+uint64_t epoch_ = 0;                 // Changes of the driver ids so far
 
-// Are we initialized and ready to track
-bool initialized_ = false;
+// Tracker serial -> body, and the same by driver id
+std::map<std::string, int> body_ids_;
+std::vector<Resolved> driver_bodies_(UINT8_MAX + 1);
 
-// TRACKING FILTER
+// Predicted pose rate in Hz, or zero to predict after every measurement
+double prediction_rate_ = 0.0;
 
-namespace UKF {
+// Seconds between saving the filter state of each body
+double checkpoint_period_ = 10.0;
 
-  // MEASURMENT
+// Threads updating the bodies, which must stop before the bodies go away
+int workers_ = -1;
+std::unique_ptr<WorkerPool> pool_;
 
-  template <>
-  Observation::CovarianceVector Observation::measurement_covariance(
-    (Observation::CovarianceVector() << 
-      1.0e-4, 1.0e-4, 1.0e-4,   // Accel
-      1.0e-6, 1.0e-6, 1.0e-6,   // Gyro
-      1.0e-8).finished());
+// Subscribers and timers, which must outlive the initialization
+std::vector<ros::Subscriber> subs_;
+ros::Timer timer_;
+ros::Timer prediction_timer_;
 
-  // TRACKING FILTER
+// Time between a sweep being received and it reaching the filter
+Statistic latency_;
 
-  // Standard 6DoF kinematics with constant Acceleration assumption
-  template <> template <> State
-  State::derivative<>() const {
-    UKF::Quaternion omega_q;
-    omega_q.vec() = get_field<Omega>() * 0.5;
-    omega_q.w() = 0;
-    State output;
-    output.set_field<Position>(get_field<Velocity>());
-    output.set_field<Velocity>(get_field<Attitude>() * get_field<Acceleration>());
-    output.set_field<Acceleration>(UKF::Vector<3>(0, 0, 0));
-    output.set_field<Attitude>(omega_q * get_field<Attitude>());
-    output.set_field<Omega>(get_field<Alpha>());
-    output.set_field<Alpha>(UKF::Vector<3>(0, 0, 0));
-    return output;
-  }
+// CALLBACKS
 
-  // See http://www.mdpi.com/1424-8220/11/7/6771/htm
-  template <> template <> UKF::Vector<3>
-  Observation::expected_measurement<State, Accelerometer, Error, Context>(
-    State const& state, Error const& error, Context const& context) {
-    Eigen::Affine3d iTb = tTi_[context.tracker].inverse()    // light -> imu
-                        * tTh_[context.tracker]              // head -> light
-                        * bTh_[context.tracker].inverse();   // body -> head
-    Eigen::Vector3d r = iTb.translation();
-    Eigen::Vector3d w = state.get_field<Omega>();
-    return error.get_field<AccelerometerScale>().cwiseInverse().cwiseProduct(
-        iTb.linear() * state.get_field<Acceleration>()
-      + iTb.linear() * w.cross(w.cross(r))
-      + iTb.linear() * (state.get_field<Attitude>().conjugate() * gravity_)
-      - error.get_field<AccelerometerBias>());
+// Map a driver id to another id, only looking it up in a new epoch
+int Resolve(std::vector<Resolved> & ids, uint8_t id, uint64_t epoch,
+  std::function<int(uint8_t)> lookup) {
+  Resolved & resolved = ids[id];
+  if (resolved.epoch != epoch) {
+    resolved.epoch = epoch;
+    resolved.id = lookup(id);
   }
+  return resolved.id;
+}
 
-  // See http://www.mdpi.com/1424-8220/11/7/6771/htm
-  template <> template <> UKF::Vector<3>
-  Observation::expected_measurement<State, Gyroscope, Error, Context>(
-    State const& state, Error const& error, Context const& context) {
-    Eigen::Affine3d iTb = tTi_[context.tracker].inverse()    // light -> imu
-                        * tTh_[context.tracker]              // head -> light
-                        * bTh_[context.tracker].inverse();   // body -> head
-    return error.get_field<GyroscopeScale>().cwiseInverse().cwiseProduct(
-        iTb.linear() * state.get_field<Omega>()
-      - error.get_field<GyroscopeBias>());
-  }
+// Find the body of a tracker from its driver id, or -1 if it has none
+int BodyId(uint8_t id) {
+  return Resolve(driver_bodies_, id, epoch_, [](uint8_t i) {
+    std::map<std::string, int>::const_iterator it =
+      body_ids_.find(tracker_serials_[i]);
+    return (it == body_ids_.end() ? -1 : it->second);
+  });
+}
 
-  // Lighthouse angle prediction
-  template <> template <> real_t
-  Observation::expected_measurement<State, Angle, Error, Context>(
-    State const& state, Error const& error, Context const& context) {
-    Eigen::Affine3d wTb;
-    wTb.translation() = state.get_field<Position>();
-    wTb.linear() = state.get_field<Attitude>().toRotationMatrix();
-    UKF::Vector<3> x = wTv_.inverse()                      // world -> vive
-                     * vTl_[context.lighthouse].inverse()  // vive -> lh
-                     * wTb                                 // body -> world
-                     * bTh_[context.tracker]               // head -> body
-                     * tTh_[context.tracker].inverse()     // tracker -> head
-                     * context.sensor;
-    double xyz[3], ang[2];
-    xyz[0] = x[0];
-    xyz[1] = x[1];
-    xyz[2] = x[2];
-    Predict(lighthouses_[context.lighthouse].params, xyz, ang, correct_);
-    return ang[context.axis];
+// Record the serial of the device with a driver id. If the id has moved to
+// another device, a new epoch starts, and every body forgets the engine id
+// it resolved for it.
+void LearnDriverId(bool tracker, uint8_t id, std::string const& serial) {
+  std::vector<std::string> & serials =
+    (tracker ? tracker_serials_ : lighthouse_serials_);
+  if (serials[id] == serial)
+    return;
+  serials[id] = serial;
+  if (tracker)
+    tracker_drivers_[serial] = id;
+  epoch_++;
+  for (size_t b = 0; b < bodies_.size(); b++) {
+    Body & body = *bodies_[b];
+    pool_->Post(b, [&body, tracker, id, serial]() {
+      if (tracker) {
+        body.tracker_serials[id] = serial;
+        body.tracker_ids[id] = Resolved();
+      } else {
+        body.lighthouse_serials[id] = serial;
+        body.lighthouse_ids[id] = Resolved();
+      }
+    });
   }
+}
 
-  // ERROR FILTER
-
-  template <> template <> Error
-  Error::derivative<>() const {
-    return Error::Zero();
-  }
+// Publish the pose predicted for the current time, if there is one
+void PublishPrediction(Body & body) {
+  if (!body.pub_prediction)
+    return;
+  ros::Time now = ros::Time::now();
+  Pose pose;
+  if (!body.engine->Predict(now.toSec(), pose))
+    return;
+  deepdive_ros::Prediction msg;
+  msg.header.stamp = now;
+  msg.header.frame_id = frame_world_;
+  msg.horizon = pose.horizon;
+  msg.pose.position.x = pose.position[0];
+  msg.pose.position.y = pose.position[1];
+  msg.pose.position.z = pose.position[2];
+  msg.pose.orientation.w = pose.attitude[0];
+  msg.pose.orientation.x = pose.attitude[1];
+  msg.pose.orientation.y = pose.attitude[2];
+  msg.pose.orientation.z = pose.attitude[3];
+  msg.twist.linear.x = pose.velocity[0];
+  msg.twist.linear.y = pose.velocity[1];
+  msg.twist.linear.z = pose.velocity[2];
+  msg.twist.angular.x = pose.omega[0];
+  msg.twist.angular.y = pose.omega[1];
+  msg.twist.angular.z = pose.omega[2];
+  body.pub_prediction.publish(msg);
+}
 
-  template <> template <> UKF::Vector<3>
-  Observation::expected_measurement<Error, Accelerometer, State, Context>(
-    Error const& errors, State const& state, Context const& context) {
-    return expected_measurement<State, Accelerometer, Error, Context>(
-      state, errors, context);
-  }
+// Give a sweep to the engine of a body, on its strand
+void BodyLight(Body & body, Sweep & sweep, uint8_t tracker_id,
+  uint8_t lighthouse_id) {
+  TrackingEngine & engine = *body.engine;
+  sweep.tracker = Resolve(body.tracker_ids, tracker_id, engine.Epoch(),
+    [&body](uint8_t i) {
+      return body.engine->TrackerId(body.tracker_serials[i]);
+    });
+  sweep.lighthouse = Resolve(body.lighthouse_ids, lighthouse_id,
+    engine.Epoch(), [&body](uint8_t i) {
+      return body.engine->LighthouseId(body.lighthouse_serials[i]);
+    });
+  engine.Light(sweep);
+}
 
-  template <> template <> UKF::Vector<3>
-  Observation::expected_measurement<Error, Gyroscope, State, Context>(
-    Error const& errors, State const& state, Context const& context) {
-    return expected_measurement<State, Gyroscope, Error, Context>(
-      state, errors, context);
-  }
+// Give an IMU sample to the engine of a body, on its strand
+void BodyImu(Body & body, Inertial & inertial, uint8_t tracker_id) {
+  TrackingEngine & engine = *body.engine;
+  inertial.tracker = Resolve(body.tracker_ids, tracker_id, engine.Epoch(),
+    [&body](uint8_t i) {
+      return body.engine->TrackerId(body.tracker_serials[i]);
+    });
+  engine.Imu(inertial);
+}
 
-  template <> template <> real_t
-  Observation::expected_measurement<Error, Angle, State, Context>(
-    Error const& errors, State const& state, Context const& context) {
-    return expected_measurement<State, Angle, Error, Context>(
-      state, errors, context);
+// Give everything waiting in the intake of a body to its engine, on its
+// strand. The longer the body has fallen behind, the more is shed here.
+void BodyTake(Body & body) {
+  body.intake->Take(ros::Time::now().toSec(), body.batch);
+  std::deque<Measurement>::iterator it;
+  for (it = body.batch.begin(); it != body.batch.end(); it++) {
+    if (it->light)
+      BodyLight(body, it->sweep, it->tracker, it->lighthouse);
+    else
+      BodyImu(body, it->inertial, it->tracker);
   }
+  if (prediction_rate_ <= 0 && !body.batch.empty())
+    PublishPrediction(body);
 }
 
-// UTILITY FUNCTIONS
-
-bool Delta(double & dt) {
-  static ros::Time last = ros::Time::now(), now;
-  now = ros::Time::now();
-  dt = (now - last).toSec();
-  if (dt > 0)
-    last = now;
-  return (dt > 0 && dt < 1.0);
+// Queue a measurement for a body, and wake its strand if it was idle
+void BodyPush(int b, Measurement && measurement) {
+  Body & body = *bodies_[b];
+  if (!body.intake->Push(std::move(measurement)))
+    return;
+  if (pool_->Threads() == 0)
+    BodyTake(body);
+  else
+    pool_->Post(b, [&body]() { BodyTake(body); });
 }
 
-// CALLBACKS
-
 // This will be called at approximately 120Hz
 // - Single lighthouse in 'A' mode : 120Hz (60Hz per axis)
 // - Dual lighthouses in b/A or b/c modes : 120Hz (30Hz per axis)
-void LightCallback(deepdive_ros::Light::ConstPtr const& msg) {
-  static double dt;
-  if (!use_light_ || !initialized_ || !Delta(dt))
-    return;
-
-  // Check that we are recording and that the tracker/lighthouse is ready
-  TrackerMap::iterator tracker = trackers_.find(msg->header.frame_id);
-  if (tracker == trackers_.end() || !tracker->second.ready) {
-    ROS_INFO_STREAM_THROTTLE(1, "Tracker not found or ready");
-    return;
-  }
-
-  // Check that we are recording and that the tracker/lighthouse is ready
-  LighthouseMap::iterator lighthouse = lighthouses_.find(msg->lighthouse);
-  if (lighthouse == lighthouses_.end() || !lighthouse->second.ready) {
-    ROS_INFO_STREAM_THROTTLE(1, "Lighthouse not found or ready");
-    return;
-  }
-
-  // Make sure we have a filter setup for this
-  ErrorMap::iterator error = errors_.find(msg->header.frame_id);
-  if (error == errors_.end()) {
-    ROS_INFO_STREAM_THROTTLE(1, "Tracker error filter not initialized");
-    return;
-  }
-
-  // Clean up the measurments
-  std::vector<deepdive_ros::Pulse> data;
-  for (size_t i = 0; i < msg->pulses.size(); i++) {
-    // Basic sanity checks on the data
-    if (fabs(msg->pulses[i].angle) > thresh_angle_ / 57.2958) {
-      ROS_INFO_STREAM_THROTTLE(1.0, "Rejected based on angle");
-      continue;
-    }
-    if (fabs(msg->pulses[i].duration) < thresh_duration_ / 1e6) {
-      ROS_INFO_STREAM_THROTTLE(1.0, "Rejected based on duration");
-      continue;
-    }
-    if (msg->pulses[i].sensor >= NUM_SENSORS) {
-      ROS_INFO_STREAM_THROTTLE(1.0, "Rejected based on invalid sensor id");
-      continue;
-    }
-    data.push_back(msg->pulses[i]);
-  }
-  if (thresh_count_ > 0 && data.size() < thresh_count_) {
-    ROS_INFO_STREAM_THROTTLE(1, "Not enough data so skipping bundle.");
+void LightCallback(deepdive_ros::Light const& msg) {
+  // Keep track of the transport latency, to compare process layouts
+  latency_.Feed((ros::Time::now() - msg.header.stamp).toSec());
+  ROS_INFO_STREAM_THROTTLE(10, "Light latency: " << latency_.Mean() * 1e6
+    << " +/- " << latency_.Deviation() * 1e6 << " us");
+  // Route the sweep to the body that owns the tracker
+  int b = BodyId(msg.tracker_id);
+  if (b < 0)
     return;
+  Measurement measurement;
+  measurement.light = true;
+  measurement.tracker = msg.tracker_id;
+  measurement.lighthouse = msg.lighthouse_id;
+  Sweep & sweep = measurement.sweep;
+  sweep.time = msg.header.stamp.toSec();
+  sweep.axis = msg.axis;
+  sweep.pulses.resize(msg.pulses.size());
+  for (size_t i = 0; i < msg.pulses.size(); i++) {
+    sweep.pulses[i].sensor = msg.pulses[i].sensor;
+    sweep.pulses[i].angle = msg.pulses[i].angle;
+    sweep.pulses[i].duration = msg.pulses[i].duration;
   }
-
-  // Set the context correctly
-  Context context;
-  context.tracker = msg->header.frame_id;
-  context.lighthouse = msg->lighthouse;
-  context.axis = msg->axis;
-
-  // Correct the error filter
-  error->second.a_priori_step(dt);
-  for (size_t i = 0; i < data.size(); i++) {
-    // Set the context correctly
-    context.sensor[0] = tracker->second.sensors[6 * data[i].sensor + 0];
-    context.sensor[1] = tracker->second.sensors[6 * data[i].sensor + 1];
-    context.sensor[2] = tracker->second.sensors[6 * data[i].sensor + 2];
-    // Create the observation
-    Observation obs;
-    obs.set_field<Angle>(data[i].angle);
-    error->second.innovation_step(obs, filter_.state, context);
-  }
-  error->second.a_posteriori_step();
-
-  // Correct the tracking filter
-  filter_.a_priori_step(dt);
-  for (size_t i = 0; i < data.size(); i++) {
-    // Set the context correctly
-    context.sensor[0] = tracker->second.sensors[6 * data[i].sensor + 0];
-    context.sensor[1] = tracker->second.sensors[6 * data[i].sensor + 1];
-    context.sensor[2] = tracker->second.sensors[6 * data[i].sensor + 2];
-    // Create the observation
-    Observation obs;
-    obs.set_field<Angle>(data[i].angle);
-    filter_.innovation_step(obs, error->second.state, context);
-  }
-  filter_.a_posteriori_step();
+  BodyPush(b, std::move(measurement));
 }
+
 // This will be called at approximately 250Hz
 void ImuCallback(sensor_msgs::Imu::ConstPtr const& msg) {
-  static double dt;
-  if ((!use_accelerometer_ && !use_gyroscope_) || !initialized_ || !Delta(dt))
+  // The IMU messages carry no driver id, so it is found from the serial
+  std::map<std::string, uint8_t>::const_iterator it =
+    tracker_drivers_.find(msg->header.frame_id);
+  if (it == tracker_drivers_.end())
     return;
-
-  // Check that we are recording and that the tracker/lighthouse is ready
-  TrackerMap::iterator tracker = trackers_.find(msg->header.frame_id);
-  if (tracker == trackers_.end() || !tracker->second.ready) {
-    ROS_INFO_STREAM_THROTTLE(1, "Tracker not found or ready");
+  int b = BodyId(it->second);
+  if (b < 0)
     return;
-  }
+  Measurement measurement;
+  measurement.light = false;
+  measurement.tracker = it->second;
+  Inertial & inertial = measurement.inertial;
+  inertial.time = msg->header.stamp.toSec();
+  inertial.acc[0] = msg->linear_acceleration.x;
+  inertial.acc[1] = msg->linear_acceleration.y;
+  inertial.acc[2] = msg->linear_acceleration.z;
+  inertial.gyr[0] = msg->angular_velocity.x;
+  inertial.gyr[1] = msg->angular_velocity.y;
+  inertial.gyr[2] = msg->angular_velocity.z;
+  BodyPush(b, std::move(measurement));
+}
 
-  // Make sure we have a filter setup for this
-  ErrorMap::iterator error = errors_.find(msg->header.frame_id);
-  if (error == errors_.end()) {
-    ROS_INFO_STREAM_THROTTLE(1, "Tracker error filter not initialized");
-    return;
+// This will be called back at the prediction rate
+void PredictionCallback(ros::TimerEvent const& info) {
+  for (size_t b = 0; b < bodies_.size(); b++) {
+    Body & body = *bodies_[b];
+    pool_->Post(b, [&body]() { PublishPrediction(body); });
   }
-
-  // Get the measurements
-  Eigen::Vector3d acc(
-    msg->linear_acceleration.x,
-    msg->linear_acceleration.y,
-    msg->linear_acceleration.z);
-  Eigen::Vector3d gyr(
-    msg->angular_velocity.x,
-    msg->angular_velocity.y,
-    msg->angular_velocity.z);
-
-  // Set the context correctly
-  Context context;
-  context.tracker = msg->header.frame_id;
-
-  // Create a measurement
-  Observation obs;
-  if (use_accelerometer_)
-    obs.set_field<Accelerometer>(acc);
-  if (use_gyroscope_)
-    obs.set_field<Gyroscope>(gyr);
-
-  // Step the parameter filter
-  error->second.a_priori_step(dt);
-  error->second.innovation_step(obs, filter_.state, context);
-  error->second.a_posteriori_step(); 
-
-  // Propagate the filter
-  filter_.a_priori_step(dt);
-  filter_.innovation_step(obs, error->second.state, context);
-  filter_.a_posteriori_step();
 }
 
-// This will be called back at the desired tracking rate
-void TimerCallback(ros::TimerEvent const& info) {
-  static double dt;
-  if (!initialized_ || !Delta(dt))
+// Publish the solution of a body at a time, on its strand
+void BodySolution(Body & body, ros::Time const& now) {
+  // The filter relates WORLD and IMU frames
+  Pose pose;
+  if (!body.engine->Solution(now.toSec(), pose))
     return;
 
-  // Propagate the filter forward
-  filter_.a_priori_step(dt);
-
-  // Debug
-  /*
-  ErrorMap::iterator it;
-  for (it = errors_.begin(); it != errors_.end(); it++) {
-    ROS_INFO_STREAM(it->first << ":");
-    ROS_INFO_STREAM(it->second.state);
+  // Report on measurements that did not make it into the filter, for each
+  // body in turn, which a throttled log call would not do
+  EngineStats const& stats = body.engine->Stats();
+  if ((now - body.logged).toSec() >= 10.0) {
+    body.logged = now;
+    ROS_INFO_STREAM((body.name.empty() ? "" : body.name + ": ")
+      << "Used " << stats.sweeps << " sweeps and "
+      << stats.inertials << " IMU samples. Skipped " << stats.rejected
+      << " pulses, " << stats.too_few << " small sweeps, " << stats.unknown
+      << " unknown, " << stats.out_of_order << " out of order and "
+      << stats.late << " late measurements. Reordered " << stats.reordered
+      << " measurements and solved the pose from light " << stats.bootstraps
+      << " times.");
+    IntakeStats intake = body.intake->Stats();
+    ROS_INFO_STREAM((body.name.empty() ? "" : body.name + ": ")
+      << "Intake holds " << intake.depth << " measurements (at most "
+      << intake.peak << "). Shed " << intake.stale << " stale, "
+      << intake.superseded << " superseded and " << intake.overflow
+      << " overflowing measurements. Coalesced " << intake.coalesced
+      << " IMU samples.");
   }
-  ROS_INFO_STREAM(filter_.state);
-  ROS_INFO_STREAM("Filter:");
-  ROS_INFO_STREAM(filter_.state);
-  */
 
-  // The filter relates WORLD and IMU frames
-  ros::Time now = ros::Time::now();
+  // Save the state, so that a restart does not have to learn it again
+  if (!body.checkpoint.empty()
+    && (now - body.saved).toSec() >= checkpoint_period_) {
+    body.saved = now;
+    Checkpoint checkpoint;
+    if (body.engine->GetCheckpoint(checkpoint)
+      && !WriteCheckpoint(body.checkpoint, checkpoint))
+      ROS_WARN_STREAM("Could not save the filter state to "
+        << body.checkpoint);
+  }
 
   // Broadcast the tracker pose on TF2
-  static tf2_ros::TransformBroadcaster br;
   geometry_msgs::TransformStamped tfs;
   tfs.header.stamp = now;
   tfs.header.frame_id = frame_world_;
-  tfs.child_frame_id = frame_truth_;
-  tfs.transform.translation.x = filter_.state.get_field<Position>()[0];
-  tfs.transform.translation.y = filter_.state.get_field<Position>()[1];
-  tfs.transform.translation.z = filter_.state.get_field<Position>()[2];
-  tfs.transform.rotation.w = filter_.state.get_field<Attitude>().w();
-  tfs.transform.rotation.x = filter_.state.get_field<Attitude>().x();
-  tfs.transform.rotation.y = filter_.state.get_field<Attitude>().y();
-  tfs.transform.rotation.z = filter_.state.get_field<Attitude>().z();
+  tfs.child_frame_id = body.frame;
+  tfs.transform.translation.x = pose.position[0];
+  tfs.transform.translation.y = pose.position[1];
+  tfs.transform.translation.z = pose.position[2];
+  tfs.transform.rotation.w = pose.attitude[0];
+  tfs.transform.rotation.x = pose.attitude[1];
+  tfs.transform.rotation.y = pose.attitude[2];
+  tfs.transform.rotation.z = pose.attitude[3];
   SendDynamicTransform(tfs);
 
   // Broadcast the pose with covariance
   geometry_msgs::PoseWithCovarianceStamped pwcs;
   pwcs.header.stamp = now;
   pwcs.header.frame_id = frame_world_;
-  pwcs.pose.pose.position.x = filter_.state.get_field<Position>()[0];
-  pwcs.pose.pose.position.y = filter_.state.get_field<Position>()[1];
-  pwcs.pose.pose.position.z = filter_.state.get_field<Position>()[2];
-  pwcs.pose.pose.orientation.w = filter_.state.get_field<Attitude>().w();
-  pwcs.pose.pose.orientation.x = filter_.state.get_field<Attitude>().x();
-  pwcs.pose.pose.orientation.y = filter_.state.get_field<Attitude>().y();
-  pwcs.pose.pose.orientation.z = filter_.state.get_field<Attitude>().z();
-  for (size_t i = 0; i < 6; i++)
-    for (size_t j = 0; j < 6; j++)
-      pwcs.pose.covariance[i*6 + j] = filter_.covariance(i, j);
-  pub_pose_.publish(pwcs);
-
-  // Broadcast the twist with covariance
+  pwcs.pose.pose.position.x = pose.position[0];
+  pwcs.pose.pose.position.y = pose.position[1];
+  pwcs.pose.pose.position.z = pose.position[2];
+  pwcs.pose.pose.orientation.w = pose.attitude[0];
+  pwcs.pose.pose.orientation.x = pose.attitude[1];
+  pwcs.pose.pose.orientation.y = pose.attitude[2];
+  pwcs.pose.pose.orientation.z = pose.attitude[3];
+  for (size_t i = 0; i < 36; i++)
+    pwcs.pose.covariance[i] = pose.pose_cov[i];
+  body.pub_pose.publish(pwcs);
+
+  // Broadcast the twist with covariance, where the linear part is in the
+  // world frame and the angular part in the body frame
   geometry_msgs::TwistWithCovarianceStamped twcs;
   twcs.header.stamp = now;
   twcs.header.frame_id = frame_world_;
-  twcs.twist.twist.linear.x = filter_.state.get_field<Velocity>()[0];
-  twcs.twist.twist.linear.y = filter_.state.get_field<Velocity>()[1];
-  twcs.twist.twist.linear.z = filter_.state.get_field<Velocity>()[2];
-  twcs.twist.twist.angular.x = filter_.state.get_field<Omega>()[0];
-  twcs.twist.twist.angular.y = filter_.state.get_field<Omega>()[1];
-  twcs.twist.twist.angular.z = filter_.state.get_field<Omega>()[2];
-  for (size_t i = 0; i < 6; i++)
-    for (size_t j = 0; j < 6; j++)
-      twcs.twist.covariance[i*6 + j] = filter_.covariance(6+i, 6+j);
-  pub_twist_.publish(twcs);
+  twcs.twist.twist.linear.x = pose.velocity[0];
+  twcs.twist.twist.linear.y = pose.velocity[1];
+  twcs.twist.twist.linear.z = pose.velocity[2];
+  twcs.twist.twist.angular.x = pose.omega[0];
+  twcs.twist.twist.angular.y = pose.omega[1];
+  twcs.twist.twist.angular.z = pose.omega[2];
+  for (size_t i = 0; i < 36; i++)
+    twcs.twist.covariance[i] = pose.twist_cov[i];
+  body.pub_twist.publish(twcs);
 }
 
-void CheckIfReadyToTrack() {
-  if (!initialized_) {
-    TrackerMap::const_iterator it;
-    for (it = trackers_.begin(); it != trackers_.end(); it++)
-      if (!it->second.ready) return;
-    LighthouseMap::const_iterator jt;
-    for (jt = lighthouses_.begin(); jt != lighthouses_.end(); jt++)
-      if (!jt->second.ready) return;
-    ROS_INFO_STREAM("All trackers and lighthouses found. Tracking started.");
-    initialized_ = true;
+// This will be called back at the desired tracking rate
+void TimerCallback(ros::TimerEvent const& info) {
+  ros::Time now = ros::Time::now();
+  for (size_t b = 0; b < bodies_.size(); b++) {
+    Body & body = *bodies_[b];
+    pool_->Post(b, [&body, now]() { BodySolution(body, now); });
   }
 }
 
-// Convert an angle axis to an eigen transform
-Eigen::Affine3d AngleAxisToTransform(double data[6]) {
-  Eigen::Affine3d tf = Eigen::Affine3d::Identity();
-  tf.translation() = Eigen::Vector3d(data[0], data[1], data[2]);
-  Eigen::Vector3d v(data[3], data[4], data[5]);
-  if (v.norm() > 0) {
-    Eigen::AngleAxisd aa = Eigen::AngleAxisd::Identity();
-    aa.angle() = v.norm();
-    aa.axis() = v.normalized();
-    tf.linear() = aa.toRotationMatrix();
+// Called when a new lighthouse appears, which every body sees
+void NewLighthouseCallback(LighthouseMap::iterator lighthouse) {
+  ROS_INFO_STREAM("Found lighthouse " << lighthouse->first);
+  std::string serial = lighthouse->first;
+  Lighthouse data = lighthouse->second;
+  for (size_t b = 0; b < bodies_.size(); b++) {
+    Body & body = *bodies_[b];
+    pool_->Post(b, [&body, serial, data]() {
+      body.engine->SetLighthouse(serial, data);
+    });
   }
-  return tf;
 }
 
-// Called when a new lighthouse appears
-void NewLighthouseCallback(LighthouseMap::iterator lighthouse) {
-  ROS_INFO_STREAM("Found lighthouse " << lighthouse->first);
-  // Initialize
-  vTl_[lighthouse->first] = AngleAxisToTransform(lighthouse->second.vTl);
-  // Check if we have got all info from lighthouses and trackers
-  CheckIfReadyToTrack();
+// Learn the driver ids of the lighthouses before taking their calibration
+void LighthouseIdsCallback(deepdive_ros::Lighthouses::ConstPtr const& msg) {
+  std::vector<deepdive_ros::Lighthouse>::const_iterator it;
+  for (it = msg->lighthouses.begin(); it != msg->lighthouses.end(); it++)
+    LearnDriverId(false, it->id, it->serial);
+  LighthouseCallback(msg, lighthouses_, NewLighthouseCallback);
 }
 
-// Called when a new tracker appears
+// Called when a new tracker appears, which only its body sees
 void NewTrackerCallback(TrackerMap::iterator tracker) {
   ROS_INFO_STREAM("Found tracker " << tracker->first);
-  // Initialize the error filter
-  ErrorFilter & error = errors_[tracker->first];
-  error.state.set_field<AccelerometerBias>(UKF::Vector<3>(
-    tracker->second.errors[ERROR_ACC_BIAS][0],
-    tracker->second.errors[ERROR_ACC_BIAS][1],
-    tracker->second.errors[ERROR_ACC_BIAS][2]));
-  error.state.set_field<AccelerometerScale>(UKF::Vector<3>(
-    tracker->second.errors[ERROR_ACC_SCALE][0],
-    tracker->second.errors[ERROR_ACC_SCALE][1],
-    tracker->second.errors[ERROR_ACC_SCALE][2]));
-  error.state.set_field<GyroscopeBias>(UKF::Vector<3>(
-    tracker->second.errors[ERROR_GYR_BIAS][0],
-    tracker->second.errors[ERROR_GYR_BIAS][1],
-    tracker->second.errors[ERROR_GYR_BIAS][2]));
-  error.state.set_field<GyroscopeScale>(UKF::Vector<3>(
-    tracker->second.errors[ERROR_GYR_SCALE][0],
-    tracker->second.errors[ERROR_GYR_SCALE][1],
-    tracker->second.errors[ERROR_GYR_SCALE][2]));
-  error.covariance = Error::CovarianceMatrix::Zero();
-  error.covariance.diagonal() <<
-    imu_cov_ab_, imu_cov_as_, imu_cov_gb_, imu_cov_gs_;
-  error.process_noise_covariance = Error::CovarianceMatrix::Zero();
-  error.process_noise_covariance.diagonal() <<
-    imu_proc_ab_, imu_proc_as_, imu_proc_gb_, imu_proc_gs_;
-  // Global cache
-  bTh_[tracker->first] = AngleAxisToTransform(tracker->second.bTh);
-  tTh_[tracker->first] = AngleAxisToTransform(tracker->second.tTh);
-  tTi_[tracker->first] = AngleAxisToTransform(tracker->second.tTi);
-  // Check if we have got all info from lighthouses and trackers
-  CheckIfReadyToTrack();
+  std::map<std::string, int>::const_iterator it =
+    body_ids_.find(tracker->first);
+  if (it == body_ids_.end())
+    return;
+  Body & body = *bodies_[it->second];
+  std::string serial = tracker->first;
+  Tracker data = tracker->second;
+  pool_->Post(it->second, [&body, serial, data]() {
+    body.engine->SetTracker(serial, data);
+  });
 }
 
-// MAIN ENTRY POINT OF APPLICATION
-
-bool GetPairParam(ros::NodeHandle &nh,
-  std::string const& name, UKF::Vector<2> & data) {
-  std::vector<double> tmp;
-  if (!nh.getParam(name, tmp) || tmp.size() != 2)
-    return false;
-  data[0] = tmp[0];
-  data[1] = tmp[1];
-  return true;
+// Learn the driver ids of the trackers before taking their calibration
+void TrackerIdsCallback(deepdive_ros::Trackers::ConstPtr const& msg) {
+  std::vector<deepdive_ros::Tracker>::const_iterator it;
+  for (it = msg->trackers.begin(); it != msg->trackers.end(); it++)
+    LearnDriverId(true, it->id, it->serial);
+  TrackerCallback(msg, trackers_, NewTrackerCallback);
 }
 
+// INITIALIZATION
+
 bool GetVectorParam(ros::NodeHandle &nh,
-  std::string const& name, UKF::Vector<3> & data) {
+  std::string const& name, double data[3]) {
   std::vector<double> tmp;
   if (!nh.getParam(name, tmp) || tmp.size() != 3)
     return false;
@@ -592,22 +459,91 @@ bool GetVectorParam(ros::NodeHandle &nh,
   return true;
 }
 
+// Quaternions are stored as (x, y, z, w)
 bool GetQuaternionParam(ros::NodeHandle &nh,
-  std::string const& name, UKF::Quaternion & data) {
+  std::string const& name, double data[4]) {
   std::vector<double> tmp;
   if (!nh.getParam(name, tmp) || tmp.size() != 4)
     return false;
-  data.x() = tmp[0];
-  data.y() = tmp[1];
-  data.z() = tmp[2];
-  data.w() = tmp[3];
+  data[0] = tmp[0];
+  data[1] = tmp[1];
+  data[2] = tmp[2];
+  data[3] = tmp[3];
   return true;
 }
 
-int main(int argc, char **argv) {
-  // Initialize ROS and create node handle
-  ros::init(argc, argv, "deepdive_tracker");
-  ros::NodeHandle nh("~");
+// Add a body tracked by some trackers, whose frame, topics and shared
+// memory are read from the parameters under a prefix
+void AddBody(ros::NodeHandle & nh, std::string const& name,
+  std::string const& prefix, std::vector<std::string> const& serials) {
+  int id = bodies_.size();
+  bodies_.emplace_back(new Body);
+  Body & body = *bodies_.back();
+  body.name = name;
+  body.frame = (name.empty() ? frame_truth_ : name);
+  nh.param(prefix + "frame", body.frame, body.frame);
+
+  // Get the topics for data topics, where the predicted pose is optional
+  std::string topic_pose, topic_twist, topic_prediction = "";
+  if (!nh.getParam(prefix + "topics/pose", topic_pose))
+    ROS_FATAL_STREAM("Failed to get " << prefix << "topics/pose parameter.");
+  if (!nh.getParam(prefix + "topics/twist", topic_twist))
+    ROS_FATAL_STREAM("Failed to get " << prefix << "topics/twist parameter.");
+  nh.param(prefix + "topics/prediction", topic_prediction, topic_prediction);
+
+  // Create the filter, and warm start it from the last saved state
+  body.engine.reset(new TrackingEngine(config_));
+  body.intake.reset(new Intake(intake_config_));
+  nh.param(prefix + "checkpoint", body.checkpoint, body.checkpoint);
+  if (!body.checkpoint.empty()) {
+    Checkpoint checkpoint;
+    if (ReadCheckpoint(body.checkpoint, checkpoint))
+      body.engine->SetCheckpoint(checkpoint);
+    else
+      ROS_INFO_STREAM("No filter state to start from in " << body.checkpoint);
+  }
+
+  // Tell the filter what to wait for before tracking
+  body.engine->SetRegistration(registration_);
+  LighthouseMap::iterator lt;
+  for (lt = lighthouses_.begin(); lt != lighthouses_.end(); lt++)
+    body.engine->SetLighthouse(lt->first, lt->second);
+  std::vector<std::string>::const_iterator it;
+  for (it = serials.begin(); it != serials.end(); it++) {
+    if (body_ids_.find(*it) != body_ids_.end())
+      ROS_FATAL_STREAM("Tracker " << *it << " is in more than one body");
+    body_ids_[*it] = id;
+    TrackerMap::iterator tt = trackers_.find(*it);
+    if (tt != trackers_.end())
+      body.engine->SetTracker(tt->first, tt->second);
+  }
+
+  // Optionally share the state after every correction, at the filter rate
+  std::string shm = "";
+  nh.param(prefix + "shm", shm, shm);
+  if (!shm.empty()) {
+    body.writer.reset(new PoseWriter(shm));
+    if (body.writer->Ok())
+      body.engine->OnCorrection(std::bind(&PoseWriter::Write,
+        body.writer.get(), std::placeholders::_1));
+    else
+      ROS_ERROR_STREAM("Could not share the pose on " << shm);
+  }
+
+  // Publishers for the solution
+  body.pub_pose = nh.advertise<geometry_msgs::PoseWithCovarianceStamped>
+    (topic_pose, 0);
+  body.pub_twist = nh.advertise<geometry_msgs::TwistWithCovarianceStamped>
+    (topic_twist, 0);
+  if (!topic_prediction.empty())
+    body.pub_prediction = nh.advertise<deepdive_ros::Prediction>
+      (topic_prediction, 0);
+}
+
+// Set up the solver, given the node handle to read parameters from
+void Initialize(ros::NodeHandle & nh) {
+  // Send messages from the core library to rosconsole
+  deepdive::SetLogFn(RosLog);
 
   // Get the parent information
   if (!nh.getParam("calfile", calfile_))
@@ -658,11 +594,13 @@ int main(int argc, char **argv) {
   std::vector<std::string> trackers;
   if (!nh.getParam("trackers", trackers))
     ROS_FATAL("Failed to get the tracker list.");
+  std::map<std::string, std::string> serials;
   std::vector<std::string>::iterator jt;
   for (jt = trackers.begin(); jt != trackers.end(); jt++) {
     std::string serial;
     if (!nh.getParam(*jt + "/serial", serial))
       ROS_FATAL("Failed to get the tracker serial.");
+    serials[*jt] = serial;
     std::vector<double> extrinsics;
     if (!nh.getParam(*jt + "/extrinsics", extrinsics))
       ROS_FATAL("Failed to get the tracker extrinsics.");
@@ -685,23 +623,50 @@ int main(int argc, char **argv) {
     trackers_[serial].ready = false;
   }
 
-  // Get the topics for data topics
-  std::string topic_pose, topic_twist;
-  if (!nh.getParam("topics/pose", topic_pose))
-    ROS_FATAL("Failed to get topics/pose parameter.");
-  if (!nh.getParam("topics/twist", topic_twist))
-    ROS_FATAL("Failed to get topics/twist parameter.");
+  // How often to predict the pose, for bodies that publish it
+  nh.param("prediction_rate", prediction_rate_, prediction_rate_);
+
+  // How many threads update the bodies
+  nh.param("workers", workers_, workers_);
+  nh.param("checkpoint_period", checkpoint_period_, checkpoint_period_);
+
+  // How stale a measurement may get, and how many may wait, before shedding
+  nh.param("intake/budget", intake_config_.budget, intake_config_.budget);
+  int capacity = intake_config_.capacity;
+  nh.param("intake/capacity", capacity, capacity);
+  intake_config_.capacity = std::max(capacity, 0);
 
   // Get the thresholds
-  if (!nh.getParam("thresholds/angle", thresh_angle_))
+  if (!nh.getParam("thresholds/angle", config_.thresh_angle))
     ROS_FATAL("Failed to get thresholds/angle parameter.");
-  if (!nh.getParam("thresholds/duration", thresh_duration_))
+  if (!nh.getParam("thresholds/duration", config_.thresh_duration))
     ROS_FATAL("Failed to get thresholds/duration parameter.");
-  if (!nh.getParam("thresholds/count", thresh_count_))
+  if (!nh.getParam("thresholds/count", config_.thresh_count))
     ROS_FATAL("Failed to get thresholds/count parameter.");
 
+  // How long to hold measurements, so that they are fused in time order
+  nh.param("lag", config_.lag, config_.lag);
+
+  // How long to integrate IMU samples for before fusing them as one
+  nh.param("preintegration", config_.preintegration, config_.preintegration);
+
+  // When to start and restart the filter from a pose solved from light
+  nh.param("bootstrap/count", config_.bootstrap_count, config_.bootstrap_count);
+  nh.param("bootstrap/error", config_.bootstrap_error, config_.bootstrap_error);
+  nh.param("bootstrap/lost", config_.bootstrap_lost, config_.bootstrap_lost);
+
+  // Which filter to run, defaulting to the UKF
+  std::string filter = "ukf";
+  nh.param("filter", filter, filter);
+  if (filter == "eskf")
+    config_.filter = FilterType::ESKF;
+  else if (filter == "ukf")
+    config_.filter = FilterType::UKF;
+  else
+    ROS_FATAL("Unknown filter parameter, which must be ukf or eskf.");
+
   // Whether to apply light corrections
-  if (!nh.getParam("correct", correct_))
+  if (!nh.getParam("correct", config_.correct))
     ROS_FATAL("Failed to get correct parameter.");
 
   // Get the tracker update rate.
@@ -709,121 +674,77 @@ int main(int argc, char **argv) {
     ROS_FATAL("Failed to get rate parameter.");
 
   // Get the tracker update rate.
-  if (!nh.getParam("use/gyroscope", use_gyroscope_))
+  if (!nh.getParam("use/gyroscope", config_.use_gyroscope))
     ROS_FATAL("Failed to get use/gyroscope  parameter.");
-  if (!nh.getParam("use/accelerometer", use_accelerometer_))
+  if (!nh.getParam("use/accelerometer", config_.use_accelerometer))
     ROS_FATAL("Failed to get use/accelerometer  parameter.");
-  if (!nh.getParam("use/light", use_light_))
+  if (!nh.getParam("use/light", config_.use_light))
     ROS_FATAL("Failed to get use/light parameter.");
 
   // Get gravity
-  if (!GetVectorParam(nh, "gravity", gravity_))
+  if (!GetVectorParam(nh, "gravity", config_.gravity))
     ROS_FATAL("Failed to get gravity parameter.");
 
   // Tracking filter: Initial estimates
-  UKF::Vector<3> est_position(0, 0, 0);
-  if (!GetVectorParam(nh, "initial_estimate/position", est_position))
+  if (!GetVectorParam(nh, "initial_estimate/position", config_.est_position))
     ROS_FATAL("Failed to get position parameter.");
-  UKF::Quaternion est_attitude(1, 0, 0, 0);
-  if (!GetQuaternionParam(nh, "initial_estimate/attitude", est_attitude))
+  if (!GetQuaternionParam(nh, "initial_estimate/attitude", config_.est_attitude))
     ROS_FATAL("Failed to get attitude parameter.");
-  UKF::Vector<3> est_velocity(0, 0, 0);
-  if (!GetVectorParam(nh, "initial_estimate/velocity", est_velocity))
+  if (!GetVectorParam(nh, "initial_estimate/velocity", config_.est_velocity))
     ROS_FATAL("Failed to get velocity parameter.");
-  UKF::Vector<3> est_omega(0, 0, 0);
-  if (!GetVectorParam(nh, "initial_estimate/omega", est_omega))
-    ROS_FATAL("Failed to get angular_velocity parameter.");
-  UKF::Vector<3> est_acceleration(0, 0, 0);
-  if (!GetVectorParam(nh, "initial_estimate/acceleration", est_acceleration))
+  if (!GetVectorParam(nh, "initial_estimate/omega", config_.est_omega))
+    ROS_FATAL("Failed to get omega parameter.");
+  if (!GetVectorParam(nh, "initial_estimate/acceleration", config_.est_acceleration))
     ROS_FATAL("Failed to get acceleration parameter.");
-  UKF::Vector<3> est_alpha(0, 0, 0);
-  if (!GetVectorParam(nh, "initial_estimate/alpha", est_alpha))
+  if (!GetVectorParam(nh, "initial_estimate/alpha", config_.est_alpha))
     ROS_FATAL("Failed to get alpha parameter.");
 
   // Tracking filter:  Initial covariances
-  UKF::Vector<3> cov_position(0, 0, 0);
-  if (!GetVectorParam(nh, "initial_cov/position", cov_position))
+  if (!GetVectorParam(nh, "initial_cov/position", config_.cov[0]))
     ROS_FATAL("Failed to get position parameter.");
-  UKF::Vector<3> cov_attitude(0, 0, 0);
-  if (!GetVectorParam(nh, "initial_cov/attitude", cov_attitude))
+  if (!GetVectorParam(nh, "initial_cov/attitude", config_.cov[1]))
     ROS_FATAL("Failed to get attitude parameter.");
-  UKF::Vector<3> cov_velocity(0, 0, 0);
-  if (!GetVectorParam(nh, "initial_cov/velocity", cov_velocity))
+  if (!GetVectorParam(nh, "initial_cov/velocity", config_.cov[2]))
     ROS_FATAL("Failed to get velocity parameter.");
-  UKF::Vector<3> cov_omega(0, 0, 0);
-  if (!GetVectorParam(nh, "initial_cov/omega", cov_omega))
+  if (!GetVectorParam(nh, "initial_cov/omega", config_.cov[3]))
     ROS_FATAL("Failed to get omega parameter.");
-  UKF::Vector<3> cov_accel(0, 0, 0);
-  if (!GetVectorParam(nh, "initial_cov/acceleration", cov_accel))
-    ROS_FATAL("Failed to get acceleration parameter.");
-  UKF::Vector<3> cov_alpha(0, 0, 0);
-  if (!GetVectorParam(nh, "initial_cov/alpha", cov_alpha))
+  if (!GetVectorParam(nh, "initial_cov/acceleration", config_.cov[4]))
     ROS_FATAL("Failed to get acceleration parameter.");
+  if (!GetVectorParam(nh, "initial_cov/alpha", config_.cov[5]))
+    ROS_FATAL("Failed to get alpha parameter.");
 
   // Tracking filter:  Noise
-  UKF::Vector<3> noise_position(0, 0, 0);
-  if (!GetVectorParam(nh, "process_noise_cov/position", noise_position))
+  if (!GetVectorParam(nh, "process_noise_cov/position", config_.noise[0]))
     ROS_FATAL("Failed to get position parameter.");
-  UKF::Vector<3> noise_attitude(0, 0, 0);
-  if (!GetVectorParam(nh, "process_noise_cov/attitude", noise_attitude))
+  if (!GetVectorParam(nh, "process_noise_cov/attitude", config_.noise[1]))
     ROS_FATAL("Failed to get attitude parameter.");
-  UKF::Vector<3> noise_velocity(0, 0, 0);
-  if (!GetVectorParam(nh, "process_noise_cov/velocity", noise_velocity))
+  if (!GetVectorParam(nh, "process_noise_cov/velocity", config_.noise[2]))
     ROS_FATAL("Failed to get velocity parameter.");
-  UKF::Vector<3> noise_omega(0, 0, 0);
-  if (!GetVectorParam(nh, "process_noise_cov/omega", noise_omega))
+  if (!GetVectorParam(nh, "process_noise_cov/omega", config_.noise[3]))
     ROS_FATAL("Failed to get omega parameter.");
-  UKF::Vector<3> noise_accel(0, 0, 0);
-  if (!GetVectorParam(nh, "process_noise_cov/acceleration", noise_accel))
-    ROS_FATAL("Failed to get acceleration parameter.");
-  UKF::Vector<3> noise_alpha(0, 0, 0);
-  if (!GetVectorParam(nh, "process_noise_cov/alpha", noise_alpha))
+  if (!GetVectorParam(nh, "process_noise_cov/acceleration", config_.noise[4]))
     ROS_FATAL("Failed to get acceleration parameter.");
+  if (!GetVectorParam(nh, "process_noise_cov/alpha", config_.noise[5]))
+    ROS_FATAL("Failed to get alpha parameter.");
 
-  // Setup the filter
-  filter_.state.set_field<Position>(est_position);
-  filter_.state.set_field<Attitude>(est_attitude);
-  filter_.state.set_field<Velocity>(est_velocity);
-  filter_.state.set_field<Omega>(est_omega);
-  filter_.state.set_field<Acceleration>(est_acceleration);
-  filter_.state.set_field<Alpha>(est_alpha);
-  filter_.covariance = State::CovarianceMatrix::Zero();
-  filter_.covariance.diagonal() << 
-    cov_position, cov_attitude,
-    cov_velocity, cov_omega,
-    cov_accel, cov_alpha;
-  filter_.process_noise_covariance = State::CovarianceMatrix::Zero();
-  filter_.process_noise_covariance.diagonal() <<
-    noise_position, noise_attitude,
-    noise_velocity, noise_omega,
-    noise_accel, noise_alpha;
-
-  // IMU error : initial estimate
-  if (!GetVectorParam(nh, "measurement_cov/accelerometer", obs_cov_acc_))
-    ROS_FATAL("Failed to get accelerometer parameter.");
-  if (!GetVectorParam(nh, "measurement_cov/gyroscope", obs_cov_gyr_))
-    ROS_FATAL("Failed to get gyroscope parameter.");
-  if (!nh.getParam("measurement_cov/angle", obs_cov_ang_))
-    ROS_FATAL("Failed to get angle parameter.");
-
-  // IMU error : initial estimate
-  if (!GetVectorParam(nh, "imu_initial_cov/acc_bias", imu_cov_ab_))
+  // IMU error : initial covariance
+  if (!GetVectorParam(nh, "imu_initial_cov/acc_bias", config_.imu_cov[0]))
     ROS_FATAL("Failed to get acc_bias parameter.");
-  if (!GetVectorParam(nh, "imu_initial_cov/acc_scale", imu_cov_as_))
+  if (!GetVectorParam(nh, "imu_initial_cov/acc_scale", config_.imu_cov[1]))
     ROS_FATAL("Failed to get acc_scale parameter.");
-  if (!GetVectorParam(nh, "imu_initial_cov/gyr_bias", imu_cov_gb_))
+  if (!GetVectorParam(nh, "imu_initial_cov/gyr_bias", config_.imu_cov[2]))
     ROS_FATAL("Failed to get gyr_bias parameter.");
-  if (!GetVectorParam(nh, "imu_initial_cov/gyr_scale", imu_cov_gs_))
+  if (!GetVectorParam(nh, "imu_initial_cov/gyr_scale", config_.imu_cov[3]))
     ROS_FATAL("Failed to get gyr_scale parameter.");
 
-  // IMU error : initial estimate
-  if (!GetVectorParam(nh, "imu_process_noise_cov/acc_bias", imu_proc_ab_))
+  // IMU error : process noise
+  if (!GetVectorParam(nh, "imu_process_noise_cov/acc_bias", config_.imu_noise[0]))
     ROS_FATAL("Failed to get acc_bias parameter.");
-  if (!GetVectorParam(nh, "imu_process_noise_cov/acc_scale", imu_proc_as_))
+  if (!GetVectorParam(nh, "imu_process_noise_cov/acc_scale", config_.imu_noise[1]))
     ROS_FATAL("Failed to get acc_scale parameter.");
-  if (!GetVectorParam(nh, "imu_process_noise_cov/gyr_bias", imu_proc_gb_))
+  if (!GetVectorParam(nh, "imu_process_noise_cov/gyr_bias", config_.imu_noise[2]))
     ROS_FATAL("Failed to get gyr_bias parameter.");
-  if (!GetVectorParam(nh, "imu_process_noise_cov/gyr_scale", imu_proc_gs_))
+  if (!GetVectorParam(nh, "imu_process_noise_cov/gyr_scale", config_.imu_noise[3]))
     ROS_FATAL("Failed to get gyr_scale parameter.");
 
   // If reading the configuration file results in inserting the correct
@@ -838,33 +759,74 @@ int main(int argc, char **argv) {
   SendTransforms(frame_world_, frame_vive_, frame_body_,
     registration_, lighthouses_, trackers_);
 
-  // Convert the registration info to a world transform
-  wTv_ = AngleAxisToTransform(registration_);
+  // Without a list of bodies, all trackers make up a single body
+  std::vector<std::string> bodies;
+  if (nh.getParam("bodies", bodies)) {
+    std::vector<std::string>::iterator bt;
+    for (bt = bodies.begin(); bt != bodies.end(); bt++) {
+      std::vector<std::string> names, members;
+      if (!nh.getParam(*bt + "/trackers", names))
+        ROS_FATAL_STREAM("Failed to get the tracker list of " << *bt);
+      for (jt = names.begin(); jt != names.end(); jt++) {
+        if (serials.find(*jt) == serials.end())
+          ROS_FATAL_STREAM("Body " << *bt << " has unknown tracker " << *jt);
+        else
+          members.push_back(serials[*jt]);
+      }
+      AddBody(nh, *bt, *bt + "/", members);
+    }
+  } else {
+    std::vector<std::string> members;
+    TrackerMap::iterator tt;
+    for (tt = trackers_.begin(); tt != trackers_.end(); tt++)
+      members.push_back(tt->first);
+    AddBody(nh, "", "", members);
+  }
 
-  // Markers showing sensor positions
-  pub_pose_ = nh.advertise<geometry_msgs::PoseWithCovarianceStamped>
-    (topic_pose, 0);
-  pub_twist_ = nh.advertise<geometry_msgs::TwistWithCovarianceStamped>
-    (topic_twist, 0);
+  // A single body is updated in the ROS callbacks, to save a context switch
+  size_t workers = 0;
+  if (bodies_.size() > 1)
+    workers = std::thread::hardware_concurrency();
+  if (workers_ >= 0)
+    workers = workers_;
+  pool_.reset(new WorkerPool(std::min(workers, bodies_.size()),
+    bodies_.size()));
+  ROS_INFO_STREAM("Tracking " << bodies_.size() << " bodies on "
+    << pool_->Threads() << " worker threads");
 
   // Subscribe to the motion and light callbacks
-  std::vector<ros::Subscriber> subs;
-  subs.push_back(nh.subscribe<deepdive_ros::Trackers>("/trackers", 1000,
-    std::bind(TrackerCallback, std::placeholders::_1,
-      std::ref(trackers_), NewTrackerCallback)));
-  subs.push_back(nh.subscribe<deepdive_ros::Lighthouses>("/lighthouses", 1000,
-    std::bind(LighthouseCallback, std::placeholders::_1,
-      std::ref(lighthouses_), NewLighthouseCallback)));
-  subs.push_back(nh.subscribe("/light", 1000, LightCallback));
-  subs.push_back(nh.subscribe("/imu", 1000, ImuCallback));
+  subs_.push_back(nh.subscribe("/trackers", 1000, TrackerIdsCallback));
+  subs_.push_back(nh.subscribe("/lighthouses", 1000, LighthouseIdsCallback));
+  // Light is read from only one topic, as the bridge may publish it on both
+  bool legacy = false;
+  nh.param("legacy", legacy, legacy);
+  if (legacy)
+    subs_.push_back(nh.subscribe("/light", 1000, LightCallback));
+  else
+    subs_.push_back(nh.subscribe<deepdive_ros::LightBatch>("/light_batch",
+      1000, std::bind(LightBatchCallback, std::placeholders::_1,
+        LightCallback)));
+  subs_.push_back(nh.subscribe("/imu", 1000, ImuCallback));
 
   // Start a timer to callback
-  ros::Timer timer = nh.createTimer(
+  timer_ = nh.createTimer(
     ros::Duration(ros::Rate(rate_)), TimerCallback, false, true);
+  if (prediction_rate_ > 0)
+    prediction_timer_ = nh.createTimer(ros::Duration(
+      ros::Rate(prediction_rate_)), PredictionCallback, false, true);
+}
 
-  // Block until safe shutdown
-  ros::spin();
+// NODELET
 
-  // Success!
-  return 0;
-}
+namespace deepdive {
+
+class TrackNodelet : public nodelet::Nodelet {
+ private:
+  void onInit() {
+    Initialize(getPrivateNodeHandle());
+  }
+};
+
+}  // namespace deepdive
+
+PLUGINLIB_EXPORT_CLASS(deepdive::TrackNodelet, nodelet::Nodelet)
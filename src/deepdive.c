@@ -34,10 +34,21 @@
 #include <deepdive.h>
 
 // Interface implementations
-#include "deepdive_usb.h"
+#include "deepdive_transport.h"
+#include "deepdive_log.h"
+#include "deepdive_shm.h"
+#include "deepdive_snapshot.h"
 
 // Initialize the driver
 struct Driver * deepdive_init() {
+  return deepdive_init_transport(TRANSPORT_USB, NULL);
+}
+
+// Initialize the driver with the given transport
+struct Driver * deepdive_init_transport(TransportType type, const char * arg) {
+  const struct Transport * transport = deepdive_transport(type);
+  if (transport == NULL)
+    return NULL;
   // Create a new driver context
   struct Driver *drv = malloc(sizeof(struct Driver));
   if (drv == NULL)
@@ -53,9 +64,28 @@ struct Driver * deepdive_init() {
   drv->general.pulse_max_for_sweep    = 1800UL;
   drv->general.pulse_synctime_offset  = 20000UL;
   drv->general.pulse_synctime_slack   = 5000UL;
+  // Lighthouses live in the driver, so they can point back to it up front
+  for (size_t i = 0; i < MAX_NUM_LIGHTHOUSES; i++)
+    drv->lighthouses[i].driver = drv;
+  // Start the logger before anything that might need it
+  if (deepdive_log_init(drv) == 0) {
+    free(drv);
+    return NULL;
+  }
   // Initialize tracker
-  if (deepdive_usb_init(drv) == 0) {
-    printf("No devices found\n");
+  drv->transport = transport;
+  if (transport->init(drv, arg) == 0) {
+    LOG_ERROR(drv, NULL, "No devices found");
+    transport->close(drv);
+    deepdive_log_close(drv);
+    free(drv);
+    return NULL;
+  }
+  // Latest state per tracker, allocated now so that polling never allocates
+  if (deepdive_snapshot_init(drv) == 0) {
+    LOG_ERROR(drv, NULL, "Could not allocate snapshots");
+    transport->close(drv);
+    deepdive_log_close(drv);
     free(drv);
     return NULL;
   }
@@ -94,6 +124,24 @@ void deepdive_install_lighthouse_fn(struct Driver * drv, lighthouse_func fbp) {
   if (fbp) drv->lighthouse_fn = fbp;
 }
 
+// Attach user data to the driver
+void deepdive_install_user(struct Driver * drv, void * user) {
+  if (drv == NULL) return;
+  drv->user = user;
+}
+
+// Get the user data attached to the driver
+void * deepdive_user(struct Driver * drv) {
+  if (drv == NULL) return NULL;
+  return drv->user;
+}
+
+// Register a log sink
+void deepdive_install_log_fn(struct Driver * drv, log_func fbp) {
+  if (drv == NULL) return;
+  if (fbp) drv->log_fn = fbp;
+}
+
 // GETTERS
 
 // Get the general configuration data
@@ -122,6 +170,19 @@ struct Tracker * deepdive_tracker(struct Driver * drv, const char* id) {
   return NULL;
 }
 
+// Get the lighthouse with the given id
+struct Lighthouse * deepdive_lighthouse_id(struct Driver * drv, uint8_t id) {
+  if (!drv || id >= MAX_NUM_LIGHTHOUSES) return NULL;
+  if (drv->lighthouses[id].serial[0] == '\0') return NULL;
+  return &drv->lighthouses[id];
+}
+
+// Get the tracker with the given id
+struct Tracker * deepdive_tracker_id(struct Driver * drv, uint8_t id) {
+  if (!drv || id >= drv->num_trackers) return NULL;
+  return drv->trackers[id];
+}
+
 // Poll the driver for events
 int deepdive_poll(struct Driver * drv) {
   if (drv == NULL) return -1;
@@ -132,17 +193,16 @@ int deepdive_poll(struct Driver * drv) {
         drv->tracker_fn(drv->trackers[i]);
     drv->pushed = 1;
   }
-  // Handle any USB events
-  return libusb_handle_events(drv->usb);
+  // Handle any device events
+  return drv->transport->poll(drv);
 }
 
 // Close the driver and clean up memory
 void deepdive_close(struct Driver * drv) {
   if (drv == NULL) return;
-  for (size_t i = 0; i < drv->num_trackers; i++) {
-    libusb_close(drv->trackers[i]->udev);
-    free(drv->trackers[i]);
-  }
-  libusb_exit(drv->usb);
+  drv->transport->close(drv);
+  deepdive_shm_close(drv);
+  deepdive_snapshot_close(drv);
+  deepdive_log_close(drv);
   free(drv);
 }
@@ -67,6 +67,24 @@
 // Forward declaration of driver context
 struct Driver;
 struct Tracker;
+struct Log;
+struct Shm;
+struct Transport;
+
+// Log levels
+typedef enum {
+  LEVEL_DEBUG       = 0,
+  LEVEL_INFO        = 1,
+  LEVEL_WARN        = 2,
+  LEVEL_ERROR       = 3
+} LogLevel;
+
+// How the driver talks to the devices
+typedef enum {
+  TRANSPORT_USB     = 0,    // libusb, claiming every interface
+  TRANSPORT_HIDRAW  = 1,    // Linux hidraw nodes, leaving the kernel driver
+  TRANSPORT_REPLAY  = 2     // Packets read from a deepdive_sim file
+} TransportType;
 
 // Extrinsics axes
 typedef enum {
@@ -90,7 +108,8 @@ typedef enum {
 struct Endpoint {
   struct Tracker *tracker;
   CallbackType type;
-  struct libusb_transfer *tx;
+  struct libusb_transfer *tx;               // Transfer (libusb)
+  int fd;                                   // Device node (hidraw)
   uint8_t buffer[USB_INT_BUFF_LENGTH];
 };
 
@@ -153,6 +172,7 @@ typedef struct {
 
 // Information about a tracked device
 struct Tracker {
+  uint8_t id;                               // Index in the driver's list
   uint16_t type;                            // Tracker type
   struct Driver * driver;                   // Parent driver
   struct libusb_device_handle * udev;       // Udev handle
@@ -197,7 +217,9 @@ struct Motor {
 // Lighthouse information
 struct Lighthouse {
   uint32_t timestamp;                   // Time of last update (0 = invalud)
-  uint8_t id;                           // ID of this lighthouse
+  uint8_t id;                           // Index in the driver's list
+  struct Driver * driver;               // Parent driver
+  uint32_t uid;                         // Serial number sent over OOTX
   uint16_t fw_version;                  // Firmware version
   char serial[MAX_SERIAL_LENGTH];       // Unique serial number
   struct Motor motors[MAX_NUM_MOTORS];  // Motor calibration data
@@ -230,9 +252,39 @@ typedef void (*but_func)(struct Tracker * tracker,
   uint32_t mask, uint16_t trigger, int16_t horizontal, int16_t vertical);
 typedef void (*tracker_func)(struct Tracker * tracker);
 typedef void (*lighthouse_func)(struct Lighthouse * lighthouse);
+typedef void (*log_func)(uint8_t level, const char * msg);
+
+// Latest sweep of one lighthouse axis seen by a tracker
+struct SnapshotSweep {
+  uint32_t synctime;                    // Sync pulse time (0 = none yet)
+  uint16_t num_sensors;                 // Number of detections
+  uint16_t sensors[MAX_NUM_SENSORS];    // Sensor channels
+  uint32_t angles[MAX_NUM_SENSORS];     // Angles in ticks
+  uint16_t lengths[MAX_NUM_SENSORS];    // Pulse lengths in ticks
+};
+
+// Most recent state of a tracker
+struct Snapshot {
+  uint64_t seq;                         // Number of updates (0 = none yet)
+  uint8_t id;                           // Tracker id
+  uint32_t timecode;                    // Timecode of the last IMU sample
+  int16_t acc[3];                       // Last accelerometer sample
+  int16_t gyr[3];                       // Last gyroscope sample
+  int16_t mag[3];                       // Last magnetometer sample
+  struct SnapshotSweep sweeps[MAX_NUM_LIGHTHOUSES][MAX_NUM_MOTORS];
+  uint32_t buttons;                     // Button mask
+  uint16_t trigger;                     // Trigger value
+  int16_t horizontal;                   // Pad horizontal position
+  int16_t vertical;                     // Pad vertical position
+  uint8_t charge;                       // Battery charge
+  uint8_t ischarging;                   // Charging?
+  uint8_t ison;                         // Turned on?
+};
 
 // Driver context
 struct Driver {
+  const struct Transport * transport;  // Device access
+  void * transport_data;         // Transport-specific state
   struct libusb_context* usb;
   uint16_t num_trackers;
   struct Tracker *trackers[MAX_NUM_TRACKERS];
@@ -244,11 +296,20 @@ struct Driver {
   struct Lighthouse lighthouses[MAX_NUM_LIGHTHOUSES];
   struct General general;        // General configuration
   uint8_t pushed;                // Have we pushed thie tracker/general config
+  struct Log * log;              // Asynchronous log ring
+  log_func log_fn;               // Called from the log thread for each message
+  struct Shm * shm;              // Shared-memory event broadcast
+  void * user;                   // Opaque user data for the callbacks
+  struct SnapshotBuffer * snapshots; // Latest state, indexed by tracker id
 };
 
 // Initialize the driver
 struct Driver * deepdive_init();
 
+// Initialize the driver with the given transport. For TRANSPORT_REPLAY the
+// argument is the path to a packet file, otherwise it is ignored.
+struct Driver * deepdive_init_transport(TransportType type, const char * arg);
+
 // Register a light callback function
 void deepdive_install_light_fn(struct Driver * drv, lig_func fbp);
 
@@ -264,6 +325,45 @@ void deepdive_install_tracker_fn(struct Driver * drv, tracker_func fbp);
 // Register a lighthouse callback function
 void deepdive_install_lighthouse_fn(struct Driver * drv, lighthouse_func fbp);
 
+// Register a log sink (default: stderr). Called from the log thread.
+void deepdive_install_log_fn(struct Driver * drv, log_func fbp);
+
+// Attach user data to the driver. Callbacks can get back to it through the
+// driver field of the tracker or lighthouse that they are passed.
+void deepdive_install_user(struct Driver * drv, void * user);
+
+// Get the user data attached to the driver
+void * deepdive_user(struct Driver * drv);
+
+// Set the minimum log level and the maximum number of messages per second
+void deepdive_log_config(struct Driver * drv, uint8_t level, uint32_t rate);
+
+// Publish all decoded events to the named shared-memory segment, which holds
+// the given number of events (a power of two). Other processes may then read
+// the events with the client library in deepdive_shm_client.h.
+int deepdive_shm_serve(struct Driver * drv, const char * name, uint32_t slots);
+
+// Prepare the calling thread for real-time polling. All memory is locked
+// and the stack faulted in, and then the thread is optionally switched to
+// SCHED_FIFO with the given priority (0 keeps the current policy) and pinned
+// to a CPU (-1 for any). The driver allocates nothing once it has been
+// initialized, so call this after deepdive_init() and deepdive_shm_serve(),
+// from the thread that will call deepdive_poll(). Note that libusb allocates
+// inside libusb_submit_transfer(), so only the hidraw and replay transports
+// are allocation-free. Returns 0 if any step failed, usually for lack of
+// privileges, in which case the remaining steps are still applied.
+int deepdive_rt_thread(struct Driver * drv, int priority, int cpu);
+
+// Copy out the most recent state of the tracker with the given id. This may
+// be called from any thread at any rate, and never blocks the decoders. It
+// is lock-free but not wait-free: the copy is retried internally if the
+// decoders publish twice while it is being made, which a reader that is
+// descheduled or slower than the decoders may keep running into. The number
+// of retries is bounded. Returns 1 on success, 0 if there is no such
+// tracker, or -1 if the decoders kept overtaking the copy, in which case
+// the caller may simply try again later.
+int deepdive_snapshot(struct Driver * drv, uint8_t id, struct Snapshot * out);
+
 // Get the general configuration data
 struct General * deepdive_general(struct Driver * drv);
 
@@ -273,7 +373,19 @@ struct Lighthouse * deepdive_lighthouse(struct Driver * drv, const char* id);
 // Get the calibration data for a tracker with the given serial number
 struct Tracker * deepdive_tracker(struct Driver * tracker, const char* id);
 
-// Poll the driver for events
+// Trackers and lighthouses are numbered densely from zero in the order they
+// are found, and keep their id for the lifetime of the driver. The id is in
+// the id field of the structures passed to every callback, so that clients
+// can keep per-device state in arrays rather than looking up serials.
+
+// Get the lighthouse with the given id, or NULL if it has not been seen
+struct Lighthouse * deepdive_lighthouse_id(struct Driver * drv, uint8_t id);
+
+// Get the tracker with the given id, or NULL if there is no such tracker
+struct Tracker * deepdive_tracker_id(struct Driver * drv, uint8_t id);
+
+// Poll the driver for events. This returns within about a tenth of a second
+// even if no device sends anything, so that the caller can do other work.
 int deepdive_poll(struct Driver * drv);
 
 // Close the driver and clean up memory
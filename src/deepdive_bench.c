@@ -0,0 +1,527 @@
+/* 
+  Unofficial driver for Vive Trackers and up to two lighthouses, with an
+    emphasis on pulling tracker and lighthouse calibration data from devices.
+  
+  Adapted from: https://github.com/cnlohr/libsurvive
+  Which was based off: https://github.com/collabora/OSVR-Vive-Libre
+    Originally Copyright 2016 Philipp Zabel
+    Originally Copyright 2016 Lubosz Sarnecki <lubosz.sarnecki@collabora.co.uk>
+    Originally Copyright (C) 2013 Fredrik Hultin
+    Originally Copyright (C) 2013 Jakob Bornecrantz
+  Using documentation from: https://github.com/nairol/LighthouseRedox
+  
+  Copyright (c) 2017 Andrew Symington
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+#include <argtable2.h>
+
+#include <deepdive.h>
+
+#include <time.h>
+#include <math.h>
+#include <errno.h>
+#include <sys/resource.h>
+
+// Decoders under test
+#include "deepdive_dev_tracker.h"
+#include "deepdive_dev_watchman.h"
+#include "deepdive_data_light.h"
+
+// Packet encoders
+#include "deepdive_sim.h"
+
+// Size of the synthetic input streams. There is one sync pulse per cycle,
+// because the OOTX decoder consumes a data bit from every sync pulse.
+#define BENCH_NUM_CYCLES      4096
+#define BENCH_NUM_SYNCS       1
+#define BENCH_NUM_SWEEPS      12
+#define BENCH_NUM_PULSES      (BENCH_NUM_CYCLES*(BENCH_NUM_SYNCS+BENCH_NUM_SWEEPS))
+#define BENCH_NUM_FLOATS      4096
+#define BENCH_OOTX_BITS       SIM_MAX_OOTX_BITS
+
+// Time between sync pulses in ticks (120Hz)
+#define BENCH_SYNC_PERIOD     400000
+
+// A benchmark case
+typedef struct {
+  const char * name;
+  void (*fn)(size_t i);
+  size_t calls;                             // Calls per pass over input
+  size_t events;                            // Events per pass over input
+} Bench;
+
+// Driver and tracker under test
+static struct Driver drv_;
+static struct Tracker tracker_;
+static uint64_t num_light_ = 0;
+
+// Synthetic inputs
+static SimPulse pulses_[BENCH_NUM_PULSES];
+static uint8_t wired_light_[BENCH_NUM_PULSES / 7 + 1][USB_INT_BUFF_LENGTH];
+static size_t num_wired_light_ = 0;
+static uint8_t wired_imu_[BENCH_NUM_CYCLES][USB_INT_BUFF_LENGTH];
+static uint8_t watchman_[BENCH_NUM_PULSES][USB_INT_BUFF_LENGTH];
+static size_t num_watchman_ = 0;
+static uint8_t floats_[BENCH_NUM_FLOATS][2];
+static uint8_t ootx_[BENCH_OOTX_BITS];
+static size_t num_ootx_ = 0;
+static size_t num_sync_ = 0;
+static size_t num_sweep_ = 0;
+static SimPulse syncs_[BENCH_NUM_PULSES];
+static SimPulse sweeps_[BENCH_NUM_PULSES];
+
+// Monotonic time in nanoseconds
+static uint64_t bench_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// Count light bundles, so the compiler can't elide any work
+static void bench_light(struct Tracker * tracker,
+  struct Lighthouse * lighthouse, uint8_t axis, uint32_t synctime,
+    uint16_t num_sensors, uint16_t *sensors, uint32_t *sweeptimes,
+      uint32_t *angles, uint16_t *lengths) {
+  num_light_ += num_sensors;
+}
+
+// Clear all decoder state, so that a new pass can start from time zero
+static void bench_reset(void) {
+  memset(&tracker_.lcd, 0, sizeof(tracker_.lcd));
+  memset(&tracker_.ootx, 0, sizeof(tracker_.ootx));
+  tracker_.timecode = 0;
+  tracker_.ootx[0].lighthouse = &drv_.lighthouses[0];
+  tracker_.ootx[1].lighthouse = &drv_.lighthouses[1];
+}
+
+// INPUT GENERATION
+
+// Build all of the synthetic streams
+static void bench_generate(void) {
+  // Lighthouse OOTX frame with a plausible payload
+  uint8_t frame[33];
+  for (size_t i = 0; i < sizeof(frame); i++)
+    frame[i] = (uint8_t)(i * 37 + 11);
+  num_ootx_ = deepdive_sim_ootx(ootx_, BENCH_OOTX_BITS, frame, sizeof(frame));
+  // Pulse train for a single lighthouse alternating between axes
+  size_t n = 0;
+  for (uint32_t c = 0; c < BENCH_NUM_CYCLES; c++) {
+    uint32_t t0 = 1000 + c * BENCH_SYNC_PERIOD;
+    uint8_t acode = (c & 1) | (ootx_[c % num_ootx_] << 1);
+    for (uint16_t s = 0; s < BENCH_NUM_SYNCS; s++) {
+      SimPulse p = {t0 + s * 3, s * 2, 3000 + 500 * acode};
+      syncs_[num_sync_++] = p;
+      pulses_[n++] = p;
+    }
+    for (uint16_t s = 0; s < BENCH_NUM_SWEEPS; s++) {
+      SimPulse p = {t0 + 50000 + s * 9000, s * 2 + (c & 1), 150 + s * 10};
+      sweeps_[num_sweep_++] = p;
+      pulses_[n++] = p;
+    }
+  }
+  // Wired light reports
+  for (size_t i = 0; i < n; i += 7) {
+    size_t k = (n - i < 7 ? n - i : 7);
+    deepdive_sim_wired_light(wired_light_[num_wired_light_++], pulses_ + i, k);
+  }
+  // Watchman packets
+  for (size_t i = 0; i < n; ) {
+    size_t k = (n - i < SIM_WATCHMAN_PULSES ? n - i : SIM_WATCHMAN_PULSES);
+    uint8_t * buf = watchman_[num_watchman_++];
+    buf[0] = 35;
+    deepdive_sim_watchman(buf + 1, USB_INT_BUFF_LENGTH - 1,
+      pulses_ + i, k, NULL, NULL, NULL);
+    i += k;
+  }
+  // Wired IMU reports with a 1ms timecode
+  for (size_t i = 0; i < BENCH_NUM_CYCLES; i++) {
+    int16_t acc[3] = {i % 100, -4096, 10}, gyr[3] = {-3, 4, (int16_t) i};
+    deepdive_sim_wired_imu(wired_imu_[i], i * 48000, acc, gyr);
+  }
+  // Half precision floats spanning normal, denormal, zero and inf/nan
+  for (size_t i = 0; i < BENCH_NUM_FLOATS; i++) {
+    uint16_t h = (uint16_t)(i * 16411u);
+    memcpy(floats_[i], &h, 2);
+  }
+}
+
+// BENCHMARKS
+
+static void run_tracker_light(size_t i) {
+  deepdive_dev_tracker_light(&tracker_, wired_light_[i], USB_INT_BUFF_LENGTH);
+}
+
+static void run_tracker_imu(size_t i) {
+  deepdive_dev_tracker_imu(&tracker_, wired_imu_[i], USB_INT_BUFF_LENGTH);
+}
+
+static void run_watchman(size_t i) {
+  deepdive_dev_watchman(&tracker_, watchman_[i], USB_INT_BUFF_LENGTH);
+}
+
+static void run_data_light(size_t i) {
+  deepdive_data_light(&tracker_,
+    pulses_[i].time, pulses_[i].sensor, pulses_[i].length);
+}
+
+static void run_data_light_sync(size_t i) {
+  deepdive_data_light(&tracker_,
+    syncs_[i].time, syncs_[i].sensor, syncs_[i].length);
+}
+
+static void run_data_light_sweep(size_t i) {
+  deepdive_data_light(&tracker_,
+    sweeps_[i].time, sweeps_[i].sensor, sweeps_[i].length);
+}
+
+static void run_ootx_feed(size_t i) {
+  ootx_feed(&tracker_, 0, ootx_[i], i);
+}
+
+static volatile float sink_;
+static void run_convert_float(size_t i) {
+  sink_ = convert_float(floats_[i]);
+}
+
+// ALLOCATION COUNTING
+
+// Defining these in the executable interposes them for the whole process,
+// including libdeepdive and libusb. Only allocations made by the polling
+// thread after it has entered real-time mode are counted. The aligned
+// allocators all go through the one that glibc exports.
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t num, size_t size);
+extern void * __libc_realloc(void * ptr, size_t size);
+extern void * __libc_memalign(size_t alignment, size_t size);
+static __thread int count_allocs_ = 0;
+static uint64_t num_allocs_ = 0;
+
+void * malloc(size_t size) {
+  if (count_allocs_)
+    num_allocs_++;
+  return __libc_malloc(size);
+}
+
+void * calloc(size_t num, size_t size) {
+  if (count_allocs_)
+    num_allocs_++;
+  return __libc_calloc(num, size);
+}
+
+void * realloc(void * ptr, size_t size) {
+  if (count_allocs_)
+    num_allocs_++;
+  return __libc_realloc(ptr, size);
+}
+
+void * memalign(size_t alignment, size_t size) {
+  if (count_allocs_)
+    num_allocs_++;
+  return __libc_memalign(alignment, size);
+}
+
+void * aligned_alloc(size_t alignment, size_t size) {
+  if (count_allocs_)
+    num_allocs_++;
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void ** ptr, size_t alignment, size_t size) {
+  if (count_allocs_)
+    num_allocs_++;
+  if (alignment % sizeof(void *) || (alignment & (alignment - 1)))
+    return EINVAL;
+  void * mem = __libc_memalign(alignment, size);
+  if (mem == NULL)
+    return ENOMEM;
+  *ptr = mem;
+  return 0;
+}
+
+// LIVE TRANSPORT
+
+// Arrival statistics for live data
+static uint64_t live_imu_ = 0;
+static uint64_t live_light_ = 0;
+static uint64_t live_last_ns_ = 0;
+static uint32_t live_last_tc_ = 0;
+static double live_sum_ = 0.0, live_sum2_ = 0.0, live_max_ = 0.0;
+static uint64_t live_count_ = 0;
+static struct Tracker * live_tracker_ = NULL;
+
+// Count pulses from the live driver
+static void live_light(struct Tracker * tracker,
+  struct Lighthouse * lighthouse, uint8_t axis, uint32_t synctime,
+    uint16_t num_sensors, uint16_t *sensors, uint32_t *sweeptimes,
+      uint32_t *angles, uint16_t *lengths) {
+  live_light_ += num_sensors;
+}
+
+// Compare the host arrival interval to the device timecode interval, which
+// captures the latency jitter added by the transport
+static void live_imu(struct Tracker * tracker, uint32_t timecode,
+  int16_t acc[3], int16_t gyr[3], int16_t mag[3]) {
+  uint64_t now = bench_now();
+  live_imu_++;
+  if (tracker != live_tracker_)
+    return;
+  if (live_last_ns_ > 0) {
+    double host = (double)(now - live_last_ns_) * 1e-3;
+    double dev = (double)(uint32_t)(timecode - live_last_tc_)
+      * 1e6 / SIM_TICKS_PER_SEC;
+    double jitter = host - dev;
+    live_sum_ += jitter;
+    live_sum2_ += jitter * jitter;
+    if (fabs(jitter) > live_max_)
+      live_max_ = fabs(jitter);
+    live_count_++;
+  }
+  live_last_ns_ = now;
+  live_last_tc_ = timecode;
+}
+
+// CPU time used by this process, in nanoseconds
+static uint64_t bench_cpu(void) {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  return (uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ULL
+    + (uint64_t)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ULL;
+}
+
+// Read from a transport for a while and report rates, CPU and IMU jitter.
+// In real-time mode, any allocation by the polling thread is a failure.
+// Returns 0 if the driver could not be initialized, -1 if the thread could
+// not be switched to real-time mode, and 1 on success.
+static int bench_live(TransportType type, const char * name, const char * arg,
+  uint64_t seconds, int json, int rt, int priority, int cpu) {
+  struct Driver * drv = deepdive_init_transport(type, arg);
+  if (!drv)
+    return 0;
+  live_tracker_ = drv->trackers[0];
+  deepdive_install_light_fn(drv, live_light);
+  deepdive_install_imu_fn(drv, live_imu);
+  if (rt) {
+    if (!deepdive_rt_thread(drv, priority, cpu)) {
+      deepdive_close(drv);
+      return -1;
+    }
+    count_allocs_ = 1;
+  }
+  uint64_t tic = bench_now(), cpu_tic = bench_cpu();
+  while (bench_now() - tic < seconds * 1000000000ULL)
+    if (deepdive_poll(drv))
+      break;
+  count_allocs_ = 0;
+  double wall = (double)(bench_now() - tic) * 1e-9;
+  double used = (double)(bench_cpu() - cpu_tic) * 1e-9;
+  deepdive_close(drv);
+  double mean = live_count_ ? live_sum_ / live_count_ : 0.0;
+  double std = live_count_ ?
+    sqrt(live_sum2_ / live_count_ - mean * mean) : 0.0;
+  if (json) {
+    printf("{\"transport\": \"%s\", \"seconds\": %.3f, "
+      "\"imu_per_sec\": %.1f, \"light_per_sec\": %.1f, "
+      "\"cpu_percent\": %.2f, \"jitter_mean_us\": %.2f, "
+      "\"jitter_std_us\": %.2f, \"jitter_max_us\": %.2f, "
+      "\"allocs\": %llu}\n",
+      name, wall, live_imu_ / wall, live_light_ / wall,
+      100.0 * used / wall, mean, std, live_max_,
+      (unsigned long long) num_allocs_);
+  } else {
+    printf("transport,seconds,imu_per_sec,light_per_sec,cpu_percent,"
+      "jitter_mean_us,jitter_std_us,jitter_max_us,allocs\n");
+    printf("%s,%.3f,%.1f,%.1f,%.2f,%.2f,%.2f,%.2f,%llu\n",
+      name, wall, live_imu_ / wall, live_light_ / wall,
+      100.0 * used / wall, mean, std, live_max_,
+      (unsigned long long) num_allocs_);
+  }
+  return 1;
+}
+
+// Run a benchmark for at least the given number of calls. Only the calls
+// are timed, and not the resets between passes.
+static void bench_run(Bench * b, uint64_t iterations,
+  uint64_t * calls, uint64_t * events, uint64_t * ns) {
+  uint64_t passes = (iterations + b->calls - 1) / b->calls;
+  bench_reset();
+  // The sweep-only case needs an active lighthouse to do any work
+  if (b->fn == run_data_light_sweep)
+    for (size_t i = 0; i < BENCH_NUM_SYNCS; i++)
+      run_data_light_sync(i);
+  *ns = 0;
+  for (uint64_t p = 0; p < passes; p++) {
+    uint64_t tic = bench_now();
+    for (size_t i = 0; i < b->calls; i++)
+      b->fn(i);
+    *ns += bench_now() - tic;
+    if (b->fn != run_data_light_sweep && b->fn != run_convert_float)
+      bench_reset();
+  }
+  *calls = passes * b->calls;
+  *events = passes * b->events;
+}
+
+// Main entry point for application
+int main(int argc, char **argv) {
+  struct arg_int  *iters  = arg_int0("n", "iterations", "<n>",
+    "minimum number of calls per benchmark (default: 1000000)");
+  struct arg_str  *filter = arg_str0("f", "filter", "<name>",
+    "only run benchmarks whose name contains this string");
+  struct arg_str  *format = arg_str0(NULL, "format", "csv|json",
+    "output format (default: csv)");
+  struct arg_str  *live   = arg_str0(NULL, "live", "usb|hidraw|replay",
+    "measure a live transport instead of the decoders");
+  struct arg_file *replay = arg_file0(NULL, "replay", "<file>",
+    "packet file for the replay transport");
+  struct arg_int  *secs   = arg_int0(NULL, "seconds", "<n>",
+    "how long to measure the live transport (default: 10)");
+  struct arg_int  *rt     = arg_int0(NULL, "rt", "<priority>",
+    "poll in real-time mode and fail on any allocation");
+  struct arg_int  *cpu    = arg_int0(NULL, "cpu", "<n>",
+    "pin the real-time polling thread to a CPU");
+  struct arg_lit  *help   = arg_lit0(NULL, "help", "print this help and exit");
+  struct arg_end  *end    = arg_end(20);
+  void* argtable[] = {iters, filter, format, live, replay, secs, rt, cpu,
+    help, end};
+  const char* progname = "deepdive_bench";
+  int nerrors, exitcode = 0;
+  if (arg_nullcheck(argtable) != 0) {
+    printf("%s: insufficient memory\n", progname);
+    exitcode = 1;
+    goto exit;
+  }
+  nerrors = arg_parse(argc, argv, argtable);
+  if (help->count > 0) {
+    printf("Usage: %s", progname);
+    arg_print_syntax(stdout, argtable, "\n");
+    printf("This program benchmarks the deepdive packet decoders.\n");
+    arg_print_glossary(stdout, argtable,"  %-25s %s\n");
+    exitcode = 0;
+    goto exit;
+  }
+  if (nerrors > 0) {
+    arg_print_errors(stdout,end,progname);
+    printf("Try '%s --help' for more information.\n", progname);
+    exitcode = 2;
+    goto exit;
+  }
+  int json = (format->count > 0 && !strcmp(format->sval[0], "json"));
+  uint64_t iterations = (iters->count > 0 ? iters->ival[0] : 1000000);
+  // Live transports need hardware, so they replace the decoder benchmarks
+  if (live->count > 0) {
+    TransportType type = TRANSPORT_USB;
+    if (!strcmp(live->sval[0], "hidraw")) {
+      type = TRANSPORT_HIDRAW;
+    } else if (!strcmp(live->sval[0], "replay")) {
+      type = TRANSPORT_REPLAY;
+    } else if (strcmp(live->sval[0], "usb")) {
+      printf("%s: unknown transport '%s'\n", progname, live->sval[0]);
+      exitcode = 2;
+      goto exit;
+    }
+    // Real-time polling must not allocate, which libusb does
+    if (cpu->count > 0 && rt->count == 0) {
+      printf("%s: --cpu needs --rt\n", progname);
+      exitcode = 2;
+      goto exit;
+    }
+    if (rt->count > 0 && type == TRANSPORT_USB) {
+      printf("%s: --rt needs the hidraw or replay transport\n", progname);
+      exitcode = 2;
+      goto exit;
+    }
+    int ret = bench_live(type, live->sval[0],
+      replay->count ? replay->filename[0] : NULL,
+      secs->count > 0 ? secs->ival[0] : 10, json,
+      rt->count, rt->count ? rt->ival[0] : 0, cpu->count ? cpu->ival[0] : -1);
+    if (ret == 0) {
+      printf("%s: could not initialize driver\n", progname);
+      exitcode = 3;
+    } else if (ret < 0) {
+      printf("%s: could not switch to real-time mode\n", progname);
+      exitcode = 7;
+    } else if (num_allocs_ > 0) {
+      printf("%s: %llu allocation(s) in real-time mode\n", progname,
+        (unsigned long long) num_allocs_);
+      exitcode = 6;
+    }
+    goto exit;
+  }
+  // Set up a driver context with a single tracker and two lighthouses
+  drv_.lig_fn = bench_light;
+  drv_.trackers[drv_.num_trackers++] = &tracker_;
+  strcpy(drv_.lighthouses[0].serial, "0");
+  strcpy(drv_.lighthouses[1].serial, "1");
+  tracker_.driver = &drv_;
+  tracker_.type = USB_PROD_TRACKER;
+  strcpy(tracker_.serial, "BENCH");
+  bench_generate();
+  // Benchmark cases, with the number of light or bit events in each call
+  Bench benches[] = {
+    {"deepdive_dev_tracker_light", run_tracker_light,
+      num_wired_light_, BENCH_NUM_PULSES},
+    {"deepdive_dev_tracker_imu", run_tracker_imu,
+      BENCH_NUM_CYCLES, BENCH_NUM_CYCLES},
+    {"deepdive_dev_watchman", run_watchman,
+      num_watchman_, BENCH_NUM_PULSES},
+    {"deepdive_data_light", run_data_light,
+      BENCH_NUM_PULSES, BENCH_NUM_PULSES},
+    {"deepdive_data_light_sync", run_data_light_sync,
+      num_sync_, num_sync_},
+    {"deepdive_data_light_sweep", run_data_light_sweep,
+      num_sweep_, num_sweep_},
+    {"ootx_feed", run_ootx_feed,
+      num_ootx_, num_ootx_},
+    {"convert_float", run_convert_float,
+      BENCH_NUM_FLOATS, BENCH_NUM_FLOATS},
+  };
+  size_t num = sizeof(benches) / sizeof(benches[0]);
+  // Run the benchmarks
+  if (json)
+    printf("[\n");
+  else
+    printf("name,calls,events,ns_per_call,events_per_sec\n");
+  int first = 1;
+  for (size_t i = 0; i < num; i++) {
+    if (filter->count > 0 && !strstr(benches[i].name, filter->sval[0]))
+      continue;
+    uint64_t calls, events, ns;
+    bench_run(&benches[i], iterations, &calls, &events, &ns);
+    double nspc = (double) ns / calls;
+    double eps = ns ? (double) events * 1e9 / ns : 0.0;
+    if (json) {
+      printf("%s  {\"name\": \"%s\", \"calls\": %llu, \"events\": %llu, "
+        "\"ns_per_call\": %.3f, \"events_per_sec\": %.1f}",
+        first ? "" : ",\n", benches[i].name, (unsigned long long) calls,
+        (unsigned long long) events, nspc, eps);
+    } else {
+      printf("%s,%llu,%llu,%.3f,%.1f\n", benches[i].name,
+        (unsigned long long) calls, (unsigned long long) events, nspc, eps);
+    }
+    first = 0;
+  }
+  if (json)
+    printf("\n]\n");
+exit:
+  arg_freetable(argtable,sizeof(argtable)/sizeof(argtable[0]));
+  return exitcode;
+}
@@ -0,0 +1,237 @@
+/*
+  Compares the cost of handling decoded events through the C callbacks with
+  the templated handlers of the C++ front-end in deepdive_driver.hh. Both run
+  the same synthetic packets through the same decoders, and do the same work
+  per event, so any difference is down to the dispatch.
+
+  Copyright (c) 2017 Andrew Symington
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+// C++ front-end
+#include "deepdive_driver.hh"
+
+// Decoders and packet encoders
+extern "C" {
+  #include <argtable2.h>
+  #include "deepdive_dev_tracker.h"
+  #include "deepdive_sim.h"
+}
+
+// STL
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+// Size of the synthetic input streams
+static constexpr size_t NUM_CYCLES = 4096;
+static constexpr size_t NUM_SWEEPS = 12;
+static constexpr size_t NUM_PULSES = NUM_CYCLES * (1 + NUM_SWEEPS);
+static constexpr size_t NUM_LIGHT = NUM_PULSES / 7 + 1;
+
+// Driver and tracker under test
+static struct Driver drv_;
+static struct Tracker tracker_;
+
+// Synthetic inputs
+static uint8_t light_[NUM_LIGHT][USB_INT_BUFF_LENGTH];
+static size_t num_light_ = 0;
+static uint8_t imu_[NUM_CYCLES][USB_INT_BUFF_LENGTH];
+
+// Work done per event, shared by both paths
+struct Totals {
+  uint64_t pulses = 0;
+  uint64_t angles = 0;
+  int64_t acc = 0;
+};
+
+// C PATH, which needs global state
+
+static Totals totals_;
+
+static void c_light(struct Tracker * tracker, struct Lighthouse * lighthouse,
+  uint8_t axis, uint32_t synctime, uint16_t num_sensors, uint16_t *sensors,
+  uint32_t *sweeptimes, uint32_t *angles, uint16_t *lengths) {
+  totals_.pulses += num_sensors;
+  for (uint16_t i = 0; i < num_sensors; i++)
+    totals_.angles += angles[i];
+}
+
+static void c_imu(struct Tracker * tracker, uint32_t timecode,
+  int16_t acc[3], int16_t gyr[3], int16_t mag[3]) {
+  totals_.acc += acc[0] + acc[1] + acc[2];
+}
+
+// C++ PATH, with the state in the handler
+
+struct BenchHandler : deepdive::Handler {
+  void OnLight(struct Tracker * tracker, struct Lighthouse * lighthouse,
+    uint8_t axis, uint32_t synctime, uint16_t num_sensors, uint16_t *sensors,
+    uint32_t *sweeptimes, uint32_t *angles, uint16_t *lengths) {
+    totals.pulses += num_sensors;
+    for (uint16_t i = 0; i < num_sensors; i++)
+      totals.angles += angles[i];
+  }
+  void OnImu(struct Tracker * tracker, uint32_t timecode,
+    int16_t acc[3], int16_t gyr[3], int16_t mag[3]) {
+    totals.acc += acc[0] + acc[1] + acc[2];
+  }
+  Totals totals;
+};
+
+// INPUT GENERATION
+
+// A single lighthouse alternating between axes, in wired light reports
+static void Generate() {
+  static SimPulse pulses[NUM_PULSES];
+  size_t n = 0;
+  for (uint32_t c = 0; c < NUM_CYCLES; c++) {
+    uint32_t t0 = 1000 + c * SIM_SYNC_PERIOD;
+    pulses[n++] = SimPulse{t0, 0, static_cast<uint16_t>(3000 + 500 * (c & 1))};
+    for (uint16_t s = 0; s < NUM_SWEEPS; s++)
+      pulses[n++] = SimPulse{t0 + 50000 + s * 9000,
+        static_cast<uint16_t>(s * 2 + (c & 1)),
+        static_cast<uint16_t>(150 + s * 10)};
+  }
+  for (size_t i = 0; i < n; i += 7)
+    deepdive_sim_wired_light(light_[num_light_++], pulses + i,
+      n - i < 7 ? n - i : 7);
+  for (size_t i = 0; i < NUM_CYCLES; i++) {
+    int16_t acc[3] = {static_cast<int16_t>(i % 100), -4096, 10};
+    int16_t gyr[3] = {-3, 4, static_cast<int16_t>(i)};
+    deepdive_sim_wired_imu(imu_[i], i * 48000, acc, gyr);
+  }
+}
+
+// BENCHMARKS
+
+// Clear all decoder state, so that a new pass can start from time zero
+static void Reset() {
+  memset(&tracker_.lcd, 0, sizeof(tracker_.lcd));
+  memset(&tracker_.ootx, 0, sizeof(tracker_.ootx));
+  tracker_.timecode = 0;
+  tracker_.ootx[0].lighthouse = &drv_.lighthouses[0];
+  tracker_.ootx[1].lighthouse = &drv_.lighthouses[1];
+}
+
+// Run all light and IMU reports through the decoders for a number of passes,
+// returning the time taken in nanoseconds
+static uint64_t Run(uint64_t passes) {
+  std::chrono::steady_clock::time_point tic = std::chrono::steady_clock::now();
+  for (uint64_t p = 0; p < passes; p++) {
+    Reset();
+    for (size_t i = 0; i < num_light_; i++)
+      deepdive_dev_tracker_light(&tracker_, light_[i], USB_INT_BUFF_LENGTH);
+    for (size_t i = 0; i < NUM_CYCLES; i++)
+      deepdive_dev_tracker_imu(&tracker_, imu_[i], USB_INT_BUFF_LENGTH);
+  }
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - tic).count();
+}
+
+// Print one result
+static void Print(const char * name, uint64_t passes, uint64_t ns,
+  Totals const& totals, bool json, bool first) {
+  uint64_t calls = passes * (num_light_ + NUM_CYCLES);
+  double nspc = static_cast<double>(ns) / calls;
+  double pps = ns ? static_cast<double>(totals.pulses) * 1e9 / ns : 0.0;
+  if (json) {
+    printf("%s  {\"name\": \"%s\", \"calls\": %llu, \"pulses\": %llu, "
+      "\"ns_per_call\": %.3f, \"pulses_per_sec\": %.1f}", first ? "" : ",\n",
+      name, static_cast<unsigned long long>(calls),
+      static_cast<unsigned long long>(totals.pulses), nspc, pps);
+  } else {
+    printf("%s,%llu,%llu,%.3f,%.1f\n", name,
+      static_cast<unsigned long long>(calls),
+      static_cast<unsigned long long>(totals.pulses), nspc, pps);
+  }
+}
+
+// Main entry point for application
+int main(int argc, char **argv) {
+  struct arg_int  *iters  = arg_int0("n", "passes", "<n>",
+    "number of passes over the input (default: 100)");
+  struct arg_str  *format = arg_str0(NULL, "format", "csv|json",
+    "output format (default: csv)");
+  struct arg_lit  *help   = arg_lit0(NULL, "help", "print this help and exit");
+  struct arg_end  *end    = arg_end(20);
+  void* argtable[] = {iters, format, help, end};
+  const char* progname = "deepdive_bench_dispatch";
+  int nerrors, exitcode = 0;
+  if (arg_nullcheck(argtable) != 0) {
+    printf("%s: insufficient memory\n", progname);
+    exitcode = 1;
+    goto exit;
+  }
+  nerrors = arg_parse(argc, argv, argtable);
+  if (help->count > 0) {
+    printf("Usage: %s", progname);
+    arg_print_syntax(stdout, argtable, "\n");
+    printf("This program compares C and C++ event dispatch.\n");
+    arg_print_glossary(stdout, argtable,"  %-25s %s\n");
+    goto exit;
+  }
+  if (nerrors > 0) {
+    arg_print_errors(stdout, end, progname);
+    printf("Try '%s --help' for more information.\n", progname);
+    exitcode = 2;
+    goto exit;
+  }
+  {
+    bool json = (format->count > 0 && !strcmp(format->sval[0], "json"));
+    uint64_t passes = (iters->count > 0 ? iters->ival[0] : 100);
+    // Set up a driver context with a single tracker and two lighthouses
+    drv_.trackers[drv_.num_trackers++] = &tracker_;
+    strcpy(drv_.lighthouses[0].serial, "0");
+    strcpy(drv_.lighthouses[1].serial, "1");
+    drv_.lighthouses[0].driver = &drv_;
+    drv_.lighthouses[1].driver = &drv_;
+    tracker_.driver = &drv_;
+    tracker_.type = USB_PROD_TRACKER;
+    strcpy(tracker_.serial, "BENCH");
+    Generate();
+    if (json)
+      printf("[\n");
+    else
+      printf("name,calls,pulses,ns_per_call,pulses_per_sec\n");
+    // C callbacks
+    drv_.lig_fn = c_light;
+    drv_.imu_fn = c_imu;
+    uint64_t ns = Run(passes);
+    Print("c_callbacks", passes, ns, totals_, json, true);
+    // C++ handler
+    BenchHandler handler;
+    deepdive::Attach(&drv_, handler);
+    ns = Run(passes);
+    Print("cpp_handler", passes, ns, handler.totals, json, false);
+    if (json)
+      printf("\n]\n");
+    // Both paths must have seen exactly the same events
+    if (handler.totals.pulses != totals_.pulses
+      || handler.totals.angles != totals_.angles
+      || handler.totals.acc != totals_.acc) {
+      printf("%s: C and C++ paths disagree\n", progname);
+      exitcode = 3;
+    }
+  }
+exit:
+  arg_freetable(argtable, sizeof(argtable) / sizeof(argtable[0]));
+  return exitcode;
+}
@@ -32,11 +32,16 @@
 */
 
 #include "deepdive_data_button.h"
+#include "deepdive_shm.h"
+#include "deepdive_snapshot.h"
 
 // Called when a new button event occurs
 void deepdive_data_button(struct Tracker * tracker,
   uint32_t mask, uint16_t trigger, int16_t horizontal, int16_t vertical) {
   tracker->buttonmask = mask;
+  deepdive_snapshot_button(tracker, mask, trigger, horizontal, vertical);
+  if (mask || trigger)
+    deepdive_shm_button(tracker, mask, trigger, horizontal, vertical);
   if (tracker->driver->but_fn && (mask || trigger))
     tracker->driver->but_fn(tracker, mask, trigger, horizontal, vertical);
 }
\ No newline at end of file
@@ -32,10 +32,14 @@
 */
 
 #include "deepdive_data_imu.h"
+#include "deepdive_shm.h"
+#include "deepdive_snapshot.h"
 
 void deepdive_data_imu(struct Tracker * tracker,
   uint32_t timecode, int16_t acc[3], int16_t gyr[3], int16_t mag[3]) {
   // Simple passthrough
+  deepdive_shm_imu(tracker, timecode, acc, gyr, mag);
+  deepdive_snapshot_imu(tracker, timecode, acc, gyr, mag);
   if (tracker->driver->imu_fn)
     tracker->driver->imu_fn(tracker, timecode, acc, gyr, mag);
 }
\ No newline at end of file
@@ -32,6 +32,9 @@
 */
 
 #include "deepdive_data_light.h"
+#include "deepdive_log.h"
+#include "deepdive_shm.h"
+#include "deepdive_snapshot.h"
 
 #include <zlib.h>
 
@@ -44,7 +47,7 @@ union custom_float {
 };
 
 // Converts a 16bit float to a 32 bit float
-static float convert_float(uint8_t* data) {
+float convert_float(uint8_t* data) {
   uint16_t x = *(uint16_t*)data;
   union custom_float fnum;
   fnum.f = 0;
@@ -79,8 +82,7 @@ static float convert_float(uint8_t* data) {
 static void decode_packet(struct Tracker *tracker, uint8_t id,
   uint8_t *data, uint32_t tc) {
   // Pop the serial number off the packet, so we can perform a lookup
-  static char serial[MAX_SERIAL_LENGTH];
-  sprintf(serial, "%u", *(uint32_t*)(data + 0x02));
+  uint32_t uid = *(uint32_t*)(data + 0x02);
 
   // We need to search to see if we already know about this LH
   uint8_t idx, available = MAX_NUM_LIGHTHOUSES;
@@ -89,8 +91,9 @@ static void decode_packet(struct Tracker *tracker, uint8_t id,
     // free record, which we will use in the case the serial is not found.
     if (!tracker->driver->lighthouses[idx].timestamp &&
       available == MAX_NUM_LIGHTHOUSES) available = idx;
-    // If we find the tracker
-    if (!strcmp(tracker->driver->lighthouses[idx].serial, serial))
+    // If we find the lighthouse, which has a serial once it is in use
+    if (tracker->driver->lighthouses[idx].serial[0] &&
+      tracker->driver->lighthouses[idx].uid == uid)
       break;
   }
 
@@ -98,8 +101,9 @@ static void decode_packet(struct Tracker *tracker, uint8_t id,
   // from more than two lighthouses. But, if we do, you should see this...
   if (idx >= MAX_NUM_LIGHTHOUSES) {
     if (available == MAX_NUM_LIGHTHOUSES) {
-      printf("We appear to have seen more than MAX_NUM_LIGHTHOUSES\n");
-      printf("We are therefore going to disregard this OOTX data :(\n");
+      LOG_WARN(tracker->driver, tracker->serial,
+        "Seen more than %d lighthouses, disregarding OOTX data",
+          MAX_NUM_LIGHTHOUSES);
       return;
     }
     idx = available;
@@ -107,7 +111,11 @@ static void decode_packet(struct Tracker *tracker, uint8_t id,
 
   // Populate this data
   struct Lighthouse *lh = &tracker->driver->lighthouses[idx]; 
-  strcpy(lh->serial, serial);
+  if (lh->uid != uid || !lh->serial[0])
+    snprintf(lh->serial, MAX_SERIAL_LENGTH, "%u", uid);
+  lh->id = idx;
+  lh->driver = tracker->driver;
+  lh->uid = uid;
   lh->fw_version = *(uint16_t*)(data + 0x00);
   lh->motors[0].phase = convert_float(data + 0x06);
   lh->motors[1].phase = convert_float(data + 0x08);
@@ -135,6 +143,7 @@ static void decode_packet(struct Tracker *tracker, uint8_t id,
   tracker->ootx[id].lighthouse = lh;
 
   // Push the new lighthouse data to the callee
+  deepdive_shm_lighthouse(tracker->driver, lh);
   if (tracker->driver->lighthouse_fn)
     tracker->driver->lighthouse_fn(lh);
 }
@@ -154,7 +163,7 @@ static uint32_t swapl(uint32_t val) {
 }
 
 // Process a single bit of the OOTX data
-static void ootx_feed(struct Tracker *tracker, 
+void ootx_feed(struct Tracker *tracker,
   uint8_t lh, uint8_t bit, uint32_t tc) {
   // OOTX decoders to gather base station configuration
   if (lh >= MAX_NUM_LIGHTHOUSES)
@@ -317,6 +326,10 @@ void handle_measurements(struct Tracker * tracker) {
   // Push off the measurement bundle ONLY when we have received
   // an OOTX from the current lighthouse and if we have data
   if (num_sensors > 0 && tracker->ootx[lh].lighthouse) {
+    deepdive_shm_light(tracker, tracker->ootx[lh].lighthouse,
+      motor, st, num_sensors, sensors, sweeptimes, angles, lengths);
+    deepdive_snapshot_light(tracker, tracker->ootx[lh].lighthouse,
+      motor, st, num_sensors, sensors, angles, lengths);
     if (tracker->driver->lig_fn)
       tracker->driver->lig_fn(tracker, tracker->ootx[lh].lighthouse,
         motor, st, num_sensors, sensors, sweeptimes, angles, lengths);
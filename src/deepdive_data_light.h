@@ -36,6 +36,21 @@
 
 #include <deepdive.h>
 
+// Converts a 16bit float to a 32 bit float
+float convert_float(uint8_t* data);
+
+// Process a single bit of the OOTX data
+void ootx_feed(struct Tracker *tracker,
+  uint8_t lh, uint8_t bit, uint32_t tc);
+
+// Handle a sync pulse
+void handle_sync(struct Tracker * tracker,
+  uint32_t timecode, uint16_t sensor, uint16_t length);
+
+// Handle a sweep pulse
+void handle_sweep(struct Tracker * tracker,
+  uint32_t timecode, uint16_t sensor, uint16_t length);
+
 // Process light data
 void deepdive_data_light(struct Tracker * tracker,
   uint32_t timecode, uint16_t sensor, uint16_t length);
@@ -35,6 +35,7 @@
 #include "deepdive_data_imu.h"
 #include "deepdive_data_light.h"
 #include "deepdive_data_button.h"
+#include "deepdive_log.h"
 
 // Pop a value off the array (shifts the pointer to the next element)
 #define POP1  (*(buf++))
@@ -261,7 +262,8 @@ static void watchman_decode(struct Tracker * tracker, uint8_t *buf) {
 
     return;
 end:
-    printf("Light decoding fault: %d", fault);
+    LOG_WARN(tracker->driver, tracker->serial,
+      "Light decoding fault: %d", fault);
   }
 }
 
@@ -280,6 +282,7 @@ void deepdive_dev_watchman(struct Tracker * tracker, uint8_t *buf, int32_t len)
     tracker->ison = 0;
     break;
   default:
-    printf("Unknown watchman code\n");
+    LOG_DEBUG(tracker->driver, tracker->serial,
+      "Unknown watchman code: %d", id);
   }
 }
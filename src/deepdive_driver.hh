@@ -0,0 +1,211 @@
+/*
+  Header-only C++ front-end to libdeepdive. A Driver owns one driver context,
+  and its event loop is templated on a handler type:
+
+    struct Counter : deepdive::Handler {
+      void OnLight(struct Tracker * tracker, struct Lighthouse * lighthouse,
+        uint8_t axis, uint32_t synctime, uint16_t num_sensors,
+        uint16_t *sensors, uint32_t *sweeptimes, uint32_t *angles,
+        uint16_t *lengths) { pulses += num_sensors; }
+      size_t pulses = 0;
+    };
+
+    deepdive::Driver driver;
+    Counter counter;
+    while (driver.Poll(counter) == 0) {}
+
+  Each handler type gets its own set of callbacks, in which the handler's
+  methods are called directly and so can be inlined. Only the events that
+  the handler overrides are installed, and its state travels in the driver's
+  user data, so no global state is needed. The decoders themselves live in
+  the library, so there is still one call through a pointer per event.
+
+  Copyright (c) 2017 Andrew Symington
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef DEEPDIVE_DRIVER_HH
+#define DEEPDIVE_DRIVER_HH
+
+// Libdeepdive interface
+extern "C" {
+  #include <deepdive.h>
+}
+
+// STL
+#include <atomic>
+#include <type_traits>
+#include <utility>
+
+namespace deepdive {
+
+// Handlers derive from this, and hide the events that they want. Nothing is
+// virtual: events that are not hidden are never installed.
+struct Handler {
+  void OnLight(struct ::Tracker * tracker, struct ::Lighthouse * lighthouse,
+    uint8_t axis, uint32_t synctime, uint16_t num_sensors, uint16_t *sensors,
+    uint32_t *sweeptimes, uint32_t *angles, uint16_t *lengths) {}
+  void OnImu(struct ::Tracker * tracker, uint32_t timecode,
+    int16_t acc[3], int16_t gyr[3], int16_t mag[3]) {}
+  void OnButton(struct ::Tracker * tracker, uint32_t mask, uint16_t trigger,
+    int16_t horizontal, int16_t vertical) {}
+  void OnTracker(struct ::Tracker * tracker) {}
+  void OnLighthouse(struct ::Lighthouse * lighthouse) {}
+};
+
+// Callbacks for one handler type, which recover the handler from the driver
+template <typename H>
+struct Dispatch {
+  static H & Get(struct ::Driver * driver) {
+    return *static_cast<H*>(driver->user);
+  }
+  static void Light(struct ::Tracker * tracker,
+    struct ::Lighthouse * lighthouse, uint8_t axis, uint32_t synctime,
+    uint16_t num_sensors, uint16_t *sensors, uint32_t *sweeptimes,
+    uint32_t *angles, uint16_t *lengths) {
+    Get(tracker->driver).OnLight(tracker, lighthouse, axis, synctime,
+      num_sensors, sensors, sweeptimes, angles, lengths);
+  }
+  static void Imu(struct ::Tracker * tracker, uint32_t timecode,
+    int16_t acc[3], int16_t gyr[3], int16_t mag[3]) {
+    Get(tracker->driver).OnImu(tracker, timecode, acc, gyr, mag);
+  }
+  static void Button(struct ::Tracker * tracker, uint32_t mask,
+    uint16_t trigger, int16_t horizontal, int16_t vertical) {
+    Get(tracker->driver).OnButton(tracker, mask, trigger,
+      horizontal, vertical);
+  }
+  static void Tracker(struct ::Tracker * tracker) {
+    Get(tracker->driver).OnTracker(tracker);
+  }
+  static void Lighthouse(struct ::Lighthouse * lighthouse) {
+    Get(lighthouse->driver).OnLighthouse(lighthouse);
+  }
+};
+
+// A hidden method has a different member pointer type to the default
+template <typename M>
+constexpr bool Hides(M, M) { return false; }
+template <typename M, typename N>
+constexpr bool Hides(M, N) { return true; }
+
+// Which events a handler type hides from Handler, and so wants installed
+template <typename H>
+struct Handles {
+  static constexpr bool light = Hides(&H::OnLight, &Handler::OnLight);
+  static constexpr bool imu = Hides(&H::OnImu, &Handler::OnImu);
+  static constexpr bool button = Hides(&H::OnButton, &Handler::OnButton);
+  static constexpr bool tracker = Hides(&H::OnTracker, &Handler::OnTracker);
+  static constexpr bool lighthouse =
+    Hides(&H::OnLighthouse, &Handler::OnLighthouse);
+};
+
+// Point a driver's callbacks at a handler. This also works on a driver that
+// was not created by deepdive_init(), such as in the benchmarks.
+template <typename H>
+inline void Attach(struct ::Driver * driver, H & handler) {
+  driver->user = &handler;
+  driver->lig_fn = Handles<H>::light ? Dispatch<H>::Light : nullptr;
+  driver->imu_fn = Handles<H>::imu ? Dispatch<H>::Imu : nullptr;
+  driver->but_fn = Handles<H>::button ? Dispatch<H>::Button : nullptr;
+  driver->tracker_fn = Handles<H>::tracker ? Dispatch<H>::Tracker : nullptr;
+  driver->lighthouse_fn =
+    Handles<H>::lighthouse ? Dispatch<H>::Lighthouse : nullptr;
+}
+
+// Owns a driver context, which is closed when the object is destroyed
+class Driver {
+ public:
+  // Open every device on the given transport. For TRANSPORT_REPLAY the
+  // argument is the path to a packet file. Check Ok() before polling.
+  explicit Driver(TransportType type = TRANSPORT_USB,
+    const char * arg = nullptr)
+      : driver_(deepdive_init_transport(type, arg)), type_(nullptr) {}
+
+  ~Driver() {
+    if (driver_)
+      deepdive_close(driver_);
+  }
+
+  // Move-only, as there is only one driver context
+  Driver(Driver const&) = delete;
+  Driver& operator=(Driver const&) = delete;
+  Driver(Driver && other) noexcept
+    : driver_(other.driver_), type_(other.type_) {
+    other.driver_ = nullptr;
+  }
+  Driver& operator=(Driver && other) noexcept {
+    std::swap(driver_, other.driver_);
+    std::swap(type_, other.type_);
+    return *this;
+  }
+
+  // Whether any devices were found
+  bool Ok() const { return driver_ != nullptr; }
+
+  // The underlying C context, for the rest of the C API
+  struct ::Driver * Get() const { return driver_; }
+
+  // Copy out the most recent state of a tracker. Safe from any thread.
+  // Returns false if there is no such tracker, or if the decoders kept
+  // overtaking the copy, in which case it may be tried again later.
+  bool Latest(uint8_t id, struct ::Snapshot & out) const {
+    return deepdive_snapshot(driver_, id, &out) > 0;
+  }
+
+  // Handle any pending events, returning non-zero on error. The handler
+  // must outlive the call.
+  template <typename H>
+  int Poll(H & handler) {
+    if (!driver_)
+      return -1;
+    if (driver_->user != &handler || type_ != Type<H>()) {
+      Attach(driver_, handler);
+      type_ = Type<H>();
+    }
+    return deepdive_poll(driver_);
+  }
+
+  // Handle events until stopped or an error occurs
+  template <typename H>
+  int Run(H & handler, std::atomic<bool> const& stop) {
+    int ret = 0;
+    while (!stop.load(std::memory_order_relaxed))
+      if ((ret = Poll(handler)))
+        break;
+    return ret;
+  }
+
+ private:
+  // A unique address per handler type, as two handlers of different types
+  // may share an address
+  template <typename H>
+  static void const* Type() {
+    static char type;
+    return &type;
+  }
+
+  struct ::Driver * driver_;
+  void const* type_;                 // Type of the attached handler
+};
+
+}  // namespace deepdive
+
+#endif
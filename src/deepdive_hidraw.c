@@ -0,0 +1,291 @@
+/* 
+  Unofficial driver for Vive Trackers and up to two lighthouses, with an
+    emphasis on pulling tracker and lighthouse calibration data from devices.
+  
+  Adapted from: https://github.com/cnlohr/libsurvive
+  Which was based off: https://github.com/collabora/OSVR-Vive-Libre
+    Originally Copyright 2016 Philipp Zabel
+    Originally Copyright 2016 Lubosz Sarnecki <lubosz.sarnecki@collabora.co.uk>
+    Originally Copyright (C) 2013 Fredrik Hultin
+    Originally Copyright (C) 2013 Jakob Bornecrantz
+  Using documentation from: https://github.com/nairol/LighthouseRedox
+  
+  Copyright (c) 2017 Andrew Symington
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+// Interface implementations
+#include "deepdive_transport.h"
+#include "deepdive_log.h"
+
+#include <linux/hidraw.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <libgen.h>
+
+// Where the kernel lists hidraw nodes
+#define HIDRAW_CLASS          "/sys/class/hidraw"
+#define HIDRAW_MAX_EVENTS     16
+#define HIDRAW_TIMEOUT_MS     100
+
+// Read a small sysfs attribute, without the trailing newline
+static int read_attr(const char * dir, const char * name,
+  char * buf, size_t len) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  FILE * fp = fopen(path, "r");
+  if (!fp)
+    return 0;
+  size_t n = fread(buf, 1, len - 1, fp);
+  fclose(fp);
+  while (n > 0 && (buf[n-1] == '\n' || buf[n-1] == '\r'))
+    n--;
+  buf[n] = '\0';
+  return n > 0;
+}
+
+// Find the vendor and product of a HID device from its uevent
+static int read_hid_id(const char * dir, uint32_t * vendor, uint32_t * product) {
+  char uevent[1024];
+  if (!read_attr(dir, "uevent", uevent, sizeof(uevent)))
+    return 0;
+  char * line = strstr(uevent, "HID_ID=");
+  uint32_t bus;
+  return line && sscanf(line, "HID_ID=%x:%x:%x", &bus, vendor, product) == 3;
+}
+
+// Get a feature report through the first interface
+static int hidraw_get_feature(struct Tracker * tracker,
+  uint8_t * data, int len) {
+  return ioctl(tracker->endpoints[0].fd, HIDIOCGFEATURE(len), data);
+}
+
+// Set a feature report through the first interface
+static int hidraw_set_feature(struct Tracker * tracker,
+  uint8_t * data, int len) {
+  return ioctl(tracker->endpoints[0].fd, HIDIOCSFEATURE(len), data);
+}
+
+// Close the device nodes of a tracker
+static void close_tracker(struct Tracker * tracker) {
+  for (size_t i = 0; i < MAX_ENDPOINTS; i++)
+    if (tracker->endpoints[i].fd >= 0)
+      close(tracker->endpoints[i].fd);
+  free(tracker);
+}
+
+// Stop reading a tracker whose device has gone away. The tracker itself is
+// kept, so that its id stays valid, and it is marked as off.
+static void drop_tracker(struct Tracker * tracker) {
+  for (size_t i = 0; i < MAX_ENDPOINTS; i++) {
+    if (tracker->endpoints[i].fd < 0)
+      continue;
+    // Closing the node also removes it from the epoll set
+    close(tracker->endpoints[i].fd);
+    tracker->endpoints[i].fd = -1;
+  }
+  tracker->ison = 0;
+}
+
+// Open one hidraw node and attach it to the tracker owning its USB device,
+// which is created on first sight. Interfaces may appear in any order.
+static void add_node(struct Driver * drv, const char * node,
+  struct Tracker ** found, char (*parents)[PATH_MAX], uint16_t * num_found) {
+  // The device link points at the HID device, below the USB interface
+  char hid[PATH_MAX], link[PATH_MAX];
+  snprintf(link, sizeof(link), "%s/%s/device", HIDRAW_CLASS, node);
+  if (!realpath(link, hid))
+    return;
+  uint32_t vendor, product;
+  if (!read_hid_id(hid, &vendor, &product) || vendor != USB_VEND_HTC)
+    return;
+  if (product != USB_PROD_TRACKER && product != USB_PROD_CONTROLLER
+    && product != USB_PROD_WATCHMAN)
+    return;
+  char intf[PATH_MAX], attr[32];
+  strcpy(intf, hid);
+  dirname(intf);
+  unsigned int num;
+  if (!read_attr(intf, "bInterfaceNumber", attr, sizeof(attr))
+    || sscanf(attr, "%x", &num) != 1)
+    return;
+  // Watchman data only arrives on the first interface
+  if (num >= MAX_ENDPOINTS || (product == USB_PROD_WATCHMAN && num > 0))
+    return;
+  char parent[PATH_MAX];
+  strcpy(parent, intf);
+  dirname(parent);
+  // Find or create the tracker for this USB device
+  struct Tracker * tracker = NULL;
+  for (uint16_t i = 0; i < *num_found; i++)
+    if (strcmp(parents[i], parent) == 0)
+      tracker = found[i];
+  if (!tracker) {
+    if (*num_found == MAX_NUM_TRACKERS)
+      return;
+    tracker = malloc(sizeof(struct Tracker));
+    if (!tracker)
+      return;
+    memset(tracker, 0, sizeof(struct Tracker));
+    tracker->driver = drv;
+    tracker->type = product;
+    for (size_t i = 0; i < MAX_NUM_LIGHTHOUSES; i++)
+      tracker->ootx[i].lighthouse = NULL;
+    for (size_t i = 0; i < MAX_ENDPOINTS; i++) {
+      tracker->endpoints[i].tracker = tracker;
+      tracker->endpoints[i].fd = -1;
+    }
+    if (!read_attr(parent, "serial", tracker->serial, MAX_SERIAL_LENGTH))
+      snprintf(tracker->serial, MAX_SERIAL_LENGTH, "%s", node);
+    strcpy(parents[*num_found], parent);
+    found[(*num_found)++] = tracker;
+  }
+  // Open the node without taking it from anyone else
+  char dev[PATH_MAX];
+  snprintf(dev, sizeof(dev), "/dev/%s", node);
+  int fd = open(dev, O_RDWR | O_NONBLOCK);
+  if (fd < 0) {
+    LOG_WARN(drv, tracker->serial,
+      "Cannot open interface %u (errno: %d)", num, errno);
+    return;
+  }
+  tracker->endpoints[num].fd = fd;
+  if (product == USB_PROD_WATCHMAN)
+    tracker->endpoints[num].type = WATCHMAN;
+  else
+    tracker->endpoints[num].type = (CallbackType) num;
+}
+
+// Enumerate the hidraw nodes and return the number of devices found
+static int hidraw_init(struct Driver * drv, const char * arg) {
+  int epfd = epoll_create1(0);
+  drv->transport_data = (void*)(intptr_t) epfd;
+  if (epfd < 0)
+    return 0;
+
+  // Group the nodes by the USB device they belong to
+  struct Tracker * found[MAX_NUM_TRACKERS];
+  uint16_t num_found = 0;
+  char (*parents)[PATH_MAX] = malloc(MAX_NUM_TRACKERS * PATH_MAX);
+  if (!parents)
+    return 0;
+  DIR * dir = opendir(HIDRAW_CLASS);
+  if (dir) {
+    struct dirent * entry;
+    while ((entry = readdir(dir)))
+      if (strncmp(entry->d_name, "hidraw", 6) == 0)
+        add_node(drv, entry->d_name, found, parents, &num_found);
+    closedir(dir);
+  }
+  free(parents);
+
+  // Now that all interfaces are open, configure each device
+  for (uint16_t i = 0; i < num_found; i++) {
+    struct Tracker * tracker = found[i];
+    if (tracker->endpoints[0].fd < 0)
+      goto fail;
+    if (tracker->type != USB_PROD_WATCHMAN) {
+      // Send a magic code to power on the tracker
+      if (!deepdive_transport_power(tracker))
+        LOG_WARN(drv, tracker->serial, "Power on failed");
+      else
+        LOG_DEBUG(drv, tracker->serial, "Power on success");
+    }
+    // Get the configuration for this device
+    if (deepdive_transport_config(tracker,
+      tracker->type == USB_PROD_WATCHMAN) < 0) {
+      LOG_WARN(drv, tracker->serial, "Calibration cannot be pulled. Ignoring.");
+      goto fail;
+    }
+    // Wake the poll loop on data from any interface
+    for (size_t j = 0; j < MAX_ENDPOINTS; j++) {
+      struct epoll_event ev;
+      ev.events = EPOLLIN;
+      ev.data.ptr = &tracker->endpoints[j];
+      if (tracker->endpoints[j].fd >= 0
+        && epoll_ctl(epfd, EPOLL_CTL_ADD, tracker->endpoints[j].fd, &ev))
+          goto fail;
+    }
+    if (tracker->type == USB_PROD_WATCHMAN)
+      LOG_INFO(drv, tracker->serial, "Found watchman");
+    else
+      LOG_INFO(drv, tracker->serial, "Found tracker");
+    deepdive_transport_add(drv, tracker);
+    continue;
+
+    // Closing the node also removes it from the epoll set
+fail:
+    close_tracker(tracker);
+  }
+
+  // Success
+  return drv->num_trackers;
+}
+
+// Wait for reports and drain every node that has data. A device that goes
+// away is dropped, and the others are still read.
+static int hidraw_poll(struct Driver * drv) {
+  struct epoll_event events[HIDRAW_MAX_EVENTS];
+  int n = epoll_wait((int)(intptr_t) drv->transport_data,
+    events, HIDRAW_MAX_EVENTS, HIDRAW_TIMEOUT_MS);
+  if (n < 0)
+    return errno == EINTR ? 0 : -1;
+  for (int i = 0; i < n; i++) {
+    struct Endpoint * ep = events[i].data.ptr;
+    // Another node of the same device may already have been dropped
+    if (ep->fd < 0)
+      continue;
+    if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+      LOG_WARN(drv, ep->tracker->serial, "Device disconnected");
+      drop_tracker(ep->tracker);
+      continue;
+    }
+    // Each read returns exactly one report
+    ssize_t len;
+    while ((len = read(ep->fd, ep->buffer, USB_INT_BUFF_LENGTH)) > 0)
+      deepdive_transport_dispatch(ep, len);
+    if (len < 0 && errno != EAGAIN) {
+      LOG_WARN(drv, ep->tracker->serial, "Read failed (errno: %d)", errno);
+      drop_tracker(ep->tracker);
+    }
+  }
+  return 0;
+}
+
+// Close the nodes and free the trackers
+static void hidraw_close(struct Driver * drv) {
+  for (size_t i = 0; i < drv->num_trackers; i++)
+    close_tracker(drv->trackers[i]);
+  int epfd = (int)(intptr_t) drv->transport_data;
+  if (epfd >= 0)
+    close(epfd);
+}
+
+// Leaves the kernel HID driver bound, so it only needs read/write access to
+// the /dev/hidraw* nodes and coexists with other readers
+const struct Transport deepdive_transport_hidraw = {
+  "hidraw", hidraw_init, hidraw_poll, hidraw_close,
+  hidraw_get_feature, hidraw_set_feature
+};
@@ -0,0 +1,247 @@
+/* 
+  Unofficial driver for Vive Trackers and up to two lighthouses, with an
+    emphasis on pulling tracker and lighthouse calibration data from devices.
+  
+  Adapted from: https://github.com/cnlohr/libsurvive
+  Which was based off: https://github.com/collabora/OSVR-Vive-Libre
+    Originally Copyright 2016 Philipp Zabel
+    Originally Copyright 2016 Lubosz Sarnecki <lubosz.sarnecki@collabora.co.uk>
+    Originally Copyright (C) 2013 Fredrik Hultin
+    Originally Copyright (C) 2013 Jakob Bornecrantz
+  Using documentation from: https://github.com/nairol/LighthouseRedox
+  
+  Copyright (c) 2017 Andrew Symington
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+#include "deepdive_log.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+// How long the drain thread sleeps between passes
+#define LOG_DRAIN_PERIOD_NS   10000000L
+
+// Maximum length of a formatted message
+#define LOG_MSG_LENGTH        256
+
+// A single fixed-size log record. No pointers into transient memory are
+// held, except for the format string which must be a literal.
+struct LogRecord {
+  atomic_size_t seq;                // Sequence number for this cell
+  uint64_t ns;                      // Wall time at which record was pushed
+  const char * fmt;                 // Format string (string literal)
+  char tag[MAX_SERIAL_LENGTH];      // Tag, usually a device serial
+  int32_t args[4];                  // Integer arguments
+  uint8_t level;                    // Log level
+};
+
+// Bounded multi-producer, single-consumer ring
+struct Log {
+  struct LogRecord ring[LOG_RING_LENGTH];
+  atomic_size_t head;               // Next cell to be claimed by a producer
+  size_t tail;                      // Next cell to be read by the consumer
+  atomic_uint level;                // Minimum level accepted
+  atomic_uint rate;                 // Maximum records per second (0 = any)
+  atomic_uint_least64_t window;     // Current rate limiting window (seconds)
+  atomic_uint count;                // Records accepted in current window
+  atomic_uint suppressed;           // Records rejected by rate limiter
+  atomic_uint dropped;              // Records rejected because ring was full
+  atomic_int running;               // Should the drain thread keep going?
+  pthread_mutex_t mutex;            // Serializes consumers
+  pthread_t thread;                 // Drain thread
+};
+
+static const char * level_names[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+
+// Current wall time in nanoseconds
+static uint64_t log_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// Returns non-zero if the rate limiter accepts another record
+static int log_admit(struct Log * log, uint64_t ns) {
+  uint32_t rate = atomic_load_explicit(&log->rate, memory_order_relaxed);
+  if (rate == 0)
+    return 1;
+  uint64_t now = ns / 1000000000ULL;
+  uint64_t window = atomic_load_explicit(&log->window, memory_order_relaxed);
+  if (window != now
+    && atomic_compare_exchange_strong(&log->window, &window, now))
+    atomic_store_explicit(&log->count, 0, memory_order_relaxed);
+  return atomic_fetch_add_explicit(&log->count, 1, memory_order_relaxed) < rate;
+}
+
+// Deliver a single message to the sink
+static void log_emit(struct Driver * drv, uint8_t level, uint64_t ns,
+  const char * msg) {
+  if (drv->log_fn) {
+    drv->log_fn(level, msg);
+    return;
+  }
+  fprintf(stderr, "[%llu.%06llu] [%s] %s\n",
+    (unsigned long long)(ns / 1000000000ULL),
+    (unsigned long long)((ns % 1000000000ULL) / 1000ULL),
+    level_names[level], msg);
+}
+
+// Background thread that periodically drains the ring
+static void * log_thread(void * arg) {
+  struct Driver * drv = arg;
+  struct timespec ts = {0, LOG_DRAIN_PERIOD_NS};
+  while (atomic_load(&drv->log->running)) {
+    deepdive_log_drain(drv);
+    nanosleep(&ts, NULL);
+  }
+  return NULL;
+}
+
+// Allocate the log ring and start the thread that drains it
+int deepdive_log_init(struct Driver * drv) {
+  if (drv == NULL) return 0;
+  struct Log * log = malloc(sizeof(struct Log));
+  if (log == NULL)
+    return 0;
+  memset(log, 0, sizeof(struct Log));
+  for (size_t i = 0; i < LOG_RING_LENGTH; i++)
+    atomic_init(&log->ring[i].seq, i);
+  atomic_init(&log->head, 0);
+  atomic_init(&log->level, LEVEL_INFO);
+  atomic_init(&log->rate, LOG_DEFAULT_RATE);
+  atomic_init(&log->running, 1);
+  pthread_mutex_init(&log->mutex, NULL);
+  drv->log = log;
+  if (pthread_create(&log->thread, NULL, log_thread, drv) != 0) {
+    pthread_mutex_destroy(&log->mutex);
+    free(log);
+    drv->log = NULL;
+    return 0;
+  }
+  return 1;
+}
+
+// Stop the drain thread, flush any pending records and free the ring
+void deepdive_log_close(struct Driver * drv) {
+  if (drv == NULL || drv->log == NULL) return;
+  atomic_store(&drv->log->running, 0);
+  pthread_join(drv->log->thread, NULL);
+  deepdive_log_drain(drv);
+  pthread_mutex_destroy(&drv->log->mutex);
+  free(drv->log);
+  drv->log = NULL;
+}
+
+// Push a fixed-size record onto the ring
+void deepdive_log_push(struct Driver * drv, uint8_t level, const char * tag,
+  const char * fmt, int32_t a0, int32_t a1, int32_t a2, int32_t a3) {
+  if (drv == NULL || drv->log == NULL) return;
+  struct Log * log = drv->log;
+  if (level < atomic_load_explicit(&log->level, memory_order_relaxed))
+    return;
+  uint64_t ns = log_now();
+  if (!log_admit(log, ns)) {
+    atomic_fetch_add_explicit(&log->suppressed, 1, memory_order_relaxed);
+    return;
+  }
+  // Claim a cell
+  struct LogRecord * rec;
+  size_t pos = atomic_load_explicit(&log->head, memory_order_relaxed);
+  for (;;) {
+    rec = &log->ring[pos & (LOG_RING_LENGTH - 1)];
+    size_t seq = atomic_load_explicit(&rec->seq, memory_order_acquire);
+    intptr_t dif = (intptr_t) seq - (intptr_t) pos;
+    if (dif == 0) {
+      if (atomic_compare_exchange_weak_explicit(&log->head, &pos, pos + 1,
+        memory_order_relaxed, memory_order_relaxed))
+        break;
+    } else if (dif < 0) {
+      atomic_fetch_add_explicit(&log->dropped, 1, memory_order_relaxed);
+      return;
+    } else {
+      pos = atomic_load_explicit(&log->head, memory_order_relaxed);
+    }
+  }
+  // Fill and publish the cell
+  rec->ns = ns;
+  rec->fmt = fmt;
+  rec->level = level;
+  rec->args[0] = a0;
+  rec->args[1] = a1;
+  rec->args[2] = a2;
+  rec->args[3] = a3;
+  rec->tag[0] = '\0';
+  if (tag) {
+    strncpy(rec->tag, tag, MAX_SERIAL_LENGTH - 1);
+    rec->tag[MAX_SERIAL_LENGTH - 1] = '\0';
+  }
+  atomic_store_explicit(&rec->seq, pos + 1, memory_order_release);
+}
+
+// Format and deliver all pending records to the sink
+int deepdive_log_drain(struct Driver * drv) {
+  if (drv == NULL || drv->log == NULL) return 0;
+  struct Log * log = drv->log;
+  char msg[LOG_MSG_LENGTH];
+  int n = 0;
+  pthread_mutex_lock(&log->mutex);
+  for (;;) {
+    struct LogRecord * rec = &log->ring[log->tail & (LOG_RING_LENGTH - 1)];
+    size_t seq = atomic_load_explicit(&rec->seq, memory_order_acquire);
+    if (seq != log->tail + 1)
+      break;
+    int len = 0;
+    if (rec->tag[0])
+      len = snprintf(msg, LOG_MSG_LENGTH, "%s: ", rec->tag);
+    snprintf(msg + len, LOG_MSG_LENGTH - len, rec->fmt,
+      rec->args[0], rec->args[1], rec->args[2], rec->args[3]);
+    log_emit(drv, rec->level, rec->ns, msg);
+    atomic_store_explicit(&rec->seq, log->tail + LOG_RING_LENGTH,
+      memory_order_release);
+    log->tail++;
+    n++;
+  }
+  // Report anything we had to throw away
+  uint32_t dropped = atomic_exchange(&log->dropped, 0);
+  if (dropped) {
+    snprintf(msg, LOG_MSG_LENGTH, "Log ring full, %u messages dropped",
+      dropped);
+    log_emit(drv, LEVEL_WARN, log_now(), msg);
+  }
+  uint32_t suppressed = atomic_exchange(&log->suppressed, 0);
+  if (suppressed) {
+    snprintf(msg, LOG_MSG_LENGTH, "Rate limit hit, %u messages suppressed",
+      suppressed);
+    log_emit(drv, LEVEL_WARN, log_now(), msg);
+  }
+  pthread_mutex_unlock(&log->mutex);
+  return n;
+}
+
+// Set the minimum log level and the maximum number of messages per second
+void deepdive_log_config(struct Driver * drv, uint8_t level, uint32_t rate) {
+  if (drv == NULL || drv->log == NULL) return;
+  if (level > LEVEL_ERROR) level = LEVEL_ERROR;
+  atomic_store(&drv->log->level, level);
+  atomic_store(&drv->log->rate, rate);
+}
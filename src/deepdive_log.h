@@ -0,0 +1,74 @@
+/* 
+  Unofficial driver for Vive Trackers and up to two lighthouses, with an
+    emphasis on pulling tracker and lighthouse calibration data from devices.
+  
+  Adapted from: https://github.com/cnlohr/libsurvive
+  Which was based off: https://github.com/collabora/OSVR-Vive-Libre
+    Originally Copyright 2016 Philipp Zabel
+    Originally Copyright 2016 Lubosz Sarnecki <lubosz.sarnecki@collabora.co.uk>
+    Originally Copyright (C) 2013 Fredrik Hultin
+    Originally Copyright (C) 2013 Jakob Bornecrantz
+  Using documentation from: https://github.com/nairol/LighthouseRedox
+  
+  Copyright (c) 2017 Andrew Symington
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef LIBDEEPDIVE_DEEPDIVE_LOG_H
+#define LIBDEEPDIVE_DEEPDIVE_LOG_H
+
+#include <deepdive.h>
+
+// Number of records in the log ring (must be a power of two)
+#define LOG_RING_LENGTH       1024
+
+// Default maximum number of records accepted per second
+#define LOG_DEFAULT_RATE      100
+
+// Allocate the log ring and start the thread that drains it
+int deepdive_log_init(struct Driver * drv);
+
+// Stop the drain thread, flush any pending records and free the ring
+void deepdive_log_close(struct Driver * drv);
+
+// Push a fixed-size record onto the ring. This is safe to call from the USB
+// path: it never formats, allocates, blocks or performs I/O. The format
+// string must be a literal that only uses integer conversions (%d, %u, %x),
+// since formatting is deferred to the drain thread.
+void deepdive_log_push(struct Driver * drv, uint8_t level, const char * tag,
+  const char * fmt, int32_t a0, int32_t a1, int32_t a2, int32_t a3);
+
+// Format and deliver all pending records to the sink
+int deepdive_log_drain(struct Driver * drv);
+
+// Pad missing integer arguments with zeros
+#define LOG_ARGS(fmt, a0, a1, a2, a3, ...) fmt, a0, a1, a2, a3
+
+// Leveled logging with up to four integer arguments
+#define LOG_DEBUG(drv, tag, ...) deepdive_log_push(drv, LEVEL_DEBUG, tag, \
+  LOG_ARGS(__VA_ARGS__, 0, 0, 0, 0, 0))
+#define LOG_INFO(drv, tag, ...) deepdive_log_push(drv, LEVEL_INFO, tag, \
+  LOG_ARGS(__VA_ARGS__, 0, 0, 0, 0, 0))
+#define LOG_WARN(drv, tag, ...) deepdive_log_push(drv, LEVEL_WARN, tag, \
+  LOG_ARGS(__VA_ARGS__, 0, 0, 0, 0, 0))
+#define LOG_ERROR(drv, tag, ...) deepdive_log_push(drv, LEVEL_ERROR, tag, \
+  LOG_ARGS(__VA_ARGS__, 0, 0, 0, 0, 0))
+
+#endif
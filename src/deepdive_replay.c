@@ -0,0 +1,176 @@
+/* 
+  Unofficial driver for Vive Trackers and up to two lighthouses, with an
+    emphasis on pulling tracker and lighthouse calibration data from devices.
+  
+  Adapted from: https://github.com/cnlohr/libsurvive
+  Which was based off: https://github.com/collabora/OSVR-Vive-Libre
+    Originally Copyright 2016 Philipp Zabel
+    Originally Copyright 2016 Lubosz Sarnecki <lubosz.sarnecki@collabora.co.uk>
+    Originally Copyright (C) 2013 Fredrik Hultin
+    Originally Copyright (C) 2013 Jakob Bornecrantz
+  Using documentation from: https://github.com/nairol/LighthouseRedox
+  
+  Copyright (c) 2017 Andrew Symington
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+// Interface implementations
+#include "deepdive_transport.h"
+#include "deepdive_sim.h"
+#include "deepdive_log.h"
+
+#include <time.h>
+
+// Never sleep longer than this, so that callers can still quit promptly
+#define REPLAY_MAX_SLEEP_NS   100000000ULL
+
+// Replay state
+struct Replay {
+  FILE * fp;                                // Packet file
+  uint64_t start;                           // Wall time of the first record
+  struct SimRecord rec;                     // Next record
+  uint8_t data[sizeof(struct SimRecordTracker)];
+  int pending;                              // Whether rec is unprocessed
+};
+
+// Monotonic time in nanoseconds
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Add a tracker from its metadata record
+static int add_tracker(struct Driver * drv, struct Replay * replay) {
+  struct SimRecordTracker * r = (struct SimRecordTracker *) replay->data;
+  if (replay->rec.length != sizeof(struct SimRecordTracker)
+    || replay->rec.tracker != drv->num_trackers)
+    return 0;
+  struct Tracker * tracker = malloc(sizeof(struct Tracker));
+  if (!tracker)
+    return 0;
+  memset(tracker, 0, sizeof(struct Tracker));
+  tracker->driver = drv;
+  tracker->type = r->type;
+  tracker->cal = r->cal;
+  memcpy(tracker->serial, r->serial, MAX_SERIAL_LENGTH);
+  tracker->serial[MAX_SERIAL_LENGTH - 1] = '\0';
+  for (size_t i = 0; i < MAX_NUM_LIGHTHOUSES; i++)
+    tracker->ootx[i].lighthouse = NULL;
+  for (size_t i = 0; i < MAX_ENDPOINTS; i++) {
+    tracker->endpoints[i].tracker = tracker;
+    tracker->endpoints[i].fd = -1;
+  }
+  deepdive_transport_add(drv, tracker);
+  LOG_INFO(drv, tracker->serial, "Replaying tracker");
+  return 1;
+}
+
+// Read the trackers at the head of a packet file
+static int replay_init(struct Driver * drv, const char * arg) {
+  if (!arg)
+    return 0;
+  struct Replay * replay = malloc(sizeof(struct Replay));
+  if (!replay)
+    return 0;
+  memset(replay, 0, sizeof(struct Replay));
+  drv->transport_data = replay;
+  replay->fp = fopen(arg, "rb");
+  if (!replay->fp || !deepdive_sim_read_header(replay->fp)) {
+    LOG_ERROR(drv, NULL, "Not a packet file");
+    return 0;
+  }
+  // Metadata comes first, so stop at the first packet
+  while (deepdive_sim_read_record(replay->fp, &replay->rec,
+    replay->data, sizeof(replay->data))) {
+    if (replay->rec.type == SIM_RECORD_PACKET) {
+      replay->pending = 1;
+      break;
+    }
+    if (replay->rec.type == SIM_RECORD_TRACKER && !add_tracker(drv, replay))
+      LOG_WARN(drv, NULL, "Bad tracker record %u", replay->rec.tracker);
+  }
+  replay->start = now_ns();
+  return drv->num_trackers;
+}
+
+// Deliver the next packet if it is due, or else sleep until it is. Only one
+// packet is delivered per call, so that a caller that has fallen behind the
+// file still gets control back between packets.
+static int replay_poll(struct Driver * drv) {
+  struct Replay * replay = drv->transport_data;
+  if (replay->pending) {
+    uint64_t elapsed = now_ns() - replay->start;
+    if (replay->rec.ns > elapsed) {
+      uint64_t ns = replay->rec.ns - elapsed;
+      if (ns > REPLAY_MAX_SLEEP_NS)
+        ns = REPLAY_MAX_SLEEP_NS;
+      struct timespec ts = {ns / 1000000000ULL, ns % 1000000000ULL};
+      nanosleep(&ts, NULL);
+      return 0;
+    }
+    // The decoders modify packets in place, so use the endpoint buffer
+    if (replay->rec.type == SIM_RECORD_PACKET
+      && replay->rec.tracker < drv->num_trackers
+      && replay->rec.length <= USB_INT_BUFF_LENGTH) {
+      // Watchman packets arrive on the first interface
+      uint8_t idx = replay->rec.endpoint;
+      if (idx == WATCHMAN)
+        idx = 0;
+      if (idx < MAX_ENDPOINTS) {
+        struct Endpoint * ep =
+          &drv->trackers[replay->rec.tracker]->endpoints[idx];
+        ep->type = replay->rec.endpoint;
+        memcpy(ep->buffer, replay->data, replay->rec.length);
+        deepdive_transport_dispatch(ep, replay->rec.length);
+      }
+    }
+    replay->pending = deepdive_sim_read_record(replay->fp, &replay->rec,
+      replay->data, sizeof(replay->data));
+    return 0;
+  }
+  // End of file
+  return -1;
+}
+
+// Close the file and free the trackers
+static void replay_close(struct Driver * drv) {
+  struct Replay * replay = drv->transport_data;
+  for (size_t i = 0; i < drv->num_trackers; i++)
+    free(drv->trackers[i]);
+  if (!replay)
+    return;
+  if (replay->fp)
+    fclose(replay->fp);
+  free(replay);
+}
+
+// There is no device, so feature reports succeed without doing anything
+static int replay_feature(struct Tracker * tracker, uint8_t * data, int len) {
+  return len;
+}
+
+// Feeds packets recorded by deepdive_sim through the decoders, paced by
+// their timestamps, so that the whole stack can run without hardware
+const struct Transport deepdive_transport_replay = {
+  "replay", replay_init, replay_poll, replay_close,
+  replay_feature, replay_feature
+};
@@ -0,0 +1,99 @@
+/* 
+  Unofficial driver for Vive Trackers and up to two lighthouses, with an
+    emphasis on pulling tracker and lighthouse calibration data from devices.
+  
+  Adapted from: https://github.com/cnlohr/libsurvive
+  Which was based off: https://github.com/collabora/OSVR-Vive-Libre
+    Originally Copyright 2016 Philipp Zabel
+    Originally Copyright 2016 Lubosz Sarnecki <lubosz.sarnecki@collabora.co.uk>
+    Originally Copyright (C) 2013 Fredrik Hultin
+    Originally Copyright (C) 2013 Jakob Bornecrantz
+  Using documentation from: https://github.com/nairol/LighthouseRedox
+  
+  Copyright (c) 2017 Andrew Symington
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+// Needed for CPU affinity
+#define _GNU_SOURCE
+
+#include <deepdive.h>
+
+#include "deepdive_log.h"
+
+#include <sys/mman.h>
+#include <pthread.h>
+#include <sched.h>
+#include <malloc.h>
+#include <errno.h>
+
+// Amount of stack to fault in before entering the loop
+#define RT_STACK_PREFAULT     (64 * 1024)
+
+// Touch the stack so that its pages are resident before they are needed.
+// The barrier uses the array, so the writes are not optimized away.
+static void rt_prefault_stack(void) {
+  uint8_t stack[RT_STACK_PREFAULT];
+  for (size_t i = 0; i < RT_STACK_PREFAULT; i += 4096)
+    stack[i] = 0;
+  __asm__ __volatile__("" : : "r"(stack) : "memory");
+}
+
+// Prepare the calling thread for real-time polling
+int deepdive_rt_thread(struct Driver * drv, int priority, int cpu) {
+  if (drv == NULL) return 0;
+  int ok = 1;
+  // Never give memory back to the kernel or satisfy requests with mmap, so
+  // that a stray allocation can't page fault once memory is locked
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_MMAP_MAX, 0);
+  if (mlockall(MCL_CURRENT | MCL_FUTURE)) {
+    LOG_WARN(drv, "rt", "Could not lock memory (errno: %d)", errno);
+    ok = 0;
+  }
+  rt_prefault_stack();
+  // Pin to a single CPU
+  if (cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (ret) {
+      LOG_WARN(drv, "rt", "Could not pin to CPU %d (errno: %d)", cpu, ret);
+      ok = 0;
+    }
+  }
+  // Switch to the FIFO scheduler
+  if (priority > 0) {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+    int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (ret) {
+      LOG_WARN(drv, "rt", "Could not set priority %d (errno: %d)",
+        priority, ret);
+      ok = 0;
+    }
+  }
+  if (ok)
+    LOG_INFO(drv, "rt", "Polling in real-time mode (priority: %d, cpu: %d)",
+      priority, cpu);
+  return ok;
+}
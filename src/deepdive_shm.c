@@ -0,0 +1,277 @@
+/* 
+  Unofficial driver for Vive Trackers and up to two lighthouses, with an
+    emphasis on pulling tracker and lighthouse calibration data from devices.
+  
+  Adapted from: https://github.com/cnlohr/libsurvive
+  Which was based off: https://github.com/collabora/OSVR-Vive-Libre
+    Originally Copyright 2016 Philipp Zabel
+    Originally Copyright 2016 Lubosz Sarnecki <lubosz.sarnecki@collabora.co.uk>
+    Originally Copyright (C) 2013 Fredrik Hultin
+    Originally Copyright (C) 2013 Jakob Bornecrantz
+  Using documentation from: https://github.com/nairol/LighthouseRedox
+  
+  Copyright (c) 2017 Andrew Symington
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+
+#include "deepdive_shm.h"
+#include "deepdive_shm_layout.h"
+#include "deepdive_log.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// The segment layout mirrors the driver's limits
+_Static_assert(SHM_MAX_SENSORS == MAX_NUM_SENSORS, "sensor limit mismatch");
+_Static_assert(SHM_MAX_TRACKERS == MAX_NUM_TRACKERS, "tracker limit mismatch");
+_Static_assert(SHM_MAX_LIGHTHOUSES == MAX_NUM_LIGHTHOUSES,
+  "lighthouse limit mismatch");
+_Static_assert(SHM_SERIAL_LENGTH == MAX_SERIAL_LENGTH, "serial mismatch");
+
+// Publisher context
+struct Shm {
+  char name[NAME_MAX];              // Segment name
+  size_t size;                      // Segment size in bytes
+  struct ShmHeader * hdr;           // Mapped segment
+  uint64_t head;                    // Number of events published
+};
+
+// Current monotonic time in nanoseconds
+static uint64_t shm_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// Claim the next cell in the ring, and fill in the common fields
+static struct ShmEvent * shm_begin(struct Shm * shm, uint8_t type,
+  uint8_t id, const char * serial) {
+  struct ShmSlot * slot = &shm->hdr->ring[shm->head & (shm->hdr->slots - 1)];
+  struct ShmEvent * event = shm_slot_begin(slot);
+  event->ns = shm_now();
+  event->type = type;
+  event->id = id;
+  strncpy(event->serial, serial, SHM_SERIAL_LENGTH - 1);
+  event->serial[SHM_SERIAL_LENGTH - 1] = '\0';
+  return event;
+}
+
+// Publish the cell claimed by shm_begin
+static void shm_commit(struct Shm * shm) {
+  struct ShmSlot * slot = &shm->hdr->ring[shm->head & (shm->hdr->slots - 1)];
+  shm->head++;
+  shm_slot_commit(slot, shm->head);
+  atomic_store_explicit(&shm->hdr->head, shm->head, memory_order_release);
+}
+
+// Copy tracker calibration into an event
+static void shm_fill_tracker(struct ShmEvent * event, struct Tracker * t) {
+  struct ShmTracker * d = &event->data.tracker;
+  d->type = t->type;
+  d->num_channels = t->cal.num_channels;
+  memcpy(d->channels, t->cal.channels, sizeof(d->channels));
+  memcpy(d->positions, t->cal.positions, sizeof(d->positions));
+  memcpy(d->normals, t->cal.normals, sizeof(d->normals));
+  memcpy(d->acc_bias, t->cal.acc_bias, sizeof(d->acc_bias));
+  memcpy(d->acc_scale, t->cal.acc_scale, sizeof(d->acc_scale));
+  memcpy(d->gyr_bias, t->cal.gyr_bias, sizeof(d->gyr_bias));
+  memcpy(d->gyr_scale, t->cal.gyr_scale, sizeof(d->gyr_scale));
+  memcpy(d->imu_transform, t->cal.imu_transform, sizeof(d->imu_transform));
+  memcpy(d->head_transform, t->cal.head_transform, sizeof(d->head_transform));
+}
+
+// Copy lighthouse calibration into an event
+static void shm_fill_lighthouse(struct ShmEvent * event,
+  struct Lighthouse * l) {
+  struct ShmLighthouse * d = &event->data.lighthouse;
+  d->id = l->id;
+  d->fw_version = l->fw_version;
+  d->hw_version = l->hw_version;
+  d->mode_current = l->mode_current;
+  d->sys_faults = l->sys_faults;
+  for (size_t i = 0; i < SHM_MAX_MOTORS; i++) {
+    d->phase[i] = l->motors[i].phase;
+    d->tilt[i] = l->motors[i].tilt;
+    d->gibphase[i] = l->motors[i].gibphase;
+    d->gibmag[i] = l->motors[i].gibmag;
+    d->curve[i] = l->motors[i].curve;
+  }
+  memcpy(d->accel, l->accel, sizeof(d->accel));
+}
+
+// Update a metadata cell, which late readers use to catch up
+static void shm_metadata(struct ShmSlot * slot, struct ShmEvent * src) {
+  uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+  struct ShmEvent * event = shm_slot_begin(slot);
+  memcpy(event, src, sizeof(struct ShmEvent));
+  atomic_store_explicit(&slot->seq, seq + 1, memory_order_release);
+}
+
+// Start publishing decoded events to a shared-memory segment
+int deepdive_shm_serve(struct Driver * drv, const char * name,
+  uint32_t slots) {
+  if (drv == NULL || drv->shm != NULL) return 0;
+  if (slots == 0 || (slots & (slots - 1))) {
+    LOG_ERROR(drv, "shm", "Ring length %u is not a power of two", slots);
+    return 0;
+  }
+  struct Shm * shm = malloc(sizeof(struct Shm));
+  if (shm == NULL)
+    return 0;
+  memset(shm, 0, sizeof(struct Shm));
+  // Segment names must start with a slash
+  snprintf(shm->name, NAME_MAX, "%s%s",
+    (name && name[0] == '/') ? "" : "/", name ? name : "deepdive");
+  shm->size = shm_size(slots);
+  // A segment left by an earlier server may still be mapped by readers, who
+  // would fault if it were truncated, so unlink it and start a fresh one
+  shm_unlink(shm->name);
+  int fd = shm_open(shm->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) {
+    LOG_ERROR(drv, "shm", "Could not create the segment");
+    free(shm);
+    return 0;
+  }
+  if (ftruncate(fd, shm->size) != 0) {
+    LOG_ERROR(drv, "shm", "Could not size the segment");
+    close(fd);
+    shm_unlink(shm->name);
+    free(shm);
+    return 0;
+  }
+  shm->hdr = mmap(NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shm->hdr == MAP_FAILED) {
+    LOG_ERROR(drv, "shm", "Could not map the segment");
+    shm_unlink(shm->name);
+    free(shm);
+    return 0;
+  }
+  // The segment is zero-filled, so all cells start out empty. Readers
+  // check the magic last, so fill it in once everything else is ready.
+  shm->hdr->version = SHM_VERSION;
+  shm->hdr->slots = slots;
+  shm->hdr->event_size = sizeof(struct ShmEvent);
+  atomic_init(&shm->hdr->head, 0);
+  atomic_init(&shm->hdr->running, 1);
+  atomic_thread_fence(memory_order_release);
+  shm->hdr->magic = SHM_MAGIC;
+  drv->shm = shm;
+  // Seed the metadata with whatever calibration we already have
+  for (size_t i = 0; i < drv->num_trackers; i++)
+    deepdive_shm_tracker(drv->trackers[i]);
+  for (size_t i = 0; i < MAX_NUM_LIGHTHOUSES; i++)
+    if (drv->lighthouses[i].timestamp)
+      deepdive_shm_lighthouse(drv, &drv->lighthouses[i]);
+  return 1;
+}
+
+// Unmap and unlink the segment, telling readers that we have gone away
+void deepdive_shm_close(struct Driver * drv) {
+  if (drv == NULL || drv->shm == NULL) return;
+  atomic_store_explicit(&drv->shm->hdr->running, 0, memory_order_release);
+  munmap(drv->shm->hdr, drv->shm->size);
+  shm_unlink(drv->shm->name);
+  free(drv->shm);
+  drv->shm = NULL;
+}
+
+// Publish a sweep
+void deepdive_shm_light(struct Tracker * tracker,
+  struct Lighthouse * lighthouse, uint8_t axis, uint32_t synctime,
+  uint16_t num_sensors, uint16_t *sensors, uint32_t *sweeptimes,
+  uint32_t *angles, uint16_t *lengths) {
+  struct Shm * shm = tracker->driver->shm;
+  if (shm == NULL) return;
+  if (num_sensors > SHM_MAX_SENSORS)
+    num_sensors = SHM_MAX_SENSORS;
+  struct ShmEvent * event = shm_begin(shm, SHM_EVENT_LIGHT, tracker->id,
+    tracker->serial);
+  struct ShmLight * d = &event->data.light;
+  strncpy(d->lighthouse, lighthouse->serial, SHM_SERIAL_LENGTH - 1);
+  d->lighthouse[SHM_SERIAL_LENGTH - 1] = '\0';
+  d->lighthouse_id = lighthouse->id;
+  d->axis = axis;
+  d->synctime = synctime;
+  d->num_sensors = num_sensors;
+  memcpy(d->sensors, sensors, num_sensors * sizeof(uint16_t));
+  memcpy(d->sweeptimes, sweeptimes, num_sensors * sizeof(uint32_t));
+  memcpy(d->angles, angles, num_sensors * sizeof(uint32_t));
+  memcpy(d->lengths, lengths, num_sensors * sizeof(uint16_t));
+  shm_commit(shm);
+}
+
+// Publish an inertial sample
+void deepdive_shm_imu(struct Tracker * tracker, uint32_t timecode,
+  int16_t acc[3], int16_t gyr[3], int16_t mag[3]) {
+  struct Shm * shm = tracker->driver->shm;
+  if (shm == NULL) return;
+  struct ShmEvent * event = shm_begin(shm, SHM_EVENT_IMU, tracker->id,
+    tracker->serial);
+  struct ShmImu * d = &event->data.imu;
+  d->timecode = timecode;
+  memcpy(d->acc, acc, sizeof(d->acc));
+  memcpy(d->gyr, gyr, sizeof(d->gyr));
+  memcpy(d->mag, mag, sizeof(d->mag));
+  shm_commit(shm);
+}
+
+// Publish a button event
+void deepdive_shm_button(struct Tracker * tracker,
+  uint32_t mask, uint16_t trigger, int16_t horizontal, int16_t vertical) {
+  struct Shm * shm = tracker->driver->shm;
+  if (shm == NULL) return;
+  struct ShmEvent * event = shm_begin(shm, SHM_EVENT_BUTTON, tracker->id,
+    tracker->serial);
+  event->data.button.mask = mask;
+  event->data.button.trigger = trigger;
+  event->data.button.horizontal = horizontal;
+  event->data.button.vertical = vertical;
+  shm_commit(shm);
+}
+
+// Publish tracker calibration
+void deepdive_shm_tracker(struct Tracker * tracker) {
+  struct Driver * drv = tracker->driver;
+  if (drv->shm == NULL) return;
+  struct ShmEvent * event = shm_begin(drv->shm, SHM_EVENT_TRACKER,
+    tracker->id, tracker->serial);
+  shm_fill_tracker(event, tracker);
+  shm_commit(drv->shm);
+  shm_metadata(&drv->shm->hdr->trackers[tracker->id], event);
+}
+
+// Publish lighthouse calibration
+void deepdive_shm_lighthouse(struct Driver * drv,
+  struct Lighthouse * lighthouse) {
+  if (drv->shm == NULL) return;
+  struct ShmEvent * event = shm_begin(drv->shm, SHM_EVENT_LIGHTHOUSE,
+    lighthouse->id, lighthouse->serial);
+  shm_fill_lighthouse(event, lighthouse);
+  shm_commit(drv->shm);
+  size_t i = lighthouse - drv->lighthouses;
+  if (i < MAX_NUM_LIGHTHOUSES)
+    shm_metadata(&drv->shm->hdr->lighthouses[i], event);
+}
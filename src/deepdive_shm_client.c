@@ -0,0 +1,159 @@
+/* 
+  Unofficial driver for Vive Trackers and up to two lighthouses, with an
+    emphasis on pulling tracker and lighthouse calibration data from devices.
+  
+  Adapted from: https://github.com/cnlohr/libsurvive
+  Which was based off: https://github.com/collabora/OSVR-Vive-Libre
+    Originally Copyright 2016 Philipp Zabel
+    Originally Copyright 2016 Lubosz Sarnecki <lubosz.sarnecki@collabora.co.uk>
+    Originally Copyright (C) 2013 Fredrik Hultin
+    Originally Copyright (C) 2013 Jakob Bornecrantz
+  Using documentation from: https://github.com/nairol/LighthouseRedox
+  
+  Copyright (c) 2017 Andrew Symington
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+
+#include "deepdive_shm_layout.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Number of attempts at reading a metadata cell
+#define SHM_METADATA_TRIES    16
+
+// Reader context. All reader state is private, so the publisher never
+// needs to know how many readers there are or how far behind they are.
+struct ShmReader {
+  size_t size;                      // Segment size in bytes
+  struct ShmHeader * hdr;           // Mapped segment (read-only)
+  ShmReadMode mode;                 // Consumption semantics
+  uint64_t cursor;                  // Number of events consumed
+  uint64_t lost;                    // Events overwritten before being read
+};
+
+// Attach to the segment published by a driver
+struct ShmReader * deepdive_shm_attach(const char * name, ShmReadMode mode) {
+  char path[NAME_MAX];
+  snprintf(path, NAME_MAX, "%s%s",
+    (name && name[0] == '/') ? "" : "/", name ? name : "deepdive");
+  int fd = shm_open(path, O_RDONLY, 0);
+  if (fd < 0)
+    return NULL;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(struct ShmHeader)) {
+    close(fd);
+    return NULL;
+  }
+  struct ShmHeader * hdr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (hdr == MAP_FAILED)
+    return NULL;
+  // The magic is written last, so check it before anything else
+  int ok = (hdr->magic == SHM_MAGIC);
+  atomic_thread_fence(memory_order_acquire);
+  ok = ok && hdr->version == SHM_VERSION
+          && hdr->event_size == sizeof(struct ShmEvent)
+          && shm_size(hdr->slots) <= (size_t) st.st_size;
+  if (!ok) {
+    munmap(hdr, st.st_size);
+    return NULL;
+  }
+  struct ShmReader * reader = malloc(sizeof(struct ShmReader));
+  if (reader == NULL) {
+    munmap(hdr, st.st_size);
+    return NULL;
+  }
+  reader->size = st.st_size;
+  reader->hdr = hdr;
+  reader->mode = mode;
+  reader->cursor = atomic_load_explicit(&hdr->head, memory_order_acquire);
+  reader->lost = 0;
+  return reader;
+}
+
+// Copy out the next event
+int deepdive_shm_read(struct ShmReader * reader, struct ShmEvent * event) {
+  if (reader == NULL || event == NULL) return -1;
+  struct ShmHeader * hdr = reader->hdr;
+  for (;;) {
+    uint64_t head = atomic_load_explicit(&hdr->head, memory_order_acquire);
+    if (reader->cursor >= head)
+      return atomic_load_explicit(&hdr->running, memory_order_acquire) ? 0 : -1;
+    // Readers that fall more than a ring behind skip to the oldest event
+    if (reader->mode == SHM_READ_LATEST) {
+      reader->cursor = head - 1;
+    } else if (head - reader->cursor > hdr->slots) {
+      reader->lost += head - hdr->slots - reader->cursor;
+      reader->cursor = head - hdr->slots;
+    }
+    // Event n is held in cell n modulo the ring length, with sequence n + 1
+    struct ShmSlot * slot = &hdr->ring[reader->cursor & (hdr->slots - 1)];
+    if (shm_slot_read(slot, reader->cursor + 1, event)) {
+      reader->cursor++;
+      return 1;
+    }
+    // The publisher lapped us while we were copying, so try again
+  }
+}
+
+// Number of events that were overwritten before being read
+uint64_t deepdive_shm_lost(struct ShmReader * reader) {
+  if (reader == NULL) return 0;
+  return reader->lost;
+}
+
+// Copy out a metadata cell, retrying while the publisher is updating it.
+// Cells that have never been written are indistinguishable from busy ones,
+// so give up after a few attempts.
+static int shm_read_metadata(struct ShmSlot * slot, struct ShmEvent * event) {
+  for (int i = 0; i < SHM_METADATA_TRIES; i++)
+    if (shm_slot_read(slot, 0, event))
+      return 1;
+  return 0;
+}
+
+// Copy out the latest tracker and lighthouse calibration
+int deepdive_shm_metadata(struct ShmReader * reader,
+  struct ShmEvent * events, int max) {
+  if (reader == NULL || events == NULL) return 0;
+  int n = 0;
+  for (size_t i = 0; i < SHM_MAX_LIGHTHOUSES && n < max; i++)
+    if (shm_read_metadata(&reader->hdr->lighthouses[i], &events[n]))
+      n++;
+  for (size_t i = 0; i < SHM_MAX_TRACKERS && n < max; i++)
+    if (shm_read_metadata(&reader->hdr->trackers[i], &events[n]))
+      n++;
+  return n;
+}
+
+// Detach from the segment and free the reader
+void deepdive_shm_detach(struct ShmReader * reader) {
+  if (reader == NULL) return;
+  munmap(reader->hdr, reader->size);
+  free(reader);
+}
@@ -0,0 +1,167 @@
+/* 
+  Unofficial driver for Vive Trackers and up to two lighthouses, with an
+    emphasis on pulling tracker and lighthouse calibration data from devices.
+  
+  Adapted from: https://github.com/cnlohr/libsurvive
+  Which was based off: https://github.com/collabora/OSVR-Vive-Libre
+    Originally Copyright 2016 Philipp Zabel
+    Originally Copyright 2016 Lubosz Sarnecki <lubosz.sarnecki@collabora.co.uk>
+    Originally Copyright (C) 2013 Fredrik Hultin
+    Originally Copyright (C) 2013 Jakob Bornecrantz
+  Using documentation from: https://github.com/nairol/LighthouseRedox
+  
+  Copyright (c) 2017 Andrew Symington
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+#ifndef LIBDEEPDIVE_DEEPDIVE_SHM_CLIENT_H
+#define LIBDEEPDIVE_DEEPDIVE_SHM_CLIENT_H
+
+#include <stdint.h>
+
+// Default name of the shared-memory segment
+#define SHM_DEFAULT_NAME      "/deepdive"
+
+// Default number of events held in the ring (must be a power of two)
+#define SHM_DEFAULT_SLOTS     4096
+
+// Limits, which match those of the driver
+#define SHM_MAX_SENSORS       32
+#define SHM_MAX_TRACKERS      128
+#define SHM_MAX_LIGHTHOUSES   2
+#define SHM_MAX_MOTORS        2
+#define SHM_SERIAL_LENGTH     32
+
+// Types of event published by the driver
+typedef enum {
+  SHM_EVENT_LIGHT       = 0,
+  SHM_EVENT_IMU         = 1,
+  SHM_EVENT_BUTTON      = 2,
+  SHM_EVENT_TRACKER     = 3,
+  SHM_EVENT_LIGHTHOUSE  = 4
+} ShmEventType;
+
+// How a reader consumes the ring
+typedef enum {
+  SHM_READ_ALL          = 0,  // Every event in order, counting any overruns
+  SHM_READ_LATEST       = 1   // Only the most recent event, skipping the rest
+} ShmReadMode;
+
+// One sweep of one lighthouse axis, as passed to the light callback
+struct ShmLight {
+  char lighthouse[SHM_SERIAL_LENGTH];       // Lighthouse serial
+  uint8_t lighthouse_id;                    // Lighthouse id
+  uint8_t axis;                             // Motor axis
+  uint32_t synctime;                        // Sync pulse time
+  uint16_t num_sensors;                     // Number of detections
+  uint16_t sensors[SHM_MAX_SENSORS];        // Sensor ids
+  uint32_t sweeptimes[SHM_MAX_SENSORS];     // Pulse start times
+  uint32_t angles[SHM_MAX_SENSORS];         // Ticks from sweep start
+  uint16_t lengths[SHM_MAX_SENSORS];        // Pulse lengths
+};
+
+// Raw inertial sample, as passed to the IMU callback
+struct ShmImu {
+  uint32_t timecode;                        // Tracker timecode
+  int16_t acc[3];                           // Raw accelerometer
+  int16_t gyr[3];                           // Raw gyroscope
+  int16_t mag[3];                           // Raw magnetometer
+};
+
+// Button state, as passed to the button callback
+struct ShmButton {
+  uint32_t mask;                            // Button mask
+  uint16_t trigger;                         // Trigger value
+  int16_t horizontal;                       // Pad horizontal
+  int16_t vertical;                         // Pad vertical
+};
+
+// Tracker calibration, with the same layout as the driver's Calibration
+struct ShmTracker {
+  uint16_t type;                            // Tracker type
+  uint8_t num_channels;                     // Number of photodiodes (PDs)
+  uint8_t channels[SHM_MAX_SENSORS];        // Channel assignment for PDs
+  float positions[SHM_MAX_SENSORS][3];      // PD positions
+  float normals[SHM_MAX_SENSORS][3];        // PD normals
+  float acc_bias[3];                        // Acceleromater bias
+  float acc_scale[3];                       // Accelerometer scale
+  float gyr_bias[3];                        // Gyro bias
+  float gyr_scale[3];                       // Gyro scale
+  float imu_transform[7];                   // Tracker -> IMU trasform
+  float head_transform[7];                  // Tracker -> Head transform
+};
+
+// Lighthouse calibration, decoded from OOTX
+struct ShmLighthouse {
+  uint8_t id;                               // ID of this lighthouse
+  uint16_t fw_version;                      // Firmware version
+  uint8_t hw_version;                       // Hardware version
+  uint8_t mode_current;                     // Current mode
+  uint8_t sys_faults;                       // Fault flags
+  float phase[SHM_MAX_MOTORS];              // Motor calibration
+  float tilt[SHM_MAX_MOTORS];
+  float gibphase[SHM_MAX_MOTORS];
+  float gibmag[SHM_MAX_MOTORS];
+  float curve[SHM_MAX_MOTORS];
+  float accel[3];                           // Acceleration vector
+};
+
+// A single decoded event. Plain data only, so it may be copied freely.
+struct ShmEvent {
+  uint64_t seq;                             // Sequence number (from 1)
+  uint64_t ns;                              // Receive time (CLOCK_MONOTONIC)
+  uint8_t type;                             // ShmEventType
+  uint8_t id;                               // Tracker or lighthouse id
+  char serial[SHM_SERIAL_LENGTH];           // Tracker or lighthouse serial
+  union {
+    struct ShmLight light;
+    struct ShmImu imu;
+    struct ShmButton button;
+    struct ShmTracker tracker;
+    struct ShmLighthouse lighthouse;
+  } data;
+};
+
+// Reader context
+struct ShmReader;
+
+// Attach to the segment published by a driver. Readers only ever map the
+// segment read-only, so any number may attach without slowing the driver.
+struct ShmReader * deepdive_shm_attach(const char * name, ShmReadMode mode);
+
+// Copy out the next event. Returns 1 if an event was read, 0 if there is
+// nothing new and -1 if the publisher has gone away.
+int deepdive_shm_read(struct ShmReader * reader, struct ShmEvent * event);
+
+// Number of events that were overwritten before a SHM_READ_ALL reader got
+// to them. Readers that fall more than a ring behind skip to the oldest.
+uint64_t deepdive_shm_lost(struct ShmReader * reader);
+
+// Copy out the latest tracker and lighthouse calibration, so that readers
+// which attach late need not wait for it to be sent again. Returns the
+// number of events written, up to max.
+int deepdive_shm_metadata(struct ShmReader * reader,
+  struct ShmEvent * events, int max);
+
+// Detach from the segment and free the reader
+void deepdive_shm_detach(struct ShmReader * reader);
+
+#endif
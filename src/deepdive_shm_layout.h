@@ -0,0 +1,101 @@
+/* 
+  Unofficial driver for Vive Trackers and up to two lighthouses, with an
+    emphasis on pulling tracker and lighthouse calibration data from devices.
+  
+  Adapted from: https://github.com/cnlohr/libsurvive
+  Which was based off: https://github.com/collabora/OSVR-Vive-Libre
+    Originally Copyright 2016 Philipp Zabel
+    Originally Copyright 2016 Lubosz Sarnecki <lubosz.sarnecki@collabora.co.uk>
+    Originally Copyright (C) 2013 Fredrik Hultin
+    Originally Copyright (C) 2013 Jakob Bornecrantz
+  Using documentation from: https://github.com/nairol/LighthouseRedox
+  
+  Copyright (c) 2017 Andrew Symington
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+#ifndef LIBDEEPDIVE_DEEPDIVE_SHM_LAYOUT_H
+#define LIBDEEPDIVE_DEEPDIVE_SHM_LAYOUT_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "deepdive_shm_client.h"
+
+// Identifies a deepdive segment, and the version of its layout
+#define SHM_MAGIC             0x48534444
+#define SHM_VERSION           2
+
+// An event cell. The sequence number doubles as a seqlock: it is zero
+// while the publisher is writing the cell, and the event's sequence
+// number once the write is complete.
+struct ShmSlot {
+  atomic_uint_least64_t seq;
+  struct ShmEvent event;
+};
+
+// Shared-memory segment, written by a single publisher
+struct ShmHeader {
+  uint32_t magic;                           // SHM_MAGIC
+  uint32_t version;                         // SHM_VERSION
+  uint32_t slots;                           // Ring length (power of two)
+  uint32_t event_size;                      // sizeof(struct ShmEvent)
+  atomic_uint_least64_t head;               // Number of events published
+  atomic_int running;                       // Cleared when publisher stops
+  struct ShmSlot trackers[SHM_MAX_TRACKERS];
+  struct ShmSlot lighthouses[SHM_MAX_LIGHTHOUSES];
+  struct ShmSlot ring[];
+};
+
+// Size of a segment with the given ring length
+static inline size_t shm_size(uint32_t slots) {
+  return sizeof(struct ShmHeader) + (size_t) slots * sizeof(struct ShmSlot);
+}
+
+// Mark a cell as being written, and return the event to fill in
+static inline struct ShmEvent * shm_slot_begin(struct ShmSlot * slot) {
+  atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  return &slot->event;
+}
+
+// Publish a cell that has been filled in
+static inline void shm_slot_commit(struct ShmSlot * slot, uint64_t seq) {
+  slot->event.seq = seq;
+  atomic_store_explicit(&slot->seq, seq, memory_order_release);
+}
+
+// Copy out a cell. Returns its sequence number, or zero if the cell was
+// being written or did not hold the expected sequence number (if nonzero).
+static inline uint64_t shm_slot_read(struct ShmSlot * slot, uint64_t expect,
+  struct ShmEvent * event) {
+  uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+  if (seq == 0 || (expect && seq != expect))
+    return 0;
+  memcpy(event, &slot->event, sizeof(struct ShmEvent));
+  atomic_thread_fence(memory_order_acquire);
+  if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq)
+    return 0;
+  return seq;
+}
+
+#endif
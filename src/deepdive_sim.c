@@ -0,0 +1,908 @@
+/* 
+  Unofficial driver for Vive Trackers and up to two lighthouses, with an
+    emphasis on pulling tracker and lighthouse calibration data from devices.
+  
+  Adapted from: https://github.com/cnlohr/libsurvive
+  Which was based off: https://github.com/collabora/OSVR-Vive-Libre
+    Originally Copyright 2016 Philipp Zabel
+    Originally Copyright 2016 Lubosz Sarnecki <lubosz.sarnecki@collabora.co.uk>
+    Originally Copyright (C) 2013 Fredrik Hultin
+    Originally Copyright (C) 2013 Jakob Bornecrantz
+  Using documentation from: https://github.com/nairol/LighthouseRedox
+  
+  Copyright (c) 2017 Andrew Symington
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+#include "deepdive_sim.h"
+
+#include <math.h>
+#include <zlib.h>
+
+// MATH HELPERS
+
+// Rotate a vector by a unit quaternion (w, x, y, z)
+static void quat_rotate(const double q[4], const double v[3], double out[3]) {
+  double t[3] = {
+    2.0 * (q[2] * v[2] - q[3] * v[1]),
+    2.0 * (q[3] * v[0] - q[1] * v[2]),
+    2.0 * (q[1] * v[1] - q[2] * v[0])
+  };
+  out[0] = v[0] + q[0] * t[0] + (q[2] * t[2] - q[3] * t[1]);
+  out[1] = v[1] + q[0] * t[1] + (q[3] * t[0] - q[1] * t[2]);
+  out[2] = v[2] + q[0] * t[2] + (q[1] * t[1] - q[2] * t[0]);
+}
+
+// Rotate a vector by the inverse of a unit quaternion
+static void quat_rotate_inv(const double q[4], const double v[3],
+  double out[3]) {
+  double c[4] = {q[0], -q[1], -q[2], -q[3]};
+  quat_rotate(c, v, out);
+}
+
+// Quaternion product a * b
+static void quat_mult(const double a[4], const double b[4], double out[4]) {
+  double r[4] = {
+    a[0] * b[0] - a[1] * b[1] - a[2] * b[2] - a[3] * b[3],
+    a[0] * b[1] + a[1] * b[0] + a[2] * b[3] - a[3] * b[2],
+    a[0] * b[2] - a[1] * b[3] + a[2] * b[0] + a[3] * b[1],
+    a[0] * b[3] + a[1] * b[2] - a[2] * b[1] + a[3] * b[0]
+  };
+  memcpy(out, r, sizeof(r));
+}
+
+static void quat_normalize(double q[4]) {
+  double n = sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+  for (int i = 0; i < 4; i++) q[i] /= n;
+}
+
+// Quaternion from a rotation about an axis
+static void quat_axis_angle(double x, double y, double z, double a,
+  double q[4]) {
+  double n = sqrt(x * x + y * y + z * z);
+  q[0] = cos(a / 2.0);
+  q[1] = sin(a / 2.0) * x / n;
+  q[2] = sin(a / 2.0) * y / n;
+  q[3] = sin(a / 2.0) * z / n;
+}
+
+// Quaternion from a rotation matrix with the given columns
+static void quat_from_axes(const double x[3], const double y[3],
+  const double z[3], double q[4]) {
+  double tr = x[0] + y[1] + z[2];
+  if (tr > 0) {
+    double s = 0.5 / sqrt(tr + 1.0);
+    q[0] = 0.25 / s;
+    q[1] = (y[2] - z[1]) * s;
+    q[2] = (z[0] - x[2]) * s;
+    q[3] = (x[1] - y[0]) * s;
+  } else if (x[0] > y[1] && x[0] > z[2]) {
+    double s = 2.0 * sqrt(1.0 + x[0] - y[1] - z[2]);
+    q[0] = (y[2] - z[1]) / s;
+    q[1] = 0.25 * s;
+    q[2] = (y[0] + x[1]) / s;
+    q[3] = (z[0] + x[2]) / s;
+  } else if (y[1] > z[2]) {
+    double s = 2.0 * sqrt(1.0 + y[1] - x[0] - z[2]);
+    q[0] = (z[0] - x[2]) / s;
+    q[1] = (y[0] + x[1]) / s;
+    q[2] = 0.25 * s;
+    q[3] = (z[1] + y[2]) / s;
+  } else {
+    double s = 2.0 * sqrt(1.0 + z[2] - x[0] - y[1]);
+    q[0] = (x[1] - y[0]) / s;
+    q[1] = (z[0] + x[2]) / s;
+    q[2] = (z[1] + y[2]) / s;
+    q[3] = 0.25 * s;
+  }
+  quat_normalize(q);
+}
+
+static void cross(const double a[3], const double b[3], double out[3]) {
+  out[0] = a[1] * b[2] - a[2] * b[1];
+  out[1] = a[2] * b[0] - a[0] * b[2];
+  out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static void normalize(double v[3]) {
+  double n = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+  for (int i = 0; i < 3; i++) v[i] /= n;
+}
+
+// RANDOM NUMBERS
+
+// xorshift64* generator
+static uint64_t rng_next(struct Sim * sim) {
+  sim->rng ^= sim->rng >> 12;
+  sim->rng ^= sim->rng << 25;
+  sim->rng ^= sim->rng >> 27;
+  return sim->rng * 0x2545F4914F6CDD1DULL;
+}
+
+// Uniform random number in [0, 1)
+static double rng_uniform(struct Sim * sim) {
+  return (rng_next(sim) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Standard normal random number
+static double rng_normal(struct Sim * sim) {
+  double u = rng_uniform(sim), v = rng_uniform(sim);
+  if (u < 1e-300) u = 1e-300;
+  return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+// ENCODERS
+
+// Append a bit to an OOTX stream
+static size_t ootx_bit(uint8_t * bits, size_t max, size_t n, uint8_t bit) {
+  if (n < max) bits[n] = bit;
+  return n + 1;
+}
+
+// Append a byte to an OOTX stream, MSB first
+static size_t ootx_byte(uint8_t * bits, size_t max, size_t n, uint8_t byte) {
+  for (int i = 7; i >= 0; i--)
+    n = ootx_bit(bits, max, n, (byte >> i) & 1);
+  return n;
+}
+
+// Encode a frame as preamble, length, payload and CRC, with a sync bit after
+// every 16 bit word, exactly as a lighthouse would transmit it.
+size_t deepdive_sim_ootx(uint8_t * bits, size_t max,
+  const uint8_t * data, uint16_t len) {
+  size_t n = 0;
+  for (int i = 0; i < PREAMBLE_LENGTH; i++)
+    n = ootx_bit(bits, max, n, 0);
+  n = ootx_bit(bits, max, n, 1);
+  n = ootx_byte(bits, max, n, len & 0xff);
+  n = ootx_byte(bits, max, n, len >> 8);
+  n = ootx_bit(bits, max, n, 1);
+  uint16_t padded = len + (len % 2);
+  for (uint16_t i = 0; i < padded; i += 2) {
+    n = ootx_byte(bits, max, n, i < len ? data[i] : 0);
+    n = ootx_byte(bits, max, n, i + 1 < len ? data[i + 1] : 0);
+    n = ootx_bit(bits, max, n, 1);
+  }
+  uint32_t crc = crc32(crc32(0L, NULL, 0), data, len);
+  n = ootx_byte(bits, max, n, (crc >> 0) & 0xff);
+  n = ootx_byte(bits, max, n, (crc >> 8) & 0xff);
+  n = ootx_bit(bits, max, n, 1);
+  n = ootx_byte(bits, max, n, (crc >> 16) & 0xff);
+  n = ootx_byte(bits, max, n, (crc >> 24) & 0xff);
+  n = ootx_bit(bits, max, n, 1);
+  return n;
+}
+
+// Convert a 32 bit float to a 16 bit float (round to nearest)
+uint16_t deepdive_sim_half(float f) {
+  union { float f; uint32_t i; } u = {f};
+  uint16_t sign = (u.i >> 16) & 0x8000;
+  int32_t exp = ((u.i >> 23) & 0xff) - 127 + 15;
+  uint32_t man = u.i & 0x7fffff;
+  if (((u.i >> 23) & 0xff) == 0xff)
+    return sign | 0x7c00 | (man ? 0x200 : 0);
+  if (exp >= 31)
+    return sign | 0x7c00;
+  if (exp <= 0) {
+    if (exp < -10) return sign;
+    man |= 0x800000;
+    uint32_t shift = 14 - exp;
+    return sign | ((man + (1u << (shift - 1))) >> shift);
+  }
+  uint16_t h = sign | (exp << 10) | (man >> 13);
+  if (man & 0x1000) h++;
+  return h;
+}
+
+// Pack the OOTX payload for a lighthouse
+void deepdive_sim_ootx_payload(const struct Lighthouse * lh, uint32_t serial,
+  uint8_t data[SIM_OOTX_LENGTH]) {
+  uint16_t h;
+  memset(data, 0, SIM_OOTX_LENGTH);
+  memcpy(data + 0x00, &lh->fw_version, 2);
+  memcpy(data + 0x02, &serial, 4);
+#define HALF(off, val) h = deepdive_sim_half(val); memcpy(data + off, &h, 2)
+  HALF(0x06, lh->motors[0].phase);
+  HALF(0x08, lh->motors[1].phase);
+  HALF(0x0a, lh->motors[0].tilt);
+  HALF(0x0c, lh->motors[1].tilt);
+  data[0x0e] = lh->sys_unlock_count;
+  data[0x0f] = lh->hw_version;
+  HALF(0x10, lh->motors[0].curve);
+  HALF(0x12, lh->motors[1].curve);
+  data[0x14] = (int8_t) lh->accel[0];
+  data[0x15] = (int8_t) lh->accel[1];
+  data[0x16] = (int8_t) lh->accel[2];
+  HALF(0x17, lh->motors[0].gibphase);
+  HALF(0x19, lh->motors[1].gibphase);
+  HALF(0x1b, lh->motors[0].gibmag);
+  HALF(0x1d, lh->motors[1].gibmag);
+#undef HALF
+  data[0x1f] = lh->mode_current;
+  data[0x20] = lh->sys_faults;
+}
+
+// Pack up to seven pulses into a wired light report
+void deepdive_sim_wired_light(uint8_t buf[USB_INT_BUFF_LENGTH],
+  const SimPulse * pulses, size_t n) {
+  memset(buf, 0xff, USB_INT_BUFF_LENGTH);
+  buf[0] = 0x25;
+  for (size_t i = 0; i < n && i < 7; i++) {
+    memcpy(buf + i * 8 + 1, &pulses[i].sensor, 2);
+    memcpy(buf + i * 8 + 3, &pulses[i].length, 2);
+    memcpy(buf + i * 8 + 5, &pulses[i].time, 4);
+  }
+}
+
+// Pack an IMU sample into a wired IMU report (the first of three slots)
+void deepdive_sim_wired_imu(uint8_t buf[USB_INT_BUFF_LENGTH],
+  uint32_t tc, const int16_t acc[3], const int16_t gyr[3]) {
+  memset(buf, 0, USB_INT_BUFF_LENGTH);
+  buf[0] = 0x20;
+  memcpy(buf + 1, acc, 6);
+  memcpy(buf + 7, gyr, 6);
+  memcpy(buf + 13, &tc, 4);
+}
+
+// Insertion sort of event times, latest first
+static void sort_desc(uint32_t * t, size_t n) {
+  for (size_t i = 1; i < n; i++)
+    for (size_t j = i; j > 0 && t[j - 1] < t[j]; j--) {
+      uint32_t tmp = t[j];
+      t[j] = t[j - 1];
+      t[j - 1] = tmp;
+    }
+}
+
+// Pack pulses and an optional IMU sample into a watchman radio sub-packet.
+// The layout is [time1][qty][time2], then optionally an IMU block of type
+// 0xe8, followed by [leds][reverse varint deltas][24 bit timecode].
+size_t deepdive_sim_watchman(uint8_t * buf, size_t max,
+  const SimPulse * pulses, size_t n,
+    const uint32_t * tc, const int16_t acc[3], const int16_t gyr[3]) {
+  uint32_t times[2 * SIM_WATCHMAN_PULSES];
+  uint8_t marked[2 * SIM_WATCHMAN_PULSES] = {0};
+  uint8_t done[SIM_WATCHMAN_PULSES] = {0};
+  uint8_t tmp[USB_INT_BUFF_LENGTH + 16];
+  uint8_t * out = tmp + 3;
+  if (n > SIM_WATCHMAN_PULSES)
+    return 0;
+  // The IMU block
+  if (tc) {
+    *(out++) = 0xe8;
+    *(out++) = *tc & 0xff;
+    memcpy(out, acc, 6);
+    memcpy(out + 6, gyr, 6);
+    out += 12;
+  }
+  if (n > 0) {
+    size_t m = 0;
+    for (size_t i = 0; i < n; i++) {
+      times[m++] = pulses[i].time;
+      times[m++] = pulses[i].time + pulses[i].length;
+    }
+    sort_desc(times, m);
+    for (size_t i = 1; i < m; i++)
+      if (times[i] == times[i - 1])
+        return 0;
+    // LEDs, in the order that the decoder will consume end times
+    size_t pl = 0;
+    for (size_t k = 0; k < n; k++) {
+      while (marked[pl]) pl++;
+      size_t j, s;
+      for (j = 0; j < n; j++)
+        if (!done[j] && pulses[j].time + pulses[j].length == times[pl]) break;
+      if (j == n || pulses[j].sensor >= MAX_NUM_SENSORS)
+        return 0;
+      for (s = pl + 1; s < m; s++)
+        if (times[s] == pulses[j].time) break;
+      if (s == m || s - pl - 1 > 7)
+        return 0;
+      uint8_t led = (uint8_t)((pulses[j].sensor << 3) | (s - pl - 1));
+      // Without an IMU block, the first LED byte is also the packet type,
+      // and channels 28-31 would be mistaken for buttons, battery or IMU.
+      if (k == 0 && !tc && pulses[j].sensor >= 28)
+        return 0;
+      *(out++) = led;
+      marked[s] = 1;
+      done[j] = 1;
+      pl++;
+    }
+    // Deltas between times, from the earliest to the latest. Each is stored
+    // as 7 bit groups, least significant group first and flagged with 0x80.
+    for (size_t i = m - 1; i > 0; i--) {
+      uint32_t d = times[i - 1] - times[i];
+      uint8_t g[5];
+      int k = 0;
+      do {
+        g[k++] = d & 0x7f;
+        d >>= 7;
+      } while (d);
+      *(out++) = g[0] | 0x80;
+      for (int q = 1; q < k; q++)
+        *(out++) = g[q];
+    }
+    // Lower 24 bits of the latest time
+    *(out++) = (times[0] >> 0) & 0xff;
+    *(out++) = (times[0] >> 8) & 0xff;
+    *(out++) = (times[0] >> 16) & 0xff;
+    tmp[0] = (times[0] >> 24) & 0xff;
+  } else if (tc) {
+    tmp[0] = (*tc >> 24) & 0xff;
+  } else {
+    return 0;
+  }
+  tmp[1] = (uint8_t)(out - (tmp + 3) + 1);
+  tmp[2] = tc ? (*tc >> 16) & 0xff : 0;
+  size_t len = out - tmp;
+  if (len > max)
+    return 0;
+  memcpy(buf, tmp, len);
+  return len;
+}
+
+// MODEL
+
+// Predict the sweep angles of a point in the lighthouse frame
+void deepdive_sim_predict(const struct Lighthouse * params,
+  const double xyz[3], double ang[2]) {
+  const struct Motor * m = params->motors;
+  ang[0] = atan2(xyz[0] - (m[0].tilt + m[0].curve * xyz[1]) * xyz[1], xyz[2]);
+  ang[1] = atan2(xyz[1] - (m[1].tilt + m[1].curve * xyz[0]) * xyz[0], xyz[2]);
+  ang[0] -= m[0].phase + m[0].gibmag * sin(ang[0] + m[0].gibphase);
+  ang[1] -= m[1].phase + m[1].gibmag * sin(ang[1] + m[1].gibphase);
+}
+
+// Fill in the geometry of a synthetic puck: an outer ring of sensors facing
+// outwards and upwards, and an inner ring facing mostly upwards.
+void deepdive_sim_default_calibration(struct Calibration * cal) {
+  memset(cal, 0, sizeof(struct Calibration));
+  cal->num_channels = 22;
+  for (uint8_t i = 0; i < cal->num_channels; i++) {
+    double a, r, z, tilt;
+    if (i < 16) {
+      a = 2.0 * M_PI * i / 16.0;
+      r = 0.040;
+      z = 0.010;
+      tilt = M_PI / 4.0;
+    } else {
+      a = 2.0 * M_PI * (i - 16) / 6.0 + M_PI / 6.0;
+      r = 0.020;
+      z = 0.030;
+      tilt = M_PI / 8.0;
+    }
+    cal->channels[i] = i;
+    cal->positions[i][0] = r * cos(a);
+    cal->positions[i][1] = r * sin(a);
+    cal->positions[i][2] = z;
+    cal->normals[i][0] = sin(tilt) * cos(a);
+    cal->normals[i][1] = sin(tilt) * sin(a);
+    cal->normals[i][2] = cos(tilt);
+  }
+  for (int i = 0; i < 3; i++) {
+    cal->acc_scale[i] = 1.0;
+    cal->gyr_scale[i] = 1.0;
+  }
+  cal->imu_transform[3] = 1.0;
+  cal->head_transform[3] = 1.0;
+  cal->timestamp = 1;
+}
+
+// Fill in plausible motor parameters and a pose looking at (0, 0, 1) from
+// opposite corners of a 4m x 4m room
+void deepdive_sim_default_lighthouse(uint8_t idx, struct Lighthouse * params,
+  double pos[3], double quat[4]) {
+  memset(params, 0, sizeof(struct Lighthouse));
+  double s = (idx % 2 ? -1.0 : 1.0);
+  params->fw_version = 0x0262;
+  params->hw_version = 9;
+  params->mode_current = idx;
+  params->motors[0].phase = s * 0.0125;
+  params->motors[1].phase = -s * 0.0090;
+  params->motors[0].tilt = 0.0040;
+  params->motors[1].tilt = -0.0060;
+  params->motors[0].curve = 0.0010;
+  params->motors[1].curve = -0.0015;
+  params->motors[0].gibphase = 0.75;
+  params->motors[1].gibphase = -1.25;
+  params->motors[0].gibmag = 0.0045;
+  params->motors[1].gibmag = -0.0030;
+  params->accel[0] = 0;
+  params->accel[1] = 127;
+  params->accel[2] = -8;
+  pos[0] = 2.0 * s;
+  pos[1] = 2.0 * s;
+  pos[2] = 2.5;
+  // The lighthouse looks down its z axis, with y pointing down
+  double z[3] = {-pos[0], -pos[1], 1.0 - pos[2]}, x[3], y[3];
+  double down[3] = {0.0, 0.0, -1.0};
+  normalize(z);
+  cross(down, z, x);
+  normalize(x);
+  cross(z, x, y);
+  quat_from_axes(x, y, z, quat);
+}
+
+// SIMULATOR
+
+// Create a simulator with the given random seed
+struct Sim * deepdive_sim_init(uint64_t seed) {
+  struct Sim * sim = malloc(sizeof(struct Sim));
+  if (sim == NULL)
+    return NULL;
+  memset(sim, 0, sizeof(struct Sim));
+  sim->rng = seed ? seed : 0x9e3779b97f4a7c15ULL;
+  return sim;
+}
+
+// Add a lighthouse, returning its index or -1 on failure
+int deepdive_sim_add_lighthouse(struct Sim * sim,
+  const struct Lighthouse * params, const double pos[3], const double quat[4]) {
+  if (sim == NULL || sim->num_lighthouses >= MAX_NUM_LIGHTHOUSES)
+    return -1;
+  uint8_t idx = sim->num_lighthouses++;
+  struct SimLighthouse * l = &sim->lighthouses[idx];
+  memcpy(&l->lh, params, sizeof(struct Lighthouse));
+  l->lh.id = idx;
+  memcpy(l->pos, pos, sizeof(l->pos));
+  memcpy(l->quat, quat, sizeof(l->quat));
+  quat_normalize(l->quat);
+  // The serial number is a 32 bit integer on the wire
+  uint32_t serial = (uint32_t) strtoul(params->serial, NULL, 10);
+  if (serial == 0)
+    serial = 1000000000u + idx;
+  snprintf(l->lh.serial, MAX_SERIAL_LENGTH, "%u", serial);
+  // Precompute the OOTX bit stream, padded with zeros between frames
+  uint8_t data[SIM_OOTX_LENGTH];
+  deepdive_sim_ootx_payload(&l->lh, serial, data);
+  l->num_bits = deepdive_sim_ootx(l->bits, SIM_MAX_OOTX_BITS,
+    data, SIM_OOTX_LENGTH);
+  l->num_bits += 8;
+  // Start each lighthouse at a different point in its stream
+  l->bit = (idx * l->num_bits) / 3;
+  return idx;
+}
+
+// Add a tracker, returning its index or -1 on failure
+int deepdive_sim_add_tracker(struct Sim * sim, const char * serial,
+  uint16_t type, const struct Calibration * cal, const double offset[3]) {
+  if (sim == NULL || sim->num_trackers >= SIM_MAX_TRACKERS)
+    return -1;
+  struct SimTracker * t = malloc(sizeof(struct SimTracker));
+  if (t == NULL)
+    return -1;
+  memset(t, 0, sizeof(struct SimTracker));
+  strncpy(t->serial, serial, MAX_SERIAL_LENGTH - 1);
+  t->type = type;
+  memcpy(&t->cal, cal, sizeof(struct Calibration));
+  if (offset)
+    memcpy(t->offset, offset, sizeof(t->offset));
+  t->imu = SIM_START_TICKS;
+  sim->trackers[sim->num_trackers] = t;
+  return sim->num_trackers++;
+}
+
+// Read a trajectory from a CSV file with rows (t x y z qw qx qy qz)
+int deepdive_sim_load_trajectory(struct Sim * sim, const char * path) {
+  FILE * fp = fopen(path, "r");
+  if (fp == NULL)
+    return 0;
+  size_t cap = 1024, n = 0;
+  SimPose * poses = malloc(cap * sizeof(SimPose));
+  char line[512];
+  while (poses && fgets(line, sizeof(line), fp)) {
+    SimPose p;
+    if (line[0] == '#')
+      continue;
+    for (char * c = line; *c; c++)
+      if (*c == ',') *c = ' ';
+    if (sscanf(line, "%lf %lf %lf %lf %lf %lf %lf %lf", &p.t,
+      &p.pos[0], &p.pos[1], &p.pos[2],
+      &p.quat[0], &p.quat[1], &p.quat[2], &p.quat[3]) != 8)
+      continue;
+    if (n > 0 && p.t <= poses[n - 1].t)
+      continue;
+    quat_normalize(p.quat);
+    if (n == cap) {
+      cap *= 2;
+      SimPose * tmp = realloc(poses, cap * sizeof(SimPose));
+      if (tmp == NULL) {
+        free(poses);
+        poses = NULL;
+        break;
+      }
+      poses = tmp;
+    }
+    poses[n++] = p;
+  }
+  fclose(fp);
+  if (poses == NULL || n < 2) {
+    free(poses);
+    return 0;
+  }
+  free(sim->trajectory);
+  sim->trajectory = poses;
+  sim->num_poses = n;
+  return 1;
+}
+
+// Generate a built-in trajectory: a wobbling circle at about 1m height
+int deepdive_sim_default_trajectory(struct Sim * sim, double duration) {
+  size_t n = (size_t)(duration * 100.0) + 2;
+  SimPose * poses = malloc(n * sizeof(SimPose));
+  if (poses == NULL)
+    return 0;
+  for (size_t i = 0; i < n; i++) {
+    double t = i * 0.01, w = 2.0 * M_PI / 8.0;
+    double yaw[4], roll[4];
+    poses[i].t = t;
+    poses[i].pos[0] = 0.5 * cos(w * t);
+    poses[i].pos[1] = 0.5 * sin(w * t);
+    poses[i].pos[2] = 1.0 + 0.1 * sin(2.0 * w * t);
+    quat_axis_angle(0, 0, 1, w * t + M_PI / 2.0, yaw);
+    quat_axis_angle(1, 0, 0, 0.2 * sin(3.0 * w * t), roll);
+    quat_mult(yaw, roll, poses[i].quat);
+  }
+  free(sim->trajectory);
+  sim->trajectory = poses;
+  sim->num_poses = n;
+  return 1;
+}
+
+// Register the packet sink
+void deepdive_sim_install_packet_fn(struct Sim * sim, sim_func fn, void * arg) {
+  if (sim == NULL) return;
+  sim->packet_fn = fn;
+  sim->arg = arg;
+}
+
+// Interpolate the trajectory of a tracker at the given time
+void deepdive_sim_pose(struct Sim * sim, uint16_t tracker, double t,
+  double pos[3], double quat[4]) {
+  SimPose * p = sim->trajectory;
+  size_t lo = 0, hi = sim->num_poses - 1;
+  if (t <= p[lo].t) t = p[lo].t;
+  if (t >= p[hi].t) t = p[hi].t;
+  while (hi - lo > 1) {
+    size_t mid = (lo + hi) / 2;
+    if (p[mid].t <= t) lo = mid; else hi = mid;
+  }
+  double a = (t - p[lo].t) / (p[hi].t - p[lo].t);
+  double dot = 0.0;
+  for (int i = 0; i < 4; i++)
+    dot += p[lo].quat[i] * p[hi].quat[i];
+  for (int i = 0; i < 3; i++)
+    pos[i] = (1.0 - a) * p[lo].pos[i] + a * p[hi].pos[i]
+      + sim->trackers[tracker]->offset[i];
+  for (int i = 0; i < 4; i++)
+    quat[i] = (1.0 - a) * p[lo].quat[i]
+      + a * (dot < 0 ? -p[hi].quat[i] : p[hi].quat[i]);
+  quat_normalize(quat);
+}
+
+// Synthesize an IMU sample from the trajectory by finite differences
+static void sim_imu(struct Sim * sim, uint16_t idx, uint64_t tick) {
+  struct SimTracker * t = sim->trackers[idx];
+  const double h = 0.005, g[3] = {0.0, 0.0, 9.80665};
+  double ts = (double) tick / SIM_TICKS_PER_SEC;
+  double p0[3], p1[3], p2[3], q0[4], q1[4], q2[4], dq[4];
+  deepdive_sim_pose(sim, idx, ts - h, p0, q0);
+  deepdive_sim_pose(sim, idx, ts, p1, q1);
+  deepdive_sim_pose(sim, idx, ts + h, p2, q2);
+  // Specific force in the body frame
+  double f[3], fb[3];
+  for (int i = 0; i < 3; i++)
+    f[i] = (p2[i] - 2.0 * p1[i] + p0[i]) / (h * h) + g[i];
+  quat_rotate_inv(q1, f, fb);
+  // Angular velocity in the body frame
+  double c[4] = {q0[0], -q0[1], -q0[2], -q0[3]}, w[3];
+  quat_mult(c, q2, dq);
+  if (dq[0] < 0)
+    for (int i = 0; i < 4; i++) dq[i] = -dq[i];
+  double s = sqrt(dq[1] * dq[1] + dq[2] * dq[2] + dq[3] * dq[3]);
+  double a = 2.0 * atan2(s, dq[0]);
+  for (int i = 0; i < 3; i++)
+    w[i] = (s > 1e-12 ? dq[i + 1] / s * a : 0.0) / (2.0 * h);
+  // Quantize using the default scales
+  for (int i = 0; i < 3; i++) {
+    double ra = fb[i] / DEFAULT_ACC_SCALE;
+    double rg = w[i] / DEFAULT_GYR_SCALE;
+    t->acc[i] = (int16_t)(ra > 32767 ? 32767 : (ra < -32768 ? -32768 : ra));
+    t->gyr[i] = (int16_t)(rg > 32767 ? 32767 : (rg < -32768 ? -32768 : rg));
+  }
+  t->tc = (uint32_t) tick;
+}
+
+// Deliver a packet to the sink
+static void sim_emit(struct Sim * sim, uint16_t idx, uint32_t tick,
+  uint8_t endpoint, const uint8_t * buf) {
+  // Recover the 64 bit tick count from the wrapping 32 bit one
+  uint64_t base = SIM_START_TICKS + sim->cycle * SIM_SYNC_PERIOD;
+  uint64_t full = (base & ~0xffffffffULL) | tick;
+  if (full + 0x80000000ULL < base) full += 0x100000000ULL;
+  uint64_t ns = full * 1000000000ULL / SIM_TICKS_PER_SEC;
+  sim->num_packets++;
+  if (sim->packet_fn)
+    sim->packet_fn(sim, idx, ns, endpoint, buf, USB_INT_BUFF_LENGTH);
+}
+
+// Send a radio sub-packet, pairing small ones into a single report 36
+static void sim_radio(struct Sim * sim, uint16_t idx, uint32_t tick,
+  const uint8_t * sub, size_t len) {
+  struct SimTracker * t = sim->trackers[idx];
+  uint8_t buf[USB_INT_BUFF_LENGTH];
+  memset(buf, 0, sizeof(buf));
+  if (t->num_pending && len && len <= SIM_WATCHMAN_SUBLEN) {
+    buf[0] = 36;
+    memcpy(buf + 1, t->pending, t->num_pending);
+    memcpy(buf + 1 + SIM_WATCHMAN_SUBLEN, sub, len);
+    t->num_pending = 0;
+    sim_emit(sim, idx, tick, WATCHMAN, buf);
+    return;
+  }
+  if (t->num_pending) {
+    buf[0] = 35;
+    memcpy(buf + 1, t->pending, t->num_pending);
+    t->num_pending = 0;
+    sim_emit(sim, idx, (uint32_t) t->ns_pending, WATCHMAN, buf);
+    memset(buf, 0, sizeof(buf));
+  }
+  if (len == 0)
+    return;
+  if (len <= SIM_WATCHMAN_SUBLEN) {
+    memcpy(t->pending, sub, len);
+    t->num_pending = len;
+    t->ns_pending = tick;
+    return;
+  }
+  buf[0] = 35;
+  memcpy(buf + 1, sub, len);
+  sim_emit(sim, idx, tick, WATCHMAN, buf);
+}
+
+// Packetize the pulses and IMU samples of one tracker for the current cycle
+static void sim_packetize(struct Sim * sim, uint16_t idx, uint64_t end) {
+  struct SimTracker * t = sim->trackers[idx];
+  uint8_t buf[USB_INT_BUFF_LENGTH];
+  uint32_t imu_period = SIM_TICKS_PER_SEC / (t->type == USB_PROD_WATCHMAN
+    ? SIM_IMU_RATE_WATCHMAN : SIM_IMU_RATE_TRACKER);
+  size_t i = 0;
+  while (i < t->num_pulses || t->imu < end) {
+    // Work out how many pulses go into the next light packet
+    size_t n = t->num_pulses - i;
+    if (t->type == USB_PROD_WATCHMAN) {
+      if (n > SIM_WATCHMAN_PULSES) n = SIM_WATCHMAN_PULSES;
+    } else {
+      if (n > 7) n = 7;
+    }
+    uint32_t light = n ? t->pulses[i + n - 1].time : 0;
+    // IMU samples that are due before this light packet
+    if (t->imu < end && (n == 0 || (uint32_t)(t->imu) - light > 0x80000000u
+      || (uint32_t)(t->imu) == light)) {
+      sim_imu(sim, idx, t->imu);
+      if (t->type == USB_PROD_WATCHMAN) {
+        size_t len = deepdive_sim_watchman(buf, sizeof(buf) - 1, NULL, 0,
+          &t->tc, t->acc, t->gyr);
+        sim_radio(sim, idx, t->tc, buf, len);
+      } else {
+        deepdive_sim_wired_imu(buf, t->tc, t->acc, t->gyr);
+        sim_emit(sim, idx, t->tc, TRACKER_IMU, buf);
+      }
+      t->imu += imu_period;
+      continue;
+    }
+    // Light packet
+    if (t->type == USB_PROD_WATCHMAN) {
+      size_t len = 0;
+      while (n > 0) {
+        len = deepdive_sim_watchman(buf, sizeof(buf) - 1,
+          t->pulses + i, n, NULL, NULL, NULL);
+        // Some packets need an IMU block in front to be decodable
+        if (len == 0)
+          len = deepdive_sim_watchman(buf, sizeof(buf) - 1,
+            t->pulses + i, n, &t->tc, t->acc, t->gyr);
+        if (len > 0) break;
+        n--;
+      }
+      if (n == 0) {
+        i++;
+        continue;
+      }
+      sim_radio(sim, idx, t->pulses[i + n - 1].time, buf, len);
+    } else {
+      deepdive_sim_wired_light(buf, t->pulses + i, n);
+      sim_emit(sim, idx, t->pulses[i + n - 1].time, TRACKER_LIGHT, buf);
+    }
+    i += n;
+  }
+  // Don't hold radio packets across cycles
+  if (t->type == USB_PROD_WATCHMAN)
+    sim_radio(sim, idx, 0, NULL, 0);
+}
+
+// Append a pulse to the current cycle of a tracker
+static void sim_pulse(struct SimTracker * t, uint32_t time,
+  uint16_t sensor, uint16_t length) {
+  if (t->num_pulses >= SIM_MAX_PULSES)
+    return;
+  // Keep pulses sorted by rising edge, with unique edges
+  size_t j = t->num_pulses++;
+  while (j > 0 && t->pulses[j - 1].time > time) {
+    t->pulses[j] = t->pulses[j - 1];
+    j--;
+  }
+  if (j > 0 && t->pulses[j - 1].time == time)
+    time++;
+  t->pulses[j].time = time;
+  t->pulses[j].sensor = sensor;
+  t->pulses[j].length = length;
+}
+
+// Simulate one sync cycle, returning 0 when the trajectory is exhausted
+int deepdive_sim_step(struct Sim * sim) {
+  if (sim == NULL || sim->num_poses < 2 || sim->num_lighthouses == 0)
+    return 0;
+  uint64_t t0 = SIM_START_TICKS + sim->cycle * SIM_SYNC_PERIOD;
+  double ts = (double)(t0 + SIM_SWEEP_CENTER) / SIM_TICKS_PER_SEC;
+  if (ts > sim->trajectory[sim->num_poses - 1].t)
+    return 0;
+  // In A/B mode the lighthouses take turns to sweep both axes
+  uint8_t axis = sim->cycle & 1;
+  uint8_t sweeping = (sim->cycle >> 1) % sim->num_lighthouses;
+  for (uint16_t k = 0; k < sim->num_trackers; k++) {
+    struct SimTracker * t = sim->trackers[k];
+    t->num_pulses = 0;
+    // Sensor positions and normals in the world frame
+    double pos[3], quat[4], sp[MAX_NUM_SENSORS][3], sn[MAX_NUM_SENSORS][3];
+    deepdive_sim_pose(sim, k, ts, pos, quat);
+    for (uint8_t s = 0; s < t->cal.num_channels; s++) {
+      double p[3] = {t->cal.positions[s][0], t->cal.positions[s][1],
+        t->cal.positions[s][2]};
+      double n[3] = {t->cal.normals[s][0], t->cal.normals[s][1],
+        t->cal.normals[s][2]};
+      quat_rotate(quat, p, sp[s]);
+      quat_rotate(quat, n, sn[s]);
+      for (int i = 0; i < 3; i++) sp[s][i] += pos[i];
+    }
+    for (uint8_t l = 0; l < sim->num_lighthouses; l++) {
+      struct SimLighthouse * lh = &sim->lighthouses[l];
+      uint32_t sync = (uint32_t)(t0 + l * SIM_LH_OFFSET);
+      double lp[MAX_NUM_SENSORS][3], ang[2];
+      int facing[MAX_NUM_SENSORS], first = -1, seen = 0;
+      for (uint8_t s = 0; s < t->cal.num_channels; s++) {
+        double d[3] = {lh->pos[0] - sp[s][0], lh->pos[1] - sp[s][1],
+          lh->pos[2] - sp[s][2]};
+        double w[3] = {-d[0], -d[1], -d[2]};
+        quat_rotate_inv(lh->quat, w, lp[s]);
+        normalize(d);
+        facing[s] = (d[0] * sn[s][0] + d[1] * sn[s][1] + d[2] * sn[s][2]
+          > cos(SIM_MAX_INCIDENCE)) && lp[s][2] > 0;
+        t->truth[l][axis][s] = NAN;
+        if (!facing[s])
+          continue;
+        seen = 1;
+        if (first < 0 && rng_uniform(sim) >= sim->occlusion)
+          first = s;
+      }
+      // The sync flash is lost only if every facing sensor is occluded. It
+      // is reported on a single sensor, as the OOTX decoder consumes a data
+      // bit from every sync pulse it sees.
+      if (first >= 0) {
+        uint8_t acode = axis | (lh->bits[lh->bit] << 1)
+          | ((l != sweeping) << 2);
+        sim_pulse(t, sync + (uint32_t)(sim->noise * rng_normal(sim)),
+          first, 3000 + 500 * acode);
+      } else if (seen) {
+        sim->num_occluded++;
+      }
+      if (l != sweeping)
+        continue;
+      // Sweep hits
+      for (uint8_t s = 0; s < t->cal.num_channels; s++) {
+        if (!facing[s])
+          continue;
+        deepdive_sim_predict(&lh->lh, lp[s], ang);
+        if (fabs(ang[0]) > SIM_MAX_FOV || fabs(ang[1]) > SIM_MAX_FOV)
+          continue;
+        t->truth[l][axis][s] = ang[axis];
+        if (rng_uniform(sim) < sim->occlusion) {
+          sim->num_occluded++;
+          continue;
+        }
+        double dist = sqrt(lp[s][0] * lp[s][0] + lp[s][1] * lp[s][1]
+          + lp[s][2] * lp[s][2]);
+        double len = 100.0 + 300.0 / (dist > 0.5 ? dist : 0.5);
+        double ticks = SIM_SWEEP_CENTER + ang[axis] * SIM_SWEEP_DURATION / M_PI;
+        ticks += sim->noise * rng_normal(sim) - len / 2.0;
+        sim_pulse(t, sync + (uint32_t) llround(ticks), s, (uint16_t) len);
+        sim->num_pulses++;
+      }
+      // Reflections look like real pulses on a random channel
+      if (t->cal.num_channels && rng_uniform(sim) < sim->reflection) {
+        uint16_t s = rng_next(sim) % t->cal.num_channels;
+        double ticks = SIM_SWEEP_CENTER + (rng_uniform(sim) - 0.5) * 200000.0;
+        sim_pulse(t, sync + (uint32_t) ticks, s,
+          (uint16_t)(100 + rng_uniform(sim) * 500));
+        sim->num_reflections++;
+      }
+    }
+    sim_packetize(sim, k, t0 + SIM_SYNC_PERIOD);
+  }
+  // Each lighthouse sends one OOTX bit per cycle
+  for (uint8_t l = 0; l < sim->num_lighthouses; l++) {
+    struct SimLighthouse * lh = &sim->lighthouses[l];
+    lh->bit = (lh->bit + 1) % lh->num_bits;
+  }
+  sim->cycle++;
+  return 1;
+}
+
+// Destroy the simulator
+void deepdive_sim_close(struct Sim * sim) {
+  if (sim == NULL) return;
+  for (uint16_t i = 0; i < sim->num_trackers; i++)
+    free(sim->trackers[i]);
+  free(sim->trajectory);
+  free(sim);
+}
+
+// PACKET FILES
+
+// Write the stream header
+int deepdive_sim_write_header(FILE * fp) {
+  struct SimStream s;
+  memcpy(s.magic, SIM_MAGIC, 4);
+  s.version = SIM_VERSION;
+  s.reserved = 0;
+  return fwrite(&s, sizeof(s), 1, fp) == 1;
+}
+
+// Write a record
+int deepdive_sim_write_record(FILE * fp, uint64_t ns, uint8_t type,
+  uint8_t tracker, uint8_t endpoint, const void * data, uint16_t len) {
+  struct SimRecord r = {ns, type, tracker, endpoint, 0, len};
+  if (fwrite(&r, sizeof(r), 1, fp) != 1)
+    return 0;
+  return len == 0 || fwrite(data, len, 1, fp) == 1;
+}
+
+// Check the stream header
+int deepdive_sim_read_header(FILE * fp) {
+  struct SimStream s;
+  if (fread(&s, sizeof(s), 1, fp) != 1)
+    return 0;
+  return !memcmp(s.magic, SIM_MAGIC, 4) && s.version == SIM_VERSION;
+}
+
+// Read the next record into data (at most max bytes), returns 0 at the end
+int deepdive_sim_read_record(FILE * fp, struct SimRecord * rec,
+  void * data, size_t max) {
+  if (fread(rec, sizeof(struct SimRecord), 1, fp) != 1)
+    return 0;
+  if (rec->length > max) {
+    // Skip anything we can't hold
+    if (fseek(fp, rec->length, SEEK_CUR))
+      return 0;
+    rec->length = 0;
+    return 1;
+  }
+  return rec->length == 0 || fread(data, rec->length, 1, fp) == 1;
+}
@@ -0,0 +1,260 @@
+/* 
+  Unofficial driver for Vive Trackers and up to two lighthouses, with an
+    emphasis on pulling tracker and lighthouse calibration data from devices.
+  
+  Adapted from: https://github.com/cnlohr/libsurvive
+  Which was based off: https://github.com/collabora/OSVR-Vive-Libre
+    Originally Copyright 2016 Philipp Zabel
+    Originally Copyright 2016 Lubosz Sarnecki <lubosz.sarnecki@collabora.co.uk>
+    Originally Copyright (C) 2013 Fredrik Hultin
+    Originally Copyright (C) 2013 Jakob Bornecrantz
+  Using documentation from: https://github.com/nairol/LighthouseRedox
+  
+  Copyright (c) 2017 Andrew Symington
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef LIBDEEPDIVE_DEEPDIVE_SIM_H
+#define LIBDEEPDIVE_DEEPDIVE_SIM_H
+
+#include <deepdive.h>
+
+// Lighthouse timing, in 48MHz ticks
+#define SIM_TICKS_PER_SEC     48000000
+#define SIM_SYNC_PERIOD       400000
+#define SIM_SWEEP_CENTER      200000
+#define SIM_SWEEP_DURATION    400000
+#define SIM_LH_OFFSET         20000
+#define SIM_START_TICKS       1000
+
+// Limits
+#define SIM_MAX_TRACKERS      MAX_NUM_TRACKERS
+#define SIM_MAX_PULSES        256
+#define SIM_MAX_OOTX_BITS     1024
+#define SIM_OOTX_LENGTH       33
+#define SIM_MAX_FOV           (60.0 * 3.14159265358979 / 180.0)
+#define SIM_MAX_INCIDENCE     (80.0 * 3.14159265358979 / 180.0)
+
+// IMU sample rates (Hz)
+#define SIM_IMU_RATE_TRACKER  1000
+#define SIM_IMU_RATE_WATCHMAN 250
+
+// Watchman radio framing
+#define SIM_WATCHMAN_PULSES   6
+#define SIM_WATCHMAN_SUBLEN   29
+
+// Packet file format
+#define SIM_MAGIC             "DDSM"
+#define SIM_VERSION           1
+
+// Record types in a packet file
+typedef enum {
+  SIM_RECORD_TRACKER    = 1,
+  SIM_RECORD_LIGHTHOUSE = 2,
+  SIM_RECORD_PACKET     = 3,
+  SIM_RECORD_POSE       = 4
+} SimRecordType;
+
+// Stream header, written once at the start of a packet file
+struct __attribute__((packed)) SimStream {
+  char magic[4];                            // SIM_MAGIC
+  uint16_t version;                         // SIM_VERSION
+  uint16_t reserved;                        // Zero
+};
+
+// Every record starts with this header, followed by length bytes
+struct __attribute__((packed)) SimRecord {
+  uint64_t ns;                              // Time since start of stream
+  uint8_t type;                             // SimRecordType
+  uint8_t tracker;                          // Tracker index
+  uint8_t endpoint;                         // CallbackType for packets
+  uint8_t reserved;                         // Zero
+  uint16_t length;                          // Payload length in bytes
+};
+
+// Tracker metadata. The calibration is stored in native layout, so files
+// are only portable between machines with the same ABI.
+struct __attribute__((packed)) SimRecordTracker {
+  char serial[MAX_SERIAL_LENGTH];           // Serial number
+  uint16_t type;                            // USB product ID
+  struct Calibration cal;                   // Calibration
+};
+
+// Ground truth pose of a lighthouse or tracker in the world frame
+struct __attribute__((packed)) SimRecordPose {
+  char serial[MAX_SERIAL_LENGTH];           // Serial number
+  double pos[3];                            // Position
+  double quat[4];                           // Orientation (w, x, y, z)
+};
+
+// A single light pulse
+typedef struct {
+  uint32_t time;                            // Rising edge in ticks
+  uint16_t sensor;                          // Sensor channel
+  uint16_t length;                          // Length in ticks
+} SimPulse;
+
+// A trajectory sample
+typedef struct {
+  double t;                                 // Time in seconds
+  double pos[3];                            // Position
+  double quat[4];                           // Orientation (w, x, y, z)
+} SimPose;
+
+// A simulated lighthouse
+struct SimLighthouse {
+  struct Lighthouse lh;                     // Serial, motors and OOTX fields
+  double pos[3];                            // Position in world frame
+  double quat[4];                           // Orientation in world frame
+  uint8_t bits[SIM_MAX_OOTX_BITS];          // OOTX bit stream
+  size_t num_bits;                          // Length of bit stream
+  size_t bit;                               // Next bit to send
+};
+
+// A simulated tracker
+struct SimTracker {
+  char serial[MAX_SERIAL_LENGTH];           // Serial number
+  uint16_t type;                            // USB product ID
+  struct Calibration cal;                   // Sensor geometry
+  double offset[3];                         // Offset from the trajectory
+  uint64_t imu;                             // Tick of next IMU sample
+  SimPulse pulses[SIM_MAX_PULSES];          // Pulses in current cycle
+  size_t num_pulses;
+  double truth[MAX_NUM_LIGHTHOUSES][MAX_NUM_MOTORS][MAX_NUM_SENSORS];
+  uint8_t pending[SIM_WATCHMAN_SUBLEN + 8]; // Radio sub-packet awaiting a pair
+  size_t num_pending;
+  uint64_t ns_pending;
+  int16_t acc[3];                           // Last IMU sample
+  int16_t gyr[3];
+  uint32_t tc;
+};
+
+// Called for every synthesized USB packet
+struct Sim;
+typedef void (*sim_func)(struct Sim * sim, uint8_t tracker, uint64_t ns,
+  uint8_t endpoint, const uint8_t * buf, uint16_t len);
+
+// Simulator context
+struct Sim {
+  uint64_t rng;                             // Random number state
+  double noise;                             // Timing noise (ticks, 1 sigma)
+  double occlusion;                         // Probability of losing a pulse
+  double reflection;                        // Probability of a reflection
+  SimPose * trajectory;                     // Ground truth trajectory
+  size_t num_poses;
+  struct SimLighthouse lighthouses[MAX_NUM_LIGHTHOUSES];
+  uint8_t num_lighthouses;
+  struct SimTracker * trackers[SIM_MAX_TRACKERS];
+  uint16_t num_trackers;
+  uint64_t cycle;                           // Current sync cycle
+  sim_func packet_fn;                       // Packet sink
+  void * arg;                               // Packet sink user data
+  uint64_t num_pulses;                      // Statistics
+  uint64_t num_packets;
+  uint64_t num_occluded;
+  uint64_t num_reflections;
+};
+
+// Create a simulator with the given random seed
+struct Sim * deepdive_sim_init(uint64_t seed);
+
+// Add a lighthouse, returning its index or -1 on failure
+int deepdive_sim_add_lighthouse(struct Sim * sim,
+  const struct Lighthouse * params, const double pos[3], const double quat[4]);
+
+// Add a tracker, returning its index or -1 on failure
+int deepdive_sim_add_tracker(struct Sim * sim, const char * serial,
+  uint16_t type, const struct Calibration * cal, const double offset[3]);
+
+// Read a trajectory from a CSV file with rows (t x y z qw qx qy qz)
+int deepdive_sim_load_trajectory(struct Sim * sim, const char * path);
+
+// Generate a built-in trajectory of the given duration
+int deepdive_sim_default_trajectory(struct Sim * sim, double duration);
+
+// Fill in the geometry of a synthetic puck
+void deepdive_sim_default_calibration(struct Calibration * cal);
+
+// Fill in plausible motor parameters and a pose looking at the origin
+void deepdive_sim_default_lighthouse(uint8_t idx, struct Lighthouse * params,
+  double pos[3], double quat[4]);
+
+// Register the packet sink
+void deepdive_sim_install_packet_fn(struct Sim * sim, sim_func fn, void * arg);
+
+// Simulate one sync cycle, returning 0 when the trajectory is exhausted
+int deepdive_sim_step(struct Sim * sim);
+
+// Interpolate the trajectory of a tracker at the given time
+void deepdive_sim_pose(struct Sim * sim, uint16_t tracker, double t,
+  double pos[3], double quat[4]);
+
+// Predict the sweep angles of a point in the lighthouse frame, using the
+// same motor calibration model as the high-level driver
+void deepdive_sim_predict(const struct Lighthouse * params,
+  const double xyz[3], double ang[2]);
+
+// Destroy the simulator
+void deepdive_sim_close(struct Sim * sim);
+
+// ENCODERS
+
+// Encode an OOTX frame as a bit stream, returning the number of bits
+size_t deepdive_sim_ootx(uint8_t * bits, size_t max,
+  const uint8_t * data, uint16_t len);
+
+// Pack the OOTX payload for a lighthouse
+void deepdive_sim_ootx_payload(const struct Lighthouse * lh, uint32_t serial,
+  uint8_t data[SIM_OOTX_LENGTH]);
+
+// Convert a 32 bit float to a 16 bit float
+uint16_t deepdive_sim_half(float f);
+
+// Pack up to seven pulses into a wired light report
+void deepdive_sim_wired_light(uint8_t buf[USB_INT_BUFF_LENGTH],
+  const SimPulse * pulses, size_t n);
+
+// Pack an IMU sample into a wired IMU report
+void deepdive_sim_wired_imu(uint8_t buf[USB_INT_BUFF_LENGTH],
+  uint32_t tc, const int16_t acc[3], const int16_t gyr[3]);
+
+// Pack pulses and an optional IMU sample into a watchman radio sub-packet
+// (without the report ID), returning its length or 0 if it can't be encoded
+size_t deepdive_sim_watchman(uint8_t * buf, size_t max,
+  const SimPulse * pulses, size_t n,
+    const uint32_t * tc, const int16_t acc[3], const int16_t gyr[3]);
+
+// PACKET FILES
+
+// Write the stream header
+int deepdive_sim_write_header(FILE * fp);
+
+// Write a record
+int deepdive_sim_write_record(FILE * fp, uint64_t ns, uint8_t type,
+  uint8_t tracker, uint8_t endpoint, const void * data, uint16_t len);
+
+// Check the stream header
+int deepdive_sim_read_header(FILE * fp);
+
+// Read the next record into data (at most max bytes), returns 0 at the end
+int deepdive_sim_read_record(FILE * fp, struct SimRecord * rec,
+  void * data, size_t max);
+
+#endif
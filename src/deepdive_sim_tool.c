@@ -0,0 +1,355 @@
+/* 
+  Unofficial driver for Vive Trackers and up to two lighthouses, with an
+    emphasis on pulling tracker and lighthouse calibration data from devices.
+  
+  Adapted from: https://github.com/cnlohr/libsurvive
+  Which was based off: https://github.com/collabora/OSVR-Vive-Libre
+    Originally Copyright 2016 Philipp Zabel
+    Originally Copyright 2016 Lubosz Sarnecki <lubosz.sarnecki@collabora.co.uk>
+    Originally Copyright (C) 2013 Fredrik Hultin
+    Originally Copyright (C) 2013 Jakob Bornecrantz
+  Using documentation from: https://github.com/nairol/LighthouseRedox
+  
+  Copyright (c) 2017 Andrew Symington
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+#include <argtable2.h>
+
+#include <deepdive.h>
+
+#include <math.h>
+#include <time.h>
+
+// Decoders and simulator
+#include "deepdive_dev_tracker.h"
+#include "deepdive_dev_watchman.h"
+#include "deepdive_sim.h"
+
+// Simulator and output file
+static struct Sim * sim_ = NULL;
+static FILE * fp_ = NULL;
+static int write_error_ = 0;
+
+// Decoder context, fed with every synthesized packet
+static int decode_ = 0;
+static struct Driver drv_;
+static struct Tracker trackers_[SIM_MAX_TRACKERS];
+static uint64_t decode_ns_ = 0;
+
+// Decoder statistics
+static uint64_t num_bundles_ = 0;
+static uint64_t num_measurements_ = 0;
+static uint64_t num_unmatched_ = 0;
+static uint64_t num_imu_ = 0;
+static uint64_t num_ootx_ = 0;
+static double sum_err_ = 0.0;
+static double sum_sq_err_ = 0.0;
+static double max_err_ = 0.0;
+
+// Monotonic time in nanoseconds
+static uint64_t sim_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// Compare decoded angles against the ground truth for the current cycle
+static void my_light_process(struct Tracker * tracker,
+  struct Lighthouse * lighthouse, uint8_t axis, uint32_t synctime,
+    uint16_t num_sensors, uint16_t *sensors, uint32_t *sweeptimes,
+      uint32_t *angles, uint16_t *lengths) {
+  struct SimTracker * t = sim_->trackers[tracker - trackers_];
+  // The OOTX serial tells us which simulated lighthouse this was
+  uint8_t l;
+  for (l = 0; l < sim_->num_lighthouses; l++)
+    if (!strcmp(sim_->lighthouses[l].lh.serial, lighthouse->serial))
+      break;
+  if (l == sim_->num_lighthouses) {
+    num_unmatched_ += num_sensors;
+    return;
+  }
+  num_bundles_++;
+  for (uint16_t i = 0; i < num_sensors; i++) {
+    double truth = t->truth[l][axis][sensors[i]];
+    if (sensors[i] >= MAX_NUM_SENSORS || isnan(truth)) {
+      num_unmatched_++;
+      continue;
+    }
+    double ang = M_PI / SIM_SWEEP_DURATION
+      * ((double) angles[i] - SIM_SWEEP_CENTER);
+    double err = fabs(ang - truth);
+    sum_err_ += err;
+    sum_sq_err_ += err * err;
+    if (err > max_err_) max_err_ = err;
+    num_measurements_++;
+  }
+}
+
+// Count decoded IMU samples
+static void my_imu_process(struct Tracker * tracker, uint32_t timecode,
+  int16_t acc[3], int16_t gyr[3], int16_t mag[3]) {
+  num_imu_++;
+}
+
+// Count decoded OOTX frames
+static void my_lighthouse_process(struct Lighthouse * lighthouse) {
+  num_ootx_++;
+}
+
+// Called for every synthesized packet
+static void my_packet_process(struct Sim * sim, uint8_t tracker, uint64_t ns,
+  uint8_t endpoint, const uint8_t * buf, uint16_t len) {
+  if (fp_ && !deepdive_sim_write_record(fp_, ns, SIM_RECORD_PACKET,
+    tracker, endpoint, buf, len))
+      write_error_ = 1;
+  if (!decode_)
+    return;
+  // The decoders modify watchman packets in place
+  uint8_t tmp[USB_INT_BUFF_LENGTH];
+  memcpy(tmp, buf, len);
+  uint64_t tic = sim_now();
+  switch (endpoint) {
+  case TRACKER_LIGHT:
+    deepdive_dev_tracker_light(&trackers_[tracker], tmp, len);
+    break;
+  case TRACKER_IMU:
+    deepdive_dev_tracker_imu(&trackers_[tracker], tmp, len);
+    break;
+  case WATCHMAN:
+    deepdive_dev_watchman(&trackers_[tracker], tmp, len);
+    break;
+  }
+  decode_ns_ += sim_now() - tic;
+}
+
+// Write the trackers and lighthouses to the head of the output file
+static int write_metadata(struct Sim * sim) {
+  for (uint16_t i = 0; i < sim->num_trackers; i++) {
+    struct SimRecordTracker r;
+    memset(&r, 0, sizeof(r));
+    strcpy(r.serial, sim->trackers[i]->serial);
+    r.type = sim->trackers[i]->type;
+    r.cal = sim->trackers[i]->cal;
+    if (!deepdive_sim_write_record(fp_, 0, SIM_RECORD_TRACKER, i, 0,
+      &r, sizeof(r))) return 0;
+  }
+  for (uint8_t i = 0; i < sim->num_lighthouses; i++) {
+    struct SimRecordPose r;
+    memset(&r, 0, sizeof(r));
+    strcpy(r.serial, sim->lighthouses[i].lh.serial);
+    memcpy(r.pos, sim->lighthouses[i].pos, sizeof(r.pos));
+    memcpy(r.quat, sim->lighthouses[i].quat, sizeof(r.quat));
+    if (!deepdive_sim_write_record(fp_, 0, SIM_RECORD_LIGHTHOUSE, i, 0,
+      &r, sizeof(r))) return 0;
+  }
+  return 1;
+}
+
+// Write the ground truth pose of every tracker for the current cycle
+static int write_poses(struct Sim * sim) {
+  uint64_t tick = SIM_START_TICKS + sim->cycle * SIM_SYNC_PERIOD
+    + SIM_SWEEP_CENTER;
+  double t = (double) tick / SIM_TICKS_PER_SEC;
+  for (uint16_t i = 0; i < sim->num_trackers; i++) {
+    struct SimRecordPose r;
+    double pos[3], quat[4];
+    deepdive_sim_pose(sim, i, t, pos, quat);
+    memset(&r, 0, sizeof(r));
+    strcpy(r.serial, sim->trackers[i]->serial);
+    memcpy(r.pos, pos, sizeof(pos));
+    memcpy(r.quat, quat, sizeof(quat));
+    if (!deepdive_sim_write_record(fp_, tick * 1000000000ULL
+      / SIM_TICKS_PER_SEC, SIM_RECORD_POSE, i, 0, &r, sizeof(r))) return 0;
+  }
+  return 1;
+}
+
+// Main entry point for application
+int main(int argc, char **argv) {
+  struct arg_file *traj    = arg_file0(NULL, "trajectory", "<csv>",
+    "trajectory with rows (t x y z qw qx qy qz) (default: built-in circle)");
+  struct arg_dbl  *dur     = arg_dbl0("d", "duration", "<s>",
+    "duration of the built-in trajectory (default: 10)");
+  struct arg_int  *ntrk    = arg_int0("t", "trackers", "<n>",
+    "number of trackers following the trajectory (default: 1)");
+  struct arg_int  *nlh     = arg_int0("l", "lighthouses", "<n>",
+    "number of lighthouses, 1 or 2 (default: 2)");
+  struct arg_lit  *wm      = arg_lit0("w", "watchman",
+    "send watchman radio packets instead of wired reports");
+  struct arg_dbl  *noise   = arg_dbl0(NULL, "noise", "<ticks>",
+    "timing noise standard deviation (default: 2)");
+  struct arg_dbl  *occ     = arg_dbl0(NULL, "occlusion", "<p>",
+    "probability that a pulse is lost (default: 0)");
+  struct arg_dbl  *refl    = arg_dbl0(NULL, "reflection", "<p>",
+    "probability of a spurious pulse per sweep (default: 0)");
+  struct arg_int  *seed    = arg_int0(NULL, "seed", "<n>",
+    "random seed (default: 1)");
+  struct arg_file *output  = arg_file0("o", "output", "<file>",
+    "write the packets to a file");
+  struct arg_lit  *decode  = arg_lit0(NULL, "decode",
+    "feed packets through the decoders and report accuracy and throughput");
+  struct arg_lit  *help    = arg_lit0(NULL, "help", "print this help and exit");
+  struct arg_end  *end     = arg_end(20);
+  void* argtable[] = {traj, dur, ntrk, nlh, wm, noise, occ, refl, seed,
+    output, decode, help, end};
+  const char* progname = "deepdive_sim";
+  int nerrors, exitcode = 0;
+  if (arg_nullcheck(argtable) != 0) {
+    printf("%s: insufficient memory\n", progname);
+    exitcode = 1;
+    goto exit;
+  }
+  nerrors = arg_parse(argc, argv, argtable);
+  if (help->count > 0) {
+    printf("Usage: %s", progname);
+    arg_print_syntax(stdout, argtable, "\n");
+    printf("This program synthesizes tracker packets from a trajectory.\n");
+    arg_print_glossary(stdout, argtable,"  %-25s %s\n");
+    exitcode = 0;
+    goto exit;
+  }
+  if (nerrors > 0) {
+    arg_print_errors(stdout,end,progname);
+    printf("Try '%s --help' for more information.\n", progname);
+    exitcode = 2;
+    goto exit;
+  }
+  int num_trackers = (ntrk->count ? ntrk->ival[0] : 1);
+  int num_lighthouses = (nlh->count ? nlh->ival[0] : 2);
+  if (num_trackers < 1 || num_trackers > SIM_MAX_TRACKERS
+    || num_lighthouses < 1 || num_lighthouses > MAX_NUM_LIGHTHOUSES) {
+    printf("%s: invalid number of trackers or lighthouses\n", progname);
+    exitcode = 2;
+    goto exit;
+  }
+  // Set up the simulator
+  sim_ = deepdive_sim_init(seed->count ? seed->ival[0] : 1);
+  if (!sim_) {
+    printf("%s: insufficient memory\n", progname);
+    exitcode = 1;
+    goto exit;
+  }
+  sim_->noise = (noise->count ? noise->dval[0] : 2.0);
+  sim_->occlusion = (occ->count ? occ->dval[0] : 0.0);
+  sim_->reflection = (refl->count ? refl->dval[0] : 0.0);
+  if (traj->count > 0) {
+    if (!deepdive_sim_load_trajectory(sim_, traj->filename[0])) {
+      printf("%s: could not read trajectory\n", progname);
+      exitcode = 3;
+      goto close;
+    }
+  } else if (!deepdive_sim_default_trajectory(sim_,
+    dur->count ? dur->dval[0] : 10.0)) {
+    printf("%s: insufficient memory\n", progname);
+    exitcode = 1;
+    goto close;
+  }
+  for (int i = 0; i < num_lighthouses; i++) {
+    struct Lighthouse params;
+    double pos[3], quat[4];
+    deepdive_sim_default_lighthouse(i, &params, pos, quat);
+    deepdive_sim_add_lighthouse(sim_, &params, pos, quat);
+  }
+  // Trackers are spread out on a grid around the trajectory
+  struct Calibration cal;
+  deepdive_sim_default_calibration(&cal);
+  for (int i = 0; i < num_trackers; i++) {
+    char serial[MAX_SERIAL_LENGTH];
+    double offset[3] = {0.2 * (i % 8), 0.2 * (i / 8), 0.0};
+    snprintf(serial, MAX_SERIAL_LENGTH, "LHR-SIM%05d", i);
+    if (deepdive_sim_add_tracker(sim_, serial, wm->count ? USB_PROD_WATCHMAN
+      : USB_PROD_TRACKER, &cal, offset) < 0) {
+      printf("%s: insufficient memory\n", progname);
+      exitcode = 1;
+      goto close;
+    }
+  }
+  deepdive_sim_install_packet_fn(sim_, my_packet_process, NULL);
+  // Open the output file
+  if (output->count > 0) {
+    fp_ = fopen(output->filename[0], "wb");
+    if (!fp_ || !deepdive_sim_write_header(fp_) || !write_metadata(sim_)) {
+      printf("%s: could not open output\n", progname);
+      exitcode = 4;
+      goto close;
+    }
+  }
+  // Set up a driver context that mirrors the simulated trackers
+  decode_ = decode->count;
+  if (decode_) {
+    drv_.lig_fn = my_light_process;
+    drv_.imu_fn = my_imu_process;
+    drv_.lighthouse_fn = my_lighthouse_process;
+    for (uint16_t i = 0; i < sim_->num_trackers; i++) {
+      trackers_[i].driver = &drv_;
+      trackers_[i].id = i;
+      trackers_[i].type = sim_->trackers[i]->type;
+      trackers_[i].cal = sim_->trackers[i]->cal;
+      strcpy(trackers_[i].serial, sim_->trackers[i]->serial);
+      drv_.trackers[drv_.num_trackers++] = &trackers_[i];
+    }
+  }
+  // Run the simulation
+  uint64_t tic = sim_now();
+  while (!write_error_) {
+    if (fp_ && !write_poses(sim_))
+      write_error_ = 1;
+    if (!deepdive_sim_step(sim_))
+      break;
+  }
+  double elapsed = (double)(sim_now() - tic) / 1e9;
+  if (write_error_) {
+    printf("%s: could not write output\n", progname);
+    exitcode = 4;
+    goto close;
+  }
+  // Summary
+  double duration = (double) sim_->cycle * SIM_SYNC_PERIOD / SIM_TICKS_PER_SEC;
+  printf("Simulated %.3f s with %u tracker(s) and %u lighthouse(s) in %.3f s\n",
+    duration, sim_->num_trackers, sim_->num_lighthouses, elapsed);
+  printf("- Packets: %llu\n", (unsigned long long) sim_->num_packets);
+  printf("- Pulses: %llu\n", (unsigned long long) sim_->num_pulses);
+  printf("- Occluded: %llu\n", (unsigned long long) sim_->num_occluded);
+  printf("- Reflections: %llu\n", (unsigned long long) sim_->num_reflections);
+  if (decode_) {
+    double secs = (double) decode_ns_ / 1e9;
+    double n = (num_measurements_ ? (double) num_measurements_ : 1.0);
+    printf("Decoded in %.3f s\n", secs);
+    printf("- OOTX frames: %llu\n", (unsigned long long) num_ootx_);
+    printf("- IMU samples: %llu\n", (unsigned long long) num_imu_);
+    printf("- Sweeps: %llu\n", (unsigned long long) num_bundles_);
+    printf("- Measurements: %llu (%llu unmatched)\n",
+      (unsigned long long) num_measurements_,
+      (unsigned long long) num_unmatched_);
+    printf("- Angle error: mean %.3e rad, rms %.3e rad, max %.3e rad\n",
+      sum_err_ / n, sqrt(sum_sq_err_ / n), max_err_);
+    if (secs > 0)
+      printf("- Throughput: %.0f packets/s, %.0f pulses/s\n",
+        sim_->num_packets / secs, sim_->num_pulses / secs);
+  }
+close:
+  if (fp_) fclose(fp_);
+  deepdive_sim_close(sim_);
+exit:
+  arg_freetable(argtable,sizeof(argtable)/sizeof(argtable[0]));
+  return exitcode;
+}
@@ -0,0 +1,169 @@
+/* 
+  Unofficial driver for Vive Trackers and up to two lighthouses, with an
+    emphasis on pulling tracker and lighthouse calibration data from devices.
+  
+  Adapted from: https://github.com/cnlohr/libsurvive
+  Which was based off: https://github.com/collabora/OSVR-Vive-Libre
+    Originally Copyright 2016 Philipp Zabel
+    Originally Copyright 2016 Lubosz Sarnecki <lubosz.sarnecki@collabora.co.uk>
+    Originally Copyright (C) 2013 Fredrik Hultin
+    Originally Copyright (C) 2013 Jakob Bornecrantz
+  Using documentation from: https://github.com/nairol/LighthouseRedox
+  
+  Copyright (c) 2017 Andrew Symington
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+#include "deepdive_snapshot.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Number of published copies per tracker
+#define SNAPSHOT_SLOTS 3
+
+// Attempts at copying out a snapshot before the reader gives up
+#define SNAPSHOT_RETRIES 64
+
+// A published copy. The generation doubles as a seqlock: it is zero while
+// the decoder is writing the slot.
+struct SnapshotSlot {
+  atomic_uint_least64_t gen;
+  struct Snapshot snapshot;
+};
+
+// Triple buffer for one tracker. The decoder folds each event into its own
+// working copy, and then publishes the copy to the slot after the latest.
+// A reader copying out the latest slot can therefore only be overtaken if
+// the decoder publishes twice more before the reader is done.
+struct SnapshotBuffer {
+  struct Snapshot work;                     // Decoder's working copy
+  uint64_t gen;                             // Last generation published
+  atomic_uint latest;                       // Most recently published slot
+  struct SnapshotSlot slots[SNAPSHOT_SLOTS];
+};
+
+// Publish the working copy of a tracker
+static void snapshot_publish(struct Tracker * tracker,
+  struct SnapshotBuffer * buf) {
+  buf->work.charge = tracker->charge;
+  buf->work.ischarging = tracker->ischarging;
+  buf->work.ison = tracker->ison;
+  unsigned next = (atomic_load_explicit(&buf->latest, memory_order_relaxed)
+    + 1) % SNAPSHOT_SLOTS;
+  struct SnapshotSlot * slot = &buf->slots[next];
+  atomic_store_explicit(&slot->gen, 0, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  memcpy(&slot->snapshot, &buf->work, sizeof(struct Snapshot));
+  atomic_store_explicit(&slot->gen, ++buf->gen, memory_order_release);
+  atomic_store_explicit(&buf->latest, next, memory_order_release);
+}
+
+// Allocate a snapshot buffer for every tracker the transport found
+int deepdive_snapshot_init(struct Driver * drv) {
+  if (drv->num_trackers == 0)
+    return 1;
+  drv->snapshots = calloc(drv->num_trackers, sizeof(struct SnapshotBuffer));
+  if (drv->snapshots == NULL)
+    return 0;
+  // Publish an empty snapshot, so that there is always one to read
+  for (size_t i = 0; i < drv->num_trackers; i++) {
+    drv->snapshots[i].work.id = i;
+    snapshot_publish(drv->trackers[i], &drv->snapshots[i]);
+  }
+  return 1;
+}
+
+// Free the snapshot buffers
+void deepdive_snapshot_close(struct Driver * drv) {
+  free(drv->snapshots);
+  drv->snapshots = NULL;
+}
+
+// Fold a sweep into the snapshot
+void deepdive_snapshot_light(struct Tracker * tracker,
+  struct Lighthouse * lighthouse, uint8_t axis, uint32_t synctime,
+  uint16_t num_sensors, uint16_t *sensors, uint32_t *angles,
+  uint16_t *lengths) {
+  struct Driver * drv = tracker->driver;
+  if (drv->snapshots == NULL || lighthouse->id >= MAX_NUM_LIGHTHOUSES
+    || axis >= MAX_NUM_MOTORS) return;
+  if (num_sensors > MAX_NUM_SENSORS)
+    num_sensors = MAX_NUM_SENSORS;
+  struct SnapshotBuffer * buf = &drv->snapshots[tracker->id];
+  struct SnapshotSweep * sweep = &buf->work.sweeps[lighthouse->id][axis];
+  sweep->synctime = synctime;
+  sweep->num_sensors = num_sensors;
+  memcpy(sweep->sensors, sensors, num_sensors * sizeof(uint16_t));
+  memcpy(sweep->angles, angles, num_sensors * sizeof(uint32_t));
+  memcpy(sweep->lengths, lengths, num_sensors * sizeof(uint16_t));
+  buf->work.seq++;
+  snapshot_publish(tracker, buf);
+}
+
+// Fold an IMU sample into the snapshot
+void deepdive_snapshot_imu(struct Tracker * tracker, uint32_t timecode,
+  int16_t acc[3], int16_t gyr[3], int16_t mag[3]) {
+  struct Driver * drv = tracker->driver;
+  if (drv->snapshots == NULL) return;
+  struct SnapshotBuffer * buf = &drv->snapshots[tracker->id];
+  buf->work.timecode = timecode;
+  memcpy(buf->work.acc, acc, sizeof(buf->work.acc));
+  memcpy(buf->work.gyr, gyr, sizeof(buf->work.gyr));
+  memcpy(buf->work.mag, mag, sizeof(buf->work.mag));
+  buf->work.seq++;
+  snapshot_publish(tracker, buf);
+}
+
+// Fold a button event into the snapshot, including releases
+void deepdive_snapshot_button(struct Tracker * tracker,
+  uint32_t mask, uint16_t trigger, int16_t horizontal, int16_t vertical) {
+  struct Driver * drv = tracker->driver;
+  if (drv->snapshots == NULL) return;
+  struct SnapshotBuffer * buf = &drv->snapshots[tracker->id];
+  buf->work.buttons = mask;
+  buf->work.trigger = trigger;
+  buf->work.horizontal = horizontal;
+  buf->work.vertical = vertical;
+  buf->work.seq++;
+  snapshot_publish(tracker, buf);
+}
+
+// Copy out the most recent state of a tracker, giving up rather than
+// spinning forever behind a decoder that publishes faster than we copy
+int deepdive_snapshot(struct Driver * drv, uint8_t id, struct Snapshot * out) {
+  if (drv == NULL || out == NULL || drv->snapshots == NULL
+    || id >= drv->num_trackers) return 0;
+  struct SnapshotBuffer * buf = &drv->snapshots[id];
+  for (int attempt = 0; attempt < SNAPSHOT_RETRIES; attempt++) {
+    unsigned i = atomic_load_explicit(&buf->latest, memory_order_acquire);
+    struct SnapshotSlot * slot = &buf->slots[i];
+    uint64_t gen = atomic_load_explicit(&slot->gen, memory_order_acquire);
+    if (gen == 0)
+      continue;
+    memcpy(out, &slot->snapshot, sizeof(struct Snapshot));
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&slot->gen, memory_order_relaxed) == gen)
+      return 1;
+  }
+  return -1;
+}
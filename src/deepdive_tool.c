@@ -35,10 +35,24 @@
 
 #include <deepdive.h>
 
+#include <signal.h>
+
+#include "deepdive_shm_client.h"
+#include "deepdive_tool_output.h"
+#include "deepdive_tool_monitor.h"
+
 // Enable X and Y axis
 int en0_ = 0;
 int en1_ = 0;
 
+// Set when the user presses ctrl+c
+volatile sig_atomic_t quit_ = 0;
+
+// Signal handler to stop polling
+void my_signal_handler(int sig) {
+  quit_ = 1;
+}
+
 // Callback to display light info
 void my_light_process(struct Tracker * tracker, struct Lighthouse * lighthouse,
   uint8_t axis, uint32_t synctime, uint16_t num_sensors, uint16_t *sensors,
@@ -170,9 +184,28 @@ int main(int argc, char **argv) {
   struct arg_lit  *button  = arg_lit0("b", "button", "print buttons");
   struct arg_lit  *lh      = arg_lit0("l", "lh", "print lighthouse info");
   struct arg_lit  *tracker = arg_lit0("t", "tracker", "print tracker info");
+  struct arg_str  *format  = arg_str0(NULL, "format", "bin|csv|jsonl",
+    "stream raw data in the given format");
+  struct arg_file *output  = arg_file0("o", "output", "<file>",
+    "write the stream to a file instead of stdout");
+  struct arg_lit  *monitor = arg_lit0("m", "monitor",
+    "show live sweep rate, jitter and sensor visibility");
+  struct arg_int  *rate    = arg_int0("r", "rate", "<hz>",
+    "monitor refresh rate (default: 2)");
+  struct arg_str  *serve   = arg_str0("s", "serve", "<name>",
+    "also publish events to a shared-memory segment");
+  struct arg_str  *trans   = arg_str0(NULL, "transport", "usb|hidraw",
+    "how to talk to the devices (default: usb)");
+  struct arg_file *replay  = arg_file0(NULL, "replay", "<file>",
+    "replay packets written by deepdive_sim instead");
+  struct arg_int  *rt      = arg_int0(NULL, "rt", "<priority>",
+    "poll in real-time mode with the given SCHED_FIFO priority (0: none)");
+  struct arg_int  *cpu     = arg_int0(NULL, "cpu", "<n>",
+    "pin polling to a CPU in real-time mode");
   struct arg_lit  *help    = arg_lit0(NULL, "help", "print this help and exit");
   struct arg_end  *end     = arg_end(20);
-  void* argtable[] = {imu, l0, l1, button, tracker, lh, help, end};
+  void* argtable[] = {imu, l0, l1, button, tracker, lh, format, output,
+    monitor, rate, serve, trans, replay, rt, cpu, help, end};
   // Verify we allocated correcty
   const char* progname = "deepdive_tool";
   int nerrors, exitcode = 0;
@@ -200,34 +233,105 @@ int main(int argc, char **argv) {
     exitcode = 2;
     goto exit;
   }
+  // Check the transport before we touch any devices
+  TransportType type = TRANSPORT_USB;
+  if (replay->count > 0) {
+    type = TRANSPORT_REPLAY;
+  } else if (trans->count > 0) {
+    if (strcmp(trans->sval[0], "hidraw") == 0) {
+      type = TRANSPORT_HIDRAW;
+    } else if (strcmp(trans->sval[0], "usb") != 0) {
+      printf("%s: unknown transport '%s'\n", progname, trans->sval[0]);
+      exitcode = 2;
+      goto exit;
+    }
+  }
+  // Real-time polling must not allocate, which libusb does
+  if (cpu->count > 0 && rt->count == 0) {
+    printf("%s: --cpu needs --rt\n", progname);
+    exitcode = 2;
+    goto exit;
+  }
+  if (rt->count > 0 && type == TRANSPORT_USB) {
+    printf("%s: --rt needs the hidraw or replay transport\n", progname);
+    exitcode = 2;
+    goto exit;
+  }
+  // Check the stream format before we touch any devices
+  int fmt = -1;
+  if (format->count > 0) {
+    fmt = output_format(format->sval[0]);
+    if (fmt < 0) {
+      printf("%s: unknown format '%s'\n", progname, format->sval[0]);
+      exitcode = 2;
+      goto exit;
+    }
+    if (!output_open(output->count ? output->filename[0] : NULL, fmt)) {
+      printf("%s: could not open output\n", progname);
+      exitcode = 4;
+      goto exit;
+    }
+  }
   // Initialize the driver
-  struct Driver * drv = deepdive_init(0);
+  struct Driver * drv = deepdive_init_transport(type,
+    replay->count ? replay->filename[0] : NULL);
   if (!drv) {
     printf("%s: could not initialize driver\n", progname);
+    output_close();
     exitcode = 3;
     goto exit;
   }
+  // Share decoded events with other local processes
+  if (serve->count > 0
+    && !deepdive_shm_serve(drv, serve->sval[0], SHM_DEFAULT_SLOTS)) {
+    printf("%s: could not serve on '%s'\n", progname, serve->sval[0]);
+    deepdive_close(drv);
+    output_close();
+    exitcode = 5;
+    goto exit;
+  }
   // Limit to X or Y
   en0_ = l0->count;
   en1_ = l1->count;
   // Install callbacks
-  if (imu->count > 0)
-    deepdive_install_imu_fn(drv, my_imu_process);
-  if (l0->count + l1->count > 0)
-    deepdive_install_light_fn(drv, my_light_process);
-  if (button->count > 0)
-    deepdive_install_button_fn(drv, my_button_process);
-  if (lh->count > 0)
-    deepdive_install_lighthouse_fn(drv, my_lighthouse_process);
-  if (tracker->count > 0)
-    deepdive_install_tracker_fn(drv, my_tracker_process);
-  // Keep going until ctrl+c
-  while(deepdive_poll(drv) == 0) {}
-    return 0;
+  if (monitor->count > 0) {
+    monitor_install(drv, rate->count ? rate->ival[0] : MONITOR_DEFAULT_RATE);
+  } else if (fmt >= 0) {
+    output_install(drv, imu->count, l0->count, l1->count, button->count);
+  } else {
+    if (imu->count > 0)
+      deepdive_install_imu_fn(drv, my_imu_process);
+    if (l0->count + l1->count > 0)
+      deepdive_install_light_fn(drv, my_light_process);
+    if (button->count > 0)
+      deepdive_install_button_fn(drv, my_button_process);
+    if (lh->count > 0)
+      deepdive_install_lighthouse_fn(drv, my_lighthouse_process);
+    if (tracker->count > 0)
+      deepdive_install_tracker_fn(drv, my_tracker_process);
+  }
+  // Nothing is allocated by the hidraw or replay transports from here on
+  if (rt->count > 0
+    && !deepdive_rt_thread(drv, rt->ival[0], cpu->count ? cpu->ival[0] : -1)) {
+    printf("%s: could not switch to real-time mode\n", progname);
+    deepdive_close(drv);
+    output_close();
+    exitcode = 6;
+    goto exit;
+  }
+  // Keep going until ctrl+c, or until the reader goes away
+  signal(SIGINT, my_signal_handler);
+  signal(SIGTERM, my_signal_handler);
+  signal(SIGPIPE, SIG_IGN);
+  while (!quit_ && deepdive_poll(drv) == 0) {
+    if (output_flush(0) < 0) break;
+    monitor_update();
+  }
   // Exit cleanly
+  deepdive_close(drv);
+  output_close();
   exitcode = 0;
 exit:
   arg_freetable(argtable,sizeof(argtable)/sizeof(argtable[0]));
   return exitcode;
 }
-
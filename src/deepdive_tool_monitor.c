@@ -0,0 +1,202 @@
+/* 
+  Unofficial driver for Vive Trackers and up to two lighthouses, with an
+    emphasis on pulling tracker and lighthouse calibration data from devices.
+  
+  Adapted from: https://github.com/cnlohr/libsurvive
+  Which was based off: https://github.com/collabora/OSVR-Vive-Libre
+    Originally Copyright 2016 Philipp Zabel
+    Originally Copyright 2016 Lubosz Sarnecki <lubosz.sarnecki@collabora.co.uk>
+    Originally Copyright (C) 2013 Fredrik Hultin
+    Originally Copyright (C) 2013 Jakob Bornecrantz
+  Using documentation from: https://github.com/nairol/LighthouseRedox
+  
+  Copyright (c) 2017 Andrew Symington
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+#include "deepdive_tool_monitor.h"
+
+#include <math.h>
+#include <time.h>
+
+// Ticks per microsecond on the 48MHz lighthouse clock
+#define TICKS_PER_US          48.0
+
+// Size of the screen buffer
+#define MONITOR_SCREEN_LENGTH 65536
+
+// Statistics for one tracker, lighthouse and axis
+typedef struct {
+  uint32_t last;                            // Last sync time
+  double period;                            // EWMA of sweep period (ticks)
+  uint64_t jitter[MONITOR_NUM_BINS];        // Deviation from period (total)
+  uint64_t missed;                          // Missed sweeps (total)
+  uint32_t sweeps;                          // Sweeps in this window
+  uint32_t hits[MAX_NUM_SENSORS];           // Hits per channel in window
+  uint64_t width;                           // Sum of pulse widths in window
+  uint32_t pulses;                          // Pulses in this window
+} Stats;
+
+// Upper bound of each jitter bin in microseconds (last bin is open)
+static const double bins_[MONITOR_NUM_BINS] = {1, 5, 20, 100, 500, INFINITY};
+static const char * labels_[MONITOR_NUM_BINS] =
+  {"<1us", "<5us", "<20us", "<100us", "<500us", ">500us"};
+
+static struct Driver * drv_ = NULL;
+static Stats stats_[MAX_NUM_TRACKERS][MAX_NUM_LIGHTHOUSES][MAX_NUM_MOTORS];
+static uint64_t period_ = 0;
+static uint64_t last_ = 0;
+static char screen_[MONITOR_SCREEN_LENGTH];
+
+// Monotonic time in nanoseconds
+static uint64_t monitor_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// Collect statistics from every sweep
+static void monitor_light(struct Tracker * tracker,
+  struct Lighthouse * lighthouse, uint8_t axis, uint32_t synctime,
+    uint16_t num_sensors, uint16_t *sensors, uint32_t *sweeptimes,
+      uint32_t *angles, uint16_t *lengths) {
+  size_t t = tracker->id, l = lighthouse->id;
+  if (t >= drv_->num_trackers || l >= MAX_NUM_LIGHTHOUSES
+    || axis >= MAX_NUM_MOTORS) return;
+  Stats * s = &stats_[t][l][axis];
+  // Sweep timing, which wraps cleanly on the 32 bit counter
+  if (s->last) {
+    double dt = (double)(uint32_t)(synctime - s->last);
+    if (s->period == 0) {
+      s->period = dt;
+    } else {
+      // Count any sweeps that went missing in between
+      double n = round(dt / s->period);
+      if (n > 1) {
+        s->missed += (uint64_t)(n - 1);
+      } else {
+        double dev = fabs(dt - s->period) / TICKS_PER_US;
+        int b = 0;
+        while (dev >= bins_[b]) b++;
+        s->jitter[b]++;
+        s->period = 0.95 * s->period + 0.05 * dt;
+      }
+    }
+  }
+  s->last = synctime;
+  s->sweeps++;
+  // Per-channel visibility and pulse widths
+  for (uint16_t i = 0; i < num_sensors; i++) {
+    if (sensors[i] < MAX_NUM_SENSORS)
+      s->hits[sensors[i]]++;
+    s->width += lengths[i];
+  }
+  s->pulses += num_sensors;
+}
+
+// Draw one character per channel to show its hit rate for this window
+static void monitor_strip(char * out, struct Tracker * tracker, Stats * s) {
+  uint32_t present = 0;
+  for (uint8_t i = 0; i < tracker->cal.num_channels; i++)
+    if (tracker->cal.channels[i] < MAX_NUM_SENSORS)
+      present |= (1u << tracker->cal.channels[i]);
+  for (int c = 0; c < MAX_NUM_SENSORS; c++) {
+    if (!(present & (1u << c)))
+      out[c] = ' ';
+    else if (s->sweeps == 0 || s->hits[c] == 0)
+      out[c] = '.';
+    else if (s->hits[c] >= s->sweeps)
+      out[c] = '#';
+    else
+      out[c] = '0' + (10 * s->hits[c]) / s->sweeps;
+  }
+  out[MAX_NUM_SENSORS] = '\0';
+}
+
+// Redraw the whole screen in one write, then reset the window counters
+static void monitor_draw(double dt) {
+  char strip[MAX_NUM_SENSORS + 1];
+  int n = 0, left = MONITOR_SCREEN_LENGTH;
+#define OUT(...) do { int r = snprintf(screen_ + n, left, __VA_ARGS__); \
+  if (r > 0 && r < left) { n += r; left -= r; } } while (0)
+  OUT("\033[H\033[2J");
+  OUT("deepdive monitor : %u tracker(s), window %.2fs\n",
+    drv_->num_trackers, dt);
+  OUT("hits per channel: ' ' no sensor, '.' none, 0-9 tenths of sweeps, "
+      "'#' every sweep\n\n");
+  for (size_t t = 0; t < drv_->num_trackers; t++) {
+    struct Tracker * tracker = drv_->trackers[t];
+    OUT("TRACKER %s (%u channels)\n", tracker->serial,
+      tracker->cal.num_channels);
+    OUT("  %-12s %2s %7s %7s %7s %8s  %-32s  jitter",
+      "LH", "AX", "Hz", "missed", "pw(us)", "hits/sw", "channels 0..31");
+    for (int b = 0; b < MONITOR_NUM_BINS; b++)
+      OUT(" %6s", labels_[b]);
+    OUT("\n");
+    for (size_t l = 0; l < MAX_NUM_LIGHTHOUSES; l++) {
+      for (size_t a = 0; a < MAX_NUM_MOTORS; a++) {
+        Stats * s = &stats_[t][l][a];
+        if (s->last == 0) continue;
+        monitor_strip(strip, tracker, s);
+        OUT("  %-12s %2zu %7.2f %7llu %7.2f %8.2f  %s  ",
+          drv_->lighthouses[l].serial, a, s->sweeps / dt,
+          (unsigned long long) s->missed,
+          s->pulses ? s->width / TICKS_PER_US / s->pulses : 0.0,
+          s->sweeps ? (double) s->pulses / s->sweeps : 0.0, strip);
+        // Histogram as a percentage of all sweeps seen so far
+        uint64_t total = 0;
+        for (int b = 0; b < MONITOR_NUM_BINS; b++)
+          total += s->jitter[b];
+        for (int b = 0; b < MONITOR_NUM_BINS; b++)
+          OUT(" %5.1f%%", total ? 100.0 * s->jitter[b] / total : 0.0);
+        OUT("\n");
+        // Reset the window
+        s->sweeps = 0;
+        s->pulses = 0;
+        s->width = 0;
+        memset(s->hits, 0, sizeof(s->hits));
+      }
+    }
+    OUT("\n");
+  }
+#undef OUT
+  fwrite(screen_, 1, n, stdout);
+  fflush(stdout);
+}
+
+// Install the light callback that gathers statistics
+void monitor_install(struct Driver * drv, int rate) {
+  drv_ = drv;
+  if (rate <= 0) rate = MONITOR_DEFAULT_RATE;
+  period_ = 1000000000ULL / rate;
+  last_ = monitor_now();
+  memset(stats_, 0, sizeof(stats_));
+  deepdive_install_light_fn(drv, monitor_light);
+}
+
+// Redraw the screen if the refresh period has elapsed
+void monitor_update(void) {
+  if (drv_ == NULL) return;
+  uint64_t now = monitor_now();
+  if (now - last_ < period_) return;
+  monitor_draw((now - last_) / 1e9);
+  last_ = now;
+}
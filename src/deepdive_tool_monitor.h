@@ -31,12 +31,21 @@
   SOFTWARE.
 */
 
-#ifndef LIBDEEPDIVE_DEEPDIVE_USB_H
-#define LIBDEEPDIVE_DEEPDIVE_USB_H
+#ifndef LIBDEEPDIVE_DEEPDIVE_TOOL_MONITOR_H
+#define LIBDEEPDIVE_DEEPDIVE_TOOL_MONITOR_H
 
 #include <deepdive.h>
 
-// Initialize and return the number of devices
-int deepdive_usb_init(struct Driver * drv);
+// Default number of screen refreshes per second
+#define MONITOR_DEFAULT_RATE  2
 
-#endif
\ No newline at end of file
+// Jitter histogram bins, as upper bounds in microseconds
+#define MONITOR_NUM_BINS      6
+
+// Install the light callback that gathers statistics
+void monitor_install(struct Driver * drv, int rate);
+
+// Redraw the screen if the refresh period has elapsed
+void monitor_update(void);
+
+#endif
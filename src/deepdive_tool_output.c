@@ -0,0 +1,534 @@
+/* 
+  Unofficial driver for Vive Trackers and up to two lighthouses, with an
+    emphasis on pulling tracker and lighthouse calibration data from devices.
+  
+  Adapted from: https://github.com/cnlohr/libsurvive
+  Which was based off: https://github.com/collabora/OSVR-Vive-Libre
+    Originally Copyright 2016 Philipp Zabel
+    Originally Copyright 2016 Lubosz Sarnecki <lubosz.sarnecki@collabora.co.uk>
+    Originally Copyright (C) 2013 Fredrik Hultin
+    Originally Copyright (C) 2013 Jakob Bornecrantz
+  Using documentation from: https://github.com/nairol/LighthouseRedox
+  
+  Copyright (c) 2017 Andrew Symington
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+#include "deepdive_tool_output.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <time.h>
+
+// Output stream state
+static int fd_ = -1;
+static OutputFormat format_ = FORMAT_BIN;
+static uint8_t *buf_ = NULL;
+static size_t len_ = 0;
+static uint64_t last_ = 0;
+static int error_ = 0;
+static struct Driver *drv_ = NULL;
+
+// Light axis filter
+static int en0_ = 1;
+static int en1_ = 1;
+
+// Monotonic time in nanoseconds
+static uint64_t output_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+// Write the whole buffer, retrying on short writes
+static int output_write(void) {
+  size_t off = 0;
+  while (off < len_) {
+    ssize_t ret = write(fd_, buf_ + off, len_ - off);
+    if (ret < 0) {
+      if (errno == EINTR) continue;
+      // Nobody is listening anymore, so discard everything from now on
+      error_ = 1;
+      len_ = 0;
+      return -1;
+    }
+    off += ret;
+  }
+  len_ = 0;
+  return 0;
+}
+
+// Called after every record to decide whether to hit the disk
+static void output_commit(void) {
+  if (len_ > OUTPUT_BUFFER_LENGTH - OUTPUT_BUFFER_SLACK)
+    output_flush(1);
+  else
+    output_flush(0);
+}
+
+// FORMATTING HELPERS
+
+static inline void put_chr(char c) {
+  buf_[len_++] = c;
+}
+
+static inline void put_str(const char * s) {
+  while (*s) buf_[len_++] = *s++;
+}
+
+static inline void put_u32(uint32_t v) {
+  char tmp[10];
+  int n = 0;
+  do {
+    tmp[n++] = '0' + (v % 10);
+    v /= 10;
+  } while (v);
+  while (n) buf_[len_++] = tmp[--n];
+}
+
+static inline void put_i32(int32_t v) {
+  if (v < 0) {
+    put_chr('-');
+    put_u32(-(int64_t) v);
+  } else {
+    put_u32(v);
+  }
+}
+
+// Floats only appear in metadata, so snprintf is fine here. JSON has no
+// literal for NaN or infinity, so these are written as null.
+static inline void put_flt(float v) {
+  if (format_ == FORMAT_JSONL && !isfinite(v)) {
+    put_str("null");
+    return;
+  }
+  len_ += snprintf((char*) buf_ + len_, 32, "%.9g", v);
+}
+
+// Write a JSON string, or a CSV field (serials never contain separators)
+static inline void put_key(const char * s) {
+  if (format_ == FORMAT_JSONL) put_chr('"');
+  put_str(s);
+  if (format_ == FORMAT_JSONL) put_chr('"');
+}
+
+static void put_i16_arr(const int16_t * v, size_t n) {
+  if (format_ == FORMAT_JSONL) put_chr('[');
+  for (size_t i = 0; i < n; i++) {
+    if (i) put_chr(',');
+    put_i32(v[i]);
+  }
+  if (format_ == FORMAT_JSONL) put_chr(']');
+}
+
+static void put_flt_arr(const float * v, size_t n) {
+  if (format_ == FORMAT_JSONL) put_chr('[');
+  for (size_t i = 0; i < n; i++) {
+    if (i) put_chr(',');
+    put_flt(v[i]);
+  }
+  if (format_ == FORMAT_JSONL) put_chr(']');
+}
+
+// Start a JSON object or CSV row with the record type and tracker serial
+static void put_begin(const char * type, const char * serial) {
+  if (format_ == FORMAT_JSONL) {
+    put_str("{\"type\":\"");
+    put_str(type);
+    put_str("\",\"serial\":\"");
+    put_str(serial);
+    put_chr('"');
+  } else {
+    put_str(type);
+    put_chr(',');
+    put_str(serial);
+  }
+}
+
+// Add a field to the current JSON object or CSV row
+static void put_field(const char * name) {
+  if (format_ == FORMAT_JSONL) {
+    put_str(",\"");
+    put_str(name);
+    put_str("\":");
+  } else {
+    put_chr(',');
+  }
+}
+
+static void put_end(void) {
+  if (format_ == FORMAT_JSONL) put_chr('}');
+  put_chr('\n');
+}
+
+// Index of the tracker in the driver list, used as a compact binary handle
+static uint8_t tracker_index(struct Tracker * tracker) {
+  return tracker->id;
+}
+
+// Index of the lighthouse in the driver list
+static uint8_t lighthouse_index(struct Lighthouse * lighthouse) {
+  return lighthouse->id;
+}
+
+// CALLBACKS
+
+// Light data : one record per sweep, one row per pulse in CSV
+static void output_light(struct Tracker * tracker,
+  struct Lighthouse * lighthouse, uint8_t axis, uint32_t synctime,
+    uint16_t num_sensors, uint16_t *sensors, uint32_t *sweeptimes,
+      uint32_t *angles, uint16_t *lengths) {
+  if (error_) return;
+  if (axis == 0 && en0_ == 0) return;
+  if (axis == 1 && en1_ == 0) return;
+  switch (format_) {
+  case FORMAT_BIN: {
+    struct RecordLight * r = (struct RecordLight *)(buf_ + len_);
+    r->header.type = RECORD_LIGHT;
+    r->header.tracker = tracker_index(tracker);
+    r->header.size = sizeof(struct RecordLight)
+      + num_sensors * sizeof(struct RecordPulse);
+    r->lighthouse = lighthouse_index(lighthouse);
+    r->axis = axis;
+    r->num_sensors = num_sensors;
+    r->synctime = synctime;
+    struct RecordPulse * p = (struct RecordPulse *)(r + 1);
+    for (uint16_t i = 0; i < num_sensors; i++) {
+      p[i].sensor = sensors[i];
+      p[i].length = lengths[i];
+      p[i].sweeptime = sweeptimes[i];
+      p[i].angle = angles[i];
+    }
+    len_ += r->header.size;
+    break;
+  }
+  case FORMAT_CSV:
+    for (uint16_t i = 0; i < num_sensors; i++) {
+      put_begin("light", tracker->serial);
+      put_chr(',');
+      put_str(lighthouse->serial);
+      put_chr(',');
+      put_u32(axis);
+      put_chr(',');
+      put_u32(synctime);
+      put_chr(',');
+      put_u32(sensors[i]);
+      put_chr(',');
+      put_u32(sweeptimes[i]);
+      put_chr(',');
+      put_u32(angles[i]);
+      put_chr(',');
+      put_u32(lengths[i]);
+      put_end();
+    }
+    break;
+  case FORMAT_JSONL:
+    put_begin("light", tracker->serial);
+    put_field("lighthouse");
+    put_key(lighthouse->serial);
+    put_field("axis");
+    put_u32(axis);
+    put_field("synctime");
+    put_u32(synctime);
+    put_field("pulses");
+    put_chr('[');
+    for (uint16_t i = 0; i < num_sensors; i++) {
+      if (i) put_chr(',');
+      put_chr('[');
+      put_u32(sensors[i]);
+      put_chr(',');
+      put_u32(sweeptimes[i]);
+      put_chr(',');
+      put_u32(angles[i]);
+      put_chr(',');
+      put_u32(lengths[i]);
+      put_chr(']');
+    }
+    put_chr(']');
+    put_end();
+    break;
+  }
+  output_commit();
+}
+
+// IMU data : raw values, scale with DEFAULT_ACC_SCALE and DEFAULT_GYR_SCALE
+static void output_imu(struct Tracker * tracker, uint32_t timecode,
+  int16_t acc[3], int16_t gyr[3], int16_t mag[3]) {
+  if (error_) return;
+  if (format_ == FORMAT_BIN) {
+    struct RecordImu * r = (struct RecordImu *)(buf_ + len_);
+    r->header.type = RECORD_IMU;
+    r->header.tracker = tracker_index(tracker);
+    r->header.size = sizeof(struct RecordImu);
+    r->timecode = timecode;
+    memcpy(r->acc, acc, sizeof(r->acc));
+    memcpy(r->gyr, gyr, sizeof(r->gyr));
+    memcpy(r->mag, mag, sizeof(r->mag));
+    len_ += r->header.size;
+  } else {
+    put_begin("imu", tracker->serial);
+    put_field("timecode");
+    put_u32(timecode);
+    put_field("acc");
+    put_i16_arr(acc, 3);
+    put_field("gyr");
+    put_i16_arr(gyr, 3);
+    put_field("mag");
+    put_i16_arr(mag, 3);
+    put_end();
+  }
+  output_commit();
+}
+
+// Button data
+static void output_button(struct Tracker * tracker,
+  uint32_t mask, uint16_t trigger, int16_t horizontal, int16_t vertical) {
+  if (error_) return;
+  if (format_ == FORMAT_BIN) {
+    struct RecordButton * r = (struct RecordButton *)(buf_ + len_);
+    r->header.type = RECORD_BUTTON;
+    r->header.tracker = tracker_index(tracker);
+    r->header.size = sizeof(struct RecordButton);
+    r->mask = mask;
+    r->trigger = trigger;
+    r->horizontal = horizontal;
+    r->vertical = vertical;
+    len_ += r->header.size;
+  } else {
+    put_begin("button", tracker->serial);
+    put_field("mask");
+    put_u32(mask);
+    put_field("trigger");
+    put_u32(trigger);
+    put_field("horizontal");
+    put_i32(horizontal);
+    put_field("vertical");
+    put_i32(vertical);
+    put_end();
+  }
+  output_commit();
+}
+
+// Tracker metadata : one tracker row plus one sensor row per channel in CSV
+static void output_tracker(struct Tracker * t) {
+  if (!t || error_) return;
+  struct Calibration * cal = &t->cal;
+  switch (format_) {
+  case FORMAT_BIN: {
+    struct RecordTracker * r = (struct RecordTracker *)(buf_ + len_);
+    memset(r, 0, sizeof(struct RecordTracker));
+    r->header.type = RECORD_TRACKER;
+    r->header.tracker = tracker_index(t);
+    r->header.size = sizeof(struct RecordTracker);
+    strncpy(r->serial, t->serial, MAX_SERIAL_LENGTH - 1);
+    r->type = t->type;
+    r->num_channels = cal->num_channels;
+    memcpy(r->channels, cal->channels, sizeof(r->channels));
+    memcpy(r->positions, cal->positions, sizeof(r->positions));
+    memcpy(r->normals, cal->normals, sizeof(r->normals));
+    memcpy(r->acc_bias, cal->acc_bias, sizeof(r->acc_bias));
+    memcpy(r->acc_scale, cal->acc_scale, sizeof(r->acc_scale));
+    memcpy(r->gyr_bias, cal->gyr_bias, sizeof(r->gyr_bias));
+    memcpy(r->gyr_scale, cal->gyr_scale, sizeof(r->gyr_scale));
+    memcpy(r->imu_transform, cal->imu_transform, sizeof(r->imu_transform));
+    memcpy(r->head_transform, cal->head_transform, sizeof(r->head_transform));
+    len_ += r->header.size;
+    break;
+  }
+  case FORMAT_CSV:
+  case FORMAT_JSONL:
+    put_begin("tracker", t->serial);
+    put_field("index");
+    put_u32(tracker_index(t));
+    put_field("product");
+    put_u32(t->type);
+    put_field("acc_bias");
+    put_flt_arr(cal->acc_bias, 3);
+    put_field("acc_scale");
+    put_flt_arr(cal->acc_scale, 3);
+    put_field("gyr_bias");
+    put_flt_arr(cal->gyr_bias, 3);
+    put_field("gyr_scale");
+    put_flt_arr(cal->gyr_scale, 3);
+    put_field("imu_transform");
+    put_flt_arr(cal->imu_transform, 7);
+    put_field("head_transform");
+    put_flt_arr(cal->head_transform, 7);
+    if (format_ == FORMAT_JSONL) {
+      put_str(",\"sensors\":[");
+      for (uint8_t i = 0; i < cal->num_channels; i++) {
+        if (i) put_chr(',');
+        put_str("{\"channel\":");
+        put_u32(cal->channels[i]);
+        put_str(",\"position\":");
+        put_flt_arr(cal->positions[i], 3);
+        put_str(",\"normal\":");
+        put_flt_arr(cal->normals[i], 3);
+        put_chr('}');
+      }
+      put_chr(']');
+      put_end();
+      break;
+    }
+    put_end();
+    for (uint8_t i = 0; i < cal->num_channels; i++) {
+      put_begin("sensor", t->serial);
+      put_chr(',');
+      put_u32(i);
+      put_chr(',');
+      put_u32(cal->channels[i]);
+      put_chr(',');
+      put_flt_arr(cal->positions[i], 3);
+      put_chr(',');
+      put_flt_arr(cal->normals[i], 3);
+      put_end();
+    }
+    break;
+  }
+  output_commit();
+}
+
+// Lighthouse metadata
+static void output_lighthouse(struct Lighthouse *l) {
+  if (!l || error_) return;
+  if (format_ == FORMAT_BIN) {
+    struct RecordLighthouse * r = (struct RecordLighthouse *)(buf_ + len_);
+    memset(r, 0, sizeof(struct RecordLighthouse));
+    r->header.type = RECORD_LIGHTHOUSE;
+    r->header.tracker = 0xff;
+    r->header.size = sizeof(struct RecordLighthouse);
+    r->lighthouse = lighthouse_index(l);
+    strncpy(r->serial, l->serial, MAX_SERIAL_LENGTH - 1);
+    r->fw_version = l->fw_version;
+    for (size_t i = 0; i < MAX_NUM_MOTORS; i++) {
+      r->motors[i][0] = l->motors[i].phase;
+      r->motors[i][1] = l->motors[i].tilt;
+      r->motors[i][2] = l->motors[i].gibphase;
+      r->motors[i][3] = l->motors[i].gibmag;
+      r->motors[i][4] = l->motors[i].curve;
+    }
+    memcpy(r->accel, l->accel, sizeof(r->accel));
+    r->hw_version = l->hw_version;
+    r->mode_current = l->mode_current;
+    r->sys_faults = l->sys_faults;
+    r->sys_unlock_count = l->sys_unlock_count;
+    len_ += r->header.size;
+  } else {
+    put_begin("lighthouse", l->serial);
+    put_field("index");
+    put_u32(lighthouse_index(l));
+    put_field("fw_version");
+    put_u32(l->fw_version);
+    for (size_t i = 0; i < MAX_NUM_MOTORS; i++) {
+      float m[5] = {l->motors[i].phase, l->motors[i].tilt,
+        l->motors[i].gibphase, l->motors[i].gibmag, l->motors[i].curve};
+      put_field(i == 0 ? "motor0" : "motor1");
+      put_flt_arr(m, 5);
+    }
+    put_field("accel");
+    put_flt_arr(l->accel, 3);
+    put_end();
+  }
+  output_commit();
+}
+
+// PUBLIC INTERFACE
+
+// Parse a format name, returning -1 if it is not recognized
+int output_format(const char * name) {
+  if (!strcmp(name, "bin")) return FORMAT_BIN;
+  if (!strcmp(name, "csv")) return FORMAT_CSV;
+  if (!strcmp(name, "jsonl")) return FORMAT_JSONL;
+  return -1;
+}
+
+// Open the output stream (NULL or "-" writes to stdout)
+int output_open(const char * path, OutputFormat format) {
+  if (path == NULL || !strcmp(path, "-"))
+    fd_ = STDOUT_FILENO;
+  else
+    fd_ = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0)
+    return 0;
+  buf_ = malloc(OUTPUT_BUFFER_LENGTH);
+  if (buf_ == NULL)
+    return 0;
+  format_ = format;
+  len_ = 0;
+  last_ = output_now();
+  // Binary streams are self-identifying
+  if (format_ == FORMAT_BIN) {
+    struct RecordStream * s = (struct RecordStream *) buf_;
+    memcpy(s->magic, OUTPUT_MAGIC, 4);
+    s->version = OUTPUT_VERSION;
+    s->reserved = 0;
+    len_ += sizeof(struct RecordStream);
+  }
+  return 1;
+}
+
+// Install the callbacks that write to the output stream
+void output_install(struct Driver * drv,
+  int imu, int ax0, int ax1, int button) {
+  drv_ = drv;
+  // If no data has been selected, then stream everything
+  if (!imu && !ax0 && !ax1 && !button)
+    imu = ax0 = ax1 = button = 1;
+  en0_ = ax0;
+  en1_ = ax1;
+  if (imu)
+    deepdive_install_imu_fn(drv, output_imu);
+  if (ax0 || ax1)
+    deepdive_install_light_fn(drv, output_light);
+  if (button)
+    deepdive_install_button_fn(drv, output_button);
+  // Metadata is needed to interpret indexes, so it is always written
+  deepdive_install_tracker_fn(drv, output_tracker);
+  deepdive_install_lighthouse_fn(drv, output_lighthouse);
+}
+
+// Write buffered data if it is older than OUTPUT_FLUSH_NS (or force it).
+// After a write error the callbacks stop buffering, and whatever is still
+// in the buffer is discarded, so that it can never overrun.
+int output_flush(int force) {
+  if (error_) {
+    len_ = 0;
+    return -1;
+  }
+  if (fd_ < 0 || len_ == 0) return 0;
+  uint64_t now = output_now();
+  if (!force && now - last_ < OUTPUT_FLUSH_NS)
+    return 0;
+  last_ = now;
+  return output_write();
+}
+
+// Flush and close the output stream
+void output_close(void) {
+  if (fd_ < 0) return;
+  output_flush(1);
+  if (fd_ != STDOUT_FILENO)
+    close(fd_);
+  fd_ = -1;
+  free(buf_);
+  buf_ = NULL;
+}
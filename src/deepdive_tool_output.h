@@ -0,0 +1,163 @@
+/* 
+  Unofficial driver for Vive Trackers and up to two lighthouses, with an
+    emphasis on pulling tracker and lighthouse calibration data from devices.
+  
+  Adapted from: https://github.com/cnlohr/libsurvive
+  Which was based off: https://github.com/collabora/OSVR-Vive-Libre
+    Originally Copyright 2016 Philipp Zabel
+    Originally Copyright 2016 Lubosz Sarnecki <lubosz.sarnecki@collabora.co.uk>
+    Originally Copyright (C) 2013 Fredrik Hultin
+    Originally Copyright (C) 2013 Jakob Bornecrantz
+  Using documentation from: https://github.com/nairol/LighthouseRedox
+  
+  Copyright (c) 2017 Andrew Symington
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef LIBDEEPDIVE_DEEPDIVE_TOOL_OUTPUT_H
+#define LIBDEEPDIVE_DEEPDIVE_TOOL_OUTPUT_H
+
+#include <deepdive.h>
+
+// Size of the output buffer, and the point at which we force a flush
+#define OUTPUT_BUFFER_LENGTH  (1 << 20)
+#define OUTPUT_BUFFER_SLACK   (1 << 16)
+
+// Maximum time data may sit in the buffer before being written
+#define OUTPUT_FLUSH_NS       100000000ULL
+
+// Binary stream version
+#define OUTPUT_MAGIC          "DDIV"
+#define OUTPUT_VERSION        1
+
+// Output formats
+typedef enum {
+  FORMAT_BIN        = 0,
+  FORMAT_CSV        = 1,
+  FORMAT_JSONL      = 2
+} OutputFormat;
+
+// Binary record types
+typedef enum {
+  RECORD_LIGHT      = 1,
+  RECORD_IMU        = 2,
+  RECORD_BUTTON     = 3,
+  RECORD_TRACKER    = 4,
+  RECORD_LIGHTHOUSE = 5
+} RecordType;
+
+// All binary records are little-endian and packed. Every record starts with
+// this header, where size is the total length of the record in bytes.
+struct __attribute__((packed)) RecordHeader {
+  uint8_t type;                             // RecordType
+  uint8_t tracker;                          // Tracker index
+  uint16_t size;                            // Record size in bytes
+};
+
+// Stream header, written once at the start of a binary stream
+struct __attribute__((packed)) RecordStream {
+  char magic[4];                            // OUTPUT_MAGIC
+  uint16_t version;                         // OUTPUT_VERSION
+  uint16_t reserved;                        // Zero
+};
+
+// A single pulse within a light record
+struct __attribute__((packed)) RecordPulse {
+  uint16_t sensor;                          // Sensor channel
+  uint16_t length;                          // Pulse length in ticks
+  uint32_t sweeptime;                       // Sweep time in ticks
+  uint32_t angle;                           // Angle in ticks from sync
+};
+
+// Light record, followed by num_sensors RecordPulse structures
+struct __attribute__((packed)) RecordLight {
+  struct RecordHeader header;
+  uint8_t lighthouse;                       // Lighthouse index
+  uint8_t axis;                             // Motor axis
+  uint16_t num_sensors;                     // Number of pulses that follow
+  uint32_t synctime;                        // Sync time in ticks
+};
+
+// IMU record (raw values)
+struct __attribute__((packed)) RecordImu {
+  struct RecordHeader header;
+  uint32_t timecode;                        // Timecode in ticks
+  int16_t acc[3];                           // Raw accelerometer
+  int16_t gyr[3];                           // Raw gyroscope
+  int16_t mag[3];                           // Raw magnetometer
+};
+
+// Button record
+struct __attribute__((packed)) RecordButton {
+  struct RecordHeader header;
+  uint32_t mask;                            // Button mask
+  uint16_t trigger;                         // Trigger value
+  int16_t horizontal;                       // Pad horizontal
+  int16_t vertical;                         // Pad vertical
+};
+
+// Tracker metadata record
+struct __attribute__((packed)) RecordTracker {
+  struct RecordHeader header;
+  char serial[MAX_SERIAL_LENGTH];           // Serial number
+  uint16_t type;                            // USB product ID
+  uint8_t num_channels;                     // Number of photodiodes
+  uint8_t channels[MAX_NUM_SENSORS];        // Channel assignment for PDs
+  float positions[MAX_NUM_SENSORS][3];      // PD positions
+  float normals[MAX_NUM_SENSORS][3];        // PD normals
+  float acc_bias[3];                        // Acceleromater bias
+  float acc_scale[3];                       // Accelerometer scale
+  float gyr_bias[3];                        // Gyro bias
+  float gyr_scale[3];                       // Gyro scale
+  float imu_transform[7];                   // Tracker -> IMU trasform
+  float head_transform[7];                  // Tracker -> Head transform
+};
+
+// Lighthouse metadata record
+struct __attribute__((packed)) RecordLighthouse {
+  struct RecordHeader header;
+  uint8_t lighthouse;                       // Lighthouse index
+  char serial[MAX_SERIAL_LENGTH];           // Serial number
+  uint16_t fw_version;                      // Firmware version
+  float motors[MAX_NUM_MOTORS][5];          // Phase, tilt, gibphase, gibmag, curve
+  float accel[3];                           // Acceleration vector
+  uint8_t hw_version;                       // Hardware version
+  uint8_t mode_current;                     // Current mode
+  uint8_t sys_faults;                       // Fault flags
+  uint8_t sys_unlock_count;                 // Desynchronization count
+};
+
+// Parse a format name, returning -1 if it is not recognized
+int output_format(const char * name);
+
+// Open the output stream (NULL or "-" writes to stdout)
+int output_open(const char * path, OutputFormat format);
+
+// Install the callbacks that write to the output stream
+void output_install(struct Driver * drv,
+  int imu, int ax0, int ax1, int button);
+
+// Write buffered data if it is older than OUTPUT_FLUSH_NS (or force it)
+int output_flush(int force);
+
+// Flush and close the output stream
+void output_close(void);
+
+#endif
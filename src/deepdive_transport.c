@@ -0,0 +1,318 @@
+/* 
+  Unofficial driver for Vive Trackers and up to two lighthouses, with an
+    emphasis on pulling tracker and lighthouse calibration data from devices.
+  
+  Adapted from: https://github.com/cnlohr/libsurvive
+  Which was based off: https://github.com/collabora/OSVR-Vive-Libre
+    Originally Copyright 2016 Philipp Zabel
+    Originally Copyright 2016 Lubosz Sarnecki <lubosz.sarnecki@collabora.co.uk>
+    Originally Copyright (C) 2013 Fredrik Hultin
+    Originally Copyright (C) 2013 Jakob Bornecrantz
+  Using documentation from: https://github.com/nairol/LighthouseRedox
+  
+  Copyright (c) 2017 Andrew Symington
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+// Interface implementations
+#include "deepdive_transport.h"
+
+// Controller implementations
+#include "deepdive_dev_tracker.h"
+#include "deepdive_dev_watchman.h"
+#include "deepdive_log.h"
+
+#include <json/json.h>
+
+#include <stdio.h>
+#include <errno.h>
+#include <zlib.h>
+
+// Special codes
+static uint8_t magic_code_power_en_[5] = {0x04};
+
+// Get a transport by type, or NULL if it is unknown
+const struct Transport * deepdive_transport(TransportType type) {
+  switch (type) {
+  case TRANSPORT_USB:
+    return &deepdive_transport_usb;
+  case TRANSPORT_HIDRAW:
+    return &deepdive_transport_hidraw;
+  case TRANSPORT_REPLAY:
+    return &deepdive_transport_replay;
+  }
+  return NULL;
+}
+
+// Add a tracker to the driver, giving it the next id
+void deepdive_transport_add(struct Driver * drv, struct Tracker * tracker) {
+  tracker->id = drv->num_trackers;
+  drv->trackers[drv->num_trackers++] = tracker;
+}
+
+// Pass a report received on an endpoint to the right decoder
+void deepdive_transport_dispatch(struct Endpoint * ep, int len) {
+  switch (ep->type) {
+   case TRACKER_IMU:
+    deepdive_dev_tracker_imu(ep->tracker, ep->buffer, len);
+    break;
+   case TRACKER_LIGHT:
+    deepdive_dev_tracker_light(ep->tracker, ep->buffer, len);
+    break;
+   case TRACKER_BUTTONS:
+    deepdive_dev_tracker_button(ep->tracker, ep->buffer, len);
+    break;
+   case WATCHMAN:
+    deepdive_dev_watchman(ep->tracker, ep->buffer, len);
+    break;
+   default:
+    break;
+  }
+}
+
+// Feature reports stall while the device is busy, so retry for a while
+static int get_feature_timeout(struct Tracker * tracker,
+  unsigned char *buf, size_t len) {
+  int ret;
+  for (uint8_t i = 0; i < 50; i++) {
+    ret = tracker->driver->transport->get_feature(tracker, buf, len);
+    if (ret != -9 && (ret != -1 || errno != EPIPE))
+      return ret;
+    usleep(1000);
+  }
+  return -1;
+}
+
+// Send the magic code that powers on a wired tracker
+int deepdive_transport_power(struct Tracker * tracker) {
+  return tracker->driver->transport->set_feature(tracker,
+    magic_code_power_en_, sizeof(magic_code_power_en_))
+      == sizeof(magic_code_power_en_);
+}
+
+static int decompress(struct Tracker * tracker,
+  const char * input, int ilen, char * output, int olen) {
+  z_stream zs;
+  memset(&zs, 0, sizeof( zs ));
+  inflateInit(&zs);
+  zs.avail_in = ilen;
+  zs.next_in = (z_const Bytef *)input;
+  zs.avail_out = olen;
+  zs.next_out = output;
+  if(inflate( &zs, Z_FINISH) != Z_STREAM_END) {
+    LOG_ERROR(tracker->driver, tracker->serial, "Could not inflate");
+    return -1;
+  }
+  int len = zs.total_out;
+  inflateEnd(&zs);
+  return len;
+}
+
+// Read an array from a json array data structure
+static int json_read_arr_dbl(json_object * jobj, float *data, size_t len) {
+  // Check that this is an array
+  enum json_type type = json_object_get_type(jobj);
+  if (type != json_type_array)
+    return 0;
+  // Read the min(desired,actual) length
+  int maxlen = json_object_array_length(jobj);
+  if (maxlen < len)
+    len = maxlen;
+  // Now read the elements
+  json_object * jval;
+  int numread = 0;
+  for (size_t i = 0; i < len; i++) {
+    jval = json_object_array_get_idx(jobj, i);
+    data[numread++] =  json_object_get_double(jval);
+  }
+  return numread;
+}
+
+// Read an array from a json array data structure
+static int json_read_arr_int(json_object * jobj, uint8_t *data, size_t len) {
+  // Check that this is an array
+  enum json_type type = json_object_get_type(jobj);
+  if (type != json_type_array)
+    return 0;
+  // Read the min(desired,actual) length
+  int maxlen = json_object_array_length(jobj);
+  if (maxlen < len)
+    len = maxlen;
+  // Now read the elements
+  json_object * jval;
+  int numread = 0;
+  for (size_t  i = 0; i < len; i++) {
+    jval = json_object_array_get_idx(jobj, i);
+    data[numread++] = json_object_get_int(jval);
+  }
+  return numread;
+}
+
+// Parse the jscond evice configuation
+static int json_parse(struct Tracker * tracker, const char* data) {
+  json_object *jobj = json_tokener_parse(data);
+  json_object *jtmp;
+  // IMU calibration parameters
+  if (json_object_object_get_ex(jobj, "device_serial_number", &jtmp))
+    strcpy(tracker->serial, json_object_get_string(jtmp));
+  if (json_object_object_get_ex(jobj, "acc_bias", &jtmp))
+    if (!json_read_arr_dbl(jtmp, tracker->cal.acc_bias, 3))
+      LOG_WARN(tracker->driver, tracker->serial,
+        "Could not read the JSON field: acc_bias");
+  if (json_object_object_get_ex(jobj, "acc_scale", &jtmp))
+    if (!json_read_arr_dbl(jtmp, tracker->cal.acc_scale, 3))
+      LOG_WARN(tracker->driver, tracker->serial,
+        "Could not read the JSON field: acc_scale");
+  if (json_object_object_get_ex(jobj, "gyro_bias", &jtmp))
+    if (!json_read_arr_dbl(jtmp, tracker->cal.gyr_bias, 3))
+      LOG_WARN(tracker->driver, tracker->serial,
+        "Could not read the JSON field: gyr_bias");
+  if (json_object_object_get_ex(jobj, "gyro_scale", &jtmp))
+    if (!json_read_arr_dbl(jtmp, tracker->cal.gyr_scale, 3))
+      LOG_WARN(tracker->driver, tracker->serial,
+        "Could not read the JSON field: gyr_scale");
+  if (json_object_object_get_ex(jobj, "trackref_from_imu", &jtmp))
+    if (!json_read_arr_dbl(jtmp, tracker->cal.imu_transform, 7))
+      LOG_WARN(tracker->driver, tracker->serial,
+        "Could not read the JSON field: trackref_from_imu");
+  if (json_object_object_get_ex(jobj, "trackref_from_head", &jtmp))
+    if (!json_read_arr_dbl(jtmp, tracker->cal.head_transform, 7))
+      LOG_WARN(tracker->driver, tracker->serial,
+        "Could not read the JSON field: trackref_from_head");
+  // Photodiode calibration parameters
+  json_object *jlhc;
+  if (json_object_object_get_ex(jobj, "lighthouse_config", &jlhc)) {
+    if (json_object_object_get_ex(jlhc, "channelMap", &jtmp)) {
+      tracker->cal.num_channels = json_read_arr_int(
+        jtmp, tracker->cal.channels, MAX_NUM_SENSORS);
+      if (tracker->cal.num_channels > 0
+       && tracker->cal.num_channels < MAX_NUM_SENSORS) {
+        json_object *jnrm;
+        if (json_object_object_get_ex(jlhc, "modelNormals", &jnrm)) {
+          for (int i = 0; i < tracker->cal.num_channels; i++) {
+            jtmp = json_object_array_get_idx(jnrm, i);
+            if (!json_read_arr_dbl(jtmp, tracker->cal.normals[i], 3))
+              LOG_WARN(tracker->driver, tracker->serial,
+                "Could not read the normal for channel %d", i);
+          }
+        }
+        json_object *jpts;
+        if (json_object_object_get_ex(jlhc, "modelPoints", &jpts)) {
+          for (int i = 0; i < tracker->cal.num_channels; i++) {
+            jtmp = json_object_array_get_idx(jpts, i);
+            if (!json_read_arr_dbl(jtmp, tracker->cal.positions[i], 3))
+              LOG_WARN(tracker->driver, tracker->serial,
+                "Could not read the position for channel %d", i);
+          }
+        }
+      } else {
+        LOG_WARN(tracker->driver, tracker->serial,
+          "Could not read the JSON: lighthouse_config::channelMap");
+      }
+    }
+  }
+  // Mark as valid!
+  tracker->cal.timestamp = 1;
+  LOG_INFO(tracker->driver, tracker->serial, "Read calibration data");
+}
+
+// Pull the calibration (sensor extrinsics and imu bias/scale) from a tracker
+int deepdive_transport_config(struct Tracker * tracker, int send_extra_magic) {
+  int ret, count = 0, size = 0;
+  uint8_t cfgbuff[64];
+  uint8_t compressed_data[8192];
+  uint8_t uncompressed_data[65536];
+  // Send a magic code to iniitalize the config download process
+  if (send_extra_magic) {
+    uint8_t cfgbuffwide[65];
+    memset(cfgbuffwide, 0, sizeof(cfgbuff));
+    cfgbuffwide[0] = 0x01;
+    ret = get_feature_timeout(
+      tracker, cfgbuffwide,sizeof(cfgbuffwide) );
+    usleep(1000);
+    uint8_t cfgbuff_send[64] = { 0xff, 0x83 };
+    for (int k = 0; k < 10; k++ ) {
+      tracker->driver->transport->set_feature(tracker, cfgbuff_send, 64);
+      usleep(1000);
+    }
+    cfgbuffwide[0] = 0xff;
+    ret = get_feature_timeout(
+      tracker, cfgbuffwide, sizeof(cfgbuffwide));
+    usleep(1000);
+  }
+  // Send Report 16 to prepare the device for reading config info
+  memset(cfgbuff, 0, sizeof(cfgbuff));
+  cfgbuff[0] = 0x10;
+  if((ret = get_feature_timeout(
+    tracker, cfgbuff, sizeof(cfgbuff) ) ) < 0 ) {
+    LOG_ERROR(tracker->driver, tracker->serial,
+      "Could not get survive config data for device");
+    return -1;
+  }
+  // Now do a bunch of Report 17 until there are no bytes left
+  cfgbuff[1] = 0xaa;
+  cfgbuff[0] = 0x11;
+  do {
+    if((ret = get_feature_timeout(
+        tracker, cfgbuff, sizeof(cfgbuff))) < 0 ) {
+      LOG_ERROR(tracker->driver, tracker->serial,
+        "Could not read config data on device (count: %d)", count);
+      return -2;
+    }
+    size = cfgbuff[1];
+    if (!size) break;
+    if( size > 62 ) {
+      LOG_ERROR(tracker->driver, tracker->serial,
+        "Too much data (%d) on packet (count: %d)", size, count);
+      return -3;
+    }
+    if (count + size >= sizeof(compressed_data)) {
+      LOG_ERROR(tracker->driver, tracker->serial,
+        "Configuration length too long (count: %d)", count);
+      return -4;
+    }
+    memcpy(&compressed_data[count], cfgbuff + 2, size);
+    count += size;
+  } while( 1 );
+
+  if (count == 0) {
+    LOG_ERROR(tracker->driver, tracker->serial, "Empty configuration");
+    return -5;
+  }
+  // Decompress the data
+  int len = decompress(tracker, compressed_data, count,
+    uncompressed_data, sizeof(uncompressed_data));
+  if (len <= 0) {
+    LOG_ERROR(tracker->driver, tracker->serial,
+      "Data for config descriptor is bad (%d)", len);
+    return -5;
+  }
+  /*
+  char fstname[128];
+  sprintf(fstname, "%s.json.gz", tracker->serial);
+  FILE *f = fopen( fstname, "wb" );
+  fwrite(uncompressed_data, len, 1, f);
+  fclose(f);
+  */
+  // Parse the JSON data structure
+  json_parse(tracker, uncompressed_data);
+  return 0;
+}
@@ -0,0 +1,77 @@
+/* 
+  Unofficial driver for Vive Trackers and up to two lighthouses, with an
+    emphasis on pulling tracker and lighthouse calibration data from devices.
+  
+  Adapted from: https://github.com/cnlohr/libsurvive
+  Which was based off: https://github.com/collabora/OSVR-Vive-Libre
+    Originally Copyright 2016 Philipp Zabel
+    Originally Copyright 2016 Lubosz Sarnecki <lubosz.sarnecki@collabora.co.uk>
+    Originally Copyright (C) 2013 Fredrik Hultin
+    Originally Copyright (C) 2013 Jakob Bornecrantz
+  Using documentation from: https://github.com/nairol/LighthouseRedox
+  
+  Copyright (c) 2017 Andrew Symington
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+
+#ifndef LIBDEEPDIVE_DEEPDIVE_TRANSPORT_H
+#define LIBDEEPDIVE_DEEPDIVE_TRANSPORT_H
+
+#include <deepdive.h>
+
+// Device access, which is the only part of the driver that differs between
+// libusb, hidraw and file replay
+struct Transport {
+  const char * name;
+  // Find devices and add them to the driver, returning the number found
+  int (*init)(struct Driver * drv, const char * arg);
+  // Wait for device data and process it, returning 0 on success. The wait
+  // is bounded, so that callers can do periodic work when devices go quiet.
+  int (*poll)(struct Driver * drv);
+  // Release the devices and free the trackers
+  void (*close)(struct Driver * drv);
+  // Get or set a feature report on the first interface of a tracker, where
+  // the first byte is the report ID. Returns the number of bytes or < 0.
+  int (*get_feature)(struct Tracker * tracker, uint8_t * data, int len);
+  int (*set_feature)(struct Tracker * tracker, uint8_t * data, int len);
+};
+
+// Available transports
+extern const struct Transport deepdive_transport_usb;
+extern const struct Transport deepdive_transport_hidraw;
+extern const struct Transport deepdive_transport_replay;
+
+// Get a transport by type, or NULL if it is unknown
+const struct Transport * deepdive_transport(TransportType type);
+
+// Add a tracker to the driver, giving it the next id
+void deepdive_transport_add(struct Driver * drv, struct Tracker * tracker);
+
+// Pass a report received on an endpoint to the right decoder
+void deepdive_transport_dispatch(struct Endpoint * ep, int len);
+
+// Send the magic code that powers on a wired tracker
+int deepdive_transport_power(struct Tracker * tracker);
+
+// Pull the calibration (sensor extrinsics and imu bias/scale) from a tracker
+int deepdive_transport_config(struct Tracker * tracker, int send_extra_magic);
+
+#endif
@@ -32,44 +32,24 @@
 */
 
 // Interface implementations
-#include "deepdive_usb.h"
+#include "deepdive_transport.h"
+#include "deepdive_log.h"
 
-// Controller implementations
-#include "deepdive_dev_tracker.h"
-#include "deepdive_dev_watchman.h"
-
-#include <json/json.h>
-
-#include <stdio.h>
-#include <errno.h>
-#include <zlib.h>
-
-// Special codes
-static uint8_t magic_code_power_en_[5] = {0x04};
+// Longest wait for events, so that callers of deepdive_poll get control back
+#define USB_TIMEOUT_MS        100
 
 // Interrupt handler
 static void interrupt_handler(struct libusb_transfer* t) {
   struct Endpoint *ep = t->user_data;
   if (t->status != LIBUSB_TRANSFER_COMPLETED ) {
-    printf("Transfer problem\n");
+    LOG_WARN(ep->tracker->driver, ep->tracker->serial,
+      "Transfer problem (status: %d)", t->status);
     return;
   }
-  switch (ep->type) {
-   case TRACKER_IMU:
-    deepdive_dev_tracker_imu(ep->tracker, ep->buffer, t->actual_length);
-    break;
-   case TRACKER_LIGHT:
-    deepdive_dev_tracker_light(ep->tracker, ep->buffer, t->actual_length);
-    break;
-   case TRACKER_BUTTONS:
-    deepdive_dev_tracker_button(ep->tracker, ep->buffer, t->actual_length);
-    break;
-   case WATCHMAN:
-    deepdive_dev_watchman(ep->tracker, ep->buffer, t->actual_length);
-    break;
-  }
+  deepdive_transport_dispatch(ep, t->actual_length);
   if (libusb_submit_transfer(t))
-    printf( "Error resubmitting transfer\n");
+    LOG_ERROR(ep->tracker->driver, ep->tracker->serial,
+      "Error resubmitting transfer");
 }
 
 static inline int update_feature_report(libusb_device_handle* dev,
@@ -87,214 +67,18 @@ static inline int getupdate_feature_report(libusb_device_handle* dev,
     interface, data, datalen, 1000 );
 }
 
-static inline int hid_get_feature_report_timeout(libusb_device_handle* dev,
-  uint16_t iface, unsigned char *buf, size_t len ) {
-  int ret;
-  for (uint8_t i = 0; i < 50; i++) {
-    ret = getupdate_feature_report(dev, iface, buf, len);
-    if (ret != -9 && (ret != -1 || errno != EPIPE))
-      return ret;
-    usleep(1000);
-  }
-  return -1;
-}
-
-static int decompress(const char * input, int ilen, char * output, int olen) {
-  z_stream zs;
-  memset(&zs, 0, sizeof( zs ));
-  inflateInit(&zs);
-  zs.avail_in = ilen;
-  zs.next_in = (z_const Bytef *)input;
-  zs.avail_out = olen;
-  zs.next_out = output;
-  if(inflate( &zs, Z_FINISH) != Z_STREAM_END) {
-    printf("Could not inflate.");
-    return -1;
-  }
-  int len = zs.total_out;
-  inflateEnd(&zs);
-  return len;
+// Get a feature report from the first interface
+static int usb_get_feature(struct Tracker * tracker, uint8_t * data, int len) {
+  return getupdate_feature_report(tracker->udev, 0, data, len);
 }
 
-// Read an array from a json array data structure
-static int json_read_arr_dbl(json_object * jobj, float *data, size_t len) {
-  // Check that this is an array
-  enum json_type type = json_object_get_type(jobj);
-  if (type != json_type_array)
-    return 0;
-  // Read the min(desired,actual) length
-  int maxlen = json_object_array_length(jobj);
-  if (maxlen < len)
-    len = maxlen;
-  // Now read the elements
-  json_object * jval;
-  int numread = 0;
-  for (size_t i = 0; i < len; i++) {
-    jval = json_object_array_get_idx(jobj, i);
-    data[numread++] =  json_object_get_double(jval);
-  }
-  return numread;
-}
-
-// Read an array from a json array data structure
-static int json_read_arr_int(json_object * jobj, uint8_t *data, size_t len) {
-  // Check that this is an array
-  enum json_type type = json_object_get_type(jobj);
-  if (type != json_type_array)
-    return 0;
-  // Read the min(desired,actual) length
-  int maxlen = json_object_array_length(jobj);
-  if (maxlen < len)
-    len = maxlen;
-  // Now read the elements
-  json_object * jval;
-  int numread = 0;
-  for (size_t  i = 0; i < len; i++) {
-    jval = json_object_array_get_idx(jobj, i);
-    data[numread++] = json_object_get_int(jval);
-  }
-  return numread;
-}
-
-// Parse the jscond evice configuation
-static int json_parse(struct Tracker * tracker, const char* data) {
-  json_object *jobj = json_tokener_parse(data);
-  json_object *jtmp;
-  // IMU calibration parameters
-  if (json_object_object_get_ex(jobj, "device_serial_number", &jtmp))
-    strcpy(tracker->serial, json_object_get_string(jtmp));
-  if (json_object_object_get_ex(jobj, "acc_bias", &jtmp))
-    if (!json_read_arr_dbl(jtmp, tracker->cal.acc_bias, 3))
-      printf("Could not read the JSON field: acc_bias\n");
-  if (json_object_object_get_ex(jobj, "acc_scale", &jtmp))
-    if (!json_read_arr_dbl(jtmp, tracker->cal.acc_scale, 3))
-      printf("Could not read the JSON field: acc_scale\n");
-  if (json_object_object_get_ex(jobj, "gyro_bias", &jtmp))
-    if (!json_read_arr_dbl(jtmp, tracker->cal.gyr_bias, 3))
-      printf("Could not read the JSON field: gyr_bias\n");
-  if (json_object_object_get_ex(jobj, "gyro_scale", &jtmp))
-    if (!json_read_arr_dbl(jtmp, tracker->cal.gyr_scale, 3))
-      printf("Could not read the JSON field: gyr_scale\n");
-  if (json_object_object_get_ex(jobj, "trackref_from_imu", &jtmp))
-    if (!json_read_arr_dbl(jtmp, tracker->cal.imu_transform, 7))
-      printf("Could not read the JSON field: trackref_from_imu\n");
-  if (json_object_object_get_ex(jobj, "trackref_from_head", &jtmp))
-    if (!json_read_arr_dbl(jtmp, tracker->cal.head_transform, 7))
-      printf("Could not read the JSON field: trackref_from_head\n");
-  // Photodiode calibration parameters
-  json_object *jlhc;
-  if (json_object_object_get_ex(jobj, "lighthouse_config", &jlhc)) {
-    if (json_object_object_get_ex(jlhc, "channelMap", &jtmp)) {
-      tracker->cal.num_channels = json_read_arr_int(
-        jtmp, tracker->cal.channels, MAX_NUM_SENSORS);
-      if (tracker->cal.num_channels > 0
-       && tracker->cal.num_channels < MAX_NUM_SENSORS) {
-        json_object *jnrm;
-        if (json_object_object_get_ex(jlhc, "modelNormals", &jnrm)) {
-          for (int i = 0; i < tracker->cal.num_channels; i++) {
-            jtmp = json_object_array_get_idx(jnrm, i);
-            if (!json_read_arr_dbl(jtmp, tracker->cal.normals[i], 3))
-              printf("Could not read the normal for channel %u\n", i);
-          }
-        }
-        json_object *jpts;
-        if (json_object_object_get_ex(jlhc, "modelPoints", &jpts)) {
-          for (int i = 0; i < tracker->cal.num_channels; i++) {
-            jtmp = json_object_array_get_idx(jpts, i);
-            if (!json_read_arr_dbl(jtmp, tracker->cal.positions[i], 3))
-              printf("Could not read the position for channel %u\n", i);
-          }
-        }
-      } else {
-        printf("Could not read the JSON: lighthouse_config::channelMap\n");
-      }
-    }
-  }
-  // Mark as valid!
-  tracker->cal.timestamp = 1;
-  printf("Read calibration data for tracker %s\n", tracker->serial);
-}
-
-// Read the tracker configuration (sensor extrinsics and imu bias/scale)
-static int get_config(struct Tracker * tracker, int send_extra_magic) {
-  int ret, count = 0, size = 0;
-  uint8_t cfgbuff[64];
-  uint8_t compressed_data[8192];
-  uint8_t uncompressed_data[65536];
-  // Send a magic code to iniitalize the config download process
-  if (send_extra_magic) {
-    uint8_t cfgbuffwide[65];
-    memset(cfgbuffwide, 0, sizeof(cfgbuff));
-    cfgbuffwide[0] = 0x01;
-    ret = hid_get_feature_report_timeout(
-      tracker->udev, 0, cfgbuffwide,sizeof(cfgbuffwide) );
-    usleep(1000);
-    uint8_t cfgbuff_send[64] = { 0xff, 0x83 };
-    for (int k = 0; k < 10; k++ ) {
-      update_feature_report(tracker->udev, 0, cfgbuff_send, 64 );
-      usleep(1000);
-    }
-    cfgbuffwide[0] = 0xff;
-    ret = hid_get_feature_report_timeout(
-      tracker->udev, 0, cfgbuffwide, sizeof(cfgbuffwide));
-    usleep(1000);
-  }
-  // Send Report 16 to prepare the device for reading config info
-  memset(cfgbuff, 0, sizeof(cfgbuff));
-  cfgbuff[0] = 0x10;
-  if((ret = hid_get_feature_report_timeout(
-    tracker->udev, 0, cfgbuff, sizeof(cfgbuff) ) ) < 0 ) {
-    printf( "Could not get survive config data for device");
-    return -1;
-  }
-  // Now do a bunch of Report 17 until there are no bytes left
-  cfgbuff[1] = 0xaa;
-  cfgbuff[0] = 0x11;
-  do {
-    if((ret = hid_get_feature_report_timeout(
-        tracker->udev, 0, cfgbuff, sizeof(cfgbuff))) < 0 ) {
-      printf("Could not read config data on device (count: %d)\n", count );
-      return -2;
-    }
-    size = cfgbuff[1];
-    if (!size) break;
-    if( size > 62 ) {
-      printf("Too much data (%d) on packet (count: %d)", size, count);
-      return -3;
-    }
-    if (count + size >= sizeof(compressed_data)) {
-      printf("Configuration length too long (count: %d)", count);
-      return -4;
-    }
-    memcpy(&compressed_data[count], cfgbuff + 2, size);
-    count += size;
-  } while( 1 );
-
-  if (count == 0) {
-    printf( "Empty configuration");
-    return -5;
-  }
-  // Decompress the data
-  int len = decompress(compressed_data, count,
-    uncompressed_data, sizeof(uncompressed_data));
-  if (len <= 0) {
-    printf( "Error: data for config descriptor is bad. (%d)", len);
-    return -5;
-  }
-  /*
-  char fstname[128];
-  sprintf(fstname, "%s.json.gz", tracker->serial);
-  FILE *f = fopen( fstname, "wb" );
-  fwrite(uncompressed_data, len, 1, f);
-  fclose(f);
-  */
-  // Parse the JSON data structure
-  json_parse(tracker, uncompressed_data);
-  return 0;
+// Set a feature report on the first interface
+static int usb_set_feature(struct Tracker * tracker, uint8_t * data, int len) {
+  return update_feature_report(tracker->udev, 0, data, len);
 }
 
 // Enumerate all USBs on the bus and return the number of devices found
-int deepdive_usb_init(struct Driver * drv) {
+static int usb_init(struct Driver * drv, const char * arg) {
   // Initialize libusb
   int ret = libusb_init(&drv->usb);
   if (ret)
@@ -399,18 +183,18 @@ int deepdive_usb_init(struct Driver * drv) {
       if(ret)
         goto fail;
       // Send a magic code to power on the tracker
-      if (update_feature_report(tracker->udev, 0, magic_code_power_en_,
-        sizeof(magic_code_power_en_)) != sizeof(magic_code_power_en_))
-          printf("Power on failed\n");
+      if (!deepdive_transport_power(tracker))
+          LOG_WARN(drv, tracker->serial, "Power on failed");
       else
-        printf("Power on success\n");
+        LOG_DEBUG(drv, tracker->serial, "Power on success");
       // Get the configuration for this device
-      ret = get_config(tracker, 0);
+      ret = deepdive_transport_config(tracker, 0);
       if (ret < 0) {
-        printf("Calibration cannot be pulled. Ignoring.\n");
+        LOG_WARN(drv, tracker->serial,
+          "Calibration cannot be pulled. Ignoring.");
         goto fail;
       }
-      printf("Found tracker %s\n", tracker->serial);
+      LOG_INFO(drv, tracker->serial, "Found tracker");
       break;
      ///////////////////////
      // WIRELESS WATCHMAN //
@@ -429,16 +213,17 @@ int deepdive_usb_init(struct Driver * drv) {
       if (ret)
         goto fail;
       // Get the configuration for this device
-      ret = get_config(tracker, 1);
+      ret = deepdive_transport_config(tracker, 1);
       if (ret < 0) {
-        printf("Calibration cannot be pulled. Ignoring.\n");
+        LOG_WARN(drv, tracker->serial,
+          "Calibration cannot be pulled. Ignoring.");
         goto fail;
       }
-      printf("Found watchman %s\n", tracker->serial);
+      LOG_INFO(drv, tracker->serial, "Found watchman");
       break;
     }
     // Add the tracker to the dynamic list of trackers
-    drv->trackers[drv->num_trackers++] = tracker;
+    deepdive_transport_add(drv, tracker);
     continue;
 
     // Catch-all to prevent memory leaks
@@ -451,4 +236,25 @@ fail:
 
   // Success
   return drv->num_trackers;
-}
\ No newline at end of file
+}
+
+// Handle any USB events, returning if none arrive within the timeout
+static int usb_poll(struct Driver * drv) {
+  struct timeval tv = {0, USB_TIMEOUT_MS * 1000};
+  return libusb_handle_events_timeout_completed(drv->usb, &tv, NULL);
+}
+
+// Close the devices and free the trackers
+static void usb_close(struct Driver * drv) {
+  for (size_t i = 0; i < drv->num_trackers; i++) {
+    libusb_close(drv->trackers[i]->udev);
+    free(drv->trackers[i]);
+  }
+  if (drv->usb)
+    libusb_exit(drv->usb);
+}
+
+// Claims every interface, detaching the kernel driver
+const struct Transport deepdive_transport_usb = {
+  "usb", usb_init, usb_poll, usb_close, usb_get_feature, usb_set_feature
+};
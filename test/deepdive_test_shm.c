@@ -0,0 +1,219 @@
+/* 
+  Unofficial driver for Vive Trackers and up to two lighthouses, with an
+    emphasis on pulling tracker and lighthouse calibration data from devices.
+  
+  Adapted from: https://github.com/cnlohr/libsurvive
+  Which was based off: https://github.com/collabora/OSVR-Vive-Libre
+    Originally Copyright 2016 Philipp Zabel
+    Originally Copyright 2016 Lubosz Sarnecki <lubosz.sarnecki@collabora.co.uk>
+    Originally Copyright (C) 2013 Fredrik Hultin
+    Originally Copyright (C) 2013 Jakob Bornecrantz
+  Using documentation from: https://github.com/nairol/LighthouseRedox
+  
+  Copyright (c) 2017 Andrew Symington
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+// Checks that readers of the shared-memory ring see events in order, count
+// exactly those that were overwritten before they got to them, and survive
+// the driver going away or being replaced.
+
+#undef NDEBUG
+
+#include <deepdive.h>
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Private to the driver
+#include "deepdive_shm.h"
+
+// Reader side
+#include "deepdive_shm_client.h"
+
+// Events in the ring, kept small so that readers are lapped often
+#define NUM_SLOTS 8
+
+// Events published while a reader keeps up as best it can
+#define NUM_EVENTS 320000
+
+static char name[64];
+
+static atomic_int done;
+
+// A driver with one tracker, which is all that publishing needs
+static struct Driver * driver(void) {
+  struct Driver * drv = calloc(1, sizeof(struct Driver));
+  struct Tracker * tracker = calloc(1, sizeof(struct Tracker));
+  assert(drv && tracker);
+  tracker->driver = drv;
+  strcpy(tracker->serial, "LHR-TEST");
+  drv->trackers[0] = tracker;
+  drv->num_trackers = 1;
+  return drv;
+}
+
+static void release(struct Driver * drv) {
+  free(drv->trackers[0]);
+  free(drv);
+}
+
+// Publish IMU samples whose timecodes run on from first
+static void publish(struct Driver * drv, uint32_t first, uint32_t count) {
+  int16_t zero[3] = {0, 0, 0};
+  for (uint32_t k = first; k < first + count; k++)
+    deepdive_shm_imu(drv->trackers[0], k, zero, zero, zero);
+}
+
+// Publish in bursts, so that the reader sometimes keeps up and sometimes
+// is lapped mid-copy
+static void * writer(void * arg) {
+  struct timespec pause = {0, 1000};
+  for (uint32_t k = 1; k <= NUM_EVENTS; k += 32) {
+    publish(arg, k, 32);
+    nanosleep(&pause, NULL);
+  }
+  atomic_store(&done, 1);
+  return NULL;
+}
+
+// Lapping, where the events a reader missed are known exactly
+static void test_lap(void) {
+  struct Driver * drv = driver();
+  assert(!deepdive_shm_serve(drv, name, 6));
+  assert(deepdive_shm_serve(drv, name, NUM_SLOTS));
+  struct ShmReader * all = deepdive_shm_attach(name, SHM_READ_ALL);
+  struct ShmReader * latest = deepdive_shm_attach(name, SHM_READ_LATEST);
+  assert(all && latest);
+  struct ShmEvent event;
+  assert(deepdive_shm_read(all, &event) == 0);
+
+  // Late readers still get the calibration
+  assert(deepdive_shm_metadata(all, &event, 1) == 1);
+  assert(event.type == SHM_EVENT_TRACKER);
+  assert(strcmp(event.serial, "LHR-TEST") == 0);
+
+  // Within the ring nothing is lost
+  publish(drv, 1, 5);
+  for (uint32_t k = 1; k <= 5; k++) {
+    assert(deepdive_shm_read(all, &event) == 1);
+    assert(event.type == SHM_EVENT_IMU && event.data.imu.timecode == k);
+  }
+  assert(deepdive_shm_read(all, &event) == 0);
+  assert(deepdive_shm_lost(all) == 0);
+
+  // Twenty more overrun a ring of eight, leaving the last eight to read
+  publish(drv, 6, 20);
+  for (uint32_t k = 26 - NUM_SLOTS; k < 26; k++) {
+    assert(deepdive_shm_read(all, &event) == 1);
+    assert(event.data.imu.timecode == k);
+  }
+  assert(deepdive_shm_read(all, &event) == 0);
+  assert(deepdive_shm_lost(all) == 20 - NUM_SLOTS);
+
+  // Readers of the latest event skip the rest, and lose nothing by it
+  assert(deepdive_shm_read(latest, &event) == 1);
+  assert(event.data.imu.timecode == 25);
+  assert(deepdive_shm_read(latest, &event) == 0);
+  assert(deepdive_shm_lost(latest) == 0);
+
+  // Readers keep their mapping after the driver has gone
+  deepdive_shm_close(drv);
+  assert(deepdive_shm_read(all, &event) == -1);
+  assert(deepdive_shm_read(latest, &event) == -1);
+  assert(deepdive_shm_attach(name, SHM_READ_ALL) == NULL);
+  deepdive_shm_detach(all);
+  deepdive_shm_detach(latest);
+  release(drv);
+  printf("lap: ok\n");
+}
+
+// A reader racing a writer sees every event exactly once or counts it lost,
+// never out of order
+static void test_race(void) {
+  struct Driver * drv = driver();
+  assert(deepdive_shm_serve(drv, name, NUM_SLOTS));
+  struct ShmReader * reader = deepdive_shm_attach(name, SHM_READ_ALL);
+  assert(reader);
+  pthread_t thread;
+  assert(pthread_create(&thread, NULL, writer, drv) == 0);
+  struct ShmEvent event;
+  uint64_t reads = 0, last = 0;
+  for (;;) {
+    int finished = atomic_load(&done);
+    int ret;
+    while ((ret = deepdive_shm_read(reader, &event)) == 1) {
+      assert(event.type == SHM_EVENT_IMU);
+      assert(event.seq > last && event.data.imu.timecode + 1 == event.seq);
+      last = event.seq;
+      reads++;
+    }
+    assert(ret == 0);
+    if (finished)
+      break;
+  }
+  assert(pthread_join(thread, NULL) == 0);
+  assert(last == NUM_EVENTS + 1);
+  assert(reads + deepdive_shm_lost(reader) == NUM_EVENTS);
+  printf("race: %llu read, %llu lost\n", (unsigned long long) reads,
+    (unsigned long long) deepdive_shm_lost(reader));
+  deepdive_shm_close(drv);
+  deepdive_shm_detach(reader);
+  release(drv);
+}
+
+// A driver that restarts without closing replaces the segment rather than
+// resizing it under readers of the old one
+static void test_restart(void) {
+  struct Driver * old = driver();
+  assert(deepdive_shm_serve(old, name, NUM_SLOTS));
+  struct ShmReader * stale = deepdive_shm_attach(name, SHM_READ_ALL);
+  assert(stale);
+  struct Driver * drv = driver();
+  assert(deepdive_shm_serve(drv, name, 2 * NUM_SLOTS));
+  struct ShmReader * fresh = deepdive_shm_attach(name, SHM_READ_ALL);
+  assert(fresh);
+  publish(drv, 1, 1);
+  struct ShmEvent event;
+  assert(deepdive_shm_read(stale, &event) == 0);
+  assert(deepdive_shm_read(fresh, &event) == 1);
+  assert(event.data.imu.timecode == 1);
+  deepdive_shm_detach(stale);
+  deepdive_shm_detach(fresh);
+  deepdive_shm_close(drv);
+  release(drv);
+  // The old segment is already gone, so just forget it
+  release(old);
+  printf("restart: ok\n");
+}
+
+int main(void) {
+  snprintf(name, sizeof(name), "/deepdive_test_%d", (int) getpid());
+  test_lap();
+  test_race();
+  test_restart();
+  return 0;
+}
@@ -0,0 +1,120 @@
+/* 
+  Unofficial driver for Vive Trackers and up to two lighthouses, with an
+    emphasis on pulling tracker and lighthouse calibration data from devices.
+  
+  Adapted from: https://github.com/cnlohr/libsurvive
+  Which was based off: https://github.com/collabora/OSVR-Vive-Libre
+    Originally Copyright 2016 Philipp Zabel
+    Originally Copyright 2016 Lubosz Sarnecki <lubosz.sarnecki@collabora.co.uk>
+    Originally Copyright (C) 2013 Fredrik Hultin
+    Originally Copyright (C) 2013 Jakob Bornecrantz
+  Using documentation from: https://github.com/nairol/LighthouseRedox
+  
+  Copyright (c) 2017 Andrew Symington
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+// Checks that a reader copying out snapshots while the decoder publishes
+// them as fast as it can only ever sees whole, ordered updates.
+
+#undef NDEBUG
+
+#include <deepdive.h>
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Private to the driver
+#include "deepdive_snapshot.h"
+
+// Number of IMU samples the writer publishes
+#define NUM_UPDATES 2000000
+
+static atomic_int done;
+
+// Publish samples whose every field is the sample number, so that a torn
+// copy shows up as a mismatch between fields
+static void * writer(void * arg) {
+  struct Tracker * tracker = arg;
+  for (uint32_t k = 1; k <= NUM_UPDATES; k++) {
+    int16_t v = (int16_t) k;
+    int16_t acc[3] = {v, v, v};
+    int16_t gyr[3] = {v, v, v};
+    int16_t mag[3] = {v, v, v};
+    deepdive_snapshot_imu(tracker, k, acc, gyr, mag);
+  }
+  atomic_store(&done, 1);
+  return NULL;
+}
+
+int main(void) {
+  struct Driver * drv = calloc(1, sizeof(struct Driver));
+  struct Tracker * tracker = calloc(1, sizeof(struct Tracker));
+  assert(drv && tracker);
+  tracker->driver = drv;
+  tracker->id = 0;
+  drv->trackers[0] = tracker;
+  drv->num_trackers = 1;
+  assert(deepdive_snapshot_init(drv));
+
+  // There is always something to read, and nothing for unknown trackers
+  struct Snapshot snapshot;
+  assert(deepdive_snapshot(drv, 0, &snapshot) == 1);
+  assert(snapshot.seq == 0 && snapshot.id == 0);
+  assert(deepdive_snapshot(drv, 1, &snapshot) == 0);
+
+  pthread_t thread;
+  assert(pthread_create(&thread, NULL, writer, tracker) == 0);
+  uint64_t last = 0, reads = 0, retries = 0;
+  while (!atomic_load(&done)) {
+    int ret = deepdive_snapshot(drv, 0, &snapshot);
+    if (ret < 0) {
+      retries++;
+      continue;
+    }
+    assert(ret == 1);
+    assert(snapshot.seq >= last);
+    assert(snapshot.timecode == snapshot.seq);
+    int16_t v = (int16_t) snapshot.seq;
+    for (int i = 0; i < 3; i++)
+      assert(snapshot.acc[i] == v && snapshot.gyr[i] == v
+        && snapshot.mag[i] == v);
+    last = snapshot.seq;
+    reads++;
+  }
+  assert(pthread_join(thread, NULL) == 0);
+
+  // Once the writer is done the last update is what is read
+  assert(deepdive_snapshot(drv, 0, &snapshot) == 1);
+  assert(snapshot.seq == NUM_UPDATES && snapshot.timecode == NUM_UPDATES);
+  printf("%llu consistent reads, %llu gave up, last seq %llu\n",
+    (unsigned long long) reads, (unsigned long long) retries,
+    (unsigned long long) last);
+  assert(reads > 0);
+
+  deepdive_snapshot_close(drv);
+  free(tracker);
+  free(drv);
+  return 0;
+}